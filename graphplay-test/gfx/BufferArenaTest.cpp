@@ -0,0 +1,231 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../../graphplay/graphplay.h"
+#include "../../graphplay/gfx/BufferArena.h"
+#include "../../graphplay/gfx/Geometry.h"
+
+#include <gtest/gtest.h>
+
+#include "TestOpenGLContext.h"
+
+namespace graphplay {
+    namespace gfx {
+        TEST(RangeAllocatorTest, AllocatesAndFrees) {
+            RangeAllocator space(100);
+            EXPECT_EQ(100, space.capacity());
+            EXPECT_EQ(0, space.used());
+
+            EXPECT_EQ(0, space.allocate(10));
+            EXPECT_EQ(10, space.allocate(20));
+            EXPECT_EQ(30, space.used());
+            EXPECT_EQ(70, space.largestFree());
+
+            // Zero-size ranges don't take anything.
+            EXPECT_EQ(0, space.allocate(0));
+            EXPECT_EQ(30, space.used());
+
+            EXPECT_EQ(RangeAllocator::NONE, space.allocate(71));
+
+            space.free(0, 10);
+            EXPECT_EQ(20, space.used());
+            EXPECT_EQ(2, space.freeBlocks());
+        }
+
+        TEST(RangeAllocatorTest, UsesBestFit) {
+            RangeAllocator space(100);
+            space.allocate(10);
+            space.allocate(5);
+            space.allocate(20);
+            space.allocate(5);
+
+            // Free blocks of 10 at 0, 20 at 15, and 60 at 40.
+            space.free(0, 10);
+            space.free(15, 20);
+            EXPECT_EQ(15, space.allocate(18));
+            EXPECT_EQ(0, space.allocate(8));
+            EXPECT_EQ(40, space.allocate(30));
+        }
+
+        TEST(RangeAllocatorTest, CoalescesFreeBlocks) {
+            RangeAllocator space(30);
+            EXPECT_EQ(0, space.allocate(10));
+            EXPECT_EQ(10, space.allocate(10));
+            EXPECT_EQ(20, space.allocate(10));
+            EXPECT_EQ(0, space.freeBlocks());
+
+            space.free(0, 10);
+            space.free(20, 10);
+            EXPECT_EQ(2, space.freeBlocks());
+
+            space.free(10, 10);
+            EXPECT_EQ(1, space.freeBlocks());
+            EXPECT_EQ(30, space.largestFree());
+            EXPECT_EQ(0, space.used());
+        }
+
+        TEST(RangeAllocatorTest, KnowsWhenPacked) {
+            RangeAllocator space(30);
+            EXPECT_TRUE(space.packed());
+            space.allocate(10);
+            space.allocate(10);
+            EXPECT_TRUE(space.packed());
+
+            // A hole in the middle, even if it's the only one.
+            space.allocate(10);
+            space.free(10, 10);
+            EXPECT_EQ(1, space.freeBlocks());
+            EXPECT_FALSE(space.packed());
+        }
+
+        TEST(RangeAllocatorTest, Grows) {
+            RangeAllocator space(10);
+            EXPECT_EQ(0, space.allocate(6));
+            EXPECT_EQ(RangeAllocator::NONE, space.allocate(6));
+
+            // The new space merges with the free block at the end.
+            space.grow(20);
+            EXPECT_EQ(20, space.capacity());
+            EXPECT_EQ(1, space.freeBlocks());
+            EXPECT_EQ(6, space.allocate(6));
+            EXPECT_EQ(12, space.used());
+
+            space.grow(5);
+            EXPECT_EQ(20, space.capacity());
+        }
+
+        class BufferArenaTest : public TestOpenGLContext {};
+
+        Geometry<PCNVertex>::sptr_type makeQuad(float z) {
+            PCNVertex verts[4] = {
+                { { 0.0f, 0.0f, z }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f } },
+                { { 1.0f, 0.0f, z }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f } },
+                { { 1.0f, 1.0f, z }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f } },
+                { { 0.0f, 1.0f, z }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f } },
+            };
+            GLuint elems[6] = { 0, 1, 2, 0, 2, 3 };
+            Geometry<PCNVertex>::sptr_type rv = std::make_shared<Geometry<PCNVertex> >();
+            rv->setVertexData(elems, 6, verts, 4);
+            return rv;
+        }
+
+        TEST_F(BufferArenaTest, SharesBuffersAndVertexArray) {
+            BufferArenas arenas;
+            Geometry<PCNVertex>::sptr_type a = makeQuad(0.0f), b = makeQuad(1.0f);
+            a->createBuffers(arenas);
+            b->createBuffers(arenas);
+            EXPECT_EQ(1, arenas.size());
+
+            ASSERT_NE(nullptr, a->arenaRange());
+            ASSERT_NE(nullptr, b->arenaRange());
+            EXPECT_EQ(a->arenaRange()->arena, b->arenaRange()->arena);
+            EXPECT_EQ(a->vertexBufferId(), b->vertexBufferId());
+            EXPECT_EQ(a->elemBufferId(), b->elemBufferId());
+            EXPECT_NE(0, a->vertexArrayObjectId());
+            EXPECT_EQ(a->vertexArrayObjectId(), b->vertexArrayObjectId());
+            EXPECT_EQ(GL_UNSIGNED_INT, b->elemGLType());
+            EXPECT_EQ(4*sizeof(PCNVertex) + 6*sizeof(GLuint), b->gpuBytes());
+
+            // b comes right after a, with its own base vertex.
+            EXPECT_EQ(0, a->arenaRange()->first_vertex);
+            EXPECT_EQ(4, b->arenaRange()->first_vertex);
+            EXPECT_EQ(6, b->arenaRange()->first_elem);
+
+            // Dropping a geometry gives its space back.
+            BufferArena::sptr_type arena = a->arenaRange()->arena;
+            EXPECT_EQ(8, arena->vertexSpace().used());
+            a.reset();
+            EXPECT_EQ(4, arena->vertexSpace().used());
+            EXPECT_EQ(6, arena->elemSpace().used());
+        }
+
+        TEST_F(BufferArenaTest, GrowsWhenFull) {
+            BufferArena::sptr_type arena = std::make_shared<BufferArena>(PCNVertex::description, sizeof(PCNVertex), 4, 6);
+            GLuint vao = arena->vertexArrayObjectId();
+
+            Geometry<PCNVertex>::sptr_type quad = makeQuad(0.0f);
+            const std::vector<PCNVertex> &verts = quad->vertices();
+            GLuint elems[6] = { 0, 1, 2, 0, 2, 3 };
+            ArenaRange::sptr_type first = arena->allocate(verts.data(), verts.size(), elems, 6);
+            ArenaRange::sptr_type second = arena->allocate(verts.data(), verts.size(), elems, 6);
+
+            EXPECT_EQ(8, arena->vertexSpace().capacity());
+            EXPECT_EQ(12, arena->elemSpace().capacity());
+            EXPECT_EQ(4, second->first_vertex);
+            EXPECT_EQ(vao, arena->vertexArrayObjectId());
+            EXPECT_EQ(GL_TRUE, glIsBuffer(arena->vertexBufferId()));
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+        }
+
+        TEST_F(BufferArenaTest, CompactsWhenEmptied) {
+            BufferArena::sptr_type arena = std::make_shared<BufferArena>(PCNVertex::description, sizeof(PCNVertex), 4, 6);
+            Geometry<PCNVertex>::sptr_type quad = makeQuad(0.0f);
+            const std::vector<PCNVertex> &verts = quad->vertices();
+            GLuint elems[6] = { 0, 1, 2, 0, 2, 3 };
+            ArenaRange::sptr_type first = arena->allocate(verts.data(), verts.size(), elems, 6);
+            ArenaRange::sptr_type second = arena->allocate(verts.data(), verts.size(), elems, 6);
+            ArenaRange::sptr_type third = arena->allocate(verts.data(), verts.size(), elems, 6);
+            EXPECT_EQ(16, arena->vertexSpace().capacity());
+            EXPECT_EQ(16*sizeof(PCNVertex) + 24*sizeof(GLuint), arena->gpuBytes());
+
+            // Freeing ranges doesn't give anything back by itself.
+            first.reset();
+            second.reset();
+            EXPECT_EQ(16*sizeof(PCNVertex) + 24*sizeof(GLuint), arena->gpuBytes());
+            EXPECT_EQ(4*sizeof(PCNVertex) + 6*sizeof(GLuint), arena->compactedBytes());
+
+            arena->compact();
+            EXPECT_EQ(4, arena->vertexSpace().capacity());
+            EXPECT_EQ(6, arena->elemSpace().capacity());
+            EXPECT_EQ(arena->compactedBytes(), arena->gpuBytes());
+            EXPECT_EQ(0, third->first_vertex);
+            EXPECT_EQ(0, third->first_elem);
+
+            // It starts growing again from there.
+            ArenaRange::sptr_type fourth = arena->allocate(verts.data(), verts.size(), elems, 6);
+            EXPECT_EQ(4, fourth->first_vertex);
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+        }
+
+        TEST_F(BufferArenaTest, CompactsHolesWithoutShrinking) {
+            BufferArena::sptr_type arena = std::make_shared<BufferArena>(PCNVertex::description, sizeof(PCNVertex), 4, 6);
+            Geometry<PCNVertex>::sptr_type quad = makeQuad(0.0f);
+            const std::vector<PCNVertex> &verts = quad->vertices();
+            GLuint elems[6] = { 0, 1, 2, 0, 2, 3 };
+            std::vector<ArenaRange::sptr_type> ranges;
+            for (unsigned int i = 0; i < 4; ++i) {
+                ranges.push_back(arena->allocate(verts.data(), verts.size(), elems, 6));
+            }
+
+            // Still more than half full, so the buffers stay the
+            // same size, but the hole at the start goes away.
+            ranges[0].reset();
+            EXPECT_FALSE(arena->vertexSpace().packed());
+            arena->compact();
+            EXPECT_EQ(16, arena->vertexSpace().capacity());
+            EXPECT_EQ(24, arena->elemSpace().capacity());
+            EXPECT_TRUE(arena->vertexSpace().packed());
+            EXPECT_TRUE(arena->elemSpace().packed());
+            for (unsigned int i = 1; i < 4; ++i) {
+                EXPECT_EQ(4*(i - 1), ranges[i]->first_vertex);
+                EXPECT_EQ(6*(i - 1), ranges[i]->first_elem);
+            }
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+        }
+
+        TEST_F(BufferArenaTest, CopiesRangeOnWrite) {
+            BufferArenas arenas;
+            Geometry<PCNVertex>::sptr_type quad = makeQuad(0.0f);
+            quad->createBuffers(arenas);
+
+            Geometry<PCNVertex> copy(*quad);
+            EXPECT_EQ(quad->arenaRange(), copy.arenaRange());
+            EXPECT_TRUE(copy.buffersShared());
+
+            copy.updateVertices(0, 4);
+            EXPECT_FALSE(copy.buffersShared());
+            EXPECT_NE(quad->arenaRange(), copy.arenaRange());
+            EXPECT_EQ(quad->vertexArrayObjectId(), copy.vertexArrayObjectId());
+            EXPECT_EQ(8, quad->arenaRange()->arena->vertexSpace().used());
+        }
+    }
+}
@@ -0,0 +1,131 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../../graphplay/graphplay.h"
+#include "../../graphplay/gfx/Cluster.h"
+#include "../../graphplay/gfx/Frustum.h"
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+
+#include <glm/glm.hpp>
+
+#include <gtest/gtest.h>
+
+namespace graphplay {
+    namespace gfx {
+        // A unit UV sphere with its triangles wound counter-clockwise
+        // from the outside.
+        void uvSphere(unsigned int rings, unsigned int segments,
+                      std::vector<glm::vec3> &positions, std::vector<GLuint> &elems)
+        {
+            for (unsigned int r = 0; r <= rings; ++r) {
+                float phi = static_cast<float>(M_PI) * r / rings;
+                for (unsigned int s = 0; s < segments; ++s) {
+                    float theta = 2.0f * static_cast<float>(M_PI) * s / segments;
+                    positions.push_back(glm::vec3(
+                        std::sin(phi) * std::cos(theta),
+                        std::sin(phi) * std::sin(theta),
+                        std::cos(phi)));
+                }
+            }
+
+            for (unsigned int r = 0; r < rings; ++r) {
+                for (unsigned int s = 0; s < segments; ++s) {
+                    GLuint a = r*segments + s, b = r*segments + (s + 1) % segments;
+                    GLuint c = a + segments, d = b + segments;
+                    if (r > 0) {
+                        elems.insert(elems.end(), { a, c, b });
+                    }
+                    if (r < rings - 1) {
+                        elems.insert(elems.end(), { b, c, d });
+                    }
+                }
+            }
+        }
+
+        std::multiset<std::vector<GLuint> > triangleSet(const std::vector<GLuint> &elems) {
+            std::multiset<std::vector<GLuint> > rv;
+            for (std::size_t i = 0; i + 2 < elems.size(); i += 3) {
+                std::vector<GLuint> tri(elems.begin() + i, elems.begin() + i + 3);
+                std::rotate(tri.begin(), std::min_element(tri.begin(), tri.end()), tri.end());
+                rv.insert(tri);
+            }
+            return rv;
+        }
+
+        TEST(ClusterTest, ClustersCoverEveryTriangle) {
+            std::vector<glm::vec3> positions;
+            std::vector<GLuint> elems;
+            uvSphere(32, 64, positions, elems);
+            std::vector<GLuint> orig_elems = elems;
+
+            ClusterList clusters = clusterTriangles(elems, positions);
+
+            ASSERT_EQ(triangleSet(orig_elems), triangleSet(elems));
+            ASSERT_LT(1, clusters.size());
+
+            GLuint next = 0;
+            for (auto &&c : clusters) {
+                ASSERT_EQ(next, c.first_elem);
+                ASSERT_EQ(0, c.elem_count % 3);
+                ASSERT_GE(MAX_CLUSTER_TRIANGLES*3, static_cast<unsigned int>(c.elem_count));
+                next += c.elem_count;
+
+                std::set<GLuint> verts(elems.begin() + c.first_elem, elems.begin() + c.first_elem + c.elem_count);
+                ASSERT_GE(MAX_CLUSTER_VERTICES, verts.size());
+
+                for (auto &&v : verts) {
+                    EXPECT_LE(glm::length(positions[v] - c.center), c.radius * 1.0001f);
+                }
+
+                // Every face normal is inside the cone.
+                if (c.cone_cutoff < 1.0f) {
+                    float min_dot = std::sqrt(1.0f - c.cone_cutoff*c.cone_cutoff);
+                    for (GLuint i = c.first_elem; i < c.first_elem + c.elem_count; i += 3) {
+                        glm::vec3 n = glm::normalize(glm::cross(
+                            positions[elems[i + 1]] - positions[elems[i]],
+                            positions[elems[i + 2]] - positions[elems[i]]));
+                        EXPECT_GE(glm::dot(n, c.cone_axis), min_dot - 1e-5f);
+                    }
+                }
+            }
+            ASSERT_EQ(elems.size(), next);
+        }
+
+        TEST(ClusterTest, DropsOutOfRangeTriangles) {
+            std::vector<glm::vec3> positions = { glm::vec3(0, 0, 0), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0) };
+            std::vector<GLuint> elems = { 0, 1, 2, 0, 1, 7 };
+
+            ClusterList clusters = clusterTriangles(elems, positions);
+            ASSERT_EQ(1, clusters.size());
+            ASSERT_EQ(3, elems.size());
+            EXPECT_FLOAT_EQ(1.0f, clusters[0].cone_axis.z);
+        }
+
+        TEST(ClusterTest, BackFacingClustersAreCulled) {
+            std::vector<glm::vec3> positions;
+            std::vector<GLuint> elems;
+            uvSphere(32, 64, positions, elems);
+            ClusterList clusters = clusterTriangles(elems, positions);
+
+            Frustum everything;
+            glm::vec3 eye(0.0f, 0.0f, 10.0f);
+            unsigned int visible = 0;
+            for (auto &&c : clusters) {
+                bool vis = clusterVisible(c, everything, eye);
+                if (vis) {
+                    ++visible;
+                }
+
+                // Clusters on the near side have to be kept.
+                if (c.center.z - c.radius > 0.2f) {
+                    EXPECT_TRUE(vis);
+                }
+            }
+
+            EXPECT_LT(visible, clusters.size());
+            EXPECT_LT(0, visible);
+        }
+    }
+}
@@ -0,0 +1,153 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../../graphplay/graphplay.h"
+#include "../../graphplay/gfx/DistanceField.h"
+
+#include <cmath>
+#include <random>
+
+#include <glm/glm.hpp>
+
+#include <gtest/gtest.h>
+
+namespace graphplay {
+    namespace gfx {
+        // A closed unit sphere, fine enough that its distances are
+        // close to a real sphere's.
+        void distanceFieldSphere(std::vector<GLuint> &elems, std::vector<glm::vec3> &positions) {
+            const unsigned int rings = 48, segments = 96;
+            const float pi = 3.14159265f;
+            positions.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
+            for (unsigned int r = 1; r < rings; ++r) {
+                float theta = pi*r / rings;
+                for (unsigned int s = 0; s < segments; ++s) {
+                    float phi = 2.0f*pi*s / segments;
+                    positions.push_back(glm::vec3(std::sin(theta)*std::cos(phi), std::cos(theta), std::sin(theta)*std::sin(phi)));
+                }
+            }
+            positions.push_back(glm::vec3(0.0f, -1.0f, 0.0f));
+
+            const GLuint bottom = static_cast<GLuint>(positions.size() - 1);
+            for (unsigned int s = 0; s < segments; ++s) {
+                GLuint next = (s + 1) % segments;
+                GLuint top_fan[3] = { 0, 1 + next, 1 + s };
+                elems.insert(elems.end(), top_fan, top_fan + 3);
+                for (unsigned int r = 1; r + 1 < rings; ++r) {
+                    GLuint a = 1 + (r - 1)*segments, b = a + segments;
+                    GLuint quad[6] = { a + s, a + next, b + next, a + s, b + next, b + s };
+                    elems.insert(elems.end(), quad, quad + 6);
+                }
+                GLuint last = 1 + (rings - 2)*segments;
+                GLuint bottom_fan[3] = { last + s, last + next, bottom };
+                elems.insert(elems.end(), bottom_fan, bottom_fan + 3);
+            }
+        }
+
+        TEST(DistanceFieldTest, Empty) {
+            DistanceField field;
+            EXPECT_TRUE(field.empty());
+            EXPECT_TRUE(std::isinf(field.distance(glm::vec3(0.0f))));
+
+            std::vector<GLuint> elems;
+            std::vector<glm::vec3> positions;
+            field.bake(elems, positions, 16);
+            EXPECT_TRUE(field.empty());
+
+            DistanceField decoded;
+            EXPECT_FALSE(decoded.decode(field.encode()));
+        }
+
+        TEST(DistanceFieldTest, Sphere) {
+            std::vector<GLuint> elems;
+            std::vector<glm::vec3> positions;
+            distanceFieldSphere(elems, positions);
+
+            DistanceField field;
+            field.bake(elems, positions, 24);
+            ASSERT_FALSE(field.empty());
+            const float h = field.cellSize();
+            EXPECT_FLOAT_EQ(2.0f / 24, h);
+            EXPECT_EQ(25 + 2*DistanceField::PADDING_CELLS, field.dimension(0));
+
+            // Every grid point, near the surface or not, inside or out.
+            for (unsigned int z = 0; z < field.dimension(2); ++z) {
+                for (unsigned int y = 0; y < field.dimension(1); ++y) {
+                    for (unsigned int x = 0; x < field.dimension(0); ++x) {
+                        glm::vec3 p = field.bounds().min + h*glm::vec3(x, y, z);
+                        ASSERT_NEAR(glm::length(p) - 1.0f, field.value(x, y, z), 0.01f) << x << " " << y << " " << z;
+                    }
+                }
+            }
+
+            // In between grid points.
+            std::default_random_engine eng(8080);
+            std::uniform_real_distribution<float> coord(-1.15f, 1.15f);
+            for (unsigned int i = 0; i < 200; ++i) {
+                glm::vec3 p(coord(eng), coord(eng), coord(eng));
+                float r = glm::length(p);
+                EXPECT_NEAR(r - 1.0f, field.distance(p), 0.5f*h) << i;
+                if (r > 0.3f) {
+                    EXPECT_LT(0.95f, glm::dot(glm::normalize(field.gradient(p)), p / r)) << i;
+                }
+            }
+
+            // Straight out from the grid.
+            glm::vec3 far(0.0f, 5.0f, 0.0f);
+            EXPECT_NEAR(4.0f, field.distance(far), 0.01f);
+            EXPECT_EQ(glm::vec3(0.0f, 1.0f, 0.0f), field.gradient(far));
+        }
+
+        TEST(DistanceFieldTest, OpenMesh) {
+            // A single square: there's no inside, so everything is
+            // positive.
+            std::vector<GLuint> elems = { 0, 1, 2, 0, 2, 3 };
+            std::vector<glm::vec3> positions = {
+                glm::vec3(-1.0f, 0.0f, -1.0f), glm::vec3(1.0f, 0.0f, -1.0f),
+                glm::vec3(1.0f, 0.0f, 1.0f), glm::vec3(-1.0f, 0.0f, 1.0f),
+            };
+
+            DistanceField field;
+            field.bake(elems, positions, 16);
+            ASSERT_FALSE(field.empty());
+            EXPECT_EQ(1 + 2*DistanceField::PADDING_CELLS, field.dimension(1));
+            EXPECT_NEAR(0.1f, field.distance(glm::vec3(0.3f, 0.1f, 0.2f)), 1e-5f);
+            EXPECT_NEAR(0.1f, field.distance(glm::vec3(0.3f, -0.1f, 0.2f)), 1e-5f);
+            EXPECT_NEAR(0.2f, field.distance(glm::vec3(1.2f, 0.0f, 0.0f)), 1e-5f);
+        }
+
+        TEST(DistanceFieldTest, EncodeDecode) {
+            std::vector<GLuint> elems;
+            std::vector<glm::vec3> positions;
+            distanceFieldSphere(elems, positions);
+
+            DistanceField field;
+            field.bake(elems, positions, 16);
+            EXPECT_EQ(DistanceField::hashMeshData(elems, positions), field.sourceHash());
+            ByteArray data = field.encode();
+
+            DistanceField decoded;
+            ASSERT_TRUE(decoded.decode(data));
+            EXPECT_EQ(field.sourceHash(), decoded.sourceHash());
+            EXPECT_EQ(field.resolution(), decoded.resolution());
+            EXPECT_EQ(field.cellSize(), decoded.cellSize());
+            EXPECT_EQ(field.bounds().min, decoded.bounds().min);
+            for (unsigned int a = 0; a < 3; ++a) {
+                ASSERT_EQ(field.dimension(a), decoded.dimension(a));
+            }
+            for (unsigned int z = 0; z < field.dimension(2); ++z) {
+                for (unsigned int y = 0; y < field.dimension(1); ++y) {
+                    for (unsigned int x = 0; x < field.dimension(0); ++x) {
+                        ASSERT_EQ(field.value(x, y, z), decoded.value(x, y, z));
+                    }
+                }
+            }
+
+            data.resize(data.size() - 1);
+            EXPECT_FALSE(decoded.decode(data));
+
+            // A different mesh has a different hash.
+            positions[0].y += 0.01f;
+            EXPECT_NE(field.sourceHash(), DistanceField::hashMeshData(elems, positions));
+        }
+    }
+}
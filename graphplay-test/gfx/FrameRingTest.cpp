@@ -0,0 +1,94 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../../graphplay/graphplay.h"
+#include "../../graphplay/gfx/FrameRing.h"
+#include "../../graphplay/gfx/Shader.h"
+
+#include <iostream>
+
+#include <gtest/gtest.h>
+
+#include "TestOpenGLContext.h"
+
+namespace graphplay {
+    namespace gfx {
+        class FrameRingTest : public TestOpenGLContext {};
+
+        TEST_F(FrameRingTest, AllocatesFromEachFrame) {
+            FrameRing ring(GL_UNIFORM_BUFFER, 1000, 3);
+            ASSERT_EQ(GL_TRUE, glIsBuffer(ring.bufferId()));
+            EXPECT_EQ(0, ring.frameBytes() % ring.alignment());
+            EXPECT_LE(1000, ring.frameBytes());
+
+            for (unsigned int f = 1; f <= 4; ++f) {
+                ring.beginFrame();
+                EXPECT_EQ(f % 3, ring.currentFrame());
+
+                // Each allocation starts on an aligned boundary in
+                // this frame's region.
+                GLintptr first = -1, second = -1, third = -1;
+                ASSERT_NE(nullptr, ring.allocate(100, first));
+                ASSERT_NE(nullptr, ring.allocate(100, second));
+                EXPECT_EQ((GLintptr)(ring.currentFrame()*ring.frameBytes()), first);
+                EXPECT_EQ(first + (GLintptr)ring.alignedSize(100), second);
+                EXPECT_EQ(0, second % ring.alignment());
+                EXPECT_EQ(nullptr, ring.allocate(ring.frameBytes(), third));
+                EXPECT_EQ(-1, third);
+
+                ring.unmap();
+                ring.endFrame();
+            }
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+        }
+
+        TEST_F(FrameRingTest, Grows) {
+            FrameRing ring(GL_UNIFORM_BUFFER, 256, 2);
+            std::size_t before = ring.frameBytes();
+            ring.reserve(before/2);
+            EXPECT_EQ(before, ring.frameBytes());
+
+            ring.reserve(before + 1);
+            EXPECT_LE(2*before, ring.frameBytes());
+            EXPECT_EQ(GL_TRUE, glIsBuffer(ring.bufferId()));
+
+            ring.beginFrame();
+            GLintptr offset = 0;
+            EXPECT_NE(nullptr, ring.allocate(before + 1, offset));
+            ring.endFrame();
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+        }
+
+        TEST_F(FrameRingTest, DISABLED_StallTime) {
+            // Not really a test: reports how long the CPU waits on
+            // the GPU while streaming model blocks for 10k draws a
+            // frame, with one frame in flight versus three. Only
+            // runs when disabled tests are asked for.
+            const unsigned int DRAWS = 10000, FRAMES = 200;
+
+            for (unsigned int in_flight : { 1u, 3u }) {
+                // Each block takes up a whole alignment's worth.
+                FrameRing ring(GL_UNIFORM_BUFFER, sizeof(ModelTransformationBlock), in_flight);
+                ring.reserve(DRAWS*ring.alignedSize(sizeof(ModelTransformationBlock)));
+                for (unsigned int f = 0; f < FRAMES; ++f) {
+                    ring.beginFrame();
+                    for (unsigned int d = 0; d < DRAWS; ++d) {
+                        GLintptr offset;
+                        ModelTransformationBlock *block = (ModelTransformationBlock*)ring.allocate(sizeof(ModelTransformationBlock), offset);
+                        ASSERT_NE(nullptr, block);
+                        block->set(glm::mat4x4((float)d), glm::mat3x3(1.0f));
+                    }
+                    ring.unmap();
+                    glBindBufferRange(GL_UNIFORM_BUFFER, ModelTransformationBlock::BINDING, ring.bufferId(),
+                                      ring.currentFrame()*ring.frameBytes(), sizeof(ModelTransformationBlock));
+                    ring.endFrame();
+                }
+
+                std::cerr << in_flight << " frame(s) in flight: " << ring.stalls() << " stalls, "
+                          << ring.totalStall() / 1000.0 << " ms waiting over " << FRAMES << " frames"
+                          << (ring.persistent() ? " (persistent)" : "") << std::endl;
+            }
+            glBindBufferBase(GL_UNIFORM_BUFFER, ModelTransformationBlock::BINDING, 0);
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+        }
+    }
+}
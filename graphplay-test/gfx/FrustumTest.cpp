@@ -0,0 +1,62 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../../graphplay/graphplay.h"
+#include "../../graphplay/gfx/Frustum.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <gtest/gtest.h>
+
+namespace graphplay {
+    namespace gfx {
+        TEST(FrustumTest, DefaultContainsEverything) {
+            Frustum f;
+            EXPECT_TRUE(f.intersectsSphere(glm::vec3(1000.0f, -1000.0f, 5.0f), 0.0f));
+        }
+
+        TEST(FrustumTest, OrthographicBox) {
+            Frustum f(glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f));
+
+            EXPECT_TRUE(f.intersectsSphere(glm::vec3(0.0f), 0.1f));
+            EXPECT_TRUE(f.intersectsSphere(glm::vec3(1.5f, 0.0f, 0.0f), 0.6f));
+            EXPECT_FALSE(f.intersectsSphere(glm::vec3(1.5f, 0.0f, 0.0f), 0.4f));
+            EXPECT_FALSE(f.intersectsSphere(glm::vec3(0.0f, -2.0f, 0.0f), 0.5f));
+            EXPECT_FALSE(f.intersectsSphere(glm::vec3(0.0f, 0.0f, 3.0f), 1.0f));
+
+            for (unsigned int i = 0; i < 6; ++i) {
+                EXPECT_FLOAT_EQ(1.0f, glm::length(glm::vec3(f.plane(i))));
+            }
+        }
+
+        TEST(FrustumTest, PerspectiveView) {
+            glm::mat4x4 proj = glm::perspective<float>(static_cast<float>(M_PI / 2), 1.0f, 0.1f, 100.0f);
+            glm::mat4x4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            Frustum f(proj * view);
+
+            EXPECT_TRUE(f.intersectsSphere(glm::vec3(0.0f), 1.0f));
+            EXPECT_TRUE(f.intersectsSphere(glm::vec3(9.0f, 0.0f, 0.0f), 0.5f));
+            EXPECT_FALSE(f.intersectsSphere(glm::vec3(12.0f, 0.0f, 0.0f), 0.5f));
+            EXPECT_FALSE(f.intersectsSphere(glm::vec3(0.0f, 0.0f, 20.0f), 1.0f));
+            EXPECT_FALSE(f.intersectsSphere(glm::vec3(0.0f, 0.0f, -100.0f), 1.0f));
+        }
+
+        TEST(FrustumTest, Boxes) {
+            glm::mat4x4 proj = glm::perspective<float>(static_cast<float>(M_PI / 2), 1.0f, 0.1f, 100.0f);
+            glm::mat4x4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            Frustum f(proj * view);
+
+            EXPECT_TRUE(f.intersectsBox(glm::vec3(-1.0f), glm::vec3(1.0f)));
+            // Sticking into the view from the side.
+            EXPECT_TRUE(f.intersectsBox(glm::vec3(9.0f, -1.0f, -1.0f), glm::vec3(20.0f, 1.0f, 1.0f)));
+            EXPECT_FALSE(f.intersectsBox(glm::vec3(12.0f, -1.0f, -1.0f), glm::vec3(13.0f, 1.0f, 1.0f)));
+            // Behind the camera.
+            EXPECT_FALSE(f.intersectsBox(glm::vec3(-1.0f, -1.0f, 11.0f), glm::vec3(1.0f, 1.0f, 12.0f)));
+            // Big enough to contain the whole frustum.
+            EXPECT_TRUE(f.intersectsBox(glm::vec3(-1000.0f), glm::vec3(1000.0f)));
+
+            Frustum all;
+            EXPECT_TRUE(all.intersectsBox(glm::vec3(500.0f), glm::vec3(501.0f)));
+        }
+    }
+}
@@ -0,0 +1,57 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../../graphplay/graphplay.h"
+#include "../../graphplay/gfx/GBuffer.h"
+
+#include <gtest/gtest.h>
+
+#include "TestOpenGLContext.h"
+
+namespace graphplay {
+    namespace gfx {
+        class GBufferTest : public TestOpenGLContext {};
+
+        TEST_F(GBufferTest, MakesAttachments) {
+            GBuffer gbuffer(320, 240);
+            ASSERT_TRUE(gbuffer.complete());
+            ASSERT_EQ(GL_TRUE, glIsFramebuffer(gbuffer.framebufferId()));
+            for (unsigned int i = 0; i < GBuffer::ATTACHMENTS; ++i) {
+                GLint width = 0, height = 0;
+                ASSERT_EQ(GL_TRUE, glIsTexture(gbuffer.textureId((GBuffer::Attachment)i)));
+                glBindTexture(GL_TEXTURE_2D, gbuffer.textureId((GBuffer::Attachment)i));
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+                EXPECT_EQ(320, width);
+                EXPECT_EQ(240, height);
+            }
+            glBindTexture(GL_TEXTURE_2D, 0);
+
+            // Resizing makes new ones; the same size again doesn't.
+            GLuint framebuffer = gbuffer.framebufferId();
+            gbuffer.resize(320, 240);
+            EXPECT_EQ(framebuffer, gbuffer.framebufferId());
+            gbuffer.resize(640, 480);
+            EXPECT_EQ(640, gbuffer.width());
+            EXPECT_EQ(480, gbuffer.height());
+            EXPECT_TRUE(gbuffer.complete());
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+        }
+
+        TEST_F(GBufferTest, DoesntBindWhenIncomplete) {
+            // Attachments with no pixels can't be drawn into.
+            GBuffer gbuffer(0, 0);
+            ASSERT_FALSE(gbuffer.complete());
+            EXPECT_FALSE(gbuffer.bindForGeometry());
+
+            GLint bound = -1;
+            glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bound);
+            EXPECT_EQ(0, bound);
+
+            gbuffer.resize(320, 240);
+            ASSERT_TRUE(gbuffer.complete());
+            EXPECT_TRUE(gbuffer.bindForGeometry());
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+        }
+    }
+}
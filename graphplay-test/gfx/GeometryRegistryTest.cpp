@@ -0,0 +1,114 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../../graphplay/graphplay.h"
+#include "../../graphplay/gfx/GeometryRegistry.h"
+#include "../../graphplay/gfx/Mesh.h"
+
+#include <gtest/gtest.h>
+
+#include "TestOpenGLContext.h"
+
+namespace graphplay {
+    namespace gfx {
+        class GeometryRegistryTest : public TestOpenGLContext {};
+
+        // A single triangle, which takes up 3 vertices and 3
+        // indices in its arena. The tests' arenas start out with
+        // room for just one.
+        const std::size_t TRIANGLE_BYTES = 3*sizeof(PCNVertex) + 3*sizeof(GLuint);
+        const std::size_t TRIANGLE_VERTICES = 3, TRIANGLE_ELEMS = 3;
+
+        AbstractGeometry::sptr_type makeTriangle() {
+            PCNVertex verts[3] = {
+                { { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f } },
+                { { 1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f } },
+                { { 0.0f, 1.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f } },
+            };
+            GLuint elems[3] = { 0, 1, 2 };
+            Geometry<PCNVertex>::sptr_type rv = std::make_shared<Geometry<PCNVertex> >();
+            rv->setVertexData(elems, 3, verts, 3);
+            return rv;
+        }
+
+        TEST_F(GeometryRegistryTest, SharesGeometries) {
+            GeometryRegistry registry(GeometryRegistry::DEFAULT_BUDGET, TRIANGLE_VERTICES, TRIANGLE_ELEMS);
+            unsigned int made = 0;
+            auto make = [&made]() {
+                ++made;
+                return makeTriangle();
+            };
+
+            AbstractGeometry::sptr_type a = registry.get("a", make);
+            ASSERT_NE(nullptr, a);
+            EXPECT_EQ(TRIANGLE_BYTES, a->gpuBytes());
+            EXPECT_EQ(a, registry.get("a", make));
+            EXPECT_EQ(1, made);
+
+            AbstractGeometry::sptr_type b = registry.get("b", make);
+            EXPECT_NE(a, b);
+            EXPECT_EQ(2, made);
+            EXPECT_EQ(2, registry.size());
+            EXPECT_EQ(2*TRIANGLE_BYTES, registry.gpuBytes());
+
+            EXPECT_EQ(registry.primitive("sphere"), registry.primitive("sphere"));
+            EXPECT_TRUE(registry.contains(GeometryRegistry::primitiveKey("sphere")));
+            EXPECT_EQ(nullptr, registry.primitive("dodecahedron"));
+            EXPECT_EQ(nullptr, registry.compactPly("no/such/file.ply"));
+            EXPECT_EQ(3, registry.size());
+        }
+
+        TEST_F(GeometryRegistryTest, SharesVertexArrays) {
+            GeometryRegistry registry;
+            Program::sptr_type program = createUnlitProgram();
+            AbstractGeometry::sptr_type geo = registry.primitive("icosahedron");
+
+            Mesh first(geo, program);
+            GLuint vao = geo->vertexArrayObjectId();
+            ASSERT_NE(0, vao);
+            ASSERT_NE(nullptr, geo->arenaRange());
+            EXPECT_EQ(geo->arenaRange()->arena->vertexArrayObjectId(), vao);
+
+            // Everything with the same vertex format shares it.
+            Mesh second(registry.primitive("sphere"), program);
+            EXPECT_EQ(vao, registry.primitive("sphere")->vertexArrayObjectId());
+            EXPECT_EQ(1, registry.arenas().size());
+        }
+
+        TEST_F(GeometryRegistryTest, EvictsLeastRecentlyUsed) {
+            GeometryRegistry registry(2*TRIANGLE_BYTES, TRIANGLE_VERTICES, TRIANGLE_ELEMS);
+            registry.get("a", makeTriangle);
+            registry.get("b", makeTriangle);
+            registry.get("a", makeTriangle);
+
+            // b is the least recently used, so it goes to make room.
+            registry.get("c", makeTriangle);
+            EXPECT_TRUE(registry.contains("a"));
+            EXPECT_FALSE(registry.contains("b"));
+            EXPECT_TRUE(registry.contains("c"));
+            EXPECT_EQ(2*TRIANGLE_BYTES, registry.gpuBytes());
+
+            // Geometries that are in use stay, even over budget.
+            AbstractGeometry::sptr_type d = registry.get("d", makeTriangle);
+            AbstractGeometry::sptr_type e = registry.get("e", makeTriangle);
+            EXPECT_EQ(2, registry.size());
+            registry.budget(0);
+            EXPECT_EQ(2, registry.size());
+            EXPECT_TRUE(registry.contains("d"));
+            EXPECT_TRUE(registry.contains("e"));
+
+            d.reset();
+            registry.trim();
+            EXPECT_FALSE(registry.contains("d"));
+            EXPECT_EQ(1, registry.size());
+
+            // And the arena shrinks back down around e.
+            EXPECT_EQ(TRIANGLE_BYTES, registry.gpuBytes());
+            EXPECT_EQ(0, e->arenaRange()->first_vertex);
+
+            e.reset();
+            registry.budget(GeometryRegistry::DEFAULT_BUDGET);
+            registry.evictUnused();
+            EXPECT_EQ(0, registry.size());
+        }
+    }
+}
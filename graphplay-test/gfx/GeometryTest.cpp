@@ -1,7 +1,16 @@
 // -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
 
 #include "../../graphplay/graphplay.h"
+#include "../../graphplay/Parallel.h"
 #include "../../graphplay/gfx/Geometry.h"
+#include "../../graphplay/gfx/MeshCodec.h"
+#include "../../graphplay/gfx/Shader.h"
+#include "../../graphplay/gfx/Stripify.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <set>
 
 #include <gtest/gtest.h>
 
@@ -168,6 +177,14 @@ namespace graphplay {
             assertBuffersCreated(dynamic_cast<AbstractGeometry&>(g1));
             assertBuffersCreated(dynamic_cast<AbstractGeometry&>(g2));
 
+            // The buffers are shared until one of them needs its own.
+            ASSERT_TRUE(g2.buffersShared());
+            ASSERT_EQ(g1.elemBufferId(), g2.elemBufferId());
+            ASSERT_EQ(g1.vertexBufferId(), g2.vertexBufferId());
+
+            g2.makeBuffersUnique();
+            ASSERT_FALSE(g1.buffersShared());
+            ASSERT_FALSE(g2.buffersShared());
             ASSERT_NE(g1.elemBufferId(), g2.elemBufferId());
             ASSERT_NE(g1.vertexBufferId(), g2.vertexBufferId());
 
@@ -200,6 +217,10 @@ namespace graphplay {
             assertBuffersCreated(dynamic_cast<AbstractGeometry&>(g1));
             assertBuffersCreated(dynamic_cast<AbstractGeometry&>(g2));
 
+            ASSERT_EQ(g1.elemBufferId(), g2.elemBufferId());
+            ASSERT_EQ(g1.vertexBufferId(), g2.vertexBufferId());
+
+            g1.makeBuffersUnique();
             ASSERT_NE(g1.elemBufferId(), g2.elemBufferId());
             ASSERT_NE(g1.vertexBufferId(), g2.vertexBufferId());
 
@@ -239,6 +260,41 @@ namespace graphplay {
             ASSERT_EQ(GL_FALSE, glIsBuffer(ebuf));
         }
 
+        TEST_F(GeometryTest, CopyOnWrite) {
+            Geometry<PCNVertex>::sptr_type g1 = std::make_shared<Geometry<PCNVertex> >();
+            g1->setVertexData(elems, verts);
+            g1->createBuffers();
+            Program::sptr_type program = createUnlitProgram();
+            g1->createVertexArray(*program);
+            GLuint vbuf = g1->vertexBufferId();
+
+            Geometry<PCNVertex> g2(*g1);
+            ASSERT_EQ(g1->vertexArrayObjectId(), g2.vertexArrayObjectId());
+
+            // Changing the copy leaves the original alone.
+            g2.vertices()[0].position[0] = 0.5f;
+            g2.updateVertices(0, 1);
+            ASSERT_EQ(vbuf, g1->vertexBufferId());
+            ASSERT_NE(vbuf, g2.vertexBufferId());
+            ASSERT_NE(g1->vertexArrayObjectId(), g2.vertexArrayObjectId());
+            ASSERT_EQ(program->getProgramId(), g2.vertexArrayProgramId());
+
+            float position[3];
+            glBindBuffer(GL_ARRAY_BUFFER, g2.vertexBufferId());
+            glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(position), position);
+            ASSERT_EQ(0.5f, position[0]);
+            glBindBuffer(GL_ARRAY_BUFFER, vbuf);
+            glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(position), position);
+            ASSERT_EQ(0.0f, position[0]);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            // Shared buffers outlive the geometry they came from.
+            Geometry<PCNVertex> g3(*g1);
+            g1.reset();
+            ASSERT_EQ(GL_TRUE, glIsBuffer(vbuf));
+            ASSERT_FALSE(g3.buffersShared());
+        }
+
         TEST_F(GeometryTest, CreateOctohedron) {
             Geometry<PCNVertex>::sptr_type octo = makeOctohedronGeometry();
 
@@ -247,11 +303,294 @@ namespace graphplay {
             ASSERT_LT(0, static_cast<int>(octo->vertices().size()));
         }
 
+        TEST_F(GeometryTest, BoundingBox) {
+            Geometry<PCNVertex> g;
+            g.setVertexData(elems, verts);
+            EXPECT_EQ(glm::vec3(0.0f), g.boundingBox().min);
+            EXPECT_EQ(glm::vec3(1.0f), g.boundingBox().max);
+
+            // Copies keep it, and compact vertices give (about) the
+            // same one.
+            Geometry<PCNVertex> copy(g);
+            EXPECT_EQ(g.boundingBox().max, copy.boundingBox().max);
+            CompactPCNGeometry::sptr_type compact = makeCompactGeometry(*makeOctohedronGeometry());
+            EXPECT_NEAR(-1.0f, compact->boundingBox().min.x, 0.001f);
+            EXPECT_NEAR(1.0f, compact->boundingBox().max.z, 0.001f);
+
+            g.vertices()[0].position[2] = 3.0f;
+            EXPECT_EQ(1.0f, g.boundingBox().max.z);
+            g.updateBoundingBox();
+            EXPECT_EQ(3.0f, g.boundingBox().max.z);
+        }
+
         TEST_F(GeometryTest, CreateSphere) {
             Geometry<PCNVertex>::sptr_type sphere = makeSphereGeometry();
             assertBuffersCreated(*sphere);
             ASSERT_LT(0, static_cast<int>(sphere->elements().size()));
             ASSERT_LT(0, static_cast<int>(sphere->vertices().size()));
         }
+   
+        TEST_F(GeometryTest, CreateSpherePatches) {
+            Geometry<PCNVertex>::sptr_type sphere = makeSpherePatchGeometry();
+            assertBuffersCreated(*sphere);
+            ASSERT_EQ(GL_PATCHES, sphere->draw_type);
+            ASSERT_EQ(60, sphere->elements().size());
+            ASSERT_EQ(12, sphere->vertices().size());
+            for (auto &&v : sphere->vertices()) {
+                ASSERT_FLOAT_EQ(1.0f, glm::length(vertexPosition(v)));
+            }
+        }
+
+        TEST_F(GeometryTest, CompactVertexRoundTrip) {
+            PCNVertex v { { 0.25f, -0.5f, 1.0f }, { 0.2f, 0.4f, 0.6f, 1.0f }, { 0.6f, -0.8f, 0.0f } };
+            CompactPCNVertex cv = compactVertex(v);
+            PCNVertex ev = expandVertex(cv);
+
+            ASSERT_EQ(16, sizeof(CompactPCNVertex));
+            for (unsigned int i = 0; i < 3; ++i) {
+                EXPECT_NEAR(v.position[i], ev.position[i], 1e-3);
+                EXPECT_NEAR(v.normal[i], ev.normal[i], 2e-3);
+            }
+            for (unsigned int i = 0; i < 4; ++i) {
+                EXPECT_NEAR(v.color[i], ev.color[i], 0.5f / 255.0f);
+            }
+        }
+
+        TEST_F(GeometryTest, CreateCompactGeometry) {
+            Geometry<PCNVertex>::sptr_type sphere = makeSphereGeometry();
+            CompactPCNGeometry::sptr_type compact = makeCompactGeometry(*sphere);
+
+            assertNoBuffersCreated(*compact);
+            ASSERT_EQ(&CompactPCNVertex::description, &compact->attrInfos());
+            ASSERT_EQ(sphere->draw_type, compact->draw_type);
+            ASSERT_EQ(sphere->elements(), compact->elements());
+            ASSERT_EQ(sphere->vertices().size(), compact->vertices().size());
+
+            compact->createBuffers();
+            assertBuffersCreated(*compact);
+        }
+
+        TEST_F(GeometryTest, CompactsStripifiedGeometry) {
+            Geometry<PCNVertex>::sptr_type sphere = makeSphereGeometry();
+            Geometry<PCNVertex> strips(*sphere);
+            stripify(strips);
+            ASSERT_TRUE(strips.primitive_restart);
+
+            // The restart markers have to stay markers.
+            CompactPCNGeometry::sptr_type compact = makeCompactGeometry(strips);
+            EXPECT_EQ(GL_TRIANGLE_STRIP, compact->draw_type);
+            EXPECT_TRUE(compact->primitive_restart);
+            EXPECT_EQ(strips.elements(), compact->elements());
+
+            compact->createBuffers();
+            assertBuffersCreated(*compact);
+            EXPECT_EQ(GL_UNSIGNED_SHORT, compact->elemGLType());
+        }
+
+        TEST_F(GeometryTest, SmallGeometryUsesShortIndices) {
+            Geometry<PCNVertex> g;
+            g.setVertexData(elems, verts);
+            ASSERT_EQ(GL_UNSIGNED_INT, g.elemGLType());
+
+            g.createBuffers();
+            ASSERT_EQ(GL_UNSIGNED_SHORT, g.elemGLType());
+
+            int size = 0;
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g.elemBufferId());
+            glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+            ASSERT_EQ(3*sizeof(GLushort), size);
+        }
+
+        TEST_F(GeometryTest, StripifySphere) {
+            Geometry<PCNVertex>::sptr_type sphere = makeSphereGeometry();
+            Geometry<PCNVertex> strips(*sphere);
+
+            stripify(strips);
+            ASSERT_EQ(GL_TRIANGLE_STRIP, strips.draw_type);
+            ASSERT_TRUE(strips.primitive_restart);
+            ASSERT_LT(strips.elements().size(), sphere->elements().size());
+
+            strips.createBuffers();
+            assertBuffersCreated(strips);
+            ASSERT_EQ(GL_UNSIGNED_SHORT, strips.elemGLType());
+        }
+
+        TEST_F(GeometryTest, BuildClusters) {
+            Geometry<PCNVertex>::sptr_type sphere = makeSphereGeometry();
+            Geometry<PCNVertex> g(*sphere);
+
+            g.buildClusters();
+            ASSERT_LT(1, g.clusters().size());
+            ASSERT_EQ(sphere->elements().size(), g.elements().size());
+
+            GLsizei total = 0;
+            for (auto &&c : g.clusters()) {
+                total += c.elem_count;
+            }
+            ASSERT_EQ(g.elements().size(), total);
+
+            Geometry<PCNVertex> copy(g);
+            ASSERT_EQ(g.clusters().size(), copy.clusters().size());
+
+            g.setVertexData(elems, verts);
+            ASSERT_TRUE(g.clusters().empty());
+        }
+
+        TEST_F(GeometryTest, MortonSort) {
+            Geometry<PCNVertex>::sptr_type sphere = makeSphereGeometry();
+            Geometry<PCNVertex> g(*sphere);
+
+            g.mortonSort();
+            ASSERT_EQ(sphere->vertices().size(), g.vertices().size());
+            ASSERT_EQ(sphere->elements().size(), g.elements().size());
+
+            // Every triangle is still there, with the same corners in
+            // the same order.
+            auto triangles = [](const Geometry<PCNVertex> &geo) {
+                std::multiset<std::vector<float> > rv;
+                const std::vector<GLuint> &es = geo.elements();
+                for (std::size_t f = 0; f < es.size() / 3; ++f) {
+                    std::vector<float> tri;
+                    for (unsigned int j = 0; j < 3; ++j) {
+                        const float *p = geo.vertices()[es[3*f + j]].position;
+                        tri.insert(tri.end(), p, p + 3);
+                    }
+                    rv.insert(tri);
+                }
+                return rv;
+            };
+            ASSERT_EQ(triangles(*sphere), triangles(g));
+        }
+
+        TEST_F(GeometryTest, EncodeRoundTrip) {
+            Geometry<PCNVertex>::sptr_type sphere = makeSphereGeometry();
+            sphere->mortonSort();
+
+            for (bool compress : { false, true }) {
+                ByteArray data = encodeGeometry(*sphere, compress);
+                EXPECT_GT(sphere->vertices().size()*sizeof(PCNVertex) + sphere->elements().size()*sizeof(GLuint), data.size());
+
+                Geometry<PCNVertex> g;
+                ASSERT_TRUE(decodeGeometry(data, g));
+                EXPECT_EQ(sphere->draw_type, g.draw_type);
+                EXPECT_EQ(sphere->primitive_restart, g.primitive_restart);
+                ASSERT_EQ(sphere->elements(), g.elements());
+                ASSERT_EQ(sphere->vertices().size(), g.vertices().size());
+                ASSERT_EQ(0, std::memcmp(sphere->vertices().data(), g.vertices().data(), g.vertices().size()*sizeof(PCNVertex)));
+
+                // Wrong vertex type.
+                Geometry<CompactPCNVertex> wrong;
+                EXPECT_FALSE(decodeGeometry(data, wrong));
+            }
+        }
+
+        TEST_F(GeometryTest, MutableGeometryStreams) {
+            MutableGeometry<PCNVertex> geo(*makeWireframeCubeGeometry());
+            assertNoBuffersCreated(geo);
+
+            geo.updateBuffers();
+            ASSERT_EQ(GL_TRUE, glIsBuffer(geo.vertexBufferId()));
+            ASSERT_EQ(GL_TRUE, glIsBuffer(geo.elemBufferId()));
+            EXPECT_EQ(8, geo.vertexCapacity());
+            EXPECT_EQ(24, geo.elemCapacity());
+            EXPECT_EQ(0, geo.currentSegment());
+            EXPECT_EQ(MutableGeometry<PCNVertex>::SEGMENTS*(8*sizeof(PCNVertex) + 24*sizeof(GLuint)), geo.gpuBytes());
+            EXPECT_EQ(GL_UNSIGNED_INT, geo.elemGLType());
+
+            Program::sptr_type program = createUnlitProgram();
+            geo.createVertexArray(*program);
+            GLuint vbuf = geo.vertexBufferId(), vao = geo.vertexArrayObjectId();
+
+            // Each update goes in the next segment, and comes back
+            // around to the first.
+            for (unsigned int i = 1; i <= MutableGeometry<PCNVertex>::SEGMENTS; ++i) {
+                geo.vertices()[0].position[0] = (float)i;
+                glUseProgram(program->getProgramId());
+                geo.render();
+                glFinish();
+                geo.updateBuffers();
+                EXPECT_EQ(i % MutableGeometry<PCNVertex>::SEGMENTS, geo.currentSegment());
+            }
+            EXPECT_EQ(0, geo.orphanCount());
+            EXPECT_EQ(vbuf, geo.vertexBufferId());
+            EXPECT_EQ(vao, geo.vertexArrayObjectId());
+
+            float position[3];
+            glBindBuffer(GL_ARRAY_BUFFER, vbuf);
+            glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(position), position);
+            EXPECT_EQ((float)MutableGeometry<PCNVertex>::SEGMENTS, position[0]);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            // Updating through a plain Geometry streams too.
+            Geometry<PCNVertex> &plain = geo;
+            glFinish();
+            plain.updateVertices(0, 1);
+            EXPECT_EQ(1, geo.currentSegment());
+            geo.updateBuffers();
+            geo.updateBuffers();
+            EXPECT_EQ(0, geo.currentSegment());
+
+            // Growing keeps the same buffers (and vertex array).
+            geo.vertices().push_back(geo.vertices()[0]);
+            geo.updateBuffers();
+            EXPECT_LE(9, geo.vertexCapacity());
+            EXPECT_EQ(0, geo.currentSegment());
+            EXPECT_EQ(vbuf, geo.vertexBufferId());
+            glUseProgram(program->getProgramId());
+            geo.render();
+            glUseProgram(0);
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+
+            // Copies don't share the stream.
+            MutableGeometry<PCNVertex> copy(geo);
+            assertNoBuffersCreated(copy);
+        }
+
+        // Not really a test: reports how long it takes to stream a
+        // million vertices a frame. Only run on request.
+        TEST_F(GeometryTest, DISABLED_StreamingThroughput) {
+            const std::size_t num_verts = 1000000;
+            const unsigned int frames = 30;
+
+            MutableGeometry<PCNVertex> geo;
+            geo.draw_type = GL_POINTS;
+            std::vector<GLuint> points(num_verts);
+            std::vector<PCNVertex> verts(num_verts, PCNVertex{ { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f } });
+            for (std::size_t i = 0; i < num_verts; ++i) {
+                points[i] = (GLuint)i;
+            }
+            geo.setVertexData(std::move(points), std::move(verts));
+
+            Program::sptr_type program = createUnlitProgram();
+            geo.createVertexArray(*program);
+            glUseProgram(program->getProgramId());
+
+            typedef std::chrono::steady_clock clock;
+            clock::duration update_time = clock::duration::zero();
+            clock::time_point start = clock::now();
+            for (unsigned int frame = 0; frame < frames; ++frame) {
+                std::vector<PCNVertex> &v = geo.vertices();
+                parallelFor(v.size(), 1 << 14, [&](std::size_t i) {
+                        v[i].position[0] = std::sin(0.001f*i + 0.1f*frame);
+                        v[i].position[1] = std::cos(0.001f*i + 0.1f*frame);
+                    });
+
+                clock::time_point update_start = clock::now();
+                geo.updateBuffers();
+                update_time += clock::now() - update_start;
+                geo.render();
+            }
+            glFinish();
+            clock::duration total_time = clock::now() - start;
+            glUseProgram(0);
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+
+            const double frame_bytes = num_verts*(sizeof(PCNVertex) + sizeof(GLuint));
+            std::cerr << "streamed " << num_verts << " vertices/frame: "
+                      << frames*frame_bytes / 1e6 / std::chrono::duration<double>(update_time).count() << " MB/s upload, "
+                      << 1e3*std::chrono::duration<double>(total_time).count()/frames << " ms/frame, "
+                      << geo.orphanCount() << " orphaned" << std::endl;
+        }
     }
 }
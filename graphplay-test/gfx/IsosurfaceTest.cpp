@@ -0,0 +1,160 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../../graphplay/graphplay.h"
+#include "../../graphplay/gfx/Isosurface.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <utility>
+
+#include <glm/glm.hpp>
+
+#include <gtest/gtest.h>
+
+#include "TestOpenGLContext.h"
+
+namespace graphplay {
+    namespace gfx {
+        class IsosurfaceTest : public TestOpenGLContext {};
+
+        // Whether every edge of every triangle is shared with exactly
+        // one other triangle, which has it the other way around.
+        bool isClosedManifold(const Geometry<PCNVertex> &geo) {
+            std::map<std::pair<GLuint, GLuint>, unsigned int> edges;
+            const std::vector<GLuint> &elems = geo.elements();
+            for (std::size_t f = 0; f < elems.size() / 3; ++f) {
+                for (unsigned int j = 0; j < 3; ++j) {
+                    ++edges[std::make_pair(elems[3*f + j], elems[3*f + (j + 1) % 3])];
+                }
+            }
+
+            for (auto edge : edges) {
+                auto reverse = edges.find(std::make_pair(edge.first.second, edge.first.first));
+                if (edge.second != 1 || reverse == edges.end() || reverse->second != 1) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        TEST_F(IsosurfaceTest, Sphere) {
+            ScalarGrid grid(glm::vec3(-1.5f), 3.0f / 32, 33, 33, 33);
+            grid.sample([](const glm::vec3 &p) { return glm::length(p) - 1.0f; });
+
+            const glm::vec4 color(0.2f, 0.4f, 0.6f, 1.0f);
+            Geometry<PCNVertex>::sptr_type geo = extractIsosurface(grid, 0.0f, color);
+            EXPECT_EQ(GL_TRIANGLES, geo->draw_type);
+            ASSERT_LT(100, geo->vertices().size());
+            ASSERT_TRUE(isClosedManifold(*geo));
+
+            for (const PCNVertex &v : geo->vertices()) {
+                glm::vec3 p(v.position[0], v.position[1], v.position[2]);
+                glm::vec3 n(v.normal[0], v.normal[1], v.normal[2]);
+                ASSERT_NEAR(1.0f, glm::length(p), 0.02f);
+                ASSERT_NEAR(1.0f, glm::length(n), 1e-5f);
+                ASSERT_LT(0.98f, glm::dot(n, glm::normalize(p)));
+                ASSERT_EQ(color.w, v.color[3]);
+            }
+
+            // Every triangle faces out.
+            const std::vector<GLuint> &elems = geo->elements();
+            for (std::size_t f = 0; f < elems.size() / 3; ++f) {
+                const float *a = geo->vertices()[elems[3*f]].position;
+                const float *b = geo->vertices()[elems[3*f + 1]].position;
+                const float *c = geo->vertices()[elems[3*f + 2]].position;
+                glm::vec3 pa(a[0], a[1], a[2]), pb(b[0], b[1], b[2]), pc(c[0], c[1], c[2]);
+                ASSERT_LT(0.0f, glm::dot(glm::cross(pb - pa, pc - pa), pa + pb + pc)) << f;
+            }
+        }
+
+        TEST_F(IsosurfaceTest, NothingToExtract) {
+            ScalarGrid grid(glm::vec3(0.0f), 1.0f, 4, 5, 6);
+            grid.sample([](const glm::vec3 &) { return 1.0f; });
+
+            Geometry<PCNVertex>::sptr_type geo = extractIsosurface(grid, 0.0f, glm::vec4(1.0f));
+            EXPECT_TRUE(geo->vertices().empty());
+            EXPECT_TRUE(geo->elements().empty());
+
+            // Too small to have any cells.
+            ScalarGrid flat(glm::vec3(0.0f), 1.0f, 4, 1, 6);
+            geo = extractIsosurface(flat, 0.0f, glm::vec4(1.0f));
+            EXPECT_TRUE(geo->vertices().empty());
+        }
+
+        TEST_F(IsosurfaceTest, Metaballs) {
+            ScalarGrid grid(glm::vec3(-2.0f), 0.1f, 41, 41, 41);
+            std::vector<glm::vec3> centers = { glm::vec3(-0.4f, 0.0f, 0.0f), glm::vec3(0.4f, 0.0f, 0.0f) };
+            grid.sampleMetaballs(centers, 1.0f, 0.5f);
+
+            // Untouched far away, and full density at the centers.
+            EXPECT_EQ(0.5f, grid.at(0, 0, 0));
+            EXPECT_LT(grid.at(16, 20, 20), -0.3f);
+            EXPECT_LT(0.0f, grid.at(20, 32, 20));
+
+            Geometry<PCNVertex> geo;
+            IsosurfaceExtractor extractor;
+            extractor.extract(grid, 0.0f, glm::vec4(1.0f), geo);
+            ASSERT_FALSE(geo.vertices().empty());
+            EXPECT_TRUE(isClosedManifold(geo));
+
+            // The same thing, from bodies.
+            std::vector<fzx::Body::sptr_type> bodies;
+            for (const glm::vec3 &c : centers) {
+                bodies.push_back(std::make_shared<fzx::Body>(1.0f, c, glm::vec3(0.0f), fzx::BBox()));
+            }
+            ScalarGrid from_bodies(glm::vec3(-2.0f), 0.1f, 41, 41, 41);
+            from_bodies.sampleMetaballs(bodies, 1.0f, 1.0f, 0.5f);
+            EXPECT_EQ(grid.values(), from_bodies.values());
+
+            // Moving them apart splits them up, and extracting again
+            // into the same geometry replaces what was there.
+            centers[0].x = -1.2f;
+            centers[1].x = 1.2f;
+            grid.sampleMetaballs(centers, 1.0f, 0.5f);
+            extractor.extract(grid, 0.0f, glm::vec4(1.0f), geo);
+            Geometry<PCNVertex>::sptr_type fresh = extractIsosurface(grid, 0.0f, glm::vec4(1.0f));
+            EXPECT_EQ(fresh->elements(), geo.elements());
+            ASSERT_EQ(fresh->vertices().size(), geo.vertices().size());
+            EXPECT_TRUE(isClosedManifold(geo));
+            for (const PCNVertex &v : geo.vertices()) {
+                ASSERT_LT(0.3f, std::abs(v.position[0]));
+            }
+        }
+
+        // Not really a test: reports how long it takes to fill and
+        // extract a 128^3 metaball field. Disabled, since it
+        // takes a while.
+        TEST_F(IsosurfaceTest, DISABLED_Throughput) {
+            const unsigned int n = 129;
+            ScalarGrid grid(glm::vec3(-1.0f), 2.0f / (n - 1), n, n, n);
+            std::vector<glm::vec3> centers;
+            for (unsigned int i = 0; i < 16; ++i) {
+                float a = 0.4f*i;
+                centers.push_back(glm::vec3(0.6f*std::cos(a), 0.5f*std::sin(1.3f*a), 0.6f*std::sin(a)));
+            }
+
+            typedef std::chrono::steady_clock clock;
+            Geometry<PCNVertex> geo;
+            IsosurfaceExtractor extractor;
+            clock::duration sample_time = clock::duration::zero(), extract_time = clock::duration::zero();
+            const unsigned int frames = 5;
+            for (unsigned int f = 0; f < frames; ++f) {
+                clock::time_point start = clock::now();
+                grid.sampleMetaballs(centers, 0.35f, 0.3f);
+                clock::time_point sampled = clock::now();
+                extractor.extract(grid, 0.0f, glm::vec4(1.0f), geo);
+                extract_time += clock::now() - sampled;
+                sample_time += sampled - start;
+            }
+            ASSERT_FALSE(geo.vertices().empty());
+
+            auto ms = [frames](clock::duration d) {
+                return std::chrono::duration<double, std::milli>(d).count() / frames;
+            };
+            std::cerr << "128^3 metaballs: sample " << ms(sample_time) << " ms, extract " << ms(extract_time)
+                      << " ms, " << geo.vertices().size() << " vertices, " << geo.elements().size() / 3 << " triangles" << std::endl;
+        }
+    }
+}
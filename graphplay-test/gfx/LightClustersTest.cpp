@@ -0,0 +1,169 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../../graphplay/graphplay.h"
+#include "../../graphplay/gfx/LightClusters.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <gtest/gtest.h>
+
+namespace graphplay {
+    namespace gfx {
+        Light pointLight(const glm::vec3 &position, float radius) {
+            Light rv;
+            rv.enabled = true;
+            rv.position = position;
+            rv.color = glm::vec4(1.0f);
+            rv.specular_exp = 4;
+            rv.radius = radius;
+            return rv;
+        }
+
+        // The cluster a point in view space falls in, the way the
+        // shaders find it.
+        unsigned int clusterOf(const LightClusters &clusters, const glm::mat4x4 &projection, const glm::vec3 &point) {
+            glm::vec4 clip = projection * glm::vec4(point, 1.0f);
+            float nx = (clip.x / clip.w + 1.0f) / 2.0f, ny = (clip.y / clip.w + 1.0f) / 2.0f;
+            unsigned int x = std::min((unsigned int)(nx * LightClusters::TILES_ACROSS), LightClusters::TILES_ACROSS - 1);
+            unsigned int y = std::min((unsigned int)(ny * LightClusters::TILES_DOWN), LightClusters::TILES_DOWN - 1);
+            return LightClusters::clusterIndex(x, y, clusters.slice(-point.z));
+        }
+
+        bool clusterHas(const LightClusters &clusters, unsigned int cluster, GLuint light) {
+            const GLuint *lights = clusters.lights(cluster);
+            return std::find(lights, lights + clusters.lightCount(cluster), light) != lights + clusters.lightCount(cluster);
+        }
+
+        TEST(LightClustersTest, SlicesCoverNearToFar) {
+            LightClusters clusters;
+            clusters.setProjection(glm::perspective<float>(static_cast<float>(M_PI / 2), 1.0f, 0.1f, 100.0f));
+            EXPECT_NEAR(0.1f, clusters.nearPlane(), 1.0e-4f);
+            EXPECT_NEAR(100.0f, clusters.farPlane(), 0.1f);
+
+            EXPECT_EQ(0, clusters.slice(0.1f));
+            EXPECT_EQ(0, clusters.slice(0.01f));
+            EXPECT_EQ(LightClusters::SLICES - 1, clusters.slice(99.9f));
+            EXPECT_EQ(LightClusters::SLICES - 1, clusters.slice(1000.0f));
+
+            // Halfway, logarithmically.
+            EXPECT_EQ(LightClusters::SLICES / 2, clusters.slice(3.3f));
+            for (float depth = 0.2f; depth < 100.0f; depth *= 1.1f) {
+                EXPECT_LE(clusters.slice(depth), clusters.slice(depth * 1.1f));
+            }
+        }
+
+        TEST(LightClustersTest, AssignsLightsNearby) {
+            glm::mat4x4 projection = glm::perspective<float>(static_cast<float>(M_PI / 2), 16.0f / 9.0f, 0.1f, 100.0f);
+            LightClusters clusters;
+            clusters.setProjection(projection);
+
+            std::vector<Light> lights = {
+                pointLight(glm::vec3(0.0f, 0.0f, -10.0f), 1.0f),
+                pointLight(glm::vec3(0.0f, 0.0f, -10.0f), 1.0f),
+                pointLight(glm::vec3(0.0f, 0.0f, 10.0f), 1.0f),
+                pointLight(glm::vec3(0.0f, 10.0f, 10.0f), 0.0f),
+            };
+            // Turned off, and behind the camera.
+            lights[1].enabled = false;
+
+            clusters.assign(lights, glm::mat4x4(1.0f));
+
+            unsigned int center = clusterOf(clusters, projection, glm::vec3(0.0f, 0.0f, -10.0f));
+            EXPECT_TRUE(clusterHas(clusters, center, 0));
+
+            // The one without a radius is everywhere, which isn't
+            // in any of the clusters.
+            ASSERT_EQ(1, clusters.lightCount(LightClusters::EVERYWHERE));
+            EXPECT_TRUE(clusterHas(clusters, LightClusters::EVERYWHERE, 3));
+
+            unsigned int slice_near = clusters.slice(9.0f), slice_far = clusters.slice(11.0f);
+            unsigned int with_light = 0;
+            for (unsigned int c = 0; c < LightClusters::CLUSTERS; ++c) {
+                EXPECT_FALSE(clusterHas(clusters, c, 3));
+                EXPECT_FALSE(clusterHas(clusters, c, 1));
+                EXPECT_FALSE(clusterHas(clusters, c, 2));
+
+                if (clusterHas(clusters, c, 0)) {
+                    unsigned int z = c / (LightClusters::TILES_ACROSS * LightClusters::TILES_DOWN);
+                    EXPECT_LE(slice_near, z);
+                    EXPECT_GE(slice_far, z);
+                    ++with_light;
+                }
+            }
+            EXPECT_LT(0, with_light);
+            EXPECT_GT(LightClusters::CLUSTERS / 10, with_light);
+        }
+
+        TEST(LightClustersTest, NoLightIsMissed) {
+            glm::mat4x4 projection = glm::perspective<float>(1.0f, 4.0f / 3.0f, 0.1f, 100.0f);
+            glm::mat4x4 view = glm::lookAt(glm::vec3(0.0f, 5.0f, 20.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            LightClusters clusters;
+            clusters.setProjection(projection);
+
+            std::default_random_engine eng(2468);
+            std::uniform_real_distribution<float> coord(-20.0f, 20.0f), radius(0.5f, 5.0f);
+            std::vector<Light> lights;
+            for (unsigned int i = 0; i < 300; ++i) {
+                lights.push_back(pointLight(glm::vec3(coord(eng), coord(eng) / 4.0f, coord(eng)), radius(eng)));
+            }
+            clusters.assign(lights, view);
+
+            // Every light that reaches a point has to be in the
+            // point's cluster.
+            std::uniform_real_distribution<float> across(-0.95f, 0.95f), depth(0.2f, 60.0f);
+            const float tan_y = std::tan(0.5f), tan_x = tan_y * 4.0f / 3.0f;
+            for (unsigned int p = 0; p < 2000; ++p) {
+                float d = depth(eng);
+                glm::vec3 point(across(eng) * d * tan_x, across(eng) * d * tan_y, -d);
+                unsigned int cluster = clusterOf(clusters, projection, point);
+
+                for (GLuint i = 0; i < lights.size(); ++i) {
+                    glm::vec4 center = view * glm::vec4(lights[i].position, 1.0f);
+                    if (glm::distance(glm::vec3(center.x, center.y, center.z), point) < lights[i].radius) {
+                        EXPECT_TRUE(clusterHas(clusters, cluster, i)) << "light " << i << " at point " << p;
+                    }
+                }
+            }
+
+            // And the clusters don't just have all of them.
+            EXPECT_GT(LightClusters::CLUSTERS * lights.size() / 10, clusters.indexCount());
+        }
+
+        TEST(LightClustersTest, DISABLED_AssignmentTime) {
+            // Not really a test: reports how long it takes to sort a
+            // lot of lights into clusters. Disabled by default.
+            const unsigned int COUNT = 1000;
+            glm::mat4x4 projection = glm::perspective<float>(1.0f, 16.0f / 9.0f, 0.1f, 100.0f);
+            LightClusters clusters;
+            clusters.setProjection(projection);
+
+            std::default_random_engine eng(1357);
+            std::uniform_real_distribution<float> coord(-50.0f, 50.0f), radius(1.0f, 4.0f);
+            std::vector<Light> lights;
+            for (unsigned int i = 0; i < COUNT; ++i) {
+                lights.push_back(pointLight(glm::vec3(coord(eng), coord(eng) / 10.0f, -std::abs(coord(eng))), radius(eng)));
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            clusters.assign(lights, glm::mat4x4(1.0f));
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+            std::size_t most = 0;
+            for (unsigned int c = 0; c < LightClusters::CLUSTERS; ++c) {
+                most = std::max<std::size_t>(most, clusters.lightCount(c));
+            }
+            std::cerr << COUNT << " lights into " << LightClusters::CLUSTERS << " clusters: "
+                      << elapsed.count() / 1000.0 << " ms, " << clusters.indexCount() << " indices, at most "
+                      << most << " in a cluster" << std::endl;
+            EXPECT_GT(COUNT, most);
+        }
+    }
+}
@@ -0,0 +1,118 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../../graphplay/graphplay.h"
+#include "../../graphplay/gfx/MeshAdjacency.h"
+
+#include <gtest/gtest.h>
+
+namespace graphplay {
+    namespace gfx {
+        // The same cube as in NormalsTest: vertex i is at
+        // ((i & 4) ? 1 : -1, (i & 2) ? 1 : -1, (i & 1) ? 1 : -1).
+        const std::vector<GLuint> closed_cube = {
+            4, 6, 7,  4, 7, 5,
+            0, 1, 3,  0, 3, 2,
+            2, 3, 7,  2, 7, 6,
+            0, 4, 5,  0, 5, 1,
+            1, 5, 7,  1, 7, 3,
+            0, 2, 6,  0, 6, 4,
+        };
+
+        std::vector<glm::vec3> cubePositions() {
+            std::vector<glm::vec3> rv;
+            for (unsigned int i = 0; i < 8; ++i) {
+                rv.push_back(glm::vec3((i & 4) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 1) ? 1.0f : -1.0f));
+            }
+            return rv;
+        }
+
+        TEST(MeshAdjacencyTest, ClosedCube) {
+            HalfEdges he = buildHalfEdges(closed_cube);
+
+            ASSERT_EQ(closed_cube.size(), he.twins.size());
+            EXPECT_EQ(0, he.boundary_edges);
+            EXPECT_EQ(0, he.non_manifold_edges);
+            EXPECT_EQ(0, countInconsistentEdges(closed_cube, he));
+
+            for (GLuint c = 0; c < he.twins.size(); ++c) {
+                GLuint t = he.twins[c];
+                ASSERT_NE(NO_TWIN, t);
+                ASSERT_EQ(c, he.twins[t]);
+                ASSERT_NE(HalfEdges::face(c), HalfEdges::face(t));
+                ASSERT_EQ(closed_cube[c], closed_cube[HalfEdges::next(t)]);
+                ASSERT_EQ(closed_cube[HalfEdges::next(c)], closed_cube[t]);
+            }
+        }
+
+        TEST(MeshAdjacencyTest, BoundaryAndNonManifoldEdges) {
+            std::vector<GLuint> quad = { 0, 1, 2, 0, 2, 3 };
+            HalfEdges he = buildHalfEdges(quad);
+            EXPECT_EQ(4, he.boundary_edges);
+            EXPECT_EQ(0, he.non_manifold_edges);
+            EXPECT_EQ(3, he.twins[2]);
+            EXPECT_EQ(NO_TWIN, he.twins[0]);
+
+            // Three faces hanging off of the edge 0-1.
+            std::vector<GLuint> fin = { 0, 1, 2, 1, 0, 3, 0, 1, 4 };
+            he = buildHalfEdges(fin);
+            EXPECT_EQ(1, he.non_manifold_edges);
+            EXPECT_EQ(6, he.boundary_edges);
+            EXPECT_EQ(NO_TWIN, he.twins[0]);
+        }
+
+        TEST(MeshAdjacencyTest, DegenerateFaces) {
+            std::vector<GLuint> elems = { 0, 1, 2, 3, 3, 4 };
+            HalfEdges he = buildHalfEdges(elems);
+            for (GLuint c = 3; c < 6; ++c) {
+                EXPECT_EQ(NO_TWIN, he.twins[c]);
+            }
+            EXPECT_EQ(3, he.boundary_edges);
+        }
+
+        TEST(MeshAdjacencyTest, RepairFlippedFace) {
+            std::vector<GLuint> elems = closed_cube;
+            std::swap(elems[13], elems[14]);
+            EXPECT_EQ(3, countInconsistentEdges(elems, buildHalfEdges(elems)));
+
+            EXPECT_EQ(1, repairWinding(elems));
+            EXPECT_EQ(0, countInconsistentEdges(elems, buildHalfEdges(elems)));
+            EXPECT_EQ(closed_cube, elems);
+        }
+
+        TEST(MeshAdjacencyTest, RepairInsideOut) {
+            std::vector<GLuint> elems = closed_cube;
+            for (std::size_t f = 0; f < elems.size() / 3; ++f) {
+                std::swap(elems[3*f + 1], elems[3*f + 2]);
+            }
+
+            // It's consistent, just backwards.
+            EXPECT_EQ(0, repairWinding(elems));
+            EXPECT_EQ(12, repairWinding(elems, cubePositions()));
+            EXPECT_EQ(closed_cube, elems);
+        }
+
+        TEST(MeshAdjacencyTest, ManyFaces) {
+            // Enough faces to be sorted and matched in several chunks
+            // when there is more than one core.
+            std::vector<GLuint> elems;
+            const GLuint n = 300;
+            for (GLuint y = 0; y < n; ++y) {
+                for (GLuint x = 0; x < n; ++x) {
+                    GLuint v = y*(n + 1) + x;
+                    GLuint tri[6] = { v, v + 1, v + n + 2, v, v + n + 2, v + n + 1 };
+                    elems.insert(elems.end(), tri, tri + 6);
+                }
+            }
+            for (std::size_t f = 0; f < elems.size() / 3; f += 7) {
+                std::swap(elems[3*f + 1], elems[3*f + 2]);
+            }
+
+            HalfEdges he = buildHalfEdges(elems);
+            EXPECT_EQ(4*n, he.boundary_edges);
+            EXPECT_LT(0, countInconsistentEdges(elems, he));
+
+            repairWinding(elems);
+            EXPECT_EQ(0, countInconsistentEdges(elems, buildHalfEdges(elems)));
+        }
+    }
+}
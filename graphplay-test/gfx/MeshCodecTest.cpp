@@ -0,0 +1,276 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../../graphplay/graphplay.h"
+#include "../../graphplay/gfx/MeshCodec.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include <gtest/gtest.h>
+
+namespace graphplay {
+    namespace gfx {
+        // A grid of rows x cols quads, with vertices that change
+        // smoothly from one to the next, like a real mesh's do.
+        void codecGrid(unsigned int rows, unsigned int cols, std::vector<GLuint> &elems, std::vector<PCNVertex> &verts) {
+            for (unsigned int r = 0; r <= rows; ++r) {
+                for (unsigned int c = 0; c <= cols; ++c) {
+                    float x = static_cast<float>(c) / cols, y = static_cast<float>(r) / rows;
+                    PCNVertex v = {
+                        { x, y, 0.1f*std::sin(6.0f*x)*std::cos(4.0f*y) },
+                        { x, y, 0.5f, 1.0f },
+                        { 0.0f, 0.0f, 1.0f }
+                    };
+                    verts.push_back(v);
+                }
+            }
+
+            for (unsigned int r = 0; r < rows; ++r) {
+                for (unsigned int c = 0; c < cols; ++c) {
+                    GLuint v = r*(cols + 1) + c;
+                    GLuint quad[6] = { v, v + 1, v + cols + 2, v, v + cols + 2, v + cols + 1 };
+                    elems.insert(elems.end(), quad, quad + 6);
+                }
+            }
+        }
+
+        std::vector<GLuint> decodedIndices(const ByteArray &data, std::size_t count) {
+            std::vector<GLuint> rv(count);
+            EXPECT_TRUE(decodeIndices(data.data(), data.size(), rv.data(), count));
+            return rv;
+        }
+
+        TEST(MeshCodecTest, IndexRoundTrip) {
+            std::default_random_engine eng(31337);
+            std::uniform_int_distribution<GLuint> any, small(0, 300);
+
+            // Big jumps both ways, restart indices, and a count that
+            // isn't a multiple of four.
+            std::vector<GLuint> elems = { 0, 1, 2, 0xFFFFFFFF, 3, 2, 1, 0, 70000, 5, 16777216, 0xFFFFFFFE, 0 };
+            for (unsigned int i = 0; i < 1001; ++i) {
+                elems.push_back(i % 3 == 0 ? any(eng) : small(eng));
+            }
+
+            ByteArray data;
+            encodeIndices(elems.data(), elems.size(), data);
+            EXPECT_EQ(elems, decodedIndices(data, elems.size()));
+
+            // Nothing at all.
+            data.clear();
+            encodeIndices(nullptr, 0, data);
+            EXPECT_TRUE(data.empty());
+            EXPECT_TRUE(decodeIndices(data.data(), 0, nullptr, 0));
+        }
+
+        TEST(MeshCodecTest, IndexCompression) {
+            std::vector<GLuint> elems;
+            std::vector<PCNVertex> verts;
+            codecGrid(100, 100, elems, verts);
+
+            // Neighboring triangles use nearby vertices, so most
+            // indices fit in a byte, plus the control bits.
+            ByteArray data;
+            encodeIndices(elems.data(), elems.size(), data);
+            EXPECT_GT(elems.size()*5/4 + elems.size()/8, data.size());
+            EXPECT_EQ(elems, decodedIndices(data, elems.size()));
+        }
+
+        TEST(MeshCodecTest, IndexMalformed) {
+            std::vector<GLuint> elems = { 0, 100000, 2, 3, 4, 5, 6, 7, 8 };
+            ByteArray data;
+            encodeIndices(elems.data(), elems.size(), data);
+
+            std::vector<GLuint> out(elems.size());
+            for (std::size_t size = 0; size < data.size(); ++size) {
+                EXPECT_FALSE(decodeIndices(data.data(), size, out.data(), out.size())) << size;
+            }
+
+            // Left over bytes are an error, too.
+            data.push_back(0);
+            EXPECT_FALSE(decodeIndices(data.data(), data.size(), out.data(), out.size()));
+        }
+
+        TEST(MeshCodecTest, VertexRoundTrip) {
+            std::vector<GLuint> elems;
+            std::vector<PCNVertex> verts;
+            codecGrid(40, 40, elems, verts);
+
+            ByteArray data;
+            encodeVertices(verts.data(), verts.size(), sizeof(PCNVertex), data);
+            EXPECT_GT(verts.size()*sizeof(PCNVertex), data.size());
+
+            std::vector<PCNVertex> out(verts.size());
+            ASSERT_TRUE(decodeVertices(data.data(), data.size(), out.data(), out.size(), sizeof(PCNVertex)));
+            EXPECT_EQ(0, std::memcmp(verts.data(), out.data(), verts.size()*sizeof(PCNVertex)));
+        }
+
+        TEST(MeshCodecTest, VertexOddSizes) {
+            std::default_random_engine eng(4242);
+            std::uniform_int_distribution<int> byte(0, 255), step(-3, 3);
+
+            // Strides that aren't a multiple of four, and counts that
+            // don't fill the last group or block.
+            for (std::size_t stride : { 1, 3, 7, 12, 21 }) {
+                for (std::size_t count : { 0, 1, 15, 17, 256, 300, 777 }) {
+                    std::vector<std::uint8_t> verts(count*stride);
+                    for (std::size_t i = 0; i < verts.size(); ++i) {
+                        // Some bytes noisy, some slowly changing.
+                        verts[i] = static_cast<std::uint8_t>(i % 2 == 0 ? byte(eng) : (i >= stride ? verts[i - stride] + step(eng) : 0));
+                    }
+
+                    ByteArray data;
+                    encodeVertices(verts.data(), count, stride, data);
+                    std::vector<std::uint8_t> out(verts.size());
+                    ASSERT_TRUE(decodeVertices(data.data(), data.size(), out.data(), count, stride)) << stride << " " << count;
+                    ASSERT_EQ(verts, out) << stride << " " << count;
+                }
+            }
+        }
+
+        TEST(MeshCodecTest, VertexMalformed) {
+            std::vector<GLuint> elems;
+            std::vector<PCNVertex> verts;
+            codecGrid(10, 10, elems, verts);
+            ByteArray data;
+            encodeVertices(verts.data(), verts.size(), sizeof(PCNVertex), data);
+
+            std::vector<PCNVertex> out(verts.size());
+            for (std::size_t size = 0; size < data.size(); size += 7) {
+                EXPECT_FALSE(decodeVertices(data.data(), size, out.data(), out.size(), sizeof(PCNVertex))) << size;
+            }
+        }
+
+        TEST(MeshCodecTest, LzRoundTrip) {
+            std::default_random_engine eng(99);
+            std::uniform_int_distribution<int> byte(0, 255);
+
+            std::vector<ByteArray> inputs(4);
+            // Repetitive, with long runs and overlapping matches.
+            const char *text = "the quick brown fox jumps over the lazy dog. ";
+            for (unsigned int i = 0; i < 200; ++i) {
+                inputs[0].insert(inputs[0].end(), text, text + std::strlen(text) - i % 7);
+            }
+            inputs[1].assign(100000, 'a');
+            // Incompressible.
+            for (unsigned int i = 0; i < 5000; ++i) {
+                inputs[2].push_back(static_cast<std::uint8_t>(byte(eng)));
+            }
+            // Empty.
+
+            for (std::size_t i = 0; i < inputs.size(); ++i) {
+                ByteArray data;
+                lzCompress(inputs[i].data(), inputs[i].size(), data);
+                if (i < 2) {
+                    EXPECT_GT(inputs[i].size()/4, data.size());
+                }
+
+                ByteArray out(inputs[i].size());
+                ASSERT_TRUE(lzDecompress(data.data(), data.size(), out.data(), out.size())) << i;
+                ASSERT_EQ(inputs[i], out) << i;
+
+                // The wrong size, or truncated.
+                out.push_back(0);
+                EXPECT_FALSE(lzDecompress(data.data(), data.size(), out.data(), out.size())) << i;
+                if (!data.empty() && !inputs[i].empty()) {
+                    EXPECT_FALSE(lzDecompress(data.data(), data.size() - 1, out.data(), inputs[i].size())) << i;
+                }
+            }
+        }
+
+        TEST(MeshCodecTest, GeometryData) {
+            std::vector<GLuint> elems;
+            std::vector<PCNVertex> verts;
+            codecGrid(30, 50, elems, verts);
+
+            EncodedGeometryHeader header;
+            header.draw_type = GL_TRIANGLES;
+            header.primitive_restart = true;
+            header.compressed = true;
+            header.vertex_stride = sizeof(PCNVertex);
+            header.vertex_count = static_cast<std::uint32_t>(verts.size());
+            header.elem_count = static_cast<std::uint32_t>(elems.size());
+            ByteArray data = encodeGeometryData(header, elems.data(), verts.data());
+
+            EncodedGeometryHeader read;
+            ASSERT_TRUE(readEncodedGeometryHeader(data, read));
+            EXPECT_EQ(header.draw_type, read.draw_type);
+            EXPECT_EQ(header.primitive_restart, read.primitive_restart);
+            EXPECT_EQ(header.compressed, read.compressed);
+            EXPECT_EQ(header.vertex_stride, read.vertex_stride);
+            EXPECT_EQ(header.vertex_count, read.vertex_count);
+            EXPECT_EQ(header.elem_count, read.elem_count);
+
+            std::vector<GLuint> out_elems(elems.size());
+            std::vector<PCNVertex> out_verts(verts.size());
+            ASSERT_TRUE(decodeGeometryData(data, read, out_elems.data(), out_verts.data()));
+            EXPECT_EQ(elems, out_elems);
+            EXPECT_EQ(0, std::memcmp(verts.data(), out_verts.data(), verts.size()*sizeof(PCNVertex)));
+
+            // Corrupt payloads and headers.
+            ByteArray bad(data.begin(), data.end() - 10);
+            EXPECT_FALSE(decodeGeometryData(bad, read, out_elems.data(), out_verts.data()));
+            bad = data;
+            bad[0] = 'X';
+            EXPECT_FALSE(readEncodedGeometryHeader(bad, read));
+            bad.resize(20);
+            EXPECT_FALSE(readEncodedGeometryHeader(bad, read));
+        }
+
+        // Not really a test: reports how fast the codec is on a
+        // million-vertex mesh. Run it with
+        // --gtest_also_run_disabled_tests.
+        TEST(MeshCodecTest, DISABLED_Throughput) {
+            std::vector<GLuint> elems;
+            std::vector<PCNVertex> verts;
+            codecGrid(999, 999, elems, verts);
+            const std::size_t raw_index_bytes = elems.size()*sizeof(GLuint), raw_vertex_bytes = verts.size()*sizeof(PCNVertex);
+
+            typedef std::chrono::steady_clock clock;
+            auto rate = [](std::size_t bytes, clock::duration d) {
+                return bytes / 1e6 / std::chrono::duration<double>(d).count();
+            };
+
+            ByteArray index_data, vertex_data;
+            clock::time_point start = clock::now();
+            encodeIndices(elems.data(), elems.size(), index_data);
+            encodeVertices(verts.data(), verts.size(), sizeof(PCNVertex), vertex_data);
+            clock::duration encode_time = clock::now() - start;
+
+            const unsigned int runs = 5;
+            std::vector<GLuint> out_elems(elems.size());
+            std::vector<PCNVertex> out_verts(verts.size());
+            clock::duration index_time = clock::duration::zero(), vertex_time = clock::duration::zero();
+            for (unsigned int i = 0; i < runs; ++i) {
+                start = clock::now();
+                ASSERT_TRUE(decodeIndices(index_data.data(), index_data.size(), out_elems.data(), out_elems.size()));
+                index_time += clock::now() - start;
+                start = clock::now();
+                ASSERT_TRUE(decodeVertices(vertex_data.data(), vertex_data.size(), out_verts.data(), out_verts.size(), sizeof(PCNVertex)));
+                vertex_time += clock::now() - start;
+            }
+            ASSERT_EQ(elems, out_elems);
+            ASSERT_EQ(0, std::memcmp(verts.data(), out_verts.data(), raw_vertex_bytes));
+
+            ByteArray packed;
+            start = clock::now();
+            lzCompress(vertex_data.data(), vertex_data.size(), packed);
+            clock::duration lz_time = clock::now() - start;
+            ByteArray unpacked(vertex_data.size());
+            start = clock::now();
+            ASSERT_TRUE(lzDecompress(packed.data(), packed.size(), unpacked.data(), unpacked.size()));
+            clock::duration unlz_time = clock::now() - start;
+
+            std::cerr << "indices: " << raw_index_bytes << " -> " << index_data.size() << " bytes, decode "
+                      << rate(runs*raw_index_bytes, index_time) << " MB/s" << std::endl
+                      << "vertices: " << raw_vertex_bytes << " -> " << vertex_data.size() << " bytes, decode "
+                      << rate(runs*raw_vertex_bytes, vertex_time) << " MB/s" << std::endl
+                      << "encode: " << rate(raw_index_bytes + raw_vertex_bytes, encode_time) << " MB/s" << std::endl
+                      << "lz: " << vertex_data.size() << " -> " << packed.size() << " bytes, compress "
+                      << rate(vertex_data.size(), lz_time) << " MB/s, decompress "
+                      << rate(vertex_data.size(), unlz_time) << " MB/s" << std::endl;
+        }
+    }
+}
@@ -0,0 +1,115 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../../graphplay/graphplay.h"
+#include "../../graphplay/gfx/Geometry.h"
+#include "../../graphplay/gfx/MeshKernels.h"
+#include "../../graphplay/fzx/BBox.h"
+
+#include <cmath>
+#include <random>
+
+#include <glm/glm.hpp>
+
+#include <gtest/gtest.h>
+
+namespace graphplay {
+    namespace gfx {
+        // An odd number of vertices, so the SIMD loops have a tail.
+        std::vector<PCNVertex> randomVertices(std::size_t count) {
+            std::default_random_engine eng(1234);
+            std::uniform_real_distribution<float> coord(-50.0f, 50.0f);
+            std::uniform_real_distribution<float> channel(0.1f, 1.0f);
+            std::vector<PCNVertex> rv(count);
+            for (auto &&v : rv) {
+                for (unsigned int j = 0; j < 3; ++j) {
+                    v.position[j] = coord(eng);
+                    v.normal[j] = coord(eng);
+                }
+                for (unsigned int j = 0; j < 4; ++j) {
+                    v.color[j] = channel(eng);
+                }
+            }
+            return rv;
+        }
+
+        TEST(MeshKernelsTest, MinMax) {
+            std::vector<PCNVertex> verts = randomVertices(100001);
+            glm::vec3 min, max;
+            positionBounds(verts, min, max);
+
+            for (unsigned int j = 0; j < 3; ++j) {
+                float lo = verts[0].position[j], hi = lo;
+                for (auto &&v : verts) {
+                    lo = std::min(lo, v.position[j]);
+                    hi = std::max(hi, v.position[j]);
+                }
+                EXPECT_EQ(lo, min[j]);
+                EXPECT_EQ(hi, max[j]);
+            }
+
+            fzx::BBox bbox = fzx::BBox::fromVertices(verts.cbegin(), verts.cend());
+            EXPECT_EQ(min, bbox.min);
+            EXPECT_EQ(max, bbox.max);
+        }
+
+        TEST(MeshKernelsTest, MinMaxPackedAndEmpty) {
+            std::vector<float> packed = { 1, 2, 3,  -4, 5, 6,  7, -8, 9 };
+            glm::vec3 min(100.0f), max(-100.0f);
+
+            minMax3(packed.data(), 0, 3*sizeof(float), min, max);
+            EXPECT_EQ(glm::vec3(100.0f), min);
+
+            minMax3(packed.data(), 3, 3*sizeof(float), min, max);
+            EXPECT_EQ(glm::vec3(-4, -8, 3), min);
+            EXPECT_EQ(glm::vec3(7, 5, 9), max);
+        }
+
+        TEST(MeshKernelsTest, TransformPositions) {
+            std::vector<PCNVertex> verts = randomVertices(10001), orig = verts;
+            glm::mat4x4 transform(
+                glm::vec4(0.5f, 0.1f, 0.0f, 0.0f),
+                glm::vec4(-0.2f, 2.0f, 0.3f, 0.0f),
+                glm::vec4(0.0f, 0.4f, 1.5f, 0.0f),
+                glm::vec4(3.0f, -1.0f, 2.0f, 1.0f));
+
+            transformPositions(verts, transform);
+
+            for (std::size_t i = 0; i < verts.size(); ++i) {
+                glm::vec4 p = transform * glm::vec4(orig[i].position[0], orig[i].position[1], orig[i].position[2], 1.0f);
+                for (unsigned int j = 0; j < 3; ++j) {
+                    ASSERT_NEAR(p[j], verts[i].position[j], 1e-4f);
+                    ASSERT_EQ(orig[i].normal[j], verts[i].normal[j]);
+                }
+                ASSERT_EQ(orig[i].color[0], verts[i].color[0]);
+            }
+        }
+
+        TEST(MeshKernelsTest, ScaleColors) {
+            std::vector<PCNVertex> verts = randomVertices(1001), orig = verts;
+            glm::vec4 scale(0.5f, 2.0f, 1.0f, 0.25f);
+
+            scaleColors(verts, scale);
+
+            for (std::size_t i = 0; i < verts.size(); ++i) {
+                for (unsigned int j = 0; j < 4; ++j) {
+                    ASSERT_FLOAT_EQ(orig[i].color[j] * scale[j], verts[i].color[j]);
+                }
+                ASSERT_EQ(orig[i].normal[0], verts[i].normal[0]);
+            }
+        }
+
+        TEST(MeshKernelsTest, TintColorsByPosition) {
+            std::vector<PCNVertex> verts = randomVertices(1001), orig = verts;
+
+            tintColorsByPosition(verts);
+
+            for (std::size_t i = 0; i < verts.size(); ++i) {
+                for (unsigned int j = 0; j < 3; ++j) {
+                    float expected = (orig[i].color[j] / orig[i].color[3]) * std::abs(orig[i].position[j]);
+                    ASSERT_FLOAT_EQ(expected, verts[i].color[j]);
+                }
+                ASSERT_EQ(1.0f, verts[i].color[3]);
+            }
+        }
+    }
+}
@@ -0,0 +1,107 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../../graphplay/graphplay.h"
+#include "../../graphplay/gfx/Normals.h"
+
+#include <cmath>
+
+#include <gtest/gtest.h>
+
+namespace graphplay {
+    namespace gfx {
+        // A cube with corners at +/-1. Vertex i is at
+        // ((i & 4) ? 1 : -1, (i & 2) ? 1 : -1, (i & 1) ? 1 : -1).
+        Geometry<PCNVertex>::vertex_array_type cubeVertices() {
+            Geometry<PCNVertex>::vertex_array_type rv;
+            for (unsigned int i = 0; i < 8; ++i) {
+                rv.push_back(PCNVertex {
+                        { (i & 4) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 1) ? 1.0f : -1.0f },
+                        { 1.0f, 1.0f, 1.0f, 1.0f },
+                        { 0.0f, 0.0f, 0.0f },
+                    });
+            }
+            return rv;
+        }
+
+        const Geometry<PCNVertex>::elem_array_type cube_elems = {
+            4, 6, 7,  4, 7, 5, // +x
+            0, 1, 3,  0, 3, 2, // -x
+            2, 3, 7,  2, 7, 6, // +y
+            0, 4, 5,  0, 5, 1, // -y
+            1, 5, 7,  1, 7, 3, // +z
+            0, 2, 6,  0, 6, 4, // -z
+        };
+
+        TEST(NormalsTest, FlatQuad) {
+            Geometry<PCNVertex>::vertex_array_type verts = {
+                { { 0, 0, 0 }, { 1, 1, 1, 1 }, { 0, 0, 0 } },
+                { { 1, 0, 0 }, { 1, 1, 1, 1 }, { 0, 0, 0 } },
+                { { 1, 1, 0 }, { 1, 1, 1, 1 }, { 0, 0, 0 } },
+                { { 0, 1, 0 }, { 1, 1, 1, 1 }, { 0, 0, 0 } },
+            };
+            Geometry<PCNVertex>::elem_array_type elems = { 0, 1, 2, 0, 2, 3 };
+
+            generateNormals(elems, verts);
+
+            ASSERT_EQ(4, verts.size());
+            for (auto &&v : verts) {
+                EXPECT_FLOAT_EQ(0.0f, v.normal[0]);
+                EXPECT_FLOAT_EQ(0.0f, v.normal[1]);
+                EXPECT_FLOAT_EQ(1.0f, v.normal[2]);
+            }
+        }
+
+        TEST(NormalsTest, SmoothCube) {
+            Geometry<PCNVertex>::vertex_array_type verts = cubeVertices();
+            Geometry<PCNVertex>::elem_array_type elems = cube_elems;
+
+            generateNormals(elems, verts);
+
+            // The angle weighting makes every corner point straight
+            // out along the diagonal, no matter how the faces were
+            // split into triangles.
+            ASSERT_EQ(8, verts.size());
+            ASSERT_EQ(cube_elems, elems);
+            const float d = 1.0f / std::sqrt(3.0f);
+            for (auto &&v : verts) {
+                for (unsigned int j = 0; j < 3; ++j) {
+                    EXPECT_NEAR(v.position[j]*d, v.normal[j], 1e-6);
+                }
+            }
+        }
+
+        TEST(NormalsTest, CreasedCube) {
+            Geometry<PCNVertex>::vertex_array_type verts = cubeVertices();
+            Geometry<PCNVertex>::elem_array_type elems = cube_elems;
+
+            generateNormals(elems, verts, static_cast<float>(M_PI / 4));
+
+            // Each corner is split into one vertex per side.
+            ASSERT_EQ(24, verts.size());
+            ASSERT_EQ(36, elems.size());
+            for (unsigned int f = 0; f < elems.size() / 3; ++f) {
+                const unsigned int axis = f / 4;
+                const float sign = (f / 2) % 2 == 0 ? 1.0f : -1.0f;
+                for (unsigned int k = 0; k < 3; ++k) {
+                    const PCNVertex &v = verts[elems[3*f + k]];
+                    for (unsigned int j = 0; j < 3; ++j) {
+                        EXPECT_NEAR(j == axis ? sign : 0.0f, v.normal[j], 1e-6);
+                    }
+                    EXPECT_FLOAT_EQ(verts[elems[3*f + k]].position[axis], sign);
+                }
+            }
+        }
+
+        TEST(NormalsTest, UnreferencedVerticesKeepNormals) {
+            Geometry<PCNVertex>::vertex_array_type verts = cubeVertices();
+            verts.push_back(PCNVertex { { 5, 5, 5 }, { 1, 1, 1, 1 }, { 0, 1, 0 } });
+            Geometry<PCNVertex>::elem_array_type elems = cube_elems;
+
+            generateNormals(elems, verts);
+            EXPECT_FLOAT_EQ(1.0f, verts[8].normal[1]);
+
+            generateNormals(elems, verts, 0.1f);
+            EXPECT_FLOAT_EQ(1.0f, verts.back().normal[1]);
+        }
+    }
+}
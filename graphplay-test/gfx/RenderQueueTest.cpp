@@ -0,0 +1,206 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../../graphplay/graphplay.h"
+#include "../../graphplay/gfx/GeometryRegistry.h"
+#include "../../graphplay/gfx/RenderQueue.h"
+
+#include <chrono>
+#include <iostream>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <gtest/gtest.h>
+
+#include "TestOpenGLContext.h"
+
+namespace graphplay {
+    namespace gfx {
+        class RenderQueueTest : public TestOpenGLContext {};
+
+        TEST_F(RenderQueueTest, SortKeys) {
+            // Program first, then vertex array, then depth.
+            EXPECT_LT(RenderQueue::sortKey(1, 9, 100.0f), RenderQueue::sortKey(2, 1, 0.5f));
+            EXPECT_LT(RenderQueue::sortKey(1, 1, 100.0f), RenderQueue::sortKey(1, 2, 0.5f));
+            EXPECT_LT(RenderQueue::sortKey(1, 1, 0.5f), RenderQueue::sortKey(1, 1, 2.0f));
+            EXPECT_LT(RenderQueue::sortKey(1, 1, 2.0f), RenderQueue::sortKey(1, 1, 1000.0f));
+
+            // Things behind the eye sort as if they were right at it.
+            EXPECT_EQ(RenderQueue::sortKey(1, 1, 0.0f), RenderQueue::sortKey(1, 1, -5.0f));
+
+            // Batches still group by program and vertex array first.
+            EXPECT_LT(RenderQueue::batchKey(1, 9, 0x10000), RenderQueue::batchKey(2, 1, 0x100));
+            EXPECT_NE(RenderQueue::batchKey(1, 1, 0x100), RenderQueue::batchKey(1, 1, 0x200));
+        }
+
+        TEST_F(RenderQueueTest, SortsAndSkipsRedundantBinds) {
+            GeometryRegistry registry;
+            Program::sptr_type unlit = createUnlitProgram(), lit = createLitProgram();
+
+            // Everything is in the same arena, so it all shares one
+            // vertex array.
+            std::vector<Mesh::sptr_type> meshes = {
+                std::make_shared<Mesh>(registry.primitive("octohedron"), unlit),
+                std::make_shared<Mesh>(registry.primitive("sphere"), lit),
+                std::make_shared<Mesh>(registry.primitive("icosahedron"), unlit),
+                std::make_shared<Mesh>(registry.primitive("sphere"), lit),
+            };
+
+            RenderQueue queue;
+            float depths[] = { 5.0f, 3.0f, 1.0f, 2.0f };
+            for (unsigned int i = 0; i < meshes.size(); ++i) {
+                queue.add(meshes[i], depths[i]);
+            }
+            queue.sort();
+            ASSERT_EQ(4, queue.size());
+
+            // Grouped by program, nearest first within each.
+            EXPECT_EQ(queue.mesh(0).programId(), queue.mesh(1).programId());
+            EXPECT_EQ(queue.mesh(2).programId(), queue.mesh(3).programId());
+            EXPECT_NE(queue.mesh(1).programId(), queue.mesh(2).programId());
+            bool unlit_first = unlit->getProgramId() < lit->getProgramId();
+            EXPECT_EQ(unlit_first ? meshes[2].get() : meshes[3].get(), &queue.mesh(0));
+            EXPECT_EQ(unlit_first ? meshes[0].get() : meshes[1].get(), &queue.mesh(1));
+
+            glm::mat4x4 view_projection = glm::perspective(1.0f, 1.0f, 0.1f, 100.0f);
+            queue.render(view_projection, glm::vec3(0.0f));
+            EXPECT_EQ(2, queue.programBinds());
+            EXPECT_EQ(1, queue.vertexArrayBinds());
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+
+            // It lets go of the meshes once they're drawn.
+            EXPECT_EQ(0, queue.size());
+            for (auto &&mesh : meshes) {
+                EXPECT_EQ(1, mesh.use_count());
+            }
+        }
+
+        TEST_F(RenderQueueTest, DrawsInstancesTogether) {
+            GeometryRegistry registry;
+            Program::sptr_type instanced = createLitInstancedProgram(), lit = createLitProgram();
+            ASSERT_TRUE(instanced->isInstanced());
+            ASSERT_FALSE(lit->isInstanced());
+
+            RenderQueue queue;
+            std::vector<Mesh::sptr_type> meshes;
+            for (unsigned int i = 0; i < 30; ++i) {
+                // Spheres and icosahedra, interleaved, plus a few
+                // that aren't instanced.
+                const char *type = i % 2 == 0 ? "sphere" : "icosahedron";
+                Program::sptr_type program = i % 10 == 9 ? lit : instanced;
+                Mesh::sptr_type mesh = std::make_shared<Mesh>(registry.primitive(type), program);
+                mesh->modelTransformation(glm::translate(glm::mat4x4(1.0f), glm::vec3((float)i, 0.0f, -10.0f)));
+                meshes.push_back(mesh);
+                queue.add(mesh, 10.0f);
+            }
+            queue.sort();
+
+            glm::mat4x4 view_projection = glm::perspective(1.0f, 1.0f, 0.1f, 100.0f);
+            queue.render(view_projection, glm::vec3(0.0f));
+
+            // One draw for each geometry's instances, plus one each
+            // for the three that aren't instanced.
+            EXPECT_EQ(5, queue.drawCalls());
+            EXPECT_EQ(2, queue.programBinds());
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+        }
+
+        TEST_F(RenderQueueTest, DrawsBatchesTogether) {
+            GeometryRegistry registry;
+            Program::sptr_type batched = createLitBatchedProgram(), lit = createLitProgram();
+            ASSERT_TRUE(batched->isBatched());
+            ASSERT_FALSE(lit->isBatched());
+
+            RenderQueue queue;
+            std::vector<Mesh::sptr_type> meshes;
+            for (unsigned int i = 0; i < 30; ++i) {
+                // Different geometries can share a batch, as long as
+                // they're in the same arena.
+                const char *type = i % 3 == 0 ? "sphere" : (i % 3 == 1 ? "icosahedron" : "octohedron");
+                Program::sptr_type program = i % 10 == 9 ? lit : batched;
+                Mesh::sptr_type mesh = std::make_shared<Mesh>(registry.primitive(type), program);
+                mesh->modelTransformation(glm::translate(glm::mat4x4(1.0f), glm::vec3((float)i - 15.0f, 0.0f, -20.0f)));
+                meshes.push_back(mesh);
+                queue.add(mesh, 10.0f);
+            }
+            queue.sort();
+
+            glm::mat4x4 view_projection = glm::perspective(1.0f, 1.0f, 0.1f, 100.0f);
+            queue.render(view_projection, glm::vec3(0.0f));
+
+            // One batch for the 27 batched meshes. That's one draw
+            // with indirect draws, or one per mesh without, plus one
+            // each for the three that aren't batched.
+            EXPECT_EQ(1, queue.batches());
+            EXPECT_EQ(RenderQueue::indirectBatches() ? 4 : 30, queue.drawCalls());
+            EXPECT_EQ(2, queue.programBinds());
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+
+            // And again, to write the next frame's draw data.
+            queue.render(view_projection, glm::vec3(0.0f));
+            EXPECT_EQ(1, queue.batches());
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+        }
+
+        TEST_F(RenderQueueTest, SkipsBatchedProgramsOutsideArenas) {
+            GeometryRegistry registry;
+            Program::sptr_type batched = createLitBatchedProgram();
+
+            // The same program is fine with geometry from an arena,
+            // but there'd be no draw data for one that isn't.
+            Mesh::sptr_type in_arena = std::make_shared<Mesh>(registry.primitive("octohedron"), batched);
+            Mesh::sptr_type outside = std::make_shared<Mesh>(makeOctohedronGeometry(), batched);
+            EXPECT_TRUE(in_arena->drawable());
+            EXPECT_FALSE(outside->drawable());
+            EXPECT_FALSE(outside->batched());
+
+            RenderQueue queue;
+            queue.add(in_arena, 1.0f);
+            queue.add(outside, 2.0f);
+            queue.sort();
+            ASSERT_EQ(1, queue.size());
+            EXPECT_EQ(in_arena.get(), &queue.mesh(0));
+
+            glm::mat4x4 view_projection = glm::perspective(1.0f, 1.0f, 0.1f, 100.0f);
+            queue.render(view_projection, glm::vec3(0.0f));
+            EXPECT_EQ(1, queue.drawCalls());
+
+            // Drawing it on its own doesn't do anything either.
+            outside->render();
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+        }
+
+        TEST_F(RenderQueueTest, DISABLED_InstancingThroughput) {
+            // Not really a test: reports how long it takes to queue,
+            // sort and draw a lot of instanced spheres. Disabled
+            // unless asked for.
+            const unsigned int COUNT = 100000;
+            GeometryRegistry registry;
+            Program::sptr_type program = createLitInstancedProgram();
+            AbstractGeometry::sptr_type sphere = registry.primitive("sphere");
+
+            std::vector<Mesh::sptr_type> meshes;
+            meshes.reserve(COUNT);
+            for (unsigned int i = 0; i < COUNT; ++i) {
+                Mesh::sptr_type mesh = std::make_shared<Mesh>(sphere, program);
+                mesh->modelTransformation(glm::translate(glm::mat4x4(1.0f), glm::vec3((float)(i % 100), (float)(i / 100 % 100), -(float)(i / 10000))));
+                meshes.push_back(mesh);
+            }
+
+            RenderQueue queue;
+            glm::mat4x4 view_projection = glm::perspective(1.0f, 1.0f, 0.1f, 100.0f);
+            auto start = std::chrono::steady_clock::now();
+            for (auto &&mesh : meshes) {
+                queue.add(mesh, 0.0f);
+            }
+            queue.sort();
+            queue.render(view_projection, glm::vec3(0.0f));
+            glFinish();
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+            std::cerr << COUNT << " instances in " << queue.drawCalls() << " draw calls: "
+                      << elapsed.count() / 1000.0 << " ms" << std::endl;
+            EXPECT_EQ(1, queue.drawCalls());
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+        }
+    }
+}
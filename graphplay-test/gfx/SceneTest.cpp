@@ -5,10 +5,130 @@
 
 #include <memory>
 
+#include <glm/gtc/matrix_transform.hpp>
+
 #include <gtest/gtest.h>
 
+#include "TestOpenGLContext.h"
+
 namespace graphplay {
     namespace gfx {
+        class SceneTest : public TestOpenGLContext {};
+
+        TEST_F(SceneTest, CullsMeshesOutsideFrustum) {
+            Scene scene(640, 480);
+            scene.getCamera().reset();
+            scene.createBuffers();
+
+            Program::sptr_type program = createUnlitProgram();
+            AbstractGeometry::sptr_type octo = makeOctohedronGeometry();
+            Mesh::sptr_type center = std::make_shared<Mesh>(octo, program);
+            Mesh::sptr_type aside = std::make_shared<Mesh>(octo, program);
+            Mesh::sptr_type behind = std::make_shared<Mesh>(octo, program);
+            // The camera is at (1, 0, 0), looking at the origin.
+            center->modelTransformation(glm::scale(glm::mat4x4(1.0f), glm::vec3(0.1f)));
+            aside->modelTransformation(glm::translate(glm::mat4x4(1.0f), glm::vec3(0.0f, 0.0f, 50.0f)));
+            behind->modelTransformation(glm::translate(glm::mat4x4(1.0f), glm::vec3(10.0f, 0.0f, 0.0f)));
+            scene.addMesh(center);
+            scene.addMesh(aside);
+            scene.addMesh(behind);
+
+            scene.render();
+            EXPECT_EQ(1, scene.getDrawnCount());
+            EXPECT_EQ(2, scene.getCulledCount());
+
+            // Moving a mesh into view gets it drawn.
+            aside->modelTransformation(glm::translate(glm::mat4x4(1.0f), glm::vec3(-5.0f, 0.0f, 0.0f)));
+            scene.render();
+            EXPECT_EQ(2, scene.getDrawnCount());
+            EXPECT_EQ(1, scene.getCulledCount());
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+        }
+
+        TEST_F(SceneTest, UploadsOnlyWhatChanged) {
+            Scene scene(640, 480);
+            scene.getCamera().reset();
+            scene.createBuffers();
+
+            // The buffers start out with everything but the camera's
+            // view, which updateBuffers picks up, and the clusters,
+            // which depend on it.
+            scene.updateBuffers();
+            const std::size_t grid_bytes = 2*(LightClusters::CLUSTERS + 1)*sizeof(GLuint);
+            EXPECT_EQ(2*sizeof(glm::mat4x4) + grid_bytes + scene.getLightClusters().indexCount()*sizeof(GLuint),
+                      scene.getUploadedBytes());
+            scene.updateBuffers();
+            EXPECT_EQ(0, scene.getUploadedBytes());
+
+            Light light = scene.getLight(0);
+            light.position = glm::vec3(10.0f, 10.0f, 0.0f);
+            light.color = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+            scene.setLight(0, light);
+            scene.setViewport(800, 600);
+            scene.updateBuffers();
+            EXPECT_EQ(sizeof(glm::mat4x4) + sizeof(glm::vec2) + sizeof(LightClusterBlock) + sizeof(LightProperties)
+                      + grid_bytes + scene.getLightClusters().indexCount()*sizeof(GLuint),
+                      scene.getUploadedBytes());
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+        }
+
+        TEST_F(SceneTest, AddsLights) {
+            Scene scene(640, 480);
+            scene.getCamera().reset();
+            scene.createBuffers();
+            ASSERT_EQ(1, scene.getLightCount());
+
+            // Setting one past the end adds the ones in between,
+            // turned off.
+            Light light = scene.getLight(0);
+            light.radius = 2.0f;
+            scene.setLight(200, light);
+            EXPECT_EQ(201, scene.getLightCount());
+            EXPECT_FALSE(scene.getLight(100).enabled);
+            EXPECT_TRUE(scene.getLight(200).enabled);
+
+            // They all go up together, since the buffer had to grow.
+            scene.updateBuffers();
+            EXPECT_LE(201*sizeof(LightProperties), scene.getUploadedBytes());
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+        }
+
+        TEST_F(SceneTest, DeferredPath) {
+            Scene scene(640, 480, Scene::DEFERRED);
+            scene.getCamera().reset();
+            ASSERT_EQ(Scene::DEFERRED, scene.getRenderPath());
+            ASSERT_EQ(nullptr, scene.getGBuffer());
+
+            scene.createBuffers();
+            const GBuffer *gbuffer = scene.getGBuffer();
+            ASSERT_NE(nullptr, gbuffer);
+            EXPECT_TRUE(gbuffer->complete());
+
+            Light light = scene.getLight(0);
+            light.radius = 2.0f;
+            scene.setLight(1, light);
+
+            Mesh::sptr_type lit = std::make_shared<Mesh>(makeOctohedronGeometry(), createLitProgram());
+            Mesh::sptr_type unlit = std::make_shared<Mesh>(makeOctohedronGeometry(), createUnlitProgram());
+            scene.addMesh(lit);
+            scene.addMesh(unlit);
+            scene.render();
+            EXPECT_EQ(2, scene.getDrawnCount());
+
+            // The GBuffer follows the viewport.
+            scene.setViewport(800, 600);
+            EXPECT_EQ(800, gbuffer->width());
+            EXPECT_EQ(600, gbuffer->height());
+            EXPECT_TRUE(gbuffer->complete());
+            scene.render();
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+
+            // The forward path doesn't have one.
+            Scene forward(640, 480);
+            forward.createBuffers();
+            EXPECT_EQ(nullptr, forward.getGBuffer());
+        }
+
         // TEST(SceneTest, DefaultConstructor) {
         //     Scene s(640, 480);
         //     ASSERT_EQ(0, s.getNumMeshes());
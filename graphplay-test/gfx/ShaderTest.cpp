@@ -3,6 +3,9 @@
 #include "../../graphplay/graphplay.h"
 #include "../../graphplay/gfx/Shader.h"
 
+#include <cstddef>
+#include <utility>
+
 #include <gtest/gtest.h>
 
 #include "TestOpenGLContext.h"
@@ -77,5 +80,152 @@ namespace graphplay {
             index = unifbs.find("view_and_projection");
             ASSERT_NE(unifbs.end(), index);
         }
+
+        TEST_F(ShaderTest, TessellatedSphereProgram) {
+            Program::sptr_type p = createTessellatedSphereProgram();
+
+            ASSERT_EQ(GL_TRUE, glIsProgram(p->getProgramId()));
+            ASSERT_NE(nullptr, p->getTessControlShader());
+            ASSERT_NE(nullptr, p->getTessEvaluationShader());
+
+            const IndexMap &unifs = p->getUniforms();
+            ASSERT_NE(unifs.end(), unifs.find("model"));
+            // The viewport comes from the view_and_projection block.
+            EXPECT_EQ(unifs.end(), unifs.find("viewport"));
+
+            const IndexMap &unifbs = p->getUniformBlocks();
+            ASSERT_NE(unifbs.end(), unifbs.find("view_and_projection"));
+            ASSERT_NE(unifbs.end(), unifbs.find("light_clusters"));
+
+            // Copies get the tessellation shaders too.
+            Program copy(*p);
+            ASSERT_EQ(GL_TRUE, glIsProgram(copy.getProgramId()));
+            ASSERT_EQ(p->getTessControlShader(), copy.getTessControlShader());
+        }
+
+        TEST_F(ShaderTest, DeferredLightingProgram) {
+            Program::sptr_type p = createDeferredLightingProgram();
+            GLuint progid = p->getProgramId();
+            ASSERT_EQ(GL_TRUE, glIsProgram(progid));
+
+            const IndexMap &unifs = p->getUniforms();
+            ASSERT_NE(unifs.end(), unifs.find("light_pass"));
+
+            const IndexMap &unifbs = p->getUniformBlocks();
+            ASSERT_NE(unifbs.end(), unifbs.find("view_and_projection"));
+            ASSERT_NE(unifbs.end(), unifbs.find("light_clusters"));
+
+            // The GBuffer samplers point at their texture units, as
+            // well as the light ones.
+            const std::pair<const char*, GLuint> samplers[] = {
+                { "light_data", Program::LIGHT_DATA_TEXTURE_UNIT },
+                { "light_grid", Program::LIGHT_GRID_TEXTURE_UNIT },
+                { "light_indices", Program::LIGHT_INDEX_TEXTURE_UNIT },
+                { "g_color", Program::GBUFFER_COLOR_TEXTURE_UNIT },
+                { "g_normal", Program::GBUFFER_NORMAL_TEXTURE_UNIT },
+                { "g_position", Program::GBUFFER_POSITION_TEXTURE_UNIT },
+            };
+            for (auto &&sampler : samplers) {
+                GLint unit = -1;
+                glGetUniformiv(progid, unifs.at(sampler.first), &unit);
+                EXPECT_EQ((GLint)sampler.second, unit) << sampler.first;
+            }
+        }
+
+        TEST_F(ShaderTest, BlocksMatchStd140) {
+            Program::sptr_type p = createLitProgram();
+            GLuint progid = p->getProgramId();
+
+            const GLchar *names[] = {
+                "view", "view_inv", "projection", "viewport",
+                "cluster_size", "deferred", "cluster_scale",
+            };
+            GLint expected[] = {
+                offsetof(ViewAndProjectionBlock, view),
+                offsetof(ViewAndProjectionBlock, view_inv),
+                offsetof(ViewAndProjectionBlock, projection),
+                offsetof(ViewAndProjectionBlock, viewport),
+                offsetof(LightClusterBlock, size),
+                offsetof(LightClusterBlock, deferred),
+                offsetof(LightClusterBlock, scale),
+            };
+            GLuint indices[7];
+            GLint offsets[7];
+            glGetUniformIndices(progid, 7, names, indices);
+            glGetActiveUniformsiv(progid, 7, indices, GL_UNIFORM_OFFSET, offsets);
+            for (int i = 0; i < 7; ++i) {
+                EXPECT_EQ(expected[i], offsets[i]) << names[i];
+            }
+
+            GLint size = 0;
+            glGetActiveUniformBlockiv(progid, p->getUniformBlocks().at("view_and_projection"), GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+            EXPECT_EQ(sizeof(ViewAndProjectionBlock), size);
+            glGetActiveUniformBlockiv(progid, p->getUniformBlocks().at("light_clusters"), GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+            EXPECT_EQ(sizeof(LightClusterBlock), size);
+
+            // The light samplers point at their texture units.
+            const std::pair<const char*, GLuint> samplers[] = {
+                { "light_data", Program::LIGHT_DATA_TEXTURE_UNIT },
+                { "light_grid", Program::LIGHT_GRID_TEXTURE_UNIT },
+                { "light_indices", Program::LIGHT_INDEX_TEXTURE_UNIT },
+            };
+            for (auto &&sampler : samplers) {
+                GLint unit = -1;
+                glGetUniformiv(progid, p->getUniforms().at(sampler.first), &unit);
+                EXPECT_EQ((GLint)sampler.second, unit) << sampler.first;
+            }
+        }
+
+        TEST_F(ShaderTest, StandardUniforms) {
+            Shader::sptr_type v = std::make_shared<Shader>(GL_VERTEX_SHADER, vertex_shader_source);
+            Shader::sptr_type f = std::make_shared<Shader>(GL_FRAGMENT_SHADER, fragment_shader_source);
+            Program::sptr_type p = std::make_shared<Program>(v, f);
+            Program::StandardUniforms &unifs = p->getStandardUniforms();
+            ASSERT_TRUE(unifs.model.valid());
+            EXPECT_FALSE(unifs.model_inv_trans_3.valid());
+            EXPECT_FALSE(p->hasModelBlock());
+            EXPECT_EQ((GLint)p->getUniforms().at("model"), unifs.model.location());
+
+            // Setting the same value again doesn't go to GL.
+            glUseProgram(p->getProgramId());
+            glm::mat4x4 m(2.0f);
+            EXPECT_TRUE(unifs.model.set(m));
+            EXPECT_FALSE(unifs.model.set(m));
+            EXPECT_TRUE(unifs.model.set(glm::mat4x4(1.0f)));
+            unifs.model.invalidate();
+            EXPECT_TRUE(unifs.model.set(glm::mat4x4(1.0f)));
+            glUseProgram(0);
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+
+            // The built in programs get their transformations from a
+            // block, or from attributes if they're instanced.
+            Program::sptr_type lit = createLitProgram();
+            EXPECT_TRUE(lit->hasModelBlock());
+            EXPECT_FALSE(lit->getStandardUniforms().model.valid());
+            Program::sptr_type instanced = createLitInstancedProgram();
+            EXPECT_TRUE(instanced->isInstanced());
+            EXPECT_FALSE(instanced->hasModelBlock());
+            EXPECT_FALSE(instanced->getStandardUniforms().model.valid());
+        }
+
+        TEST_F(ShaderTest, ModelBlock) {
+            Program::sptr_type p = createLitProgram();
+            ASSERT_TRUE(p->hasModelBlock());
+
+            GLuint index = p->getUniformBlocks().at("model_transformation");
+            GLint binding = -1, size = 0;
+            glGetActiveUniformBlockiv(p->getProgramId(), index, GL_UNIFORM_BLOCK_BINDING, &binding);
+            glGetActiveUniformBlockiv(p->getProgramId(), index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+            EXPECT_EQ((GLint)ModelTransformationBlock::BINDING, binding);
+            EXPECT_EQ(sizeof(ModelTransformationBlock), size);
+
+            ModelTransformationBlock block;
+            block.set(glm::mat4x4(2.0f), glm::mat3x3(0.5f));
+            p->setModelBlock(block);
+            GLint bound = 0;
+            glGetIntegeri_v(GL_UNIFORM_BUFFER_BINDING, ModelTransformationBlock::BINDING, &bound);
+            EXPECT_NE(0, bound);
+            EXPECT_EQ(GL_NO_ERROR, glGetError());
+        }
     }
 }
@@ -0,0 +1,146 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../../graphplay/graphplay.h"
+#include "../../graphplay/Parallel.h"
+#include "../../graphplay/gfx/SpatialSort.h"
+
+#include <algorithm>
+#include <random>
+#include <set>
+
+#include <gtest/gtest.h>
+
+namespace graphplay {
+    namespace gfx {
+        TEST(SpatialSortTest, MortonCodes) {
+            EXPECT_EQ(0u, mortonCode30(0, 0, 0));
+            EXPECT_EQ(4u, mortonCode30(1, 0, 0));
+            EXPECT_EQ(2u, mortonCode30(0, 1, 0));
+            EXPECT_EQ(1u, mortonCode30(0, 0, 1));
+            EXPECT_EQ(7u << 3, mortonCode30(2, 2, 2));
+            EXPECT_EQ(0x3FFFFFFFu, mortonCode30(1023, 1023, 1023));
+
+            fzx::BBox bounds(glm::vec3(-1.0f), glm::vec3(1.0f));
+            EXPECT_EQ(0u, mortonCode30(glm::vec3(-1.0f), bounds));
+            EXPECT_EQ(0x3FFFFFFFu, mortonCode30(glm::vec3(1.0f), bounds));
+            EXPECT_EQ(0x3FFFFFFFu, mortonCode30(glm::vec3(5.0f), bounds));
+            EXPECT_EQ((4u << 27) | (7u << 24), mortonCode30(glm::vec3(0.5f, -0.5f, -0.5f), bounds));
+
+            // Flat bounds don't divide by zero.
+            fzx::BBox flat(glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+            EXPECT_EQ(0u, mortonCode30(glm::vec3(0.0f, 0.0f, 1.0f), flat));
+        }
+
+        TEST(SpatialSortTest, RadixSortIsStable) {
+            std::default_random_engine eng(4321);
+            std::uniform_int_distribution<std::uint32_t> dist(0, (1 << 20) - 1);
+            std::vector<std::pair<std::uint32_t, std::uint32_t> > items(300001);
+            for (std::uint32_t i = 0; i < items.size(); ++i) {
+                items[i] = std::make_pair(dist(eng) & 0xFF0FFF, i);
+            }
+
+            std::vector<std::pair<std::uint32_t, std::uint32_t> > expected = items;
+            std::stable_sort(expected.begin(), expected.end(), [](const std::pair<std::uint32_t, std::uint32_t> &a, const std::pair<std::uint32_t, std::uint32_t> &b) {
+                    return a.first < b.first;
+                });
+
+            parallelRadixSort(items, 1 << 12, 24, [](const std::pair<std::uint32_t, std::uint32_t> &p) {
+                    return p.first;
+                });
+            EXPECT_EQ(expected, items);
+        }
+
+        TEST(SpatialSortTest, MortonOrder) {
+            std::vector<glm::vec3> points = {
+                glm::vec3(1.0f, 1.0f, 1.0f),
+                glm::vec3(0.0f, 0.0f, 0.0f),
+                glm::vec3(1.0f, 0.0f, 0.0f),
+                glm::vec3(0.0f, 0.0f, 1.0f),
+                glm::vec3(0.0f, 1.0f, 0.0f),
+                glm::vec3(0.0f, 0.0f, 0.0f),
+            };
+            fzx::BBox bounds(glm::vec3(0.0f), glm::vec3(1.0f));
+
+            std::vector<GLuint> expected = { 1, 5, 3, 4, 2, 0 };
+            EXPECT_EQ(expected, mortonOrder(points, bounds));
+        }
+
+        TEST(SpatialSortTest, SortTriangles) {
+            // A 20x20 grid of quads, with the vertices and triangles
+            // shuffled.
+            const GLuint n = 20;
+            std::vector<glm::vec3> positions;
+            for (GLuint y = 0; y <= n; ++y) {
+                for (GLuint x = 0; x <= n; ++x) {
+                    positions.push_back(glm::vec3(x, y, 0.0f));
+                }
+            }
+
+            std::vector<GLuint> shuffle(positions.size());
+            for (GLuint i = 0; i < shuffle.size(); ++i) {
+                shuffle[i] = i;
+            }
+            std::default_random_engine eng(99);
+            std::shuffle(shuffle.begin(), shuffle.end(), eng);
+
+            std::vector<glm::vec3> shuffled(positions.size());
+            std::vector<GLuint> to_shuffled(positions.size());
+            for (GLuint i = 0; i < shuffle.size(); ++i) {
+                shuffled[i] = positions[shuffle[i]];
+                to_shuffled[shuffle[i]] = i;
+            }
+
+            std::vector<GLuint> elems;
+            for (GLuint y = 0; y < n; ++y) {
+                for (GLuint x = 0; x < n; ++x) {
+                    GLuint v = y*(n + 1) + x;
+                    GLuint tri[6] = { v, v + 1, v + n + 2, v, v + n + 2, v + n + 1 };
+                    for (GLuint j = 0; j < 6; ++j) {
+                        elems.push_back(to_shuffled[tri[j]]);
+                    }
+                }
+            }
+
+            // Each triangle as its three positions, starting from its
+            // first corner.
+            auto triangles = [](const std::vector<GLuint> &es, const std::vector<glm::vec3> &ps) {
+                std::multiset<std::vector<float> > rv;
+                for (std::size_t f = 0; f < es.size() / 3; ++f) {
+                    std::vector<float> tri;
+                    for (unsigned int j = 0; j < 3; ++j) {
+                        const glm::vec3 &p = ps[es[3*f + j]];
+                        tri.insert(tri.end(), { p.x, p.y, p.z });
+                    }
+                    rv.insert(tri);
+                }
+                return rv;
+            };
+            std::multiset<std::vector<float> > before = triangles(elems, shuffled);
+
+            fzx::BBox bounds = fzx::BBox::fromVectors(shuffled.begin(), shuffled.end());
+            std::vector<GLuint> order = mortonOrder(shuffled, bounds);
+            std::vector<glm::vec3> sorted(shuffled.size());
+            for (GLuint i = 0; i < order.size(); ++i) {
+                sorted[i] = shuffled[order[i]];
+            }
+            reorderElements(elems, order);
+            mortonSortTriangles(elems, sorted);
+
+            EXPECT_EQ(before, triangles(elems, sorted));
+
+            std::uint32_t prev_code = 0;
+            for (GLuint i = 0; i < sorted.size(); ++i) {
+                std::uint32_t code = mortonCode30(sorted[i], bounds);
+                ASSERT_LE(prev_code, code);
+                prev_code = code;
+            }
+
+            // The triangles come out in Morton order too, so the
+            // first one is in the corner.
+            for (unsigned int j = 0; j < 3; ++j) {
+                EXPECT_GE(1.0f, sorted[elems[j]].x);
+                EXPECT_GE(1.0f, sorted[elems[j]].y);
+            }
+        }
+    }
+}
@@ -0,0 +1,99 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../../graphplay/graphplay.h"
+#include "../../graphplay/gfx/Stripify.h"
+
+#include <algorithm>
+#include <array>
+
+#include <gtest/gtest.h>
+
+namespace graphplay {
+    namespace gfx {
+        typedef std::array<GLuint, 3> Triangle;
+
+        // Rotate a triangle so that its smallest index comes first,
+        // which keeps its winding.
+        Triangle canonicalTriangle(GLuint a, GLuint b, GLuint c) {
+            if (b < a && b < c) {
+                return Triangle {{ b, c, a }};
+            } else if (c < a && c < b) {
+                return Triangle {{ c, a, b }};
+            } else {
+                return Triangle {{ a, b, c }};
+            }
+        }
+
+        std::vector<Triangle> listTriangles(const std::vector<GLuint> &tris) {
+            std::vector<Triangle> rv;
+            for (unsigned int i = 0; i + 2 < tris.size(); i += 3) {
+                rv.push_back(canonicalTriangle(tris[i], tris[i + 1], tris[i + 2]));
+            }
+            std::sort(rv.begin(), rv.end());
+            return rv;
+        }
+
+        std::vector<Triangle> stripTriangles(const std::vector<GLuint> &strips) {
+            std::vector<Triangle> rv;
+            std::size_t start = 0;
+            for (std::size_t i = 0; i <= strips.size(); ++i) {
+                if (i < strips.size() && strips[i] != PRIMITIVE_RESTART_INDEX) {
+                    continue;
+                }
+
+                for (std::size_t j = start; j + 2 < i; ++j) {
+                    if ((j - start) % 2 == 0) {
+                        rv.push_back(canonicalTriangle(strips[j], strips[j + 1], strips[j + 2]));
+                    } else {
+                        rv.push_back(canonicalTriangle(strips[j + 1], strips[j], strips[j + 2]));
+                    }
+                }
+                start = i + 1;
+            }
+            std::sort(rv.begin(), rv.end());
+            return rv;
+        }
+
+        // An n x n grid of quads, each split into two triangles.
+        std::vector<GLuint> gridTriangles(unsigned int n) {
+            std::vector<GLuint> rv;
+            for (unsigned int y = 0; y < n; ++y) {
+                for (unsigned int x = 0; x < n; ++x) {
+                    GLuint v = y*(n + 1) + x;
+                    GLuint tri[6] = { v, v + 1, v + n + 2, v, v + n + 2, v + n + 1 };
+                    rv.insert(rv.end(), tri, tri + 6);
+                }
+            }
+            return rv;
+        }
+
+        TEST(StripifyTest, SingleTriangle) {
+            std::vector<GLuint> tris = { 0, 1, 2 };
+            std::vector<GLuint> strips = stripifyTriangles(tris, 3);
+            EXPECT_EQ(3, strips.size());
+            EXPECT_EQ(listTriangles(tris), stripTriangles(strips));
+        }
+
+        TEST(StripifyTest, QuadIsOneStrip) {
+            std::vector<GLuint> tris = { 0, 1, 2, 0, 2, 3 };
+            std::vector<GLuint> strips = stripifyTriangles(tris, 4);
+            EXPECT_EQ(4, strips.size());
+            EXPECT_EQ(listTriangles(tris), stripTriangles(strips));
+        }
+
+        TEST(StripifyTest, GridKeepsEveryTriangle) {
+            std::vector<GLuint> tris = gridTriangles(8);
+            std::vector<GLuint> strips = stripifyTriangles(tris, 81);
+            EXPECT_EQ(listTriangles(tris), stripTriangles(strips));
+            EXPECT_LT(strips.size(), tris.size());
+        }
+
+        TEST(StripifyTest, DisconnectedTrianglesAreRestarted) {
+            std::vector<GLuint> tris = { 0, 1, 2, 3, 4, 5 };
+            std::vector<GLuint> strips = stripifyTriangles(tris, 6);
+            ASSERT_EQ(7, strips.size());
+            EXPECT_EQ(PRIMITIVE_RESTART_INDEX, strips[3]);
+            EXPECT_EQ(listTriangles(tris), stripTriangles(strips));
+        }
+    }
+}
@@ -0,0 +1,247 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../../graphplay/graphplay.h"
+#include "../../graphplay/gfx/TriangleBVH.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include <glm/glm.hpp>
+
+#include <gtest/gtest.h>
+
+namespace graphplay {
+    namespace gfx {
+        // A bumpy sphere of rings x segments quads, so that the tree
+        // is many levels deep and the surface isn't too regular.
+        void bumpySphere(unsigned int rings, unsigned int segments, std::vector<GLuint> &elems, std::vector<glm::vec3> &positions) {
+            const float pi = 3.14159265f;
+            for (unsigned int r = 0; r <= rings; ++r) {
+                float theta = pi*r / rings;
+                for (unsigned int s = 0; s <= segments; ++s) {
+                    float phi = 2.0f*pi*s / segments;
+                    float radius = 1.0f + 0.1f*std::sin(5.0f*theta)*std::cos(7.0f*phi);
+                    positions.push_back(radius*glm::vec3(std::sin(theta)*std::cos(phi), std::cos(theta), std::sin(theta)*std::sin(phi)));
+                }
+            }
+
+            for (unsigned int r = 0; r < rings; ++r) {
+                for (unsigned int s = 0; s < segments; ++s) {
+                    GLuint v = r*(segments + 1) + s;
+                    GLuint quad[6] = { v, v + 1, v + segments + 2, v, v + segments + 2, v + segments + 1 };
+                    elems.insert(elems.end(), quad, quad + 6);
+                }
+            }
+        }
+
+        bool bruteRaycast(
+            const std::vector<GLuint> &elems, const std::vector<glm::vec3> &positions,
+            const glm::vec3 &origin, const glm::vec3 &direction, float &best_t, GLuint &best_face)
+        {
+            bool found = false;
+            best_t = std::numeric_limits<float>::infinity();
+            for (GLuint f = 0; f < elems.size() / 3; ++f) {
+                const glm::vec3 &a = positions[elems[3*f]], &b = positions[elems[3*f + 1]], &c = positions[elems[3*f + 2]];
+                glm::vec3 e1 = b - a, e2 = c - a, p = glm::cross(direction, e2);
+                float det = glm::dot(e1, p);
+                if (det == 0.0f) {
+                    continue;
+                }
+                glm::vec3 s = origin - a, q = glm::cross(s, e1);
+                float u = glm::dot(s, p) / det, v = glm::dot(direction, q) / det, t = glm::dot(e2, q) / det;
+                if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= 0.0f && t < best_t) {
+                    best_t = t;
+                    best_face = f;
+                    found = true;
+                }
+            }
+            return found;
+        }
+
+        TEST(TriangleBVHTest, Empty) {
+            TriangleBVH bvh;
+            RayHit hit;
+            ClosestPoint closest;
+            std::vector<GLuint> faces;
+            EXPECT_TRUE(bvh.empty());
+            EXPECT_FALSE(bvh.raycast(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), hit));
+            EXPECT_FALSE(bvh.closestPoint(glm::vec3(0.0f), closest));
+            EXPECT_EQ(0, bvh.overlapBox(fzx::BBox(glm::vec3(-1.0f), glm::vec3(1.0f)), faces));
+
+            // Only degenerate or out of range triangles.
+            std::vector<GLuint> elems = { 0, 0, 1, 0, 1, 5 };
+            std::vector<glm::vec3> positions = { glm::vec3(0.0f), glm::vec3(1.0f) };
+            bvh.build(elems, positions);
+            EXPECT_TRUE(bvh.empty());
+        }
+
+        TEST(TriangleBVHTest, SingleTriangle) {
+            std::vector<GLuint> elems = { 0, 1, 2 };
+            std::vector<glm::vec3> positions = { glm::vec3(0, 0, 0), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0) };
+            TriangleBVH bvh(elems, positions);
+            ASSERT_EQ(1, bvh.triangleCount());
+
+            RayHit hit;
+            ASSERT_TRUE(bvh.raycast(glm::vec3(0.25f, 0.25f, 2.0f), glm::vec3(0.0f, 0.0f, -1.0f), hit));
+            EXPECT_FLOAT_EQ(2.0f, hit.t);
+            EXPECT_FLOAT_EQ(0.25f, hit.u);
+            EXPECT_FLOAT_EQ(0.25f, hit.v);
+            EXPECT_EQ(0, hit.face);
+
+            // Tiny components either way don't throw it off.
+            EXPECT_TRUE(bvh.raycast(glm::vec3(0.25f, 0.25f, 2.0f), glm::vec3(-1.0e-30f, 1.0e-30f, -1.0f), hit));
+            EXPECT_TRUE(bvh.raycast(glm::vec3(0.25f, 0.25f, 2.0f), glm::vec3(-0.0f, -0.0f, -1.0f), hit));
+
+            // Backwards, too far, and beside it.
+            EXPECT_FALSE(bvh.raycast(glm::vec3(0.25f, 0.25f, 2.0f), glm::vec3(0.0f, 0.0f, 1.0f), hit));
+            EXPECT_FALSE(bvh.raycast(glm::vec3(0.25f, 0.25f, 2.0f), glm::vec3(0.0f, 0.0f, -1.0f), hit, 1.5f));
+            EXPECT_FALSE(bvh.raycast(glm::vec3(0.75f, 0.75f, 2.0f), glm::vec3(0.0f, 0.0f, -1.0f), hit));
+
+            ClosestPoint closest;
+            ASSERT_TRUE(bvh.closestPoint(glm::vec3(2.0f, -1.0f, 3.0f), closest));
+            EXPECT_EQ(glm::vec3(1.0f, 0.0f, 0.0f), closest.point);
+            EXPECT_FLOAT_EQ(std::sqrt(11.0f), closest.distance);
+            EXPECT_FALSE(bvh.closestPoint(glm::vec3(2.0f, -1.0f, 3.0f), closest, 3.0f));
+
+            std::vector<GLuint> faces;
+            EXPECT_EQ(1, bvh.overlapBox(fzx::BBox(glm::vec3(0.4f, 0.4f, -0.1f), glm::vec3(1.0f, 1.0f, 0.1f)), faces));
+            // Overlaps the triangle's bounds, but not the triangle.
+            EXPECT_EQ(0, bvh.overlapBox(fzx::BBox(glm::vec3(0.6f, 0.6f, -0.1f), glm::vec3(1.0f, 1.0f, 0.1f)), faces));
+            EXPECT_EQ(std::vector<GLuint>(1, 0), faces);
+        }
+
+        TEST(TriangleBVHTest, RaycastMatchesBruteForce) {
+            std::vector<GLuint> elems;
+            std::vector<glm::vec3> positions;
+            bumpySphere(60, 90, elems, positions);
+            TriangleBVH bvh(elems, positions);
+            fzx::BBox bounds = bvh.bounds(), expected_bounds = fzx::BBox::fromVectors(positions.begin(), positions.end());
+            EXPECT_EQ(expected_bounds.min, bounds.min);
+            EXPECT_EQ(expected_bounds.max, bounds.max);
+
+            std::default_random_engine eng(2718);
+            std::uniform_real_distribution<float> coord(-3.0f, 3.0f);
+            unsigned int hits = 0;
+            for (unsigned int i = 0; i < 500; ++i) {
+                glm::vec3 origin(coord(eng), coord(eng), coord(eng));
+                glm::vec3 target(coord(eng) / 3.0f, coord(eng) / 3.0f, coord(eng) / 3.0f);
+                glm::vec3 direction = target - origin;
+                // Some axis-aligned rays, which have zeros to divide
+                // by.
+                if (i % 10 == 0) {
+                    direction = glm::vec3(0.0f, 0.0f, -origin.z);
+                }
+
+                float t;
+                GLuint face;
+                RayHit hit;
+                bool expected = bruteRaycast(elems, positions, origin, direction, t, face);
+                ASSERT_EQ(expected, bvh.raycast(origin, direction, hit)) << i;
+                if (expected) {
+                    ++hits;
+                    ASSERT_NEAR(t, hit.t, 1e-4f) << i;
+                }
+            }
+            EXPECT_LT(100, hits);
+
+            // From the inside.
+            RayHit hit;
+            ASSERT_TRUE(bvh.raycast(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), hit));
+            EXPECT_NEAR(1.0f, hit.t, 0.11f);
+        }
+
+        TEST(TriangleBVHTest, ClosestPointMatchesBruteForce) {
+            std::vector<GLuint> elems;
+            std::vector<glm::vec3> positions;
+            bumpySphere(30, 40, elems, positions);
+            TriangleBVH bvh(elems, positions);
+
+            std::default_random_engine eng(1414);
+            std::uniform_real_distribution<float> coord(-2.0f, 2.0f);
+            for (unsigned int i = 0; i < 100; ++i) {
+                glm::vec3 p(coord(eng), coord(eng), coord(eng));
+                ClosestPoint closest;
+                ASSERT_TRUE(bvh.closestPoint(p, closest));
+
+                // Nothing is closer than what it found, and the point
+                // it found is on the face it says.
+                float best = std::numeric_limits<float>::infinity();
+                for (std::size_t v = 0; v < positions.size(); ++v) {
+                    best = std::min(best, glm::length(positions[v] - p));
+                }
+                ASSERT_GE(best + 1e-5f, closest.distance);
+                ASSERT_NEAR(glm::length(closest.point - p), closest.distance, 1e-5f);
+
+                const glm::vec3 &a = positions[elems[3*closest.face]];
+                const glm::vec3 &b = positions[elems[3*closest.face + 1]];
+                const glm::vec3 &c = positions[elems[3*closest.face + 2]];
+                glm::vec3 n = glm::cross(b - a, c - a);
+                if (glm::length(n) > 1e-6f) {
+                    ASSERT_NEAR(0.0f, glm::dot(closest.point - a, glm::normalize(n)), 1e-5f);
+                }
+            }
+        }
+
+        TEST(TriangleBVHTest, OverlapBoxMatchesBruteForce) {
+            std::vector<GLuint> elems;
+            std::vector<glm::vec3> positions;
+            bumpySphere(30, 40, elems, positions);
+            TriangleBVH bvh(elems, positions);
+
+            std::default_random_engine eng(1732);
+            std::uniform_real_distribution<float> coord(-1.2f, 1.2f), size(0.01f, 0.5f);
+            for (unsigned int i = 0; i < 50; ++i) {
+                glm::vec3 center(coord(eng), coord(eng), coord(eng));
+                glm::vec3 half(size(eng), size(eng), size(eng));
+                fzx::BBox box(center - half, center + half);
+
+                std::vector<GLuint> faces;
+                std::size_t found = bvh.overlapBox(box, faces);
+                ASSERT_EQ(faces.size(), found);
+                std::sort(faces.begin(), faces.end());
+
+                // Every face with a vertex inside the box has to be
+                // found, and every face found has to overlap the box's
+                // bounds.
+                for (GLuint f = 0; f < elems.size() / 3; ++f) {
+                    fzx::BBox tri;
+                    bool inside = false;
+                    for (unsigned int j = 0; j < 3; ++j) {
+                        const glm::vec3 &p = positions[elems[3*f + j]];
+                        tri.min = glm::min(tri.min, p);
+                        tri.max = glm::max(tri.max, p);
+                        inside = inside || (glm::all(glm::lessThanEqual(box.min, p)) && glm::all(glm::lessThanEqual(p, box.max)));
+                    }
+
+                    bool reported = std::binary_search(faces.begin(), faces.end(), f);
+                    if (inside) {
+                        ASSERT_TRUE(reported) << i << " " << f;
+                    }
+                    if (reported) {
+                        ASSERT_TRUE(tri.collides(box)) << i << " " << f;
+                    }
+                }
+            }
+        }
+
+        TEST(TriangleBVHTest, LargeMesh) {
+            std::vector<GLuint> elems;
+            std::vector<glm::vec3> positions;
+            bumpySphere(100, 200, elems, positions);
+
+            // Big enough to be built as several subtrees.
+            TriangleBVH bvh(elems, positions);
+            EXPECT_EQ(elems.size() / 3, bvh.triangleCount());
+            EXPECT_LT(1, bvh.nodeCount());
+
+            RayHit hit;
+            ASSERT_TRUE(bvh.raycast(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f, 0.0f, -1.0f), hit));
+            const glm::vec3 &a = positions[elems[3*hit.face]];
+            const glm::vec3 &b = positions[elems[3*hit.face + 1]];
+            const glm::vec3 &c = positions[elems[3*hit.face + 2]];
+            glm::vec3 p = a + hit.u*(b - a) + hit.v*(c - a);
+            EXPECT_NEAR(5.0f - hit.t, p.z, 1e-4f);
+        }
+    }
+}
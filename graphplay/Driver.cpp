@@ -34,7 +34,7 @@ namespace graphplay {
     {}
 
     GPObject::GPObject(
-        gfx::PCNGeometry::sptr_type geo,
+        gfx::AbstractGeometry::sptr_type geo,
         gfx::Program::sptr_type program)
         : GPObject()
     {
@@ -42,7 +42,7 @@ namespace graphplay {
     }
 
     void GPObject::init(
-        gfx::PCNGeometry::sptr_type geo,
+        gfx::AbstractGeometry::sptr_type geo,
         gfx::Program::sptr_type program)
     {
         std::uniform_real_distribution<float> random_unit(-10.0f, 10.0f);
@@ -76,6 +76,7 @@ namespace graphplay {
         // Create the shader programs.
         gfx::Program::sptr_type unlit_program = gfx::createUnlitProgram();
         gfx::Program::sptr_type lit_program = gfx::createLitProgram();
+        gfx::Program::sptr_type sphere_program = gfx::createTessellatedSphereProgram();
 
         // Find the PLY files.
         path assets_path("assets");
@@ -84,15 +85,18 @@ namespace graphplay {
         path armadillo_path(assets_path);
         armadillo_path /= "stanford_armadillo.ply";
 
-        // Create the objects in the scene.
-        GPObject octohedron(gfx::makeOctohedronGeometry(), unlit_program);
-        GPObject icosahedron(gfx::makeIcosahedronGeometry(), unlit_program);
-        GPObject sphere(gfx::makeSphereGeometry(), lit_program);
-        GPObject bunny(gfx::loadPlyFile(bunny_path.string().c_str()), lit_program);
-        GPObject armadillo(gfx::loadPlyFile(armadillo_path.string().c_str()), lit_program);
+        // Create the objects in the scene. Their geometries come
+        // from the registry, so any more of the same kind would share
+        // them.
+        gfx::GeometryRegistry geometries;
+        GPObject octohedron(geometries.primitive("octohedron"), unlit_program);
+        GPObject icosahedron(geometries.primitive("icosahedron"), unlit_program);
+        GPObject sphere(geometries.primitive("sphere_patches"), sphere_program);
+        GPObject bunny(geometries.compactPly(bunny_path.string()), lit_program);
+        GPObject armadillo(geometries.compactPly(armadillo_path.string()), lit_program);
 
         // Create the "bounding box" geoemtry.
-        GPObject bbox(gfx::makeWireframeCubeGeometry(), unlit_program);
+        GPObject bbox(geometries.primitive("wireframe_cube"), unlit_program);
         bbox.mesh->modelTransformation(glm::scale(glm::vec3(10.0, 10.0, 10.0)));
 
         // Create the scene.
@@ -10,6 +10,7 @@
 #include "fzx/Body.h"
 #include "fzx/PhysicsSystem.h"
 #include "gfx/Geometry.h"
+#include "gfx/GeometryRegistry.h"
 #include "gfx/Mesh.h"
 #include "gfx/Scene.h"
 #include "gfx/Shader.h"
@@ -30,11 +31,11 @@ namespace graphplay {
     class GPObject {
     public:
         GPObject();
-        GPObject(gfx::PCNGeometry::sptr_type geo, gfx::Program::sptr_type program);
-        void init(gfx::PCNGeometry::sptr_type geo, gfx::Program::sptr_type program);
+        GPObject(gfx::AbstractGeometry::sptr_type geo, gfx::Program::sptr_type program);
+        void init(gfx::AbstractGeometry::sptr_type geo, gfx::Program::sptr_type program);
         void update(float alpha);
 
-        gfx::PCNGeometry::sptr_type geometry;
+        gfx::AbstractGeometry::sptr_type geometry;
         gfx::Mesh::sptr_type mesh;
         fzx::Body::sptr_type body;
     };
@@ -0,0 +1,19 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "graphplay.h"
+#include "Parallel.h"
+
+#include <algorithm>
+
+namespace graphplay {
+    unsigned int workerThreadCount() {
+        static const unsigned int count = std::max(1u, std::thread::hardware_concurrency());
+        return count;
+    }
+
+    unsigned int chunkCount(std::size_t count, std::size_t min_chunk_size) {
+        std::size_t by_size = count / std::max<std::size_t>(1, min_chunk_size);
+        std::size_t chunks = std::min<std::size_t>(by_size, workerThreadCount());
+        return static_cast<unsigned int>(std::max<std::size_t>(1, chunks));
+    }
+}
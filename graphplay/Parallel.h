@@ -0,0 +1,148 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_PARALLEL_H_
+#define _GRAPHPLAY_GRAPHPLAY_PARALLEL_H_
+
+#include "graphplay.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace graphplay {
+    // How many threads the parallel loops below will use at most.
+    unsigned int workerThreadCount();
+
+    // How many chunks parallelChunks will split count items into,
+    // given that each chunk should have at least min_chunk_size
+    // items in it.
+    unsigned int chunkCount(std::size_t count, std::size_t min_chunk_size);
+
+    // The first item of the chunk'th chunk of count items split into
+    // num_chunks pieces.
+    inline std::size_t chunkBegin(std::size_t count, unsigned int num_chunks, unsigned int chunk) {
+        return (count / num_chunks) * chunk + std::min<std::size_t>(chunk, count % num_chunks);
+    }
+
+    // Split [0, count) into chunkCount(count, min_chunk_size)
+    // contiguous ranges, and call fn(chunk, first, last) on each one
+    // on its own thread. Chunk 0 runs on the calling thread. The
+    // chunk index is there so that callers can accumulate into
+    // per-chunk storage without any locking.
+    template <typename F>
+    void parallelChunks(std::size_t count, std::size_t min_chunk_size, F fn) {
+        unsigned int num_chunks = chunkCount(count, min_chunk_size);
+
+        if (num_chunks <= 1) {
+            if (count > 0) {
+                fn(0u, std::size_t(0), count);
+            }
+            return;
+        }
+
+        std::vector<std::thread> threads;
+        threads.reserve(num_chunks - 1);
+        for (unsigned int c = 1; c < num_chunks; ++c) {
+            std::size_t first = chunkBegin(count, num_chunks, c);
+            std::size_t last = chunkBegin(count, num_chunks, c + 1);
+            threads.emplace_back([&fn, c, first, last]() { fn(c, first, last); });
+        }
+
+        fn(0u, std::size_t(0), chunkBegin(count, num_chunks, 1));
+
+        for (auto &&t : threads) {
+            t.join();
+        }
+    }
+
+    // Call fn(i) for every i in [0, count), split across threads.
+    template <typename F>
+    void parallelFor(std::size_t count, std::size_t min_chunk_size, F fn) {
+        parallelChunks(count, min_chunk_size, [&fn](unsigned int, std::size_t first, std::size_t last) {
+                for (std::size_t i = first; i < last; ++i) {
+                    fn(i);
+                }
+            });
+    }
+
+    // Sort items with less, by sorting chunks of at least
+    // min_chunk_size items on their own threads and then merging
+    // neighboring chunks together, a pair per thread, until there's
+    // only one left.
+    template <typename T, typename Compare>
+    void parallelSort(std::vector<T> &items, std::size_t min_chunk_size, Compare less) {
+        const std::size_t count = items.size();
+        const unsigned int num_chunks = chunkCount(count, min_chunk_size);
+
+        parallelChunks(count, min_chunk_size, [&](unsigned int, std::size_t first, std::size_t last) {
+                std::sort(items.begin() + first, items.begin() + last, less);
+            });
+
+        for (unsigned int width = 1; width < num_chunks; width *= 2) {
+            const unsigned int num_pairs = (num_chunks + 2*width - 1) / (2*width);
+            parallelFor(num_pairs, 1, [&](std::size_t pair) {
+                    unsigned int first = static_cast<unsigned int>(pair)*2*width;
+                    unsigned int middle = std::min(first + width, num_chunks);
+                    unsigned int last = std::min(first + 2*width, num_chunks);
+                    std::inplace_merge(
+                        items.begin() + chunkBegin(count, num_chunks, first),
+                        items.begin() + chunkBegin(count, num_chunks, middle),
+                        items.begin() + chunkBegin(count, num_chunks, last),
+                        less);
+                });
+        }
+    }
+
+    // Stable LSD radix sort of items by key(item), an unsigned
+    // integer with key_bits significant bits, a byte at a time. Each
+    // pass counts the digits of every chunk on its own thread, then
+    // each chunk scatters its items to where the counts say they go.
+    // Passes where every item has the same digit are skipped.
+    template <typename T, typename K>
+    void parallelRadixSort(std::vector<T> &items, std::size_t min_chunk_size, unsigned int key_bits, K key) {
+        const std::size_t count = items.size();
+        const unsigned int num_chunks = chunkCount(count, min_chunk_size);
+        std::vector<T> sorted(count);
+        std::vector<std::size_t> offsets(num_chunks*256);
+
+        for (unsigned int shift = 0; shift < key_bits; shift += 8) {
+            std::fill(offsets.begin(), offsets.end(), 0);
+            parallelChunks(count, min_chunk_size, [&](unsigned int chunk, std::size_t first, std::size_t last) {
+                    std::size_t *chunk_counts = &offsets[chunk*256];
+                    for (std::size_t i = first; i < last; ++i) {
+                        ++chunk_counts[(key(items[i]) >> shift) & 0xFF];
+                    }
+                });
+
+            // Lay the buckets out digit by digit, and within each
+            // digit chunk by chunk, which keeps the sort stable.
+            bool one_digit = false;
+            std::size_t running = 0;
+            for (unsigned int d = 0; d < 256; ++d) {
+                std::size_t digit_start = running;
+                for (unsigned int c = 0; c < num_chunks; ++c) {
+                    std::size_t n = offsets[c*256 + d];
+                    offsets[c*256 + d] = running;
+                    running += n;
+                }
+                if (running - digit_start == count) {
+                    one_digit = true;
+                }
+            }
+            if (one_digit) {
+                continue;
+            }
+
+            parallelChunks(count, min_chunk_size, [&](unsigned int chunk, std::size_t first, std::size_t last) {
+                    std::size_t *chunk_offsets = &offsets[chunk*256];
+                    for (std::size_t i = first; i < last; ++i) {
+                        sorted[chunk_offsets[(key(items[i]) >> shift) & 0xFF]++] = items[i];
+                    }
+                });
+            items.swap(sorted);
+        }
+    }
+}
+
+#endif
@@ -7,6 +7,8 @@
 
 #include <glm/vec4.hpp>
 
+#include "../gfx/MeshKernels.h"
+
 namespace graphplay {
     namespace fzx {
         static constexpr float FLOAT_MIN = std::numeric_limits<float>::lowest();
@@ -24,16 +26,22 @@ namespace graphplay {
     
         BBox::~BBox() {}
 
+        BBox BBox::fromPositions(const float *first, std::size_t count, std::size_t stride) {
+            BBox rv;
+            gfx::minMax3(first, count, stride, rv.min, rv.max);
+            return rv;
+        }
+
         BBox BBox::axisAlignedAfterTransform(const glm::mat4x4 &transform) const {
             glm::vec4 corners[8] = {
-                { min.x, min.y, min.z, 1.0 },
-                { min.x, min.y, max.z, 1.0 },
-                { min.x, max.y, min.z, 1.0 },
-                { min.x, max.y, max.z, 1.0 },
-                { max.x, min.y, min.z, 1.0 },
-                { max.x, min.y, max.z, 1.0 },
-                { max.x, max.y, min.z, 1.0 },
-                { max.x, max.y, max.z, 1.0 },
+                transform * glm::vec4(min.x, min.y, min.z, 1.0),
+                transform * glm::vec4(min.x, min.y, max.z, 1.0),
+                transform * glm::vec4(min.x, max.y, min.z, 1.0),
+                transform * glm::vec4(min.x, max.y, max.z, 1.0),
+                transform * glm::vec4(max.x, min.y, min.z, 1.0),
+                transform * glm::vec4(max.x, min.y, max.z, 1.0),
+                transform * glm::vec4(max.x, max.y, min.z, 1.0),
+                transform * glm::vec4(max.x, max.y, max.z, 1.0),
             };
 
             return BBox::fromVectors(corners, corners + 8);
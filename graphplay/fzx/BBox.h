@@ -6,7 +6,9 @@
 #include "../graphplay.h"
 
 #include <array>
+#include <cstddef>
 #include <limits>
+#include <type_traits>
 
 #include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
@@ -23,27 +25,23 @@ namespace graphplay {
             BBox(glm::vec3 min, glm::vec3 max);
             ~BBox();
 
+            // The iterators have to be over contiguous PCNVertex's
+            // (like a std::vector's).
             template <typename I>
             static BBox fromVertices(I first, I last) {
                 static_assert(
                     std::is_same<typename I::value_type, gfx::PCNVertex>::value,
                     "The BBox fromVertices factory function can only be called with iterators over PCNVertex's.");
 
-                BBox rv;
-                for (I i = first; i != last; ++i) {
-                    for (unsigned int j = 0; j < 3; ++j) {
-                        if (i->position[j] < rv.min[j]) {
-                            rv.min[j] = i->position[j];
-                        }
-
-                        if (i->position[j] > rv.max[j]) {
-                            rv.max[j] = i->position[j];
-                        }
-                    }
+                if (first == last) {
+                    return BBox();
                 }
-                return rv;
+                return fromPositions(first->position, static_cast<std::size_t>(last - first), sizeof(typename I::value_type));
             }
 
+            // The bounds of count 3-float positions, stride bytes apart.
+            static BBox fromPositions(const float *first, std::size_t count, std::size_t stride);
+
             template <typename I>
             static BBox fromVectors(I first, I last) {
                 BBox rv;
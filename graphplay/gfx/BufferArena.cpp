@@ -0,0 +1,403 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../graphplay.h"
+#include "BufferArena.h"
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#include "OpenGLUtils.h"
+
+namespace graphplay {
+    namespace gfx {
+        // Class RangeAllocator.
+        const std::size_t RangeAllocator::NONE;
+
+        RangeAllocator::RangeAllocator(std::size_t capacity)
+            : m_capacity(0),
+              m_used(0),
+              m_free_by_offset(),
+              m_free_by_size()
+        {
+            grow(capacity);
+        }
+
+        std::size_t RangeAllocator::allocate(std::size_t size) {
+            if (size == 0) {
+                return 0;
+            }
+
+            auto fit = m_free_by_size.lower_bound(size);
+            if (fit == m_free_by_size.end()) {
+                return NONE;
+            }
+
+            std::size_t offset = fit->second, block_size = fit->first;
+            removeFree(m_free_by_offset.find(offset));
+            if (block_size > size) {
+                addFree(offset + size, block_size - size);
+            }
+            m_used += size;
+            return offset;
+        }
+
+        void RangeAllocator::free(std::size_t offset, std::size_t size) {
+            if (size == 0) {
+                return;
+            }
+            m_used -= size;
+
+            // Merge with the blocks on either side.
+            auto next = m_free_by_offset.lower_bound(offset);
+            if (next != m_free_by_offset.end() && next->first == offset + size) {
+                auto after = std::next(next);
+                size += next->second;
+                removeFree(next);
+                next = after;
+            }
+            if (next != m_free_by_offset.begin()) {
+                auto prev = std::prev(next);
+                if (prev->first + prev->second == offset) {
+                    offset = prev->first;
+                    size += prev->second;
+                    removeFree(prev);
+                }
+            }
+            addFree(offset, size);
+        }
+
+        void RangeAllocator::grow(std::size_t new_capacity) {
+            if (new_capacity <= m_capacity) {
+                return;
+            }
+
+            std::size_t old_capacity = m_capacity;
+            m_capacity = new_capacity;
+            m_used += new_capacity - old_capacity;
+            free(old_capacity, new_capacity - old_capacity);
+        }
+
+        std::size_t RangeAllocator::largestFree() const {
+            return m_free_by_size.empty() ? 0 : m_free_by_size.rbegin()->first;
+        }
+
+        bool RangeAllocator::packed() const {
+            if (m_free_by_offset.empty()) {
+                return true;
+            }
+            auto block = m_free_by_offset.begin();
+            return m_free_by_offset.size() == 1 && block->first + block->second == m_capacity;
+        }
+
+        void RangeAllocator::addFree(std::size_t offset, std::size_t size) {
+            m_free_by_offset[offset] = size;
+            m_free_by_size.insert(std::make_pair(size, offset));
+        }
+
+        void RangeAllocator::removeFree(std::map<std::size_t, std::size_t>::iterator block) {
+            if (block == m_free_by_offset.end()) {
+                return;
+            }
+
+            auto sized = m_free_by_size.equal_range(block->second);
+            for (auto s = sized.first; s != sized.second; ++s) {
+                if (s->second == block->first) {
+                    m_free_by_size.erase(s);
+                    break;
+                }
+            }
+            m_free_by_offset.erase(block);
+        }
+
+        // Struct ArenaRange.
+        ArenaRange::ArenaRange(std::shared_ptr<BufferArena> arena,
+                               std::size_t first_vertex, std::size_t vertex_count,
+                               std::size_t first_elem, std::size_t elem_count)
+            : arena(arena),
+              first_vertex(first_vertex),
+              vertex_count(vertex_count),
+              first_elem(first_elem),
+              elem_count(elem_count)
+        {}
+
+        ArenaRange::~ArenaRange() {
+            arena->release(*this);
+        }
+
+        // Class BufferArena.
+        const std::size_t BufferArena::INITIAL_VERTICES;
+        const std::size_t BufferArena::INITIAL_ELEMS;
+
+        BufferArena::BufferArena(const AttrMap &format, std::size_t vertex_size,
+                                 std::size_t initial_vertices, std::size_t initial_elems)
+            : m_format(format),
+              m_vertex_size(vertex_size),
+              m_initial_vertices(initial_vertices),
+              m_initial_elems(initial_elems),
+              m_vertex_buffer(0),
+              m_elem_buffer(0),
+              m_array_object(0),
+              m_vertex_space(initial_vertices),
+              m_elem_space(initial_elems),
+              m_ranges()
+        {
+            GLuint buffers[2];
+            glGenBuffers(2, buffers);
+            m_vertex_buffer = buffers[0];
+            m_elem_buffer = buffers[1];
+
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_vertex_buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, initial_vertices*m_vertex_size, nullptr, GL_STATIC_DRAW);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_elem_buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, initial_elems*sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+            glGenVertexArrays(1, &m_array_object);
+            setUpVertexArray();
+        }
+
+        BufferArena::~BufferArena() {
+            if (glIsVertexArray(m_array_object)) {
+                glDeleteVertexArrays(1, &m_array_object);
+            }
+            if (glIsBuffer(m_vertex_buffer)) {
+                glDeleteBuffers(1, &m_vertex_buffer);
+            }
+            if (glIsBuffer(m_elem_buffer)) {
+                glDeleteBuffers(1, &m_elem_buffer);
+            }
+        }
+
+        ArenaRange::sptr_type BufferArena::allocate(const void *vertices, std::size_t vertex_count,
+                                                    const GLuint *elems, std::size_t elem_count) {
+            std::size_t first_vertex = allocateFrom(m_vertex_space, m_vertex_buffer, m_vertex_size, vertex_count);
+            std::size_t first_elem = allocateFrom(m_elem_space, m_elem_buffer, sizeof(GLuint), elem_count);
+
+            // Upload through the copy target, so that the element
+            // buffer binding of whatever vertex array is bound
+            // doesn't change.
+            if (vertex_count > 0) {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, m_vertex_buffer);
+                glBufferSubData(GL_COPY_WRITE_BUFFER, first_vertex*m_vertex_size, vertex_count*m_vertex_size, vertices);
+            }
+            if (elem_count > 0) {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, m_elem_buffer);
+                glBufferSubData(GL_COPY_WRITE_BUFFER, first_elem*sizeof(GLuint), elem_count*sizeof(GLuint), elems);
+            }
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+            ArenaRange::sptr_type range = std::make_shared<ArenaRange>(shared_from_this(), first_vertex, vertex_count, first_elem, elem_count);
+            m_ranges.insert(range.get());
+            return range;
+        }
+
+        ArenaRange::sptr_type BufferArena::duplicate(const ArenaRange &range) {
+            std::size_t first_vertex = allocateFrom(m_vertex_space, m_vertex_buffer, m_vertex_size, range.vertex_count);
+            std::size_t first_elem = allocateFrom(m_elem_space, m_elem_buffer, sizeof(GLuint), range.elem_count);
+
+            // Copying within a buffer is fine, as long as the two
+            // ranges don't overlap, which they can't.
+            if (range.vertex_count > 0) {
+                glBindBuffer(GL_COPY_READ_BUFFER, m_vertex_buffer);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, m_vertex_buffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                    range.first_vertex*m_vertex_size, first_vertex*m_vertex_size,
+                                    range.vertex_count*m_vertex_size);
+            }
+            if (range.elem_count > 0) {
+                glBindBuffer(GL_COPY_READ_BUFFER, m_elem_buffer);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, m_elem_buffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                    range.first_elem*sizeof(GLuint), first_elem*sizeof(GLuint),
+                                    range.elem_count*sizeof(GLuint));
+            }
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+            ArenaRange::sptr_type copy = std::make_shared<ArenaRange>(shared_from_this(), first_vertex, range.vertex_count, first_elem, range.elem_count);
+            m_ranges.insert(copy.get());
+            return copy;
+        }
+
+        void BufferArena::updateVertices(const ArenaRange &range, std::size_t first, std::size_t count, const void *vertices) {
+            if (first >= range.vertex_count) {
+                return;
+            }
+            count = std::min(count, range.vertex_count - first);
+
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_vertex_buffer);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, (range.first_vertex + first)*m_vertex_size, count*m_vertex_size, vertices);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+
+        void BufferArena::release(ArenaRange &range) {
+            m_vertex_space.free(range.first_vertex, range.vertex_count);
+            m_elem_space.free(range.first_elem, range.elem_count);
+            m_ranges.erase(&range);
+        }
+
+        // Halve capacity for as long as used still fits, but not
+        // below minimum.
+        static std::size_t shrunkCapacity(std::size_t capacity, std::size_t used, std::size_t minimum) {
+            while (capacity/2 >= std::max(used, minimum)) {
+                capacity /= 2;
+            }
+            return capacity;
+        }
+
+        std::size_t BufferArena::gpuBytes() const {
+            return m_vertex_space.capacity()*m_vertex_size + m_elem_space.capacity()*sizeof(GLuint);
+        }
+
+        std::size_t BufferArena::compactedBytes() const {
+            return shrunkCapacity(m_vertex_space.capacity(), m_vertex_space.used(), m_initial_vertices)*m_vertex_size
+                + shrunkCapacity(m_elem_space.capacity(), m_elem_space.used(), m_initial_elems)*sizeof(GLuint);
+        }
+
+        void BufferArena::compact() {
+            const std::size_t vertex_capacity = shrunkCapacity(m_vertex_space.capacity(), m_vertex_space.used(), m_initial_vertices);
+            const std::size_t elem_capacity = shrunkCapacity(m_elem_space.capacity(), m_elem_space.used(), m_initial_elems);
+            if (vertex_capacity == m_vertex_space.capacity() && elem_capacity == m_elem_space.capacity()
+                && m_vertex_space.packed() && m_elem_space.packed()) {
+                return;
+            }
+
+            GLuint buffers[2];
+            glGenBuffers(2, buffers);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[0]);
+            glBufferData(GL_COPY_WRITE_BUFFER, vertex_capacity*m_vertex_size, nullptr, GL_STATIC_DRAW);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[1]);
+            glBufferData(GL_COPY_WRITE_BUFFER, elem_capacity*sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+
+            // Keep the ranges in the order they're in, one after the
+            // other. The elements are relative to the base vertex,
+            // so they don't need to change.
+            std::vector<ArenaRange*> ranges(m_ranges.begin(), m_ranges.end());
+            std::sort(ranges.begin(), ranges.end(), [](const ArenaRange *a, const ArenaRange *b) {
+                    return a->first_vertex < b->first_vertex;
+                });
+
+            std::size_t next_vertex = 0, next_elem = 0;
+            glBindBuffer(GL_COPY_READ_BUFFER, m_vertex_buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[0]);
+            for (ArenaRange *range : ranges) {
+                if (range->vertex_count > 0) {
+                    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                        range->first_vertex*m_vertex_size, next_vertex*m_vertex_size,
+                                        range->vertex_count*m_vertex_size);
+                }
+                range->first_vertex = range->vertex_count > 0 ? next_vertex : 0;
+                next_vertex += range->vertex_count;
+            }
+            glBindBuffer(GL_COPY_READ_BUFFER, m_elem_buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[1]);
+            for (ArenaRange *range : ranges) {
+                if (range->elem_count > 0) {
+                    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                        range->first_elem*sizeof(GLuint), next_elem*sizeof(GLuint),
+                                        range->elem_count*sizeof(GLuint));
+                }
+                range->first_elem = range->elem_count > 0 ? next_elem : 0;
+                next_elem += range->elem_count;
+            }
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+            glDeleteBuffers(1, &m_vertex_buffer);
+            glDeleteBuffers(1, &m_elem_buffer);
+            m_vertex_buffer = buffers[0];
+            m_elem_buffer = buffers[1];
+
+            // Everything that's in use is at the start now.
+            m_vertex_space = RangeAllocator(vertex_capacity);
+            m_vertex_space.allocate(next_vertex);
+            m_elem_space = RangeAllocator(elem_capacity);
+            m_elem_space.allocate(next_elem);
+
+            setUpVertexArray();
+        }
+
+        std::size_t BufferArena::allocateFrom(RangeAllocator &space, GLuint &buffer, std::size_t unit_size, std::size_t count) {
+            std::size_t offset = space.allocate(count);
+            if (offset != RangeAllocator::NONE) {
+                return offset;
+            }
+
+            // Out of room: double the buffer, copying what's there
+            // over on the GPU.
+            std::size_t old_capacity = space.capacity();
+            std::size_t new_capacity = std::max(2*old_capacity, old_capacity + count);
+            GLuint new_buffer = 0;
+            glGenBuffers(1, &new_buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, new_buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, new_capacity*unit_size, nullptr, GL_STATIC_DRAW);
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, old_capacity*unit_size);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            glDeleteBuffers(1, &buffer);
+            buffer = new_buffer;
+
+            space.grow(new_capacity);
+            setUpVertexArray();
+            return space.allocate(count);
+        }
+
+        void BufferArena::setUpVertexArray() {
+            const IndexMap &locations = standardAttributeLocations();
+
+            glBindVertexArray(m_array_object);
+            glBindBuffer(GL_ARRAY_BUFFER, m_vertex_buffer);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_elem_buffer);
+            for (auto &&attr : m_format) {
+                auto location = locations.find(attr.first);
+                if (location == locations.end()) {
+                    continue;
+                }
+
+                glEnableVertexAttribArray(location->second);
+                glVertexAttribPointer(
+                    location->second,
+                    attr.second.count,
+                    attr.second.type,
+                    attr.second.normalized,
+                    (GLsizei)m_vertex_size,
+                    attr.second.offset);
+            }
+
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        }
+
+        // Class BufferArenas.
+        BufferArenas::BufferArenas(std::size_t initial_vertices, std::size_t initial_elems)
+            : m_initial_vertices(initial_vertices),
+              m_initial_elems(initial_elems),
+              m_arenas()
+        {}
+
+        std::size_t BufferArenas::gpuBytes() const {
+            std::size_t total = 0;
+            for (auto &&arena : m_arenas) {
+                total += arena.second->gpuBytes();
+            }
+            return total;
+        }
+
+        std::size_t BufferArenas::compactedBytes() const {
+            std::size_t total = 0;
+            for (auto &&arena : m_arenas) {
+                total += arena.second->compactedBytes();
+            }
+            return total;
+        }
+
+        void BufferArenas::compact() {
+            for (auto &&arena : m_arenas) {
+                arena.second->compact();
+            }
+        }
+    }
+}
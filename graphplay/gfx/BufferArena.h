@@ -0,0 +1,176 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_BUFFER_ARENA_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_BUFFER_ARENA_H_
+
+#include "../graphplay.h"
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <set>
+
+#include "../opengl.h"
+#include "VertexFormat.h"
+
+namespace graphplay {
+    namespace gfx {
+        // Hands out ranges of a space of capacity units (vertices,
+        // elements...) from a list of free blocks. Allocations take
+        // the smallest free block they fit in, and freed blocks are
+        // merged with the free blocks on either side of them.
+        class RangeAllocator {
+        public:
+            static const std::size_t NONE = ~std::size_t(0);
+
+            RangeAllocator(std::size_t capacity = 0);
+
+            // The offset of a free range of size units, or NONE if
+            // there isn't one. Zero-size ranges are all at 0.
+            std::size_t allocate(std::size_t size);
+            void free(std::size_t offset, std::size_t size);
+
+            // Add free space at the end.
+            void grow(std::size_t new_capacity);
+
+            inline std::size_t capacity() const { return m_capacity; }
+            inline std::size_t used() const { return m_used; }
+            std::size_t largestFree() const;
+            inline std::size_t freeBlocks() const { return m_free_by_offset.size(); }
+            // Whether the free space is all in one block at the end.
+            bool packed() const;
+
+        private:
+            void addFree(std::size_t offset, std::size_t size);
+            void removeFree(std::map<std::size_t, std::size_t>::iterator block);
+
+            std::size_t m_capacity, m_used;
+            std::map<std::size_t, std::size_t> m_free_by_offset;
+            std::multimap<std::size_t, std::size_t> m_free_by_size;
+        };
+
+        class BufferArena;
+
+        // A geometry's vertices and elements inside a BufferArena.
+        // The elements are relative to first_vertex, so they're drawn
+        // with it as the base vertex. The range is given back to the
+        // arena when the last reference to it goes away.
+        struct ArenaRange {
+            typedef std::shared_ptr<ArenaRange> sptr_type;
+
+            ArenaRange(std::shared_ptr<BufferArena> arena,
+                       std::size_t first_vertex, std::size_t vertex_count,
+                       std::size_t first_elem, std::size_t elem_count);
+            ArenaRange(const ArenaRange &other) = delete;
+            ArenaRange& operator=(const ArenaRange &other) = delete;
+            ~ArenaRange();
+
+            std::shared_ptr<BufferArena> arena;
+            std::size_t first_vertex, vertex_count;
+            std::size_t first_elem, elem_count;
+        };
+
+        // One big vertex buffer and one big element buffer for
+        // every geometry with a particular vertex format, and a
+        // single vertex array for drawing any of them. The vertex
+        // array uses the standard attribute locations, so it works
+        // with every program. Elements are always 32 bits.
+        //
+        // The buffers double in size (copying on the GPU) when they
+        // run out of room, and compact() packs the ranges down and
+        // halves them again once enough has been freed. The vertex
+        // array stays the same, but the buffer ids and the ranges'
+        // offsets change, so ask for them rather than keeping them.
+        class BufferArena : public std::enable_shared_from_this<BufferArena> {
+        public:
+            typedef std::shared_ptr<BufferArena> sptr_type;
+
+            static const std::size_t INITIAL_VERTICES = 1 << 16;
+            static const std::size_t INITIAL_ELEMS = 1 << 18;
+
+            BufferArena(const AttrMap &format, std::size_t vertex_size,
+                        std::size_t initial_vertices = INITIAL_VERTICES,
+                        std::size_t initial_elems = INITIAL_ELEMS);
+            BufferArena(const BufferArena &other) = delete;
+            BufferArena& operator=(const BufferArena &other) = delete;
+            ~BufferArena();
+
+            // Copy vertices and elements into the arena.
+            ArenaRange::sptr_type allocate(const void *vertices, std::size_t vertex_count,
+                                           const GLuint *elems, std::size_t elem_count);
+
+            // A new range with the same contents as range, copied on
+            // the GPU.
+            ArenaRange::sptr_type duplicate(const ArenaRange &range);
+
+            // Overwrite vertices [first, first + count) of range.
+            void updateVertices(const ArenaRange &range, std::size_t first, std::size_t count, const void *vertices);
+
+            // How much the buffers take up on the GPU, and how much
+            // they would after compact().
+            std::size_t gpuBytes() const;
+            std::size_t compactedBytes() const;
+
+            // Move the ranges down to the start of the buffers, if
+            // there are holes between them, and shrink the buffers if
+            // they're less than half full (but never below the size
+            // they started out at).
+            void compact();
+
+            inline const AttrMap& format() const { return m_format; }
+            inline std::size_t vertexSize() const { return m_vertex_size; }
+            inline GLuint vertexBufferId() const { return m_vertex_buffer; }
+            inline GLuint elemBufferId() const { return m_elem_buffer; }
+            inline GLuint vertexArrayObjectId() const { return m_array_object; }
+            inline const RangeAllocator& vertexSpace() const { return m_vertex_space; }
+            inline const RangeAllocator& elemSpace() const { return m_elem_space; }
+
+        private:
+            friend struct ArenaRange;
+            void release(ArenaRange &range);
+
+            std::size_t allocateFrom(RangeAllocator &space, GLuint &buffer, std::size_t unit_size, std::size_t count);
+            void setUpVertexArray();
+
+            AttrMap m_format;
+            std::size_t m_vertex_size;
+            std::size_t m_initial_vertices, m_initial_elems;
+            GLuint m_vertex_buffer, m_elem_buffer, m_array_object;
+            RangeAllocator m_vertex_space, m_elem_space;
+            // Every range that hasn't been released, for compact()
+            // to move.
+            std::set<ArenaRange*> m_ranges;
+        };
+
+        // An arena for each vertex format, made when it's first
+        // needed, starting out with room for initial_vertices and
+        // initial_elems.
+        class BufferArenas {
+        public:
+            BufferArenas(std::size_t initial_vertices = BufferArena::INITIAL_VERTICES,
+                         std::size_t initial_elems = BufferArena::INITIAL_ELEMS);
+
+            template <typename V>
+            BufferArena::sptr_type arenaFor() {
+                BufferArena::sptr_type &arena = m_arenas[&V::description];
+                if (!arena) {
+                    arena = std::make_shared<BufferArena>(V::description, sizeof(V), m_initial_vertices, m_initial_elems);
+                }
+                return arena;
+            }
+
+            inline std::size_t size() const { return m_arenas.size(); }
+
+            // All the arenas together.
+            std::size_t gpuBytes() const;
+            std::size_t compactedBytes() const;
+            void compact();
+
+        private:
+            std::size_t m_initial_vertices, m_initial_elems;
+            std::map<const AttrMap*, BufferArena::sptr_type> m_arenas;
+        };
+    }
+}
+
+#endif
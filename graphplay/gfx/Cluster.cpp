@@ -0,0 +1,218 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../graphplay.h"
+#include "Cluster.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "../Parallel.h"
+#include "Frustum.h"
+#include "MeshAdjacency.h"
+
+namespace graphplay {
+    namespace gfx {
+        static const unsigned int NO_CLUSTER = 0xFFFFFFFF;
+        static const unsigned int NO_FACE = 0xFFFFFFFF;
+        static const std::size_t MIN_CLUSTER_CHUNK = 64;
+        static const std::size_t MIN_FACE_CHUNK = 1 << 14;
+        static const float DIST_WEIGHT = 2.0f;
+        static const float CONE_WEIGHT = 2.0f;
+
+        // The unit normal of the face starting at elems[first], or
+        // zero if it's degenerate.
+        static glm::vec3 faceNormal(
+            const std::vector<GLuint> &elems, const std::vector<glm::vec3> &positions,
+            std::size_t first)
+        {
+            const glm::vec3 &p0 = positions[elems[first]];
+            glm::vec3 n = glm::cross(positions[elems[first + 1]] - p0, positions[elems[first + 2]] - p0);
+            float len = glm::length(n);
+            return len > 0.0f ? n / len : glm::vec3(0.0f);
+        }
+
+        static void clusterBounds(
+            Cluster &cluster, const std::vector<GLuint> &elems,
+            const std::vector<glm::vec3> &positions)
+        {
+            const GLuint last = cluster.first_elem + cluster.elem_count;
+
+            glm::vec3 lo = positions[elems[cluster.first_elem]], hi = lo;
+            for (GLuint i = cluster.first_elem; i < last; ++i) {
+                lo = glm::min(lo, positions[elems[i]]);
+                hi = glm::max(hi, positions[elems[i]]);
+            }
+
+            cluster.center = (lo + hi) * 0.5f;
+            cluster.radius = 0.0f;
+            for (GLuint i = cluster.first_elem; i < last; ++i) {
+                cluster.radius = std::max(cluster.radius, glm::length(positions[elems[i]] - cluster.center));
+            }
+
+            std::vector<glm::vec3> normals;
+            glm::vec3 sum(0.0f);
+            for (GLuint i = cluster.first_elem; i < last; i += 3) {
+                glm::vec3 n = faceNormal(elems, positions, i);
+                if (n != glm::vec3(0.0f)) {
+                    normals.push_back(n);
+                    sum += n;
+                }
+            }
+
+            // Fall back to a cone that never culls if the normals are
+            // spread over more than a hemisphere (or there aren't any).
+            cluster.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+            cluster.cone_cutoff = 1.0f;
+            float sum_len = glm::length(sum);
+            if (sum_len > 0.0f) {
+                cluster.cone_axis = sum / sum_len;
+
+                float min_dot = 1.0f;
+                for (auto &&n : normals) {
+                    min_dot = std::min(min_dot, glm::dot(cluster.cone_axis, n));
+                }
+
+                if (min_dot > 0.1f) {
+                    cluster.cone_cutoff = std::sqrt(1.0f - min_dot*min_dot);
+                }
+            }
+        }
+
+        ClusterList clusterTriangles(std::vector<GLuint> &elems, const std::vector<glm::vec3> &positions) {
+            const std::size_t num_faces = elems.size() / 3;
+            const std::size_t num_verts = positions.size();
+            VertexCorners vc = buildVertexCorners(elems, num_verts);
+
+            std::vector<bool> used(num_faces, false);
+            for (std::size_t f = 0; f < num_faces; ++f) {
+                used[f] = elems[3*f] >= num_verts || elems[3*f + 1] >= num_verts || elems[3*f + 2] >= num_verts;
+            }
+
+            std::vector<glm::vec3> face_normals(num_faces, glm::vec3(0.0f));
+            parallelFor(num_faces, MIN_FACE_CHUNK, [&](std::size_t f) {
+                    if (!used[f]) {
+                        face_normals[f] = faceNormal(elems, positions, 3*f);
+                    }
+                });
+
+            // The last cluster each vertex was added to, so we can
+            // tell how many new vertices a face would bring along.
+            std::vector<unsigned int> vert_cluster(num_verts, NO_CLUSTER);
+            std::vector<GLuint> cluster_verts;
+            std::vector<GLuint> new_elems;
+            new_elems.reserve(elems.size());
+            ClusterList rv;
+
+            std::size_t seed = 0;
+            while (true) {
+                while (seed < num_faces && used[seed]) {
+                    ++seed;
+                }
+                if (seed == num_faces) {
+                    break;
+                }
+
+                const unsigned int id = static_cast<unsigned int>(rv.size());
+                Cluster cluster;
+                cluster.first_elem = static_cast<GLuint>(new_elems.size());
+                cluster_verts.clear();
+
+                glm::vec3 normal_sum(0.0f), position_sum(0.0f);
+                unsigned int num_tris = 0;
+                unsigned int face = static_cast<unsigned int>(seed);
+                while (face != NO_FACE) {
+                    used[face] = true;
+                    normal_sum += face_normals[face];
+                    ++num_tris;
+                    for (unsigned int k = 0; k < 3; ++k) {
+                        GLuint v = elems[3*face + k];
+                        new_elems.push_back(v);
+                        if (vert_cluster[v] != id) {
+                            vert_cluster[v] = id;
+                            cluster_verts.push_back(v);
+                            position_sum += positions[v];
+                        }
+                    }
+
+                    if (num_tris == MAX_CLUSTER_TRIANGLES) {
+                        break;
+                    }
+
+                    // Grow into the neighboring face with the lowest
+                    // score. Every new vertex costs one, and faces
+                    // that are far from the middle of the cluster or
+                    // turned away from the rest of it cost up to
+                    // DIST_WEIGHT and CONE_WEIGHT more, so clusters
+                    // stay round and their normal cones stay narrow.
+                    glm::vec3 centroid = position_sum / static_cast<float>(cluster_verts.size());
+                    float spread = 0.0f;
+                    for (auto &&cv : cluster_verts) {
+                        spread = std::max(spread, glm::length(positions[cv] - centroid));
+                    }
+                    if (spread == 0.0f) {
+                        spread = 1.0f;
+                    }
+
+                    float normal_len = glm::length(normal_sum);
+                    glm::vec3 axis = normal_len > 0.0f ? normal_sum / normal_len : glm::vec3(0.0f);
+
+                    face = NO_FACE;
+                    float best_score = 0.0f;
+                    for (std::size_t i = 0; i < cluster_verts.size(); ++i) {
+                        GLuint v = cluster_verts[i];
+                        for (unsigned int j = vc.begin(v); j < vc.end(v); ++j) {
+                            unsigned int f = vc.corners[j] / 3;
+                            if (used[f]) {
+                                continue;
+                            }
+
+                            unsigned int num_new = 0;
+                            for (unsigned int k = 0; k < 3; ++k) {
+                                if (vert_cluster[elems[3*f + k]] != id) {
+                                    ++num_new;
+                                }
+                            }
+
+                            if (cluster_verts.size() + num_new > MAX_CLUSTER_VERTICES) {
+                                continue;
+                            }
+
+                            glm::vec3 middle = (positions[elems[3*f]] + positions[elems[3*f + 1]] + positions[elems[3*f + 2]]) / 3.0f;
+                            float score = num_new
+                                + DIST_WEIGHT*glm::length(middle - centroid) / spread
+                                + CONE_WEIGHT*(1.0f - glm::dot(face_normals[f], axis)) / 2.0f;
+                            if (face == NO_FACE || score < best_score) {
+                                face = f;
+                                best_score = score;
+                            }
+                        }
+                    }
+                }
+
+                cluster.elem_count = static_cast<GLsizei>(new_elems.size() - cluster.first_elem);
+                rv.push_back(cluster);
+            }
+
+            elems = std::move(new_elems);
+
+            parallelFor(rv.size(), MIN_CLUSTER_CHUNK, [&](std::size_t c) {
+                    clusterBounds(rv[c], elems, positions);
+                });
+
+            return rv;
+        }
+
+        bool clusterVisible(const Cluster &cluster, const Frustum &frustum, const glm::vec3 &eye) {
+            if (!frustum.intersectsSphere(cluster.center, cluster.radius)) {
+                return false;
+            }
+
+            // Every face is back-facing if the whole bounding sphere is
+            // behind every plane the normal cone allows.
+            glm::vec3 to_center = cluster.center - eye;
+            return glm::dot(to_center, cluster.cone_axis) < cluster.cone_cutoff*glm::length(to_center) + cluster.radius;
+        }
+    }
+}
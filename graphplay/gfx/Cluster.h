@@ -0,0 +1,64 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_CLUSTER_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_CLUSTER_H_
+
+#include "../graphplay.h"
+
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "../opengl.h"
+
+namespace graphplay {
+    namespace gfx {
+        class Frustum;
+
+#ifdef MSVC
+        const
+#else
+        constexpr
+#endif
+        unsigned int MAX_CLUSTER_VERTICES = 64;
+
+#ifdef MSVC
+        const
+#else
+        constexpr
+#endif
+        unsigned int MAX_CLUSTER_TRIANGLES = 124;
+
+        // A run of connected triangles in a geometry's element array,
+        // small enough to be culled as a unit.
+        struct Cluster {
+            GLuint first_elem;
+            GLsizei elem_count;
+
+            // The bounding sphere of the cluster's vertices.
+            glm::vec3 center;
+            float radius;
+
+            // All of the cluster's face normals are within the cone
+            // around cone_axis. cone_cutoff is the sine of the cone's
+            // half-angle, or 1 if the cone is too wide to cull with.
+            glm::vec3 cone_axis;
+            float cone_cutoff;
+        };
+
+        typedef std::vector<Cluster> ClusterList;
+
+        // Reorder the triangles in elems so that they're grouped into
+        // clusters of at most MAX_CLUSTER_VERTICES vertices and
+        // MAX_CLUSTER_TRIANGLES triangles, and return the clusters.
+        // Triangles that refer past the end of positions are dropped.
+        ClusterList clusterTriangles(std::vector<GLuint> &elems, const std::vector<glm::vec3> &positions);
+
+        // Whether any part of the cluster might be visible. Both the
+        // frustum and the eye position need to be in the same (model)
+        // space as the cluster.
+        bool clusterVisible(const Cluster &cluster, const Frustum &frustum, const glm::vec3 &eye);
+    }
+}
+
+#endif
@@ -0,0 +1,473 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../graphplay.h"
+#include "DistanceField.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+#include <glm/glm.hpp>
+
+#include "../Parallel.h"
+#include "TriangleBVH.h"
+
+namespace graphplay {
+    namespace gfx {
+        const unsigned int DistanceField::BAND_CELLS;
+        const unsigned int DistanceField::PADDING_CELLS;
+
+        static const std::uint8_t MAGIC[4] = { 'G', 'P', 'S', 'D' };
+        static const std::uint32_t FORMAT_VERSION = 1;
+        static const std::size_t HEADER_SIZE = 4 + 11*4;
+        static const unsigned int BRICK_SIZE = 4;
+        static const float INFINITE_DISTANCE = std::numeric_limits<float>::infinity();
+
+        // Where grid points that haven't found the surface yet think
+        // it is. Far enough away that anything is closer, but not so
+        // far that its distance squared overflows.
+        static const float NO_SEED = 1.0e15f;
+
+        static inline void putU32(ByteArray &out, std::uint32_t v) {
+            for (unsigned int b = 0; b < 4; ++b) {
+                out.push_back(static_cast<std::uint8_t>(v >> 8*b));
+            }
+        }
+
+        static inline void putFloat(ByteArray &out, float f) {
+            std::uint32_t v;
+            std::memcpy(&v, &f, 4);
+            putU32(out, v);
+        }
+
+        static inline std::uint32_t getU32(const std::uint8_t *p) {
+            return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+        }
+
+        static inline float getFloat(const std::uint8_t *p) {
+            std::uint32_t v = getU32(p);
+            float f;
+            std::memcpy(&f, &v, 4);
+            return f;
+        }
+
+        static inline float distanceSquared(const glm::vec3 &a, const glm::vec3 &b) {
+            float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+            return dx*dx + dy*dy + dz*dz;
+        }
+
+        DistanceField::DistanceField()
+            : m_bounds(),
+              m_cell_size(0.0f),
+              m_resolution(0),
+              m_source_hash(0),
+              m_values()
+        {
+            m_dims[0] = m_dims[1] = m_dims[2] = 0;
+        }
+
+        std::uint32_t DistanceField::hashMeshData(const std::vector<GLuint> &elems, const std::vector<glm::vec3> &positions) {
+            // FNV-1a.
+            std::uint32_t hash = 2166136261u;
+            auto add = [&hash](const void *data, std::size_t size) {
+                const std::uint8_t *bytes = static_cast<const std::uint8_t*>(data);
+                for (std::size_t i = 0; i < size; ++i) {
+                    hash = (hash ^ bytes[i])*16777619u;
+                }
+            };
+
+            for (std::size_t i = 0; i < positions.size(); ++i) {
+                float p[3] = { positions[i].x, positions[i].y, positions[i].z };
+                add(p, sizeof(p));
+            }
+            if (!elems.empty()) {
+                add(elems.data(), elems.size()*sizeof(GLuint));
+            }
+            return hash;
+        }
+
+        void DistanceField::bake(const std::vector<GLuint> &elems, const std::vector<glm::vec3> &positions, unsigned int resolution) {
+            *this = DistanceField();
+            m_source_hash = hashMeshData(elems, positions);
+            m_resolution = resolution;
+
+            TriangleBVH bvh(elems, positions);
+            if (bvh.empty() || resolution == 0) {
+                return;
+            }
+
+            const fzx::BBox mesh_bounds = bvh.bounds();
+            const glm::vec3 extent = mesh_bounds.max - mesh_bounds.min;
+            const float longest = std::max(extent.x, std::max(extent.y, extent.z));
+            if (!(longest > 0.0f)) {
+                return;
+            }
+
+            const float h = longest / resolution;
+            m_cell_size = h;
+            for (unsigned int a = 0; a < 3; ++a) {
+                m_dims[a] = static_cast<unsigned int>(std::ceil(extent[a] / h)) + 1 + 2*PADDING_CELLS;
+            }
+            m_bounds.min = mesh_bounds.min - glm::vec3(PADDING_CELLS*h);
+            m_bounds.max = m_bounds.min + h*glm::vec3(m_dims[0] - 1.0f, m_dims[1] - 1.0f, m_dims[2] - 1.0f);
+
+            const unsigned int dx = m_dims[0], dy = m_dims[1], dz = m_dims[2];
+            const std::size_t num_points = static_cast<std::size_t>(dx)*dy*dz;
+            const glm::vec3 origin = m_bounds.min;
+            auto pointAt = [origin, h](unsigned int x, unsigned int y, unsigned int z) {
+                return glm::vec3(origin.x + h*x, origin.y + h*y, origin.z + h*z);
+            };
+
+            // The exact band: only look at points in bricks that have
+            // some triangle near them.
+            const float band = BAND_CELLS*h;
+            std::vector<glm::vec3> seeds(num_points, glm::vec3(NO_SEED));
+            std::vector<std::uint8_t> exact(num_points, 0);
+            const unsigned int bricks[3] = {
+                (dx + BRICK_SIZE - 1) / BRICK_SIZE,
+                (dy + BRICK_SIZE - 1) / BRICK_SIZE,
+                (dz + BRICK_SIZE - 1) / BRICK_SIZE,
+            };
+            parallelFor(static_cast<std::size_t>(bricks[0])*bricks[1]*bricks[2], 16, [&](std::size_t b) {
+                    const unsigned int lo[3] = {
+                        static_cast<unsigned int>(b % bricks[0])*BRICK_SIZE,
+                        static_cast<unsigned int>((b / bricks[0]) % bricks[1])*BRICK_SIZE,
+                        static_cast<unsigned int>(b / (bricks[0]*bricks[1]))*BRICK_SIZE,
+                    };
+                    const unsigned int hi[3] = {
+                        std::min(lo[0] + BRICK_SIZE, dx),
+                        std::min(lo[1] + BRICK_SIZE, dy),
+                        std::min(lo[2] + BRICK_SIZE, dz),
+                    };
+
+                    std::vector<GLuint> faces;
+                    fzx::BBox box(pointAt(lo[0], lo[1], lo[2]) - glm::vec3(band), pointAt(hi[0] - 1, hi[1] - 1, hi[2] - 1) + glm::vec3(band));
+                    if (bvh.overlapBox(box, faces) == 0) {
+                        return;
+                    }
+
+                    for (unsigned int z = lo[2]; z < hi[2]; ++z) {
+                        for (unsigned int y = lo[1]; y < hi[1]; ++y) {
+                            for (unsigned int x = lo[0]; x < hi[0]; ++x) {
+                                ClosestPoint closest;
+                                if (bvh.closestPoint(pointAt(x, y, z), closest, band)) {
+                                    std::size_t i = (static_cast<std::size_t>(z)*dy + y)*dx + x;
+                                    seeds[i] = closest.point;
+                                    exact[i] = 1;
+                                }
+                            }
+                        }
+                    }
+                });
+
+            // Jump flood the band's surface points out to everything
+            // else, with halving steps and one more pass of step 1 at
+            // the end to clean up.
+            std::vector<unsigned int> steps;
+            unsigned int step = 1;
+            while (2*step < std::max(dx, std::max(dy, dz))) {
+                step *= 2;
+            }
+            for (; step >= 1; step /= 2) {
+                steps.push_back(step);
+            }
+            steps.push_back(1);
+
+            // The neighbors at offsets -k, 0 and k along an axis that
+            // are inside the grid.
+            auto neighbors = [](unsigned int c, int k, unsigned int size, unsigned int *out) {
+                unsigned int n = 0;
+                if (c >= static_cast<unsigned int>(k)) {
+                    out[n++] = c - k;
+                }
+                out[n++] = c;
+                if (c + k < size) {
+                    out[n++] = c + k;
+                }
+                return n;
+            };
+
+            std::vector<glm::vec3> next_seeds(seeds);
+            for (unsigned int s : steps) {
+                const int k = static_cast<int>(s);
+                parallelFor(dz, 1, [&](std::size_t z) {
+                        unsigned int zs[3], ys[3], xs[3];
+                        const unsigned int nzs = neighbors(static_cast<unsigned int>(z), k, dz, zs);
+                        for (unsigned int y = 0; y < dy; ++y) {
+                            const unsigned int nys = neighbors(y, k, dy, ys);
+                            for (unsigned int x = 0; x < dx; ++x) {
+                                const std::size_t i = (z*dy + y)*dx + x;
+                                if (exact[i]) {
+                                    next_seeds[i] = seeds[i];
+                                    continue;
+                                }
+
+                                // Points without a seed yet have one
+                                // so far away that anything beats it.
+                                const glm::vec3 p = pointAt(x, y, static_cast<unsigned int>(z));
+                                const unsigned int nxs = neighbors(x, k, dx, xs);
+                                std::size_t best_i = i;
+                                float best = distanceSquared(p, seeds[i]);
+                                for (unsigned int a = 0; a < nzs; ++a) {
+                                    for (unsigned int b = 0; b < nys; ++b) {
+                                        const std::size_t row = (static_cast<std::size_t>(zs[a])*dy + ys[b])*dx;
+                                        for (unsigned int c = 0; c < nxs; ++c) {
+                                            const float d = distanceSquared(p, seeds[row + xs[c]]);
+                                            if (d < best) {
+                                                best = d;
+                                                best_i = row + xs[c];
+                                            }
+                                        }
+                                    }
+                                }
+                                next_seeds[i] = seeds[best_i];
+                            }
+                        }
+                    });
+                seeds.swap(next_seeds);
+            }
+
+            // Count how many of the three axis-aligned rays through
+            // each point say it's inside. The rays are nudged off the
+            // grid lines a little, so they're less likely to go right
+            // through the edges and corners of axis-aligned meshes.
+            std::vector<std::uint8_t> inside_votes(num_points, 0);
+            const float nudge = 1.0e-3f*h, skip = 1.0e-4f*h;
+            for (unsigned int a = 0; a < 3; ++a) {
+                const unsigned int b = (a + 1) % 3, c = (a + 2) % 3;
+                parallelFor(static_cast<std::size_t>(m_dims[b])*m_dims[c], 64, [&](std::size_t row) {
+                        unsigned int coords[3];
+                        coords[a] = 0;
+                        coords[b] = static_cast<unsigned int>(row % m_dims[b]);
+                        coords[c] = static_cast<unsigned int>(row / m_dims[b]);
+
+                        glm::vec3 start = pointAt(coords[0], coords[1], coords[2]), direction(0.0f);
+                        start[a] -= h;
+                        start[b] += nudge;
+                        start[c] += 0.7f*nudge;
+                        direction[a] = 1.0f;
+
+                        // All the crossings along the row, nearest
+                        // first.
+                        std::vector<float> crossings;
+                        glm::vec3 from = start;
+                        RayHit hit;
+                        while (bvh.raycast(from, direction, hit)) {
+                            from[a] += hit.t;
+                            crossings.push_back(from[a]);
+                            from[a] += skip;
+                        }
+
+                        std::size_t crossed = 0;
+                        for (unsigned int i = 0; i < m_dims[a]; ++i) {
+                            coords[a] = i;
+                            float at = origin[a] + h*i;
+                            while (crossed < crossings.size() && crossings[crossed] < at) {
+                                ++crossed;
+                            }
+                            if (crossed % 2 == 1) {
+                                ++inside_votes[(static_cast<std::size_t>(coords[2])*dy + coords[1])*dx + coords[0]];
+                            }
+                        }
+                    });
+            }
+
+            m_values.resize(num_points);
+            parallelFor(dz, 1, [&](std::size_t z) {
+                    for (unsigned int y = 0; y < dy; ++y) {
+                        for (unsigned int x = 0; x < dx; ++x) {
+                            const std::size_t i = (z*dy + y)*dx + x;
+                            float d = seeds[i].x == NO_SEED ? INFINITE_DISTANCE : std::sqrt(distanceSquared(pointAt(x, y, static_cast<unsigned int>(z)), seeds[i]));
+                            m_values[i] = inside_votes[i] >= 2 ? -d : d;
+                        }
+                    }
+                });
+        }
+
+        // Find the cell containing point (clamped to the grid), the
+        // point's position within it, and how far outside the grid it
+        // was.
+        struct CellSample {
+            std::size_t corner;
+            float f[3];
+            glm::vec3 outside;
+        };
+
+        static CellSample findCell(const glm::vec3 &point, const fzx::BBox &bounds, float h, const unsigned int *dims) {
+            CellSample rv;
+            glm::vec3 clamped = glm::clamp(point, bounds.min, bounds.max);
+            rv.outside = point - clamped;
+
+            unsigned int cell[3];
+            for (unsigned int a = 0; a < 3; ++a) {
+                float u = (clamped[a] - bounds.min[a]) / h;
+                cell[a] = std::min(static_cast<unsigned int>(u), dims[a] - 2);
+                rv.f[a] = std::min(std::max(u - cell[a], 0.0f), 1.0f);
+            }
+            rv.corner = (static_cast<std::size_t>(cell[2])*dims[1] + cell[1])*dims[0] + cell[0];
+            return rv;
+        }
+
+        float DistanceField::distance(const glm::vec3 &point) const {
+            if (empty()) {
+                return INFINITE_DISTANCE;
+            }
+
+            const CellSample s = findCell(point, m_bounds, m_cell_size, m_dims);
+            const std::size_t sy = m_dims[0], sz = static_cast<std::size_t>(m_dims[0])*m_dims[1];
+            const float *v = &m_values[s.corner];
+            float x00 = v[0] + s.f[0]*(v[1] - v[0]);
+            float x10 = v[sy] + s.f[0]*(v[sy + 1] - v[sy]);
+            float x01 = v[sz] + s.f[0]*(v[sz + 1] - v[sz]);
+            float x11 = v[sz + sy] + s.f[0]*(v[sz + sy + 1] - v[sz + sy]);
+            float y0 = x00 + s.f[1]*(x10 - x00), y1 = x01 + s.f[1]*(x11 - x01);
+            return y0 + s.f[2]*(y1 - y0) + glm::length(s.outside);
+        }
+
+        glm::vec3 DistanceField::gradient(const glm::vec3 &point) const {
+            if (empty()) {
+                return glm::vec3(0.0f);
+            }
+
+            const CellSample s = findCell(point, m_bounds, m_cell_size, m_dims);
+            if (glm::length(s.outside) > 0.0f) {
+                return glm::normalize(s.outside);
+            }
+
+            // The derivative of the trilinear interpolation.
+            const std::size_t sy = m_dims[0], sz = static_cast<std::size_t>(m_dims[0])*m_dims[1];
+            const float *v = &m_values[s.corner];
+            const float c000 = v[0], c100 = v[1], c010 = v[sy], c110 = v[sy + 1];
+            const float c001 = v[sz], c101 = v[sz + 1], c011 = v[sz + sy], c111 = v[sz + sy + 1];
+            const float fx = s.f[0], fy = s.f[1], fz = s.f[2];
+
+            float gx =
+                (1 - fy)*(1 - fz)*(c100 - c000) + fy*(1 - fz)*(c110 - c010) +
+                (1 - fy)*fz*(c101 - c001) + fy*fz*(c111 - c011);
+            float gy =
+                (1 - fx)*(1 - fz)*(c010 - c000) + fx*(1 - fz)*(c110 - c100) +
+                (1 - fx)*fz*(c011 - c001) + fx*fz*(c111 - c101);
+            float gz =
+                (1 - fx)*(1 - fy)*(c001 - c000) + fx*(1 - fy)*(c101 - c100) +
+                (1 - fx)*fy*(c011 - c010) + fx*fy*(c111 - c110);
+            return glm::vec3(gx, gy, gz) / m_cell_size;
+        }
+
+        ByteArray DistanceField::encode() const {
+            ByteArray rv(MAGIC, MAGIC + 4);
+            putU32(rv, FORMAT_VERSION);
+            putU32(rv, m_source_hash);
+            putU32(rv, m_resolution);
+            for (unsigned int a = 0; a < 3; ++a) {
+                putU32(rv, m_dims[a]);
+            }
+            putFloat(rv, m_bounds.min.x);
+            putFloat(rv, m_bounds.min.y);
+            putFloat(rv, m_bounds.min.z);
+            putFloat(rv, m_cell_size);
+
+            // Neighboring distances are close together, so their
+            // bytes delta-encode well.
+            ByteArray grid;
+            encodeVertices(m_values.data(), m_values.size(), sizeof(float), grid);
+            putU32(rv, static_cast<std::uint32_t>(grid.size()));
+            lzCompress(grid.data(), grid.size(), rv);
+            return rv;
+        }
+
+        bool DistanceField::decode(const ByteArray &data) {
+            if (data.size() < HEADER_SIZE || !std::equal(MAGIC, MAGIC + 4, data.begin()) || getU32(&data[4]) != FORMAT_VERSION) {
+                return false;
+            }
+
+            DistanceField field;
+            field.m_source_hash = getU32(&data[8]);
+            field.m_resolution = getU32(&data[12]);
+            std::size_t num_points = 1;
+            for (unsigned int a = 0; a < 3; ++a) {
+                field.m_dims[a] = getU32(&data[16 + 4*a]);
+                if (field.m_dims[a] < 2 || field.m_dims[a] > (1u << 12)) {
+                    return false;
+                }
+                num_points *= field.m_dims[a];
+            }
+            field.m_bounds.min = glm::vec3(getFloat(&data[28]), getFloat(&data[32]), getFloat(&data[36]));
+            field.m_cell_size = getFloat(&data[40]);
+            if (!(field.m_cell_size > 0.0f)) {
+                return false;
+            }
+            field.m_bounds.max = field.m_bounds.min +
+                field.m_cell_size*glm::vec3(field.m_dims[0] - 1.0f, field.m_dims[1] - 1.0f, field.m_dims[2] - 1.0f);
+
+            // The byte planes can come out a little bigger than the
+            // values themselves, but not much.
+            const std::size_t grid_size = getU32(&data[44]);
+            if (grid_size > 2*num_points*sizeof(float)) {
+                return false;
+            }
+            ByteArray grid(grid_size);
+            field.m_values.resize(num_points);
+            if (!lzDecompress(data.data() + HEADER_SIZE, data.size() - HEADER_SIZE, grid.data(), grid.size()) ||
+                !decodeVertices(grid.data(), grid.size(), field.m_values.data(), num_points, sizeof(float)))
+            {
+                return false;
+            }
+
+            *this = std::move(field);
+            return true;
+        }
+
+        static void gatherTriangles(const Geometry<PCNVertex> &geo, std::vector<GLuint> &elems, std::vector<glm::vec3> &positions) {
+            if (geo.draw_type != GL_TRIANGLES || geo.primitive_restart) {
+                return;
+            }
+
+            const Geometry<PCNVertex>::vertex_array_type &verts = geo.vertices();
+            positions.resize(verts.size());
+            parallelFor(verts.size(), 1 << 14, [&](std::size_t i) {
+                    positions[i] = vertexPosition(verts[i]);
+                });
+            elems = geo.elements();
+        }
+
+        DistanceField::sptr_type bakeDistanceField(const Geometry<PCNVertex> &geo, unsigned int resolution) {
+            std::vector<GLuint> elems;
+            std::vector<glm::vec3> positions;
+            gatherTriangles(geo, elems, positions);
+
+            DistanceField::sptr_type rv = std::make_shared<DistanceField>();
+            rv->bake(elems, positions, resolution);
+            return rv;
+        }
+
+        std::string distanceFieldCacheFilename(const char *mesh_filename, unsigned int resolution) {
+            std::ostringstream filename;
+            filename << mesh_filename << ".sdf" << resolution;
+            return filename.str();
+        }
+
+        DistanceField::sptr_type loadDistanceField(const char *mesh_filename, const Geometry<PCNVertex> &geo, unsigned int resolution) {
+            std::vector<GLuint> elems;
+            std::vector<glm::vec3> positions;
+            gatherTriangles(geo, elems, positions);
+
+            DistanceField::sptr_type rv = std::make_shared<DistanceField>();
+            const std::string cache_filename = distanceFieldCacheFilename(mesh_filename, resolution);
+            ByteArray data;
+            if (readByteFile(cache_filename.c_str(), data) && rv->decode(data) &&
+                rv->resolution() == resolution &&
+                rv->sourceHash() == DistanceField::hashMeshData(elems, positions))
+            {
+                return rv;
+            }
+
+            rv->bake(elems, positions, resolution);
+            if (!rv->empty()) {
+                writeByteFile(cache_filename.c_str(), rv->encode());
+            }
+            return rv;
+        }
+    }
+}
@@ -0,0 +1,94 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_DISTANCE_FIELD_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_DISTANCE_FIELD_H_
+
+#include "../graphplay.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "../opengl.h"
+#include "../fzx/BBox.h"
+#include "Geometry.h"
+#include "MeshCodec.h"
+
+namespace graphplay {
+    namespace gfx {
+        // A signed distance field sampled on a regular grid around a
+        // triangle mesh: negative inside, positive outside, in the
+        // units of the mesh's positions. Lookups are trilinear, so
+        // they're only as good as the grid is fine, but they're much
+        // cheaper than asking a TriangleBVH.
+        //
+        // Grid points within BAND_CELLS cells of the surface get exact
+        // distances from a BVH; the rest get the distance to the
+        // nearest of those surface points, spread out with a jump
+        // flood. Inside and outside are decided by casting rays along
+        // each axis and counting crossings, so small holes in the mesh
+        // don't flip the sign everywhere.
+        class DistanceField {
+        public:
+            typedef std::shared_ptr<DistanceField> sptr_type;
+
+            DistanceField();
+
+            // resolution is the number of cells along the longest side
+            // of the mesh's bounding box.
+            void bake(const std::vector<GLuint> &elems, const std::vector<glm::vec3> &positions, unsigned int resolution);
+
+            // Outside the grid, these fall back to the distance to the
+            // grid plus the distance at its edge.
+            float distance(const glm::vec3 &point) const;
+            glm::vec3 gradient(const glm::vec3 &point) const;
+
+            inline bool empty() const { return m_values.empty(); }
+            inline const fzx::BBox& bounds() const { return m_bounds; }
+            inline float cellSize() const { return m_cell_size; }
+            inline unsigned int resolution() const { return m_resolution; }
+            inline unsigned int dimension(unsigned int axis) const { return m_dims[axis]; }
+            inline float value(unsigned int x, unsigned int y, unsigned int z) const {
+                return m_values[(static_cast<std::size_t>(z)*m_dims[1] + y)*m_dims[0] + x];
+            }
+
+            // A hash of the mesh data the field was baked from, to
+            // tell whether a cached field is out of date.
+            inline std::uint32_t sourceHash() const { return m_source_hash; }
+            static std::uint32_t hashMeshData(const std::vector<GLuint> &elems, const std::vector<glm::vec3> &positions);
+
+            // Serialization, with the grid packed by the mesh codec.
+            ByteArray encode() const;
+            bool decode(const ByteArray &data);
+
+            static const unsigned int BAND_CELLS = 2;
+            static const unsigned int PADDING_CELLS = 2;
+
+        private:
+            fzx::BBox m_bounds;
+            float m_cell_size;
+            unsigned int m_resolution;
+            unsigned int m_dims[3];
+            std::uint32_t m_source_hash;
+            std::vector<float> m_values;
+        };
+
+        // Bake a field for a GL_TRIANGLES geometry, in model space.
+        // Other kinds of geometry get an empty one.
+        DistanceField::sptr_type bakeDistanceField(const Geometry<PCNVertex> &geo, unsigned int resolution);
+
+        // Where the field for a mesh file is cached: next to it, with
+        // the resolution in the name.
+        std::string distanceFieldCacheFilename(const char *mesh_filename, unsigned int resolution);
+
+        // Load the cached field for the geometry loaded from
+        // mesh_filename if it's there and up to date, and otherwise
+        // bake it and write it to the cache.
+        DistanceField::sptr_type loadDistanceField(const char *mesh_filename, const Geometry<PCNVertex> &geo, unsigned int resolution);
+    }
+}
+
+#endif
@@ -0,0 +1,194 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../graphplay.h"
+#include "FrameRing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace graphplay {
+    namespace gfx {
+        const unsigned int FrameRing::DEFAULT_FRAMES;
+
+        FrameRing::FrameRing(GLenum target, std::size_t frame_bytes, unsigned int frames)
+            : m_target(target),
+              m_frame_bytes(0),
+              m_frames(std::max(frames, 1u)),
+              m_alignment(16),
+              m_buffer(0),
+              m_persistent(false),
+              m_mapped(nullptr),
+              m_frame(0),
+              m_used(0),
+              m_fences(m_frames, nullptr),
+              m_last_stall(0.0),
+              m_total_stall(0.0),
+              m_stalls(0)
+        {
+            if (target == GL_UNIFORM_BUFFER) {
+                glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &m_alignment);
+                m_alignment = std::max(m_alignment, 16);
+            }
+
+            m_frame_bytes = alignedSize(frame_bytes);
+            createBuffer();
+        }
+
+        FrameRing::~FrameRing() {
+            deleteBuffer();
+        }
+
+        std::size_t FrameRing::alignedSize(std::size_t bytes) const {
+            return (bytes + m_alignment - 1) / m_alignment * m_alignment;
+        }
+
+        void FrameRing::createBuffer() {
+            const std::size_t total = m_frame_bytes*m_frames;
+
+            glGenBuffers(1, &m_buffer);
+            glBindBuffer(m_target, m_buffer);
+
+#ifdef GL_ARB_buffer_storage
+            // The loader only has this if it was generated with the
+            // extension.
+            if (GLAD_GL_ARB_buffer_storage) {
+                const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                glBufferStorage(m_target, total, nullptr, flags);
+                m_mapped = (GLubyte*)glMapBufferRange(m_target, 0, total, flags);
+                m_persistent = m_mapped != nullptr;
+
+                // The storage can't be respecified, so the fallback
+                // needs a buffer of its own.
+                if (!m_persistent) {
+                    glDeleteBuffers(1, &m_buffer);
+                    glGenBuffers(1, &m_buffer);
+                    glBindBuffer(m_target, m_buffer);
+                }
+            }
+#endif
+
+            if (!m_persistent) {
+                glBufferData(m_target, total, nullptr, GL_STREAM_DRAW);
+            }
+
+            glBindBuffer(m_target, 0);
+        }
+
+        void FrameRing::deleteBuffer() {
+            for (auto &&fence : m_fences) {
+                if (fence) {
+                    glDeleteSync(fence);
+                    fence = nullptr;
+                }
+            }
+
+            if (glIsBuffer(m_buffer)) {
+                if (m_mapped) {
+                    glBindBuffer(m_target, m_buffer);
+                    glUnmapBuffer(m_target);
+                    glBindBuffer(m_target, 0);
+                }
+                glDeleteBuffers(1, &m_buffer);
+            }
+
+            m_buffer = 0;
+            m_mapped = nullptr;
+            m_persistent = false;
+        }
+
+        void FrameRing::reserve(std::size_t frame_bytes) {
+            if (frame_bytes <= m_frame_bytes) {
+                return;
+            }
+
+            for (unsigned int f = 0; f < m_frames; ++f) {
+                waitForFrame(f, false);
+            }
+
+            deleteBuffer();
+            m_frame_bytes = alignedSize(std::max(frame_bytes, 2*m_frame_bytes));
+            m_used = 0;
+            createBuffer();
+        }
+
+        void FrameRing::waitForFrame(unsigned int frame, bool timed) {
+            GLsync &fence = m_fences[frame];
+            if (!fence) {
+                return;
+            }
+
+            // Only count it as a stall if the GPU isn't already done.
+            if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+                auto start = std::chrono::steady_clock::now();
+                glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+                if (timed) {
+                    std::chrono::duration<double, std::micro> waited = std::chrono::steady_clock::now() - start;
+                    m_last_stall = waited.count();
+                    m_total_stall += m_last_stall;
+                    ++m_stalls;
+                }
+            }
+
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+
+        void FrameRing::beginFrame() {
+            m_frame = (m_frame + 1) % m_frames;
+            m_used = 0;
+            m_last_stall = 0.0;
+            waitForFrame(m_frame, true);
+
+            if (!m_persistent) {
+                // The fence says the GPU is done with this region, so
+                // the driver doesn't need to check.
+                const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT
+                    | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_FLUSH_EXPLICIT_BIT;
+                glBindBuffer(m_target, m_buffer);
+                m_mapped = (GLubyte*)glMapBufferRange(m_target, m_frame*m_frame_bytes, m_frame_bytes, access);
+                glBindBuffer(m_target, 0);
+                if (!m_mapped) {
+                    std::cerr << "Could not map frame " << m_frame << " of the frame ring" << std::endl;
+                }
+            }
+        }
+
+        void* FrameRing::allocate(std::size_t bytes, GLintptr &offset) {
+            const std::size_t size = alignedSize(bytes);
+            if (!m_mapped || m_used + size > m_frame_bytes) {
+                return nullptr;
+            }
+
+            const std::size_t region = m_frame*m_frame_bytes;
+            offset = (GLintptr)(region + m_used);
+            GLubyte *rv = m_persistent ? m_mapped + region + m_used : m_mapped + m_used;
+            m_used += size;
+            return rv;
+        }
+
+        void FrameRing::unmap() {
+            if (m_persistent || !m_mapped) {
+                return;
+            }
+
+            glBindBuffer(m_target, m_buffer);
+            if (m_used > 0) {
+                glFlushMappedBufferRange(m_target, 0, m_used);
+            }
+            glUnmapBuffer(m_target);
+            glBindBuffer(m_target, 0);
+            m_mapped = nullptr;
+        }
+
+        void FrameRing::endFrame() {
+            unmap();
+
+            GLsync &fence = m_fences[m_frame];
+            if (fence) {
+                glDeleteSync(fence);
+            }
+            fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+    }
+}
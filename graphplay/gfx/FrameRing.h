@@ -0,0 +1,107 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_FRAME_RING_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_FRAME_RING_H_
+
+#include "../graphplay.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "../opengl.h"
+
+namespace graphplay {
+    namespace gfx {
+        // A buffer for data that's rewritten every frame, split into
+        // a region per frame in flight so the CPU can fill one while
+        // the GPU is still reading the others. Each region is fenced
+        // when the frame that used it is submitted, and only waited
+        // on when the ring comes back around to it.
+        //
+        // With ARB_buffer_storage the whole buffer is mapped once,
+        // persistently. Without it (plain 4.1), each frame's region
+        // is mapped unsynchronized while it's being filled, which
+        // means everything has to be written before anything that
+        // reads it is drawn:
+        //
+        //     ring.beginFrame();
+        //     ... allocate() and write ...
+        //     ring.unmap();
+        //     ... draw, with glBindBufferRange(..., ring.bufferId(), offset, ...) ...
+        //     ring.endFrame();
+        class FrameRing {
+        public:
+            typedef std::unique_ptr<FrameRing> uptr_type;
+
+            static const unsigned int DEFAULT_FRAMES = 3;
+
+            FrameRing(GLenum target, std::size_t frame_bytes, unsigned int frames = DEFAULT_FRAMES);
+            FrameRing(const FrameRing &other) = delete;
+            FrameRing& operator=(const FrameRing &other) = delete;
+            ~FrameRing();
+
+            // Make each frame's region at least frame_bytes. This
+            // waits for the GPU to finish with the whole buffer, so
+            // don't call it in the middle of a frame.
+            void reserve(std::size_t frame_bytes);
+
+            // Move on to the next region, waiting for the GPU if it
+            // hasn't finished the frame that used it last.
+            void beginFrame();
+
+            // Space for bytes in the current region, lined up well
+            // enough for glBindBufferRange. offset is where it is in
+            // the buffer. Returns nullptr if the region is full.
+            void* allocate(std::size_t bytes, GLintptr &offset);
+
+            // Finished writing this frame.
+            void unmap();
+
+            // Finished drawing this frame.
+            void endFrame();
+
+            inline GLuint bufferId() const { return m_buffer; }
+            inline std::size_t frameBytes() const { return m_frame_bytes; }
+            inline unsigned int frames() const { return m_frames; }
+            inline unsigned int currentFrame() const { return m_frame; }
+            inline std::size_t used() const { return m_used; }
+            inline GLint alignment() const { return m_alignment; }
+            inline bool persistent() const { return m_persistent; }
+
+            // How much space allocate() takes for bytes.
+            std::size_t alignedSize(std::size_t bytes) const;
+
+            // How long beginFrame() waited for the GPU, in
+            // microseconds: last time, and all together.
+            inline double lastStall() const { return m_last_stall; }
+            inline double totalStall() const { return m_total_stall; }
+            inline unsigned int stalls() const { return m_stalls; }
+
+        private:
+            void createBuffer();
+            void deleteBuffer();
+            void waitForFrame(unsigned int frame, bool timed);
+
+            GLenum m_target;
+            std::size_t m_frame_bytes;
+            unsigned int m_frames;
+            GLint m_alignment;
+            GLuint m_buffer;
+            bool m_persistent;
+
+            // The whole buffer if it's persistent, otherwise the
+            // current region while it's mapped.
+            GLubyte *m_mapped;
+
+            unsigned int m_frame;
+            std::size_t m_used;
+            std::vector<GLsync> m_fences;
+
+            double m_last_stall, m_total_stall;
+            unsigned int m_stalls;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,66 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../graphplay.h"
+#include "Frustum.h"
+
+#include <glm/glm.hpp>
+
+namespace graphplay {
+    namespace gfx {
+        Frustum::Frustum()
+            : m_planes()
+        {
+            for (unsigned int i = 0; i < 6; ++i) {
+                m_planes[i] = glm::vec4(0.0f);
+            }
+        }
+
+        Frustum::Frustum(const glm::mat4x4 &clip)
+            : m_planes()
+        {
+            // Gribb & Hartmann: each plane is the last row of the clip
+            // matrix plus or minus one of the others. glm matrices are
+            // column-major, so row i is (m[0][i], m[1][i], m[2][i], m[3][i]).
+            glm::vec4 rows[4];
+            for (unsigned int i = 0; i < 4; ++i) {
+                rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+            }
+
+            for (unsigned int i = 0; i < 3; ++i) {
+                m_planes[2*i] = rows[3] + rows[i];
+                m_planes[2*i + 1] = rows[3] - rows[i];
+            }
+
+            // Normalize them, so that the distances come out right.
+            for (unsigned int i = 0; i < 6; ++i) {
+                float len = glm::length(glm::vec3(m_planes[i]));
+                if (len > 0.0f) {
+                    m_planes[i] /= len;
+                }
+            }
+        }
+
+        bool Frustum::intersectsSphere(const glm::vec3 &center, float radius) const {
+            for (unsigned int i = 0; i < 6; ++i) {
+                if (glm::dot(glm::vec3(m_planes[i]), center) + m_planes[i].w < -radius) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool Frustum::intersectsBox(const glm::vec3 &min, const glm::vec3 &max) const {
+            for (unsigned int i = 0; i < 6; ++i) {
+                // The corner furthest along the plane's normal.
+                glm::vec3 normal(m_planes[i]);
+                glm::vec3 far_corner(normal.x >= 0.0f ? max.x : min.x,
+                                     normal.y >= 0.0f ? max.y : min.y,
+                                     normal.z >= 0.0f ? max.z : min.z);
+                if (glm::dot(normal, far_corner) + m_planes[i].w < 0.0f) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+}
@@ -0,0 +1,41 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_FRUSTUM_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_FRUSTUM_H_
+
+#include "../graphplay.h"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+namespace graphplay {
+    namespace gfx {
+        class Frustum {
+        public:
+            // A frustum that contains everything.
+            Frustum();
+
+            // The frustum of a clip transformation (projection * view,
+            // or projection * view * model to get it in model space).
+            explicit Frustum(const glm::mat4x4 &clip);
+
+            // Planes are (a, b, c, d) with the inside where
+            // a*x + b*y + c*z + d >= 0, in the order left, right,
+            // bottom, top, near, far.
+            inline const glm::vec4& plane(unsigned int i) const { return m_planes[i]; }
+
+            bool intersectsSphere(const glm::vec3 &center, float radius) const;
+
+            // Whether the axis-aligned box from min to max might be
+            // inside. Like the sphere test, it can let through boxes
+            // near the frustum's corners that are really outside.
+            bool intersectsBox(const glm::vec3 &min, const glm::vec3 &max) const;
+
+        private:
+            glm::vec4 m_planes[6];
+        };
+    }
+}
+
+#endif
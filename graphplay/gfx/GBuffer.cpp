@@ -0,0 +1,177 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../graphplay.h"
+#include "GBuffer.h"
+
+#include <iostream>
+
+namespace graphplay {
+    namespace gfx {
+        GBuffer::GBuffer(unsigned int width, unsigned int height)
+            : m_width(width),
+              m_height(height),
+              m_complete(false),
+              m_framebuffer(0),
+              m_depth_buffer(0),
+              m_textures(),
+              m_vertex_array(0),
+              m_program(createDeferredLightingProgram()),
+              m_light_pass()
+        {
+            m_light_pass.resolve(m_program->getUniforms(), "light_pass");
+            glGenVertexArrays(1, &m_vertex_array);
+            createAttachments();
+        }
+
+        GBuffer::~GBuffer() {
+            deleteAttachments();
+            if (glIsVertexArray(m_vertex_array)) {
+                glDeleteVertexArrays(1, &m_vertex_array);
+            }
+        }
+
+        void GBuffer::resize(unsigned int width, unsigned int height) {
+            if (width == m_width && height == m_height) {
+                return;
+            }
+
+            m_width = width;
+            m_height = height;
+            deleteAttachments();
+            createAttachments();
+        }
+
+        void GBuffer::createAttachments() {
+            // Positions need all the precision they can get; normals
+            // and colors don't.
+            static const GLenum formats[ATTACHMENTS] = { GL_RGBA8, GL_RGBA16F, GL_RGBA32F };
+
+            glGenFramebuffers(1, &m_framebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+
+            glGenTextures(ATTACHMENTS, m_textures);
+            for (unsigned int i = 0; i < ATTACHMENTS; ++i) {
+                glBindTexture(GL_TEXTURE_2D, m_textures[i]);
+                glTexImage2D(GL_TEXTURE_2D, 0, formats[i], m_width, m_height, 0, GL_RGBA, GL_FLOAT, nullptr);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, m_textures[i], 0);
+            }
+            glBindTexture(GL_TEXTURE_2D, 0);
+
+            glGenRenderbuffers(1, &m_depth_buffer);
+            glBindRenderbuffer(GL_RENDERBUFFER, m_depth_buffer);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, m_width, m_height);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth_buffer);
+
+            // The shaders' outputs are at the same locations as the
+            // attachments.
+            const GLenum draw_buffers[ATTACHMENTS] = {
+                GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2
+            };
+            glDrawBuffers(ATTACHMENTS, draw_buffers);
+
+            GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+            m_complete = status == GL_FRAMEBUFFER_COMPLETE;
+            if (!m_complete) {
+                std::cerr << "GBuffer framebuffer is incomplete: 0x" << std::hex << status << std::dec << std::endl;
+            }
+
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+
+        void GBuffer::deleteAttachments() {
+            if (m_framebuffer == 0) {
+                return;
+            }
+
+            glDeleteFramebuffers(1, &m_framebuffer);
+            glDeleteRenderbuffers(1, &m_depth_buffer);
+            glDeleteTextures(ATTACHMENTS, m_textures);
+
+            m_framebuffer = m_depth_buffer = 0;
+            for (unsigned int i = 0; i < ATTACHMENTS; ++i) {
+                m_textures[i] = 0;
+            }
+            m_complete = false;
+        }
+
+        bool GBuffer::bindForGeometry() {
+            static const GLfloat nothing[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            static const GLfloat farthest = 1.0f;
+
+            if (!m_complete) {
+                return false;
+            }
+
+            glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+            for (GLint i = 0; i < ATTACHMENTS; ++i) {
+                glClearBufferfv(GL_COLOR, i, nothing);
+            }
+            glClearBufferfv(GL_DEPTH, 0, &farthest);
+            return true;
+        }
+
+        void GBuffer::light(bool point_lights) {
+            static const GLuint units[ATTACHMENTS] = {
+                Program::GBUFFER_COLOR_TEXTURE_UNIT,
+                Program::GBUFFER_NORMAL_TEXTURE_UNIT,
+                Program::GBUFFER_POSITION_TEXTURE_UNIT
+            };
+
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            for (unsigned int i = 0; i < ATTACHMENTS; ++i) {
+                glActiveTexture(GL_TEXTURE0 + units[i]);
+                glBindTexture(GL_TEXTURE_2D, m_textures[i]);
+            }
+
+            // Every pixel gets drawn exactly once per pass, so the
+            // depth test would only get in the way.
+            GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST), blend = glIsEnabled(GL_BLEND);
+            GLint src_rgb, dst_rgb, src_alpha, dst_alpha;
+            glGetIntegerv(GL_BLEND_SRC_RGB, &src_rgb);
+            glGetIntegerv(GL_BLEND_DST_RGB, &dst_rgb);
+            glGetIntegerv(GL_BLEND_SRC_ALPHA, &src_alpha);
+            glGetIntegerv(GL_BLEND_DST_ALPHA, &dst_alpha);
+            glDisable(GL_DEPTH_TEST);
+
+            glUseProgram(m_program->getProgramId());
+            glBindVertexArray(m_vertex_array);
+
+            // Something else may have used the program since.
+            m_light_pass.invalidate();
+            m_light_pass.set(0);
+            glDisable(GL_BLEND);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+
+            if (point_lights) {
+                m_light_pass.set(1);
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_ONE, GL_ONE);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+            }
+
+            glBindVertexArray(0);
+            glUseProgram(0);
+
+            glBlendFuncSeparate(src_rgb, dst_rgb, src_alpha, dst_alpha);
+            if (blend) {
+                glEnable(GL_BLEND);
+            } else {
+                glDisable(GL_BLEND);
+            }
+            if (depth_test) {
+                glEnable(GL_DEPTH_TEST);
+            }
+
+            for (unsigned int i = 0; i < ATTACHMENTS; ++i) {
+                glActiveTexture(GL_TEXTURE0 + units[i]);
+                glBindTexture(GL_TEXTURE_2D, 0);
+            }
+            glActiveTexture(GL_TEXTURE0);
+        }
+    }
+}
@@ -0,0 +1,87 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_GBUFFER_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_GBUFFER_H_
+
+#include "../graphplay.h"
+
+#include <memory>
+
+#include "../opengl.h"
+#include "Shader.h"
+#include "Uniform.h"
+
+namespace graphplay {
+    namespace gfx {
+        // A framebuffer for deferred shading. The meshes are drawn
+        // into it first, leaving each pixel's color, normal and
+        // world space position, and then the lights are added up over
+        // the whole screen at once:
+        //
+        //     gbuffer.bindForGeometry();
+        //     ... draw, with the light_clusters block's deferred set ...
+        //     gbuffer.light(...);
+        //
+        // The lighting goes through the same LightClusters the
+        // forward path uses, so the light_clusters block and its
+        // textures need to be bound for light() too. The position's
+        // w is 1 where something lit was drawn, -1 where something
+        // unlit was, and 0 where nothing was.
+        class GBuffer {
+        public:
+            typedef std::unique_ptr<GBuffer> uptr_type;
+
+            enum Attachment { COLOR = 0, NORMAL, POSITION, ATTACHMENTS };
+
+            GBuffer(unsigned int width, unsigned int height);
+            GBuffer(const GBuffer &other) = delete;
+            GBuffer& operator=(const GBuffer &other) = delete;
+            ~GBuffer();
+
+            // Make new attachments this size. What was in them is
+            // lost.
+            void resize(unsigned int width, unsigned int height);
+            inline unsigned int width() const { return m_width; }
+            inline unsigned int height() const { return m_height; }
+
+            // Whether the framebuffer can be drawn into.
+            inline bool complete() const { return m_complete; }
+
+            inline GLuint framebufferId() const { return m_framebuffer; }
+            inline GLuint textureId(Attachment which) const { return m_textures[which]; }
+
+            // The program light() uses, so its blocks can be bound
+            // along with the meshes'.
+            inline const Program& lightingProgram() const { return *m_program; }
+
+            // Draw into the GBuffer, starting from nothing. Returns
+            // false, and leaves the framebuffer alone, if it isn't
+            // complete().
+            bool bindForGeometry();
+
+            // Light what was drawn, into the default framebuffer: a
+            // full screen pass for the lights that reach everywhere,
+            // and then (if there are any) one for the lights in each
+            // pixel's cluster, added on top.
+            void light(bool point_lights);
+
+        private:
+            void createAttachments();
+            void deleteAttachments();
+
+            unsigned int m_width, m_height;
+            bool m_complete;
+
+            GLuint m_framebuffer, m_depth_buffer;
+            GLuint m_textures[ATTACHMENTS];
+
+            // The lighting passes don't have any vertices, but GL
+            // wants a vertex array bound anyway.
+            GLuint m_vertex_array;
+            Program::sptr_type m_program;
+            Uniform<GLint> m_light_pass;
+        };
+    }
+}
+
+#endif
@@ -4,46 +4,92 @@
 #include "Geometry.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstddef>
 #include <fstream>
 #include <sstream>
 
 #include <glm/gtc/epsilon.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/range.hpp>
 
+#include "../Parallel.h"
 #include "../load/PlyFile.h"
 #include "../fzx/BBox.h"
+#include "MeshKernels.h"
+#include "Normals.h"
 
 namespace graphplay {
     namespace gfx {
         // Class AbstractGeometry.
         AbstractGeometry::AbstractGeometry()
             : draw_type{GL_TRIANGLES},
+              primitive_restart{false},
               m_vertex_buffer{0},
               m_elem_buffer{0},
-              m_array_object{0}
-              // m_bbox{}
+              m_array_object{0},
+              m_elem_gl_type{GL_UNSIGNED_INT},
+              m_buffer_bytes{0},
+              m_array_program{0},
+              m_vertex_buffer_ref(),
+              m_elem_buffer_ref(),
+              m_array_object_ref(),
+              m_arena_range(),
+              m_base_vertex{0},
+              m_elem_offset{0},
+              m_bbox{}
         {}
 
         AbstractGeometry::AbstractGeometry(const AbstractGeometry &other) : AbstractGeometry() {
+            // Share other's GL objects, rather than copying them. The
+            // buffers get copied if either of us changes them.
             draw_type = other.draw_type;
-            m_elem_buffer = duplicateBuffer(GL_ELEMENT_ARRAY_BUFFER, other.m_elem_buffer);
-            m_vertex_buffer = duplicateBuffer(GL_ARRAY_BUFFER, other.m_vertex_buffer);
-            m_array_object = duplicateVertexArrayObject(other.m_array_object);
-            // m_bbox = other.m_bbox;
+            primitive_restart = other.primitive_restart;
+            m_elem_gl_type = other.m_elem_gl_type;
+            m_clusters = other.m_clusters;
+            m_elem_buffer = other.m_elem_buffer;
+            m_elem_buffer_ref = other.m_elem_buffer_ref;
+            m_vertex_buffer = other.m_vertex_buffer;
+            m_vertex_buffer_ref = other.m_vertex_buffer_ref;
+            m_buffer_bytes = other.m_buffer_bytes;
+            m_array_object = other.m_array_object;
+            m_array_object_ref = other.m_array_object_ref;
+            m_array_program = other.m_array_program;
+            m_arena_range = other.m_arena_range;
+            m_base_vertex = other.m_base_vertex;
+            m_elem_offset = other.m_elem_offset;
+            m_bbox = other.m_bbox;
         }
 
         AbstractGeometry::AbstractGeometry(AbstractGeometry &&other) : AbstractGeometry() {
             // Move other's GL objects over here.
             draw_type = other.draw_type;
+            primitive_restart = other.primitive_restart;
+            m_elem_gl_type = other.m_elem_gl_type;
+            m_clusters = std::move(other.m_clusters);
             m_array_object = other.m_array_object;
+            m_array_object_ref = std::move(other.m_array_object_ref);
+            m_array_program = other.m_array_program;
             m_elem_buffer = other.m_elem_buffer;
+            m_elem_buffer_ref = std::move(other.m_elem_buffer_ref);
             m_vertex_buffer = other.m_vertex_buffer;
-            // m_bbox = other.m_bbox;
+            m_vertex_buffer_ref = std::move(other.m_vertex_buffer_ref);
+            m_buffer_bytes = other.m_buffer_bytes;
+            m_arena_range = std::move(other.m_arena_range);
+            m_base_vertex = other.m_base_vertex;
+            m_elem_offset = other.m_elem_offset;
+            m_bbox = other.m_bbox;
 
             // Make other stop referencing its GL objects.
             other.m_array_object = 0;
+            other.m_array_program = 0;
             other.m_elem_buffer = 0;
             other.m_vertex_buffer = 0;
+            other.m_buffer_bytes = 0;
+            other.m_base_vertex = 0;
+            other.m_elem_offset = 0;
         }
 
         AbstractGeometry::~AbstractGeometry() {
@@ -59,52 +105,201 @@ namespace graphplay {
 
         AbstractGeometry& AbstractGeometry::operator=(AbstractGeometry &&other) {
             draw_type = other.draw_type;
+            primitive_restart = other.primitive_restart;
+            std::swap(m_elem_gl_type, other.m_elem_gl_type);
+            std::swap(m_clusters, other.m_clusters);
             std::swap(m_array_object, other.m_array_object);
+            std::swap(m_array_object_ref, other.m_array_object_ref);
+            std::swap(m_array_program, other.m_array_program);
             std::swap(m_elem_buffer, other.m_elem_buffer);
+            std::swap(m_elem_buffer_ref, other.m_elem_buffer_ref);
             std::swap(m_vertex_buffer, other.m_vertex_buffer);
+            std::swap(m_vertex_buffer_ref, other.m_vertex_buffer_ref);
+            std::swap(m_buffer_bytes, other.m_buffer_bytes);
+            std::swap(m_arena_range, other.m_arena_range);
+            std::swap(m_base_vertex, other.m_base_vertex);
+            std::swap(m_elem_offset, other.m_elem_offset);
+            std::swap(m_bbox, other.m_bbox);
             return *this;
         }
 
-        // const fzx::BBox& AbstractGeometry::boundingBox() const {
-        //     return m_bbox;
-        // }
+        void AbstractGeometry::updateBoundingBox() {}
 
-        // void AbstractGeometry::updateBoundingBox() {}
+        bool AbstractGeometry::buffersShared() const {
+            return m_vertex_buffer_ref.use_count() > 1 || m_elem_buffer_ref.use_count() > 1 || m_arena_range.use_count() > 1;
+        }
 
-        void AbstractGeometry::createBuffers() {}
+        void AbstractGeometry::makeBuffersUnique() {
+            if (!buffersShared()) {
+                return;
+            }
 
-        void AbstractGeometry::deleteBuffers() {
-            if (glIsBuffer(m_elem_buffer)) {
-                glDeleteBuffers(1, &m_elem_buffer);
+            if (m_arena_range) {
+                setArenaRange(m_arena_range->arena->duplicate(*m_arena_range));
+                return;
             }
 
-            if (glIsBuffer(m_vertex_buffer)) {
-                glDeleteBuffers(1, &m_vertex_buffer);
+            GLuint vertex_buffer = duplicateBuffer(m_vertex_buffer);
+            GLuint elem_buffer = duplicateBuffer(m_elem_buffer);
+
+            // Keep the vertex array setup, but pointed at the new
+            // buffers.
+            GLuint array_object = duplicateVertexArrayObject(m_array_object, vertex_buffer, elem_buffer);
+            GLuint array_program = m_array_program;
+
+            std::size_t buffer_bytes = m_buffer_bytes;
+            setBuffers(vertex_buffer, elem_buffer);
+            m_buffer_bytes = buffer_bytes;
+            if (array_object != 0) {
+                setVertexArray(array_object, array_program);
             }
+        }
 
+        void AbstractGeometry::createBuffers() {}
+
+        void AbstractGeometry::createBuffers(BufferArenas &arenas) {
+            createBuffers();
+        }
+
+        void AbstractGeometry::deleteBuffers() {
+            // If any copies are still using the buffers, they stay
+            // around for them.
+            m_vertex_buffer_ref.reset();
+            m_elem_buffer_ref.reset();
             m_vertex_buffer = 0;
             m_elem_buffer = 0;
+            m_buffer_bytes = 0;
+            if (m_arena_range) {
+                // The vertex array belongs to the arena.
+                m_arena_range.reset();
+                m_array_object = 0;
+            }
+            m_base_vertex = 0;
+            m_elem_offset = 0;
+
+            // The vertex array still points at the old buffers.
+            m_array_program = 0;
+        }
+
+        void AbstractGeometry::setBuffers(GLuint vertex_buffer, GLuint elem_buffer) {
+            deleteBuffers();
+            m_vertex_buffer = vertex_buffer;
+            m_vertex_buffer_ref = shareBuffer(vertex_buffer);
+            m_elem_buffer = elem_buffer;
+            m_elem_buffer_ref = shareBuffer(elem_buffer);
         }
 
         void AbstractGeometry::createVertexArray(const Program &program) {}
 
         void AbstractGeometry::deleteVertexArray() {
-            if (glIsVertexArray(m_array_object)) {
-                glDeleteVertexArrays(1, &m_array_object);
-            }
-
+            m_array_object_ref.reset();
             m_array_object = 0;
+            m_array_program = 0;
         }
 
-        void AbstractGeometry::render() const {}
+        void AbstractGeometry::setArenaRange(ArenaRange::sptr_type range) {
+            deleteBuffers();
+            deleteVertexArray();
+
+            const BufferArena &arena = *range->arena;
+            m_arena_range = range;
+            m_array_object = arena.vertexArrayObjectId();
+            m_elem_gl_type = GL_UNSIGNED_INT;
+            m_buffer_bytes = range->vertex_count*arena.vertexSize() + range->elem_count*sizeof(GLuint);
+        }
+
+        void AbstractGeometry::setVertexArray(GLuint array_object, GLuint program) {
+            deleteVertexArray();
+            m_array_object = array_object;
+            m_array_object_ref = shareVertexArray(array_object);
+            m_array_program = program;
+        }
+
+        void AbstractGeometry::render() const {
+            glBindVertexArray(m_array_object);
+            draw();
+            glBindVertexArray(0);
+        }
+
+        void AbstractGeometry::renderRanges(const std::vector<GLuint> &firsts, const std::vector<GLsizei> &counts) const {
+            glBindVertexArray(m_array_object);
+            drawRanges(firsts, counts);
+            glBindVertexArray(0);
+        }
+
+        std::size_t AbstractGeometry::elemCount() const { return 0; }
+
+        void AbstractGeometry::draw() const {}
+
+        void AbstractGeometry::drawRanges(const std::vector<GLuint> &firsts, const std::vector<GLsizei> &counts) const {}
+
+        void AbstractGeometry::drawInstances(GLsizei count) const {}
 
         // Static PCNVertex description.
         const AttrMap PCNVertex::description {
-            { "position", VertexDesc { BUFFER_OFFSET_BYTES(0*sizeof(float)), GL_FLOAT, 3 } },
-            { "color",    VertexDesc { BUFFER_OFFSET_BYTES(3*sizeof(float)), GL_FLOAT, 4 } },
-            { "normal",   VertexDesc { BUFFER_OFFSET_BYTES(7*sizeof(float)), GL_FLOAT, 3 } },
+            { "position", VertexDesc { BUFFER_OFFSET_BYTES(0*sizeof(float)), GL_FLOAT, 3, GL_FALSE } },
+            { "color",    VertexDesc { BUFFER_OFFSET_BYTES(3*sizeof(float)), GL_FLOAT, 4, GL_FALSE } },
+            { "normal",   VertexDesc { BUFFER_OFFSET_BYTES(7*sizeof(float)), GL_FLOAT, 3, GL_FALSE } },
+                };
+
+        // Static CompactPCNVertex description.
+        const AttrMap CompactPCNVertex::description {
+            { "position", VertexDesc { BUFFER_OFFSET_BYTES(offsetof(CompactPCNVertex, position)), GL_HALF_FLOAT,          4, GL_FALSE } },
+            { "normal",   VertexDesc { BUFFER_OFFSET_BYTES(offsetof(CompactPCNVertex, normal)),   GL_INT_2_10_10_10_REV, 4, GL_TRUE  } },
+            { "color",    VertexDesc { BUFFER_OFFSET_BYTES(offsetof(CompactPCNVertex, color)),    GL_UNSIGNED_BYTE,      4, GL_TRUE  } },
                 };
 
+        static_assert(sizeof(CompactPCNVertex) == 16, "CompactPCNVertex should pack down to 16 bytes.");
+
+        CompactPCNVertex compactVertex(const PCNVertex &vertex) {
+            CompactPCNVertex rv;
+
+            for (unsigned int i = 0; i < 3; ++i) {
+                rv.position[i] = glm::packHalf1x16(vertex.position[i]);
+            }
+            rv.position[3] = glm::packHalf1x16(1.0f);
+
+            glm::vec3 normal = glm::make_vec3(vertex.normal);
+            rv.normal = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+
+            for (unsigned int i = 0; i < 4; ++i) {
+                float c = std::min(std::max(vertex.color[i], 0.0f), 1.0f);
+                rv.color[i] = static_cast<GLubyte>(std::lround(c * 255.0f));
+            }
+
+            return rv;
+        }
+
+        PCNVertex expandVertex(const CompactPCNVertex &vertex) {
+            PCNVertex rv;
+
+            for (unsigned int i = 0; i < 3; ++i) {
+                rv.position[i] = glm::unpackHalf1x16(vertex.position[i]);
+            }
+
+            glm::vec4 normal = glm::unpackSnorm3x10_1x2(vertex.normal);
+            rv.normal[0] = normal.x;
+            rv.normal[1] = normal.y;
+            rv.normal[2] = normal.z;
+
+            for (unsigned int i = 0; i < 4; ++i) {
+                rv.color[i] = vertex.color[i] / 255.0f;
+            }
+
+            return rv;
+        }
+
+        glm::vec3 vertexPosition(const PCNVertex &vertex) {
+            return glm::make_vec3(vertex.position);
+        }
+
+        glm::vec3 vertexPosition(const CompactPCNVertex &vertex) {
+            return glm::vec3(
+                glm::unpackHalf1x16(vertex.position[0]),
+                glm::unpackHalf1x16(vertex.position[1]),
+                glm::unpackHalf1x16(vertex.position[2]));
+        }
+
         std::ostream& operator<<(std::ostream& stream, const PCNVertex &vertex) {
             std::stringstream buf;
             buf << "{ position = ["
@@ -413,6 +608,30 @@ namespace graphplay {
             return rv;
         }
 
+        Geometry<PCNVertex>::sptr_type makeSpherePatchGeometry() {
+            Geometry<PCNVertex>::sptr_type rv = std::make_shared<Geometry<PCNVertex> >();
+            Geometry<PCNVertex>::vertex_array_type verts;
+            std::vector<GLuint> elems(ICOSAHEDRON_VERTEX_ELEMS, ICOSAHEDRON_VERTEX_ELEMS + ICOSAHEDRON_VERTEX_ELEMS_COUNT);
+
+            for (unsigned int i = 0; i < ICOSAHEDRON_VERTEX_ARRAY_COUNT; ++i) {
+                glm::vec3 pos = glm::normalize(glm::vec3(
+                    ICOSAHEDRON_VERTEX_ARRAY[i][0],
+                    ICOSAHEDRON_VERTEX_ARRAY[i][1],
+                    ICOSAHEDRON_VERTEX_ARRAY[i][2]));
+                verts.emplace_back(
+                    PCNVertex {
+                        { pos.x, pos.y, pos.z, },
+                        { std::abs(pos.r), std::abs(pos.g), std::abs(pos.b), 1.0f, },
+                        { pos.x, pos.y, pos.z, },
+                    });
+            }
+
+            rv->draw_type = GL_PATCHES;
+            rv->setVertexData(std::move(elems), std::move(verts));
+            rv->createBuffers();
+            return rv;
+        }
+
 #ifdef MSVC
         const
 #else
@@ -502,7 +721,7 @@ namespace graphplay {
             return rv;
         }
 
-        Geometry<PCNVertex>::sptr_type loadPlyFile(const char *filename) {
+        Geometry<PCNVertex>::sptr_type loadPlyFile(const char *filename, bool morton_sort) {
             Geometry<PCNVertex>::sptr_type rv = std::make_shared<Geometry<PCNVertex> >();
             Geometry<PCNVertex>::vertex_array_type verts;
             Geometry<PCNVertex>::elem_array_type elems;
@@ -511,6 +730,7 @@ namespace graphplay {
             file.close();
 
             // Read the vertex array data.
+            bool has_normals = false;
             const Element *vertex_elem = f.getElement("vertex");
             if (vertex_elem != nullptr) {
                 const std::vector<Property> vertex_props = vertex_elem->properties();
@@ -538,6 +758,7 @@ namespace graphplay {
                         offset = static_cast<unsigned int>(offsetof(PCNVertex, color[3]));
                     } else if (pname == "nx") {
                         offset = static_cast<unsigned int>(offsetof(PCNVertex, normal[0]));
+                        has_normals = true;
                     } else if (pname == "ny") {
                         offset = static_cast<unsigned int>(offsetof(PCNVertex, normal[1]));
                     } else if (pname == "nz") {
@@ -587,23 +808,38 @@ namespace graphplay {
             glm::vec3 bcenter = (bbox.min + bbox.max) / 2.0f;
             glm::vec3 new_bb_max = bbox.max - bcenter;
             float max_dim = *std::max_element(glm::begin(new_bb_max), glm::end(new_bb_max));
-            for (Geometry<PCNVertex>::vertex_array_type::iterator v = verts.begin(); v != verts.end(); ++v) {
-                glm::vec3 pos = glm::make_vec3(v->position);
-                pos = (pos - bcenter) / max_dim;
-                v->position[0] = pos.x;
-                v->position[1] = pos.y;
-                v->position[2] = pos.z;
-            }
+            glm::mat4x4 to_unit = glm::scale(glm::mat4x4(1.0f), glm::vec3(1.0f / max_dim));
+            to_unit = glm::translate(to_unit, -bcenter);
+            transformPositions(verts, to_unit);
 
             // Compute the colors assuming each vertex is opaque.
-            for (Geometry<PCNVertex>::vertex_array_type::iterator v = verts.begin(); v != verts.end(); ++v) {
-                v->color[0] = (v->color[0] / v->color[3]) * std::abs(v->position[0]);
-                v->color[1] = (v->color[1] / v->color[3]) * std::abs(v->position[1]);
-                v->color[2] = (v->color[2] / v->color[3]) * std::abs(v->position[2]);
-                v->color[3] = 1.0;
+            tintColorsByPosition(verts);
+
+            // Raw scans often come without normals, so make some.
+            if (!has_normals) {
+                generateNormals(elems, verts);
             }
 
             rv->setVertexData(std::move(elems), std::move(verts));
+            if (morton_sort) {
+                rv->mortonSort();
+            }
+            return rv;
+        }
+
+        CompactPCNGeometry::sptr_type makeCompactGeometry(const Geometry<PCNVertex> &geo) {
+            const Geometry<PCNVertex>::vertex_array_type &verts = geo.vertices();
+            const Geometry<PCNVertex>::elem_array_type &elems = geo.elements();
+            CompactPCNGeometry::vertex_array_type compact_verts(verts.size());
+
+            parallelFor(verts.size(), 1 << 16, [&](std::size_t i) {
+                    compact_verts[i] = compactVertex(verts[i]);
+                });
+
+            CompactPCNGeometry::sptr_type rv = std::make_shared<CompactPCNGeometry>();
+            rv->draw_type = geo.draw_type;
+            rv->primitive_restart = geo.primitive_restart;
+            rv->setVertexData(CompactPCNGeometry::elem_array_type(elems), std::move(compact_verts));
             return rv;
         }
     }
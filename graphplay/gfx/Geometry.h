@@ -5,24 +5,47 @@
 
 #include "../graphplay.h"
 
+#include <cstddef>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <vector>
 
+#include <glm/vec3.hpp>
+
 #include "../opengl.h"
-// #include "../fzx/BBox.h"
+#include "BufferArena.h"
+#include "Cluster.h"
+#include "OpenGLUtils.h"
+#include "SpatialSort.h"
+#include "VertexFormat.h"
+#include "../fzx/BBox.h"
 
 namespace graphplay {
     namespace gfx {
         class Program;
 
-        struct VertexDesc {
-            void *offset;
-            GLenum type;
-            unsigned int count;
+        // The element value that starts a new primitive, for
+        // geometries with primitive_restart set. It gets narrowed to
+        // 0xFFFF along with the rest of the elements when they are
+        // uploaded as 16-bit indices.
+#ifdef MSVC
+        const
+#else
+        constexpr
+#endif
+        GLuint PRIMITIVE_RESTART_INDEX = 0xFFFFFFFF;
+
+        // One draw in a batch, laid out the way
+        // glMultiDrawElementsIndirect wants it. first_index is in
+        // elements, from the start of the element buffer.
+        struct DrawElementsCommand {
+            GLuint count;
+            GLuint instance_count;
+            GLuint first_index;
+            GLint base_vertex;
+            GLuint base_instance;
         };
-        typedef std::map<std::string, VertexDesc> AttrMap;
 
         class AbstractGeometry {
         public:
@@ -38,27 +61,106 @@ namespace graphplay {
             virtual AbstractGeometry& operator=(const AbstractGeometry &other);
             virtual AbstractGeometry& operator=(AbstractGeometry &&other);
 
-            // const fzx::BBox& boundingBox() const;
-            // virtual void updateBoundingBox();
+            // The bounds of the vertices, in model space. They're
+            // worked out when the vertex data is set, so call
+            // updateBoundingBox() after changing vertices() directly.
+            inline const fzx::BBox& boundingBox() const { return m_bbox; }
+            virtual void updateBoundingBox();
 
-            inline const GLuint vertexBufferId() const { return m_vertex_buffer; }
-            inline const GLuint elemBufferId() const { return m_elem_buffer; }
+            inline const GLuint vertexBufferId() const { return m_arena_range ? m_arena_range->arena->vertexBufferId() : m_vertex_buffer; }
+            inline const GLuint elemBufferId() const { return m_arena_range ? m_arena_range->arena->elemBufferId() : m_elem_buffer; }
             inline const GLuint vertexArrayObjectId() const { return m_array_object; }
 
+            // Where the geometry is, if its buffers are part of a
+            // BufferArena.
+            inline const ArenaRange::sptr_type& arenaRange() const { return m_arena_range; }
+
+            // The type the elements were uploaded as:
+            // GL_UNSIGNED_SHORT when there are few enough vertices,
+            // otherwise GL_UNSIGNED_INT.
+            inline GLenum elemGLType() const { return m_elem_gl_type; }
+
+            // Where the geometry's elements and vertices start in its
+            // buffers, and how many elements it has, for putting it
+            // in a batch with others from the same buffers.
+            // Arena ranges can move when the arena is compacted, so
+            // they're asked each time.
+            inline std::size_t elemOffset() const { return m_arena_range ? m_arena_range->first_elem*sizeof(GLuint) : m_elem_offset; }
+            inline GLuint firstElem() const { return (GLuint)(elemOffset() / (m_elem_gl_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint))); }
+            inline GLint baseVertex() const { return m_arena_range ? (GLint)m_arena_range->first_vertex : m_base_vertex; }
+            virtual std::size_t elemCount() const;
+
+            // How many bytes the vertex and element buffers take up
+            // on the GPU, or 0 if they haven't been created.
+            inline std::size_t gpuBytes() const { return m_buffer_bytes; }
+
+            // The program the vertex array was set up for, or 0 if
+            // there isn't one. Meshes sharing a geometry and a
+            // program share the vertex array too.
+            inline GLuint vertexArrayProgramId() const { return m_array_program; }
+
+            // The clusters the triangles are grouped into, if
+            // buildClusters() has been called.
+            inline const ClusterList& clusters() const { return m_clusters; }
+
             virtual void createBuffers();
             virtual void deleteBuffers();
             virtual void createVertexArray(const Program &program);
             virtual void deleteVertexArray();
 
-            virtual void render() const;
+            // Put the vertices and elements in the arena for the
+            // geometry's vertex format, instead of in buffers of
+            // its own. The arena's vertex array is used for drawing,
+            // whatever the program.
+            virtual void createBuffers(BufferArenas &arenas);
+
+            // Copies of a geometry share its buffers and vertex array
+            // until one of them changes what's in its buffers, which
+            // gives it its own copy (made on the GPU) first.
+            bool buffersShared() const;
+            void makeBuffersUnique();
+
+            // Bind the vertex array, draw, and unbind it again.
+            void render() const;
+            void renderRanges(const std::vector<GLuint> &firsts, const std::vector<GLsizei> &counts) const;
+
+            // Draw with the vertex array already bound, so that
+            // things drawing lots of geometries can skip binding it
+            // when it hasn't changed.
+            virtual void draw() const;
+
+            // Draw just the given ranges of elements, with one
+            // glMultiDrawElementsBaseVertex.
+            virtual void drawRanges(const std::vector<GLuint> &firsts, const std::vector<GLsizei> &counts) const;
+
+            // Draw count instances of the whole geometry, also with
+            // the vertex array already bound.
+            virtual void drawInstances(GLsizei count) const;
 
             GLenum draw_type;
+            bool primitive_restart;
 
         protected:
+            // Take ownership of newly made GL objects, letting go of
+            // the old ones.
+            void setBuffers(GLuint vertex_buffer, GLuint elem_buffer);
+            void setVertexArray(GLuint array_object, GLuint program);
+            void setArenaRange(ArenaRange::sptr_type range);
+
             GLuint m_vertex_buffer;
             GLuint m_elem_buffer;
             GLuint m_array_object;
-            // fzx::BBox m_bbox;
+            GLenum m_elem_gl_type;
+            std::size_t m_buffer_bytes;
+            GLuint m_array_program;
+            SharedGLObject m_vertex_buffer_ref, m_elem_buffer_ref, m_array_object_ref;
+            ArenaRange::sptr_type m_arena_range;
+            // Where the geometry starts in its buffers, when they
+            // aren't an arena's.
+            GLint m_base_vertex;
+            std::size_t m_elem_offset;
+            ClusterList m_clusters;
+            fzx::BBox m_bbox;
         };
 
         template <typename V>
@@ -67,7 +169,6 @@ namespace graphplay {
         public:
             typedef V vertex_type;
             typedef GLuint elem_type;
-            const static GLenum elem_gl_type = GL_UNSIGNED_INT;
             typedef std::vector<vertex_type> vertex_array_type;
             typedef std::vector<elem_type> elem_array_type;
             typedef std::unique_ptr<Geometry<V> > uptr_type;
@@ -93,7 +194,7 @@ namespace graphplay {
             virtual Geometry<V>&      operator=(const Geometry<V> &other);
             virtual Geometry<V>&      operator=(Geometry<V> &&other);
 
-            // virtual void updateBoundingBox();
+            virtual void updateBoundingBox();
 
             void setVertexData(const elem_array_type &new_elems, const vertex_array_type &new_verts);
             void setVertexData(elem_array_type &&new_elems, vertex_array_type &&new_verts);
@@ -101,14 +202,38 @@ namespace graphplay {
                 const elem_type *const new_elems, unsigned int num_elems,
                 const vertex_type *const new_verts, unsigned int num_verts);
 
+            // Split the triangles into clusters for culling. This
+            // reorders the elements, so do it before the buffers are
+            // created.
+            void buildClusters();
+
+            // Sort the vertices, and then the triangles, along a
+            // Morton curve through the bounding box, so that things
+            // that are close in space are close in the buffers. Like
+            // buildClusters(), do it before the buffers are created
+            // (and before buildClusters(), which it undoes).
+            void mortonSort();
+
             virtual void createBuffers();
+            virtual void createBuffers(BufferArenas &arenas);
             virtual void createVertexArray(const Program &program);
 
+            // Upload vertices [first, first + count) again after
+            // changing them in vertices(). The number of vertices
+            // can't have changed since the buffers were created.
+            virtual void updateVertices(std::size_t first, std::size_t count);
+
             inline vertex_array_type& vertices() { return m_vertices; }
+            inline const vertex_array_type& vertices() const { return m_vertices; }
             inline elem_array_type& elements() { return m_elems; }
+            inline const elem_array_type& elements() const { return m_elems; }
             inline const AttrMap& attrInfos() { return m_attr_infos; }
 
-            void render() const;
+            inline std::size_t elemCount() const { return m_elems.size(); }
+
+            void draw() const;
+            void drawRanges(const std::vector<GLuint> &firsts, const std::vector<GLsizei> &counts) const;
+            void drawInstances(GLsizei count) const;
 
         protected:
             vertex_array_type m_vertices;
@@ -116,24 +241,74 @@ namespace graphplay {
             const AttrMap &m_attr_infos;
         };
 
-        // template<typename V>
-        // class MutableGeometry : public Geometry<V> {
-        // public:
-        //     typedef std::unique_ptr<MutableGeometry<V> > uptr_type;
-        //     typedef std::shared_ptr<MutableGeometry<V> > sptr_type;
-        //     typedef std::weak_ptr<MutableGeometry<V> > wptr_type;
+        // Geometry that's rewritten every frame, like debug lines,
+        // deforming meshes or particles. Change vertices() and
+        // elements(), then call updateBuffers() to stream them to the
+        // GPU.
+        //
+        // The buffers are split into SEGMENTS segments, which are
+        // used round-robin, with a fence set after each segment is
+        // drawn. Each update goes into the next segment, which the
+        // GPU is usually done with by then, so it can be written
+        // without synchronizing. If the GPU isn't done with it, the
+        // buffers are orphaned instead. Either way the CPU never
+        // waits on the GPU. Elements are always 32 bits.
+        template<typename V>
+        class MutableGeometry : public Geometry<V> {
+        public:
+            typedef std::unique_ptr<MutableGeometry<V> > uptr_type;
+            typedef std::shared_ptr<MutableGeometry<V> > sptr_type;
+            typedef std::weak_ptr<MutableGeometry<V> > wptr_type;
+
+            static const unsigned int SEGMENTS = 3;
 
-        //     MutableGeometry();
-        //     MutableGeometry(const Geometry<V> &other);
-        //     MutableGeometry(Geometry<V> &&other);
-        //     virtual ~MutableGeometry();
+            MutableGeometry();
+            MutableGeometry(const MutableGeometry<V> &other);
+            MutableGeometry(const Geometry<V> &other);
+            MutableGeometry(Geometry<V> &&other);
+            virtual ~MutableGeometry();
 
-        //     virtual MutableGeometry<V>& operator=(const Geometry<V> &other);
-        //     virtual MutableGeometry<V>& operator=(Geometry<V> &&other);
+            MutableGeometry<V>& operator=(const MutableGeometry<V> &other);
+            virtual MutableGeometry<V>& operator=(const Geometry<V> &other);
+            virtual MutableGeometry<V>& operator=(Geometry<V> &&other);
 
-        //     virtual void createBuffers();
-        //     virtual void updateBuffers();
-        // };
+            virtual void createBuffers();
+            // Streamed data doesn't go in an arena; this just makes
+            // the geometry's own buffers.
+            virtual void createBuffers(BufferArenas &arenas);
+            virtual void deleteBuffers();
+
+            // Upload the vertices and elements into the next
+            // segment, and update the bounding box. The buffers grow
+            // if they don't fit.
+            void updateBuffers();
+
+            // Everything is uploaded each time anyway.
+            virtual void updateVertices(std::size_t, std::size_t) { updateBuffers(); }
+
+            // How many vertices and elements fit in each segment.
+            inline std::size_t vertexCapacity() const { return m_vertex_capacity; }
+            inline std::size_t elemCapacity() const { return m_elem_capacity; }
+            inline unsigned int currentSegment() const { return m_segment; }
+
+            // How many times an update found its segment still in
+            // use and had to orphan the buffers.
+            inline unsigned int orphanCount() const { return m_orphans; }
+
+            void draw() const;
+            void drawRanges(const std::vector<GLuint> &firsts, const std::vector<GLsizei> &counts) const;
+            void drawInstances(GLsizei count) const;
+
+        private:
+            void allocateSegments();
+            bool segmentFree(unsigned int segment);
+            void fenceSegment() const;
+            void deleteFences();
+
+            std::size_t m_vertex_capacity, m_elem_capacity;
+            unsigned int m_segment, m_orphans;
+            mutable GLsync m_fences[SEGMENTS];
+        };
 
         struct PCNVertex {
             float position[3];
@@ -144,6 +319,26 @@ namespace graphplay {
 
         typedef Geometry<PCNVertex> PCNGeometry;
 
+        // A 16-byte stand-in for PCNVertex. The position is stored as
+        // half floats (with w = 1), which is plenty for meshes that
+        // have been scaled to about [-1, 1]. The normal is packed into
+        // 10 bits per component, and the color into 8 bits per
+        // channel.
+        struct CompactPCNVertex {
+            GLushort position[4];
+            GLuint normal;
+            GLubyte color[4];
+            static const AttrMap description;
+        };
+
+        typedef Geometry<CompactPCNVertex> CompactPCNGeometry;
+
+        CompactPCNVertex compactVertex(const PCNVertex &vertex);
+        PCNVertex expandVertex(const CompactPCNVertex &vertex);
+
+        glm::vec3 vertexPosition(const PCNVertex &vertex);
+        glm::vec3 vertexPosition(const CompactPCNVertex &vertex);
+
         // Output functions.
         std::ostream& operator<<(std::ostream& stream, const PCNVertex &vertex);
 
@@ -151,10 +346,17 @@ namespace graphplay {
         Geometry<PCNVertex>::sptr_type makeOctohedronGeometry();
         Geometry<PCNVertex>::sptr_type makeIcosahedronGeometry();
         Geometry<PCNVertex>::sptr_type makeSphereGeometry();
+        // The icosahedron as 20 triangle patches, for
+        // createTessellatedSphereProgram to refine on the GPU.
+        Geometry<PCNVertex>::sptr_type makeSpherePatchGeometry();
         Geometry<PCNVertex>::sptr_type makeWireframeCubeGeometry();
         // MutableGeometry<PCNVertex>::sptr_type makeBoundingBoxGeometry(const fzx::BBox &bbox);
         Geometry<PCNVertex>::sptr_type loadPCNFile(const char *filename);
-        Geometry<PCNVertex>::sptr_type loadPlyFile(const char *filename);
+        Geometry<PCNVertex>::sptr_type loadPlyFile(const char *filename, bool morton_sort = false);
+
+        // Make a copy of a geometry with the vertices packed down to
+        // CompactPCNVertex's. The GL buffers are not created.
+        CompactPCNGeometry::sptr_type makeCompactGeometry(const Geometry<PCNVertex> &geo);
     }
 }
 
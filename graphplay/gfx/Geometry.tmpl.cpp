@@ -6,10 +6,15 @@
 #include "../graphplay.h"
 #include "Geometry.h"
 
+#include <algorithm>
+#include <cstring>
+
+#include <glm/glm.hpp>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/io.hpp>
 
-// #include "../fzx/BBox.h"
+#include "../fzx/BBox.h"
+#include "../Parallel.h"
 #include "OpenGLUtils.h"
 #include "Shader.h"
 
@@ -37,18 +42,11 @@ namespace graphplay {
 
         template <typename V>
         Geometry<V>::Geometry(Geometry<V> &&other)
-            : m_vertices(std::move(other.m_vertices)),
+            : AbstractGeometry(std::move(dynamic_cast<AbstractGeometry&>(other))),
+              m_vertices(std::move(other.m_vertices)),
               m_elems(std::move(other.m_elems)),
               m_attr_infos(V::description)
         {
-            // m_bbox = other.m_bbox;
-            m_vertex_buffer = other.m_vertex_buffer;
-            m_elem_buffer = other.m_elem_buffer;
-            m_array_object = other.m_array_object;
-            other.m_vertex_buffer = 0;
-            other.m_elem_buffer = 0;
-            other.m_array_object = 0;
-
             // std::cout << "Geometry<V> move constructor: " << &other << " -> " << this << std::endl;
         }
 
@@ -86,19 +84,23 @@ namespace graphplay {
         template <typename V>
         Geometry<V>& Geometry<V>::operator=(Geometry<V> &&other) {
             // std::cout << "Geometry<V> geometry move assignment: " << &other << " -> " << this << std::endl;
-            std::swap(m_vertex_buffer, other.m_vertex_buffer);
-            std::swap(m_elem_buffer, other.m_elem_buffer);
-            std::swap(m_array_object, other.m_array_object);
+            AbstractGeometry::operator=(std::move(dynamic_cast<AbstractGeometry&>(other)));
             std::swap(m_vertices, other.m_vertices);
             std::swap(m_elems, other.m_elems);
             // updateBoundingBox();
             return *this;
         }
 
-        // template <typename V>
-        // void Geometry<V>::updateBoundingBox() {
-        //     m_bbox = fzx::BBox::fromVertices(m_vertices.cbegin(), m_vertices.cend());
-        // }
+        template <typename V>
+        void Geometry<V>::updateBoundingBox() {
+            fzx::BBox bbox;
+            for (auto &&vertex : m_vertices) {
+                glm::vec3 position = vertexPosition(vertex);
+                bbox.min = glm::min(bbox.min, position);
+                bbox.max = glm::max(bbox.max, position);
+            }
+            m_bbox = bbox;
+        }
 
         template <typename V>
         void Geometry<V>::setVertexData(
@@ -108,7 +110,8 @@ namespace graphplay {
             // std::cout << "Geometry<V> setVertexData copy from refs" << std::endl;
             m_elems = new_elems;
             m_vertices = new_verts;
-            // updateBoundingBox();
+            m_clusters.clear();
+            updateBoundingBox();
         }
 
         template <typename V>
@@ -119,7 +122,8 @@ namespace graphplay {
             // std::cout << "Geometry<V> setVertexData move from refs" << std::endl;
             m_elems = std::move(new_elems);
             m_vertices = std::move(new_verts);
-            // updateBoundingBox();
+            m_clusters.clear();
+            updateBoundingBox();
         }
 
         template <typename V>
@@ -134,39 +138,111 @@ namespace graphplay {
         }
 
         template <typename V>
-        void Geometry<V>::createBuffers() {
-            deleteBuffers();
+        void Geometry<V>::buildClusters() {
+            m_clusters.clear();
+            if (draw_type != GL_TRIANGLES || primitive_restart) {
+                return;
+            }
 
+            std::vector<glm::vec3> positions(m_vertices.size());
+            parallelFor(m_vertices.size(), 1 << 14, [&](std::size_t i) {
+                    positions[i] = vertexPosition(m_vertices[i]);
+                });
+
+            m_clusters = clusterTriangles(m_elems, positions);
+        }
+
+        template <typename V>
+        void Geometry<V>::mortonSort() {
+            m_clusters.clear();
+            if (draw_type != GL_TRIANGLES || primitive_restart || m_vertices.empty()) {
+                return;
+            }
+
+            std::vector<glm::vec3> positions(m_vertices.size());
+            parallelFor(m_vertices.size(), 1 << 14, [&](std::size_t i) {
+                    positions[i] = vertexPosition(m_vertices[i]);
+                });
+
+            fzx::BBox bounds = fzx::BBox::fromPositions(&positions[0][0], positions.size(), sizeof(glm::vec3));
+            std::vector<GLuint> order = mortonOrder(positions, bounds);
+
+            vertex_array_type sorted_verts(m_vertices.size());
+            std::vector<glm::vec3> sorted_positions(m_vertices.size());
+            parallelFor(m_vertices.size(), 1 << 14, [&](std::size_t i) {
+                    sorted_verts[i] = m_vertices[order[i]];
+                    sorted_positions[i] = positions[order[i]];
+                });
+            m_vertices.swap(sorted_verts);
+
+            reorderElements(m_elems, order);
+            mortonSortTriangles(m_elems, sorted_positions);
+        }
+
+        template <typename V>
+        void Geometry<V>::createBuffers() {
             GLuint buffers[2];
             glGenBuffers(2, buffers);
-            m_vertex_buffer = buffers[0];
-            m_elem_buffer = buffers[1];
+            setBuffers(buffers[0], buffers[1]);
 
             glBindBuffer(GL_ARRAY_BUFFER, m_vertex_buffer);
             glBufferData(GL_ARRAY_BUFFER,
                          m_vertices.size()*sizeof(Geometry<V>::vertex_type),
                          m_vertices.data(),
                          GL_STATIC_DRAW);
+            m_buffer_bytes = m_vertices.size()*sizeof(Geometry<V>::vertex_type);
 
+            // Meshes with few enough vertices only need half as much
+            // index memory (and bandwidth). 0xFFFF is kept free for
+            // the primitive restart index.
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_elem_buffer);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                         m_elems.size()*sizeof(Geometry<V>::elem_type),
-                         m_elems.data(),
-                         GL_STATIC_DRAW);
+            if (m_vertices.size() <= 0xFFFF) {
+                std::vector<GLushort> short_elems(m_elems.size());
+                for (std::size_t i = 0; i < m_elems.size(); ++i) {
+                    short_elems[i] = m_elems[i] == PRIMITIVE_RESTART_INDEX ? 0xFFFF : static_cast<GLushort>(m_elems[i]);
+                }
+
+                m_elem_gl_type = GL_UNSIGNED_SHORT;
+                m_buffer_bytes += short_elems.size()*sizeof(GLushort);
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                             short_elems.size()*sizeof(GLushort),
+                             short_elems.data(),
+                             GL_STATIC_DRAW);
+            } else {
+                m_elem_gl_type = GL_UNSIGNED_INT;
+                m_buffer_bytes += m_elems.size()*sizeof(Geometry<V>::elem_type);
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                             m_elems.size()*sizeof(Geometry<V>::elem_type),
+                             m_elems.data(),
+                             GL_STATIC_DRAW);
+            }
 
             glBindBuffer(GL_ARRAY_BUFFER, 0);
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
         }
 
+        template <typename V>
+        void Geometry<V>::createBuffers(BufferArenas &arenas) {
+            BufferArena::sptr_type arena = arenas.arenaFor<V>();
+            setArenaRange(arena->allocate(m_vertices.data(), m_vertices.size(), m_elems.data(), m_elems.size()));
+        }
+
         template <typename V>
         void Geometry<V>::createVertexArray(const Program &program) {
+            // The arena's vertex array works with any program.
+            if (m_arena_range) {
+                return;
+            }
+
             deleteVertexArray();
             if (!glIsBuffer(m_vertex_buffer) || !glIsBuffer(m_elem_buffer)) {
                 createBuffers();
             }
 
+            GLuint array_object = 0;
             glUseProgram(program.getProgramId());
-            glGenVertexArrays(1, &m_array_object);
+            glGenVertexArrays(1, &array_object);
+            setVertexArray(array_object, program.getProgramId());
             glBindVertexArray(m_array_object);
             glBindBuffer(GL_ARRAY_BUFFER, m_vertex_buffer);
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_elem_buffer);
@@ -180,7 +256,7 @@ namespace graphplay {
                         shader_attr->second,
                         geo_attr.second.count,
                         geo_attr.second.type,
-                        GL_FALSE,
+                        geo_attr.second.normalized,
                         sizeof(Geometry<V>::vertex_type),
                         BUFFER_OFFSET_BYTES(geo_attr.second.offset));
                 }
@@ -193,88 +269,328 @@ namespace graphplay {
         }
 
         template <typename V>
-        void Geometry<V>::render() const {
-            glBindVertexArray(m_array_object);
+        void Geometry<V>::updateVertices(std::size_t first, std::size_t count) {
+            if (m_vertex_buffer == 0 && !m_arena_range) {
+                createBuffers();
+                return;
+            }
+            if (first >= m_vertices.size()) {
+                return;
+            }
+            count = std::min(count, m_vertices.size() - first);
+
+            makeBuffersUnique();
+            if (m_arena_range) {
+                m_arena_range->arena->updateVertices(*m_arena_range, first, count, &m_vertices[first]);
+                return;
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, m_vertex_buffer);
+            glBufferSubData(GL_ARRAY_BUFFER,
+                            first*sizeof(Geometry<V>::vertex_type),
+                            count*sizeof(Geometry<V>::vertex_type),
+                            &m_vertices[first]);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
 
+        template <typename V>
+        void Geometry<V>::draw() const {
             // static int i = 0;
             // if (i % 500 == 0) {
             //     dumpOpenGLState();
             // }
             // ++i;
 
-            glDrawElements(draw_type, (GLsizei)m_elems.size(), elem_gl_type, BUFFER_OFFSET_BYTES(0));
-            glBindVertexArray(0);
+            if (primitive_restart) {
+                glEnable(GL_PRIMITIVE_RESTART);
+                glPrimitiveRestartIndex(m_elem_gl_type == GL_UNSIGNED_SHORT ? 0xFFFF : PRIMITIVE_RESTART_INDEX);
+            }
+
+            // Patches are always triangles.
+            if (draw_type == GL_PATCHES) {
+                glPatchParameteri(GL_PATCH_VERTICES, 3);
+            }
+
+            glDrawElementsBaseVertex(draw_type, (GLsizei)m_elems.size(), m_elem_gl_type, BUFFER_OFFSET_BYTES(elemOffset()), baseVertex());
+
+            if (primitive_restart) {
+                glDisable(GL_PRIMITIVE_RESTART);
+            }
         }
 
-        // template <typename V>
-        // MutableGeometry<V>::MutableGeometry()
-        //     : Geometry<V>()
-        // {
-        //     // std::cout << "MutableGeometry<V> default constructor: " << this << std::endl;
-        // }
-
-        // template <typename V>
-        // MutableGeometry<V>::MutableGeometry(const Geometry<V> &other)
-        //     : Geometry<V>(other)
-        // {
-        //     // std::cout << "MutableGeometry<V> copy constructor: " << &other << " -> " << this << std::endl;
-        // }
-
-        // template <typename V>
-        // MutableGeometry<V>::MutableGeometry(Geometry<V> &&other)
-        //     : Geometry<V>(std::forward(other))
-        // {
-        //     // std::cout << "MutableGeometry<V> move constructor: " << &other << " -> " << this << std::endl;
-        // }
-
-        // template <typename V>
-        // MutableGeometry<V>::~MutableGeometry() {
-        //     // std::cout << "MutableGeometry<V> destructor: " << this << std::endl;
-        // }
-
-        // template <typename V>
-        // MutableGeometry<V>& MutableGeometry<V>::operator=(const Geometry<V> &other) {
-        //     // std::cout << "MutableGeometry<V> geometry copy assignment: " << &other << " -> " << this << std::endl;
-        //     *dynamic_cast<Geometry<V>*>(this) = other;
-        //     return *this;
-        // }
-
-        // template <typename V>
-        // MutableGeometry<V>& MutableGeometry<V>::operator=(Geometry<V> &&other) {
-        //     // std::cout << "MutableGeometry<V> geometry move assignment: " << &other << " -> " << this << std::endl;
-        //     *dynamic_cast<Geometry<V>*>(this) = std::move(other);
-        //     return *this;
-        // }
-
-        // template <typename V>
-        // void MutableGeometry<V>::createBuffers() {
-        //     this->deleteBuffers();
-
-        //     GLuint buffers[2];
-        //     glGenBuffers(2, buffers);
-        //     this->m_vertex_buffer = buffers[0];
-        //     this->m_elem_buffer = buffers[1];
-
-        //     this->updateBuffers();
-        // }
-
-        // template <typename V>
-        // void MutableGeometry<V>::updateBuffers() {
-        //     glBindBuffer(GL_ARRAY_BUFFER, this->m_vertex_buffer);
-        //     glBufferData(GL_ARRAY_BUFFER,
-        //                  this->m_vertices.size()*sizeof(typename MutableGeometry<V>::vertex_type),
-        //                  this->m_vertices.data(),
-        //                  GL_DYNAMIC_DRAW);
-
-        //     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->m_elem_buffer);
-        //     glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-        //                  this->m_elems.size()*sizeof(typename MutableGeometry<V>::elem_type),
-        //                  this->m_elems.data(),
-        //                  GL_DYNAMIC_DRAW);
-
-        //     glBindBuffer(GL_ARRAY_BUFFER, 0);
-        //     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-        // }
+        template <typename V>
+        void Geometry<V>::drawInstances(GLsizei count) const {
+            if (primitive_restart) {
+                glEnable(GL_PRIMITIVE_RESTART);
+                glPrimitiveRestartIndex(m_elem_gl_type == GL_UNSIGNED_SHORT ? 0xFFFF : PRIMITIVE_RESTART_INDEX);
+            }
+
+            // Patches are always triangles.
+            if (draw_type == GL_PATCHES) {
+                glPatchParameteri(GL_PATCH_VERTICES, 3);
+            }
+
+            glDrawElementsInstancedBaseVertex(draw_type, (GLsizei)m_elems.size(), m_elem_gl_type, BUFFER_OFFSET_BYTES(elemOffset()), count, baseVertex());
+
+            if (primitive_restart) {
+                glDisable(GL_PRIMITIVE_RESTART);
+            }
+        }
+
+        template <typename V>
+        void Geometry<V>::drawRanges(const std::vector<GLuint> &firsts, const std::vector<GLsizei> &counts) const {
+            const std::size_t elem_size = m_elem_gl_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+            std::vector<const GLvoid*> offsets(firsts.size());
+            std::vector<GLint> base_vertices(firsts.size(), baseVertex());
+            for (std::size_t i = 0; i < firsts.size(); ++i) {
+                offsets[i] = BUFFER_OFFSET_BYTES(elemOffset() + firsts[i]*elem_size);
+            }
+
+            if (primitive_restart) {
+                glEnable(GL_PRIMITIVE_RESTART);
+                glPrimitiveRestartIndex(m_elem_gl_type == GL_UNSIGNED_SHORT ? 0xFFFF : PRIMITIVE_RESTART_INDEX);
+            }
+
+            // Patches are always triangles.
+            if (draw_type == GL_PATCHES) {
+                glPatchParameteri(GL_PATCH_VERTICES, 3);
+            }
+
+            glMultiDrawElementsBaseVertex(draw_type, counts.data(), m_elem_gl_type, offsets.data(), (GLsizei)counts.size(), base_vertices.data());
+
+            if (primitive_restart) {
+                glDisable(GL_PRIMITIVE_RESTART);
+            }
+        }
+
+        template <typename V>
+        const unsigned int MutableGeometry<V>::SEGMENTS;
+
+        template <typename V>
+        MutableGeometry<V>::MutableGeometry()
+            : Geometry<V>(),
+              m_vertex_capacity(0),
+              m_elem_capacity(0),
+              m_segment(0),
+              m_orphans(0),
+              m_fences()
+        {}
+
+        // Copies get their own buffers when they're first updated,
+        // rather than sharing them, since they're going to be
+        // rewritten anyway.
+        template <typename V>
+        MutableGeometry<V>::MutableGeometry(const MutableGeometry<V> &other)
+            : Geometry<V>(other),
+              m_vertex_capacity(0),
+              m_elem_capacity(0),
+              m_segment(0),
+              m_orphans(0),
+              m_fences()
+        {
+            AbstractGeometry::deleteBuffers();
+        }
+
+        template <typename V>
+        MutableGeometry<V>::MutableGeometry(const Geometry<V> &other)
+            : Geometry<V>(other),
+              m_vertex_capacity(0),
+              m_elem_capacity(0),
+              m_segment(0),
+              m_orphans(0),
+              m_fences()
+        {
+            AbstractGeometry::deleteBuffers();
+        }
+
+        template <typename V>
+        MutableGeometry<V>::MutableGeometry(Geometry<V> &&other)
+            : Geometry<V>(std::move(other)),
+              m_vertex_capacity(0),
+              m_elem_capacity(0),
+              m_segment(0),
+              m_orphans(0),
+              m_fences()
+        {
+            AbstractGeometry::deleteBuffers();
+        }
+
+        template <typename V>
+        MutableGeometry<V>::~MutableGeometry() {
+            deleteFences();
+        }
+
+        template <typename V>
+        MutableGeometry<V>& MutableGeometry<V>::operator=(const MutableGeometry<V> &other) {
+            return *this = static_cast<const Geometry<V>&>(other);
+        }
+
+        template <typename V>
+        MutableGeometry<V>& MutableGeometry<V>::operator=(const Geometry<V> &other) {
+            Geometry<V>::operator=(other);
+            deleteBuffers();
+            return *this;
+        }
+
+        template <typename V>
+        MutableGeometry<V>& MutableGeometry<V>::operator=(Geometry<V> &&other) {
+            Geometry<V>::operator=(std::move(other));
+            deleteBuffers();
+            return *this;
+        }
+
+        template <typename V>
+        void MutableGeometry<V>::createBuffers() {
+            deleteBuffers();
+
+            GLuint buffers[2];
+            glGenBuffers(2, buffers);
+            this->setBuffers(buffers[0], buffers[1]);
+            allocateSegments();
+            updateBuffers();
+        }
+
+        template <typename V>
+        void MutableGeometry<V>::createBuffers(BufferArenas &) {
+            createBuffers();
+        }
+
+        template <typename V>
+        void MutableGeometry<V>::deleteBuffers() {
+            deleteFences();
+            AbstractGeometry::deleteBuffers();
+            m_vertex_capacity = 0;
+            m_elem_capacity = 0;
+            m_segment = 0;
+        }
+
+        template <typename V>
+        void MutableGeometry<V>::updateBuffers() {
+            if (this->m_vertex_buffer == 0) {
+                createBuffers();
+                return;
+            }
+
+            this->updateBoundingBox();
+
+            const std::size_t num_verts = this->m_vertices.size(), num_elems = this->m_elems.size();
+            if (num_verts > m_vertex_capacity || num_elems > m_elem_capacity) {
+                // Leave some room, so that slowly growing data
+                // doesn't reallocate every frame.
+                m_vertex_capacity = std::max(num_verts, m_vertex_capacity + m_vertex_capacity/2);
+                m_elem_capacity = std::max(num_elems, m_elem_capacity + m_elem_capacity/2);
+                m_segment = 0;
+                allocateSegments();
+            } else {
+                m_segment = (m_segment + 1) % SEGMENTS;
+                if (!segmentFree(m_segment)) {
+                    ++m_orphans;
+                    allocateSegments();
+                }
+            }
+
+            // Nothing else is reading this segment, so there's no
+            // need for the driver to synchronize.
+            const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+            const std::size_t vertex_offset = m_segment*m_vertex_capacity*sizeof(V);
+            const std::size_t elem_offset = m_segment*m_elem_capacity*sizeof(GLuint);
+
+            if (num_verts > 0) {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, this->m_vertex_buffer);
+                void *dest = glMapBufferRange(GL_COPY_WRITE_BUFFER, vertex_offset, num_verts*sizeof(V), access);
+                if (dest) {
+                    std::memcpy(dest, this->m_vertices.data(), num_verts*sizeof(V));
+                    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+                } else {
+                    std::cerr << "Could not map vertex buffer segment " << m_segment << std::endl;
+                }
+            }
+            if (num_elems > 0) {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, this->m_elem_buffer);
+                void *dest = glMapBufferRange(GL_COPY_WRITE_BUFFER, elem_offset, num_elems*sizeof(GLuint), access);
+                if (dest) {
+                    std::memcpy(dest, this->m_elems.data(), num_elems*sizeof(GLuint));
+                    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+                } else {
+                    std::cerr << "Could not map element buffer segment " << m_segment << std::endl;
+                }
+            }
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+            this->m_elem_gl_type = GL_UNSIGNED_INT;
+            this->m_base_vertex = static_cast<GLint>(m_segment*m_vertex_capacity);
+            this->m_elem_offset = elem_offset;
+        }
+
+        template <typename V>
+        void MutableGeometry<V>::draw() const {
+            Geometry<V>::draw();
+            fenceSegment();
+        }
+
+        template <typename V>
+        void MutableGeometry<V>::drawRanges(const std::vector<GLuint> &firsts, const std::vector<GLsizei> &counts) const {
+            Geometry<V>::drawRanges(firsts, counts);
+            fenceSegment();
+        }
+
+        template <typename V>
+        void MutableGeometry<V>::drawInstances(GLsizei count) const {
+            Geometry<V>::drawInstances(count);
+            fenceSegment();
+        }
+
+        // (Re)allocate the whole buffers, which orphans the old
+        // storage: the driver keeps it around until the GPU is done
+        // with it, and hands back fresh memory right away.
+        template <typename V>
+        void MutableGeometry<V>::allocateSegments() {
+            deleteFences();
+
+            glBindBuffer(GL_COPY_WRITE_BUFFER, this->m_vertex_buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, SEGMENTS*m_vertex_capacity*sizeof(V), nullptr, GL_STREAM_DRAW);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, this->m_elem_buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, SEGMENTS*m_elem_capacity*sizeof(GLuint), nullptr, GL_STREAM_DRAW);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+            this->m_buffer_bytes = SEGMENTS*(m_vertex_capacity*sizeof(V) + m_elem_capacity*sizeof(GLuint));
+        }
+
+        // Whether the GPU is done with the segment, checked without
+        // waiting.
+        template <typename V>
+        bool MutableGeometry<V>::segmentFree(unsigned int segment) {
+            GLsync &fence = m_fences[segment];
+            if (!fence) {
+                return true;
+            }
+
+            GLenum status = glClientWaitSync(fence, 0, 0);
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+                glDeleteSync(fence);
+                fence = nullptr;
+                return true;
+            }
+            return false;
+        }
+
+        template <typename V>
+        void MutableGeometry<V>::fenceSegment() const {
+            GLsync &fence = m_fences[m_segment];
+            if (fence) {
+                glDeleteSync(fence);
+            }
+            fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+
+        template <typename V>
+        void MutableGeometry<V>::deleteFences() {
+            for (GLsync &fence : m_fences) {
+                if (fence) {
+                    glDeleteSync(fence);
+                    fence = nullptr;
+                }
+            }
+        }
     }
 }
 
@@ -0,0 +1,147 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../graphplay.h"
+#include "GeometryRegistry.h"
+
+#include <fstream>
+#include <iostream>
+
+namespace graphplay {
+    namespace gfx {
+        const std::size_t GeometryRegistry::DEFAULT_BUDGET;
+
+        GeometryRegistry::GeometryRegistry(std::size_t budget, std::size_t arena_vertices, std::size_t arena_elems)
+            : m_budget(budget),
+              m_arenas(arena_vertices, arena_elems),
+              m_entries(),
+              m_index()
+        {}
+
+        std::string GeometryRegistry::primitiveKey(const std::string &type, const std::string &params) {
+            return params.empty() ? "primitive:" + type : "primitive:" + type + "?" + params;
+        }
+
+        std::string GeometryRegistry::assetKey(const std::string &path, const std::string &options) {
+            return options.empty() ? "asset:" + path : "asset:" + path + "?" + options;
+        }
+
+        AbstractGeometry::sptr_type GeometryRegistry::get(const std::string &key, factory_type make) {
+            auto found = m_index.find(key);
+            if (found != m_index.end()) {
+                m_entries.splice(m_entries.begin(), m_entries, found->second);
+                return found->second->geometry;
+            }
+
+            AbstractGeometry::sptr_type geo = make();
+            if (!geo) {
+                std::cerr << "Could not make geometry " << key << std::endl;
+                return geo;
+            }
+            geo->createBuffers(m_arenas);
+
+            m_entries.push_front(Entry{ key, geo });
+            m_index[key] = m_entries.begin();
+            trim();
+            return geo;
+        }
+
+        AbstractGeometry::sptr_type GeometryRegistry::primitive(const std::string &type) {
+            factory_type make;
+            if (type == "octohedron") {
+                make = makeOctohedronGeometry;
+            } else if (type == "icosahedron") {
+                make = makeIcosahedronGeometry;
+            } else if (type == "sphere") {
+                make = makeSphereGeometry;
+            } else if (type == "sphere_patches") {
+                make = makeSpherePatchGeometry;
+            } else if (type == "wireframe_cube") {
+                make = makeWireframeCubeGeometry;
+            } else {
+                std::cerr << "Unknown primitive " << type << std::endl;
+                return AbstractGeometry::sptr_type();
+            }
+
+            return get(primitiveKey(type), make);
+        }
+
+        AbstractGeometry::sptr_type GeometryRegistry::compactPly(const std::string &path) {
+            return get(assetKey(path, "morton,compact,clusters"), [&path]() {
+                    if (!std::ifstream(path.c_str(), std::ios::in | std::ios::binary)) {
+                        std::cerr << "Could not open " << path << std::endl;
+                        return AbstractGeometry::sptr_type();
+                    }
+
+                    Geometry<PCNVertex>::sptr_type ply = loadPlyFile(path.c_str(), true);
+                    if (!ply || ply->vertices().empty()) {
+                        std::cerr << "No vertices in " << path << std::endl;
+                        return AbstractGeometry::sptr_type();
+                    }
+
+                    CompactPCNGeometry::sptr_type geo = makeCompactGeometry(*ply);
+                    geo->buildClusters();
+                    return AbstractGeometry::sptr_type(geo);
+                });
+        }
+
+        bool GeometryRegistry::contains(const std::string &key) const {
+            return m_index.find(key) != m_index.end();
+        }
+
+        std::size_t GeometryRegistry::gpuBytes() const {
+            return m_arenas.gpuBytes() + bytesOutsideArenas();
+        }
+
+        std::size_t GeometryRegistry::bytesOutsideArenas() const {
+            std::size_t total = 0;
+            for (auto &&entry : m_entries) {
+                if (!entry.geometry->arenaRange()) {
+                    total += entry.geometry->gpuBytes();
+                }
+            }
+            return total;
+        }
+
+        void GeometryRegistry::budget(std::size_t new_budget) {
+            m_budget = new_budget;
+            trim();
+        }
+
+        void GeometryRegistry::trim() {
+            if (gpuBytes() <= m_budget) {
+                return;
+            }
+
+            // Dropping a geometry only frees its range inside the
+            // arena, so go by how big the arenas would be compacted,
+            // and compact them once at the end.
+            std::size_t outside = bytesOutsideArenas();
+            auto entry = m_entries.end();
+            while (m_arenas.compactedBytes() + outside > m_budget && entry != m_entries.begin()) {
+                --entry;
+                if (entry->geometry.use_count() > 1) {
+                    continue;
+                }
+
+                if (!entry->geometry->arenaRange()) {
+                    outside -= entry->geometry->gpuBytes();
+                }
+                m_index.erase(entry->key);
+                entry = m_entries.erase(entry);
+            }
+            m_arenas.compact();
+        }
+
+        void GeometryRegistry::evictUnused() {
+            for (auto entry = m_entries.begin(); entry != m_entries.end(); ) {
+                if (entry->geometry.use_count() > 1) {
+                    ++entry;
+                } else {
+                    m_index.erase(entry->key);
+                    entry = m_entries.erase(entry);
+                }
+            }
+            m_arenas.compact();
+        }
+    }
+}
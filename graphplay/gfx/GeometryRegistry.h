@@ -0,0 +1,100 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_GEOMETRY_REGISTRY_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_GEOMETRY_REGISTRY_H_
+
+#include "../graphplay.h"
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <map>
+#include <string>
+
+#include "Geometry.h"
+
+namespace graphplay {
+    namespace gfx {
+        // A cache of geometries, so that everything drawn with the
+        // same primitive or asset shares one set of buffers instead
+        // of getting its own copy. The geometries themselves are
+        // packed into a BufferArena per vertex format, so they all
+        // share the arena's buffers and vertex array.
+        //
+        // The arenas' sizes are tracked, and when the total goes over
+        // the budget the least recently used geometries are dropped
+        // and the arenas compacted to give the space back.
+        // Geometries that are still in use somewhere else are never
+        // dropped, since that wouldn't free anything and the next
+        // request for them would make a duplicate.
+        class GeometryRegistry {
+        public:
+            typedef std::function<AbstractGeometry::sptr_type ()> factory_type;
+
+            static const std::size_t DEFAULT_BUDGET = 256 << 20;
+
+            // The arenas start out with room for arena_vertices and
+            // arena_elems, and never shrink below that.
+            GeometryRegistry(std::size_t budget = DEFAULT_BUDGET,
+                             std::size_t arena_vertices = BufferArena::INITIAL_VERTICES,
+                             std::size_t arena_elems = BufferArena::INITIAL_ELEMS);
+
+            // Keys for primitives are their type and whatever
+            // parameters they were made with; keys for assets are
+            // their path and the options they were loaded with.
+            static std::string primitiveKey(const std::string &type, const std::string &params = "");
+            static std::string assetKey(const std::string &path, const std::string &options = "");
+
+            // The geometry for key. If there isn't one yet, it's made
+            // with make and moved into the arena for its format.
+            AbstractGeometry::sptr_type get(const std::string &key, factory_type make);
+
+            // One of the built-in primitives: "octohedron",
+            // "icosahedron", "sphere", "sphere_patches" or
+            // "wireframe_cube".
+            AbstractGeometry::sptr_type primitive(const std::string &type);
+
+            // A PLY file, Morton sorted, packed down to
+            // CompactPCNVertex's, and split into clusters. nullptr
+            // if it can't be read.
+            AbstractGeometry::sptr_type compactPly(const std::string &path);
+
+            bool contains(const std::string &key) const;
+            inline std::size_t size() const { return m_entries.size(); }
+
+            // How much the registry's arenas (and any geometries
+            // that aren't in one) take up on the GPU.
+            std::size_t gpuBytes() const;
+
+            inline const BufferArenas& arenas() const { return m_arenas; }
+
+            inline std::size_t budget() const { return m_budget; }
+            void budget(std::size_t new_budget);
+
+            // Drop unused geometries, least recently used first,
+            // until the registry is within its budget.
+            void trim();
+
+            // Drop every geometry that isn't being used.
+            void evictUnused();
+
+        private:
+            // What the geometries outside the arenas take up.
+            std::size_t bytesOutsideArenas() const;
+
+            struct Entry {
+                std::string key;
+                AbstractGeometry::sptr_type geometry;
+            };
+            typedef std::list<Entry> entry_list_type;
+
+            std::size_t m_budget;
+            BufferArenas m_arenas;
+            // Most recently used first.
+            entry_list_type m_entries;
+            std::map<std::string, entry_list_type::iterator> m_index;
+        };
+    }
+}
+
+#endif
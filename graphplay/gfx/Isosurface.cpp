@@ -0,0 +1,327 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../graphplay.h"
+#include "Isosurface.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+namespace graphplay {
+    namespace gfx {
+        const unsigned int IsosurfaceExtractor::SLAB_CELLS;
+
+        // The corners of a cell, as offsets along x, y and z, and its
+        // edges as pairs of corners.
+        static const unsigned int CORNERS[8][3] = {
+            { 0, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 1, 1, 0 },
+            { 0, 0, 1 }, { 1, 0, 1 }, { 0, 1, 1 }, { 1, 1, 1 },
+        };
+
+        static const unsigned int EDGES[12][2] = {
+            { 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 },
+            { 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 },
+            { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 },
+        };
+
+        ScalarGrid::ScalarGrid()
+            : m_origin(0.0f),
+              m_cell_size(1.0f),
+              m_values()
+        {
+            m_dims[0] = m_dims[1] = m_dims[2] = 0;
+        }
+
+        ScalarGrid::ScalarGrid(const glm::vec3 &origin, float cell_size, unsigned int nx, unsigned int ny, unsigned int nz)
+            : ScalarGrid()
+        {
+            resize(origin, cell_size, nx, ny, nz);
+        }
+
+        void ScalarGrid::resize(const glm::vec3 &origin, float cell_size, unsigned int nx, unsigned int ny, unsigned int nz) {
+            m_origin = origin;
+            m_cell_size = cell_size;
+            m_dims[0] = nx;
+            m_dims[1] = ny;
+            m_dims[2] = nz;
+            m_values.resize(static_cast<std::size_t>(nx)*ny*nz);
+        }
+
+        glm::vec3 ScalarGrid::gradient(unsigned int x, unsigned int y, unsigned int z) const {
+            const unsigned int p[3] = { x, y, z };
+            const std::size_t strides[3] = { 1, m_dims[0], static_cast<std::size_t>(m_dims[0])*m_dims[1] };
+            const std::size_t i = index(x, y, z);
+
+            glm::vec3 rv(0.0f);
+            for (unsigned int a = 0; a < 3; ++a) {
+                if (m_dims[a] < 2) {
+                    continue;
+                }
+                std::size_t lo = p[a] > 0 ? i - strides[a] : i;
+                std::size_t hi = p[a] + 1 < m_dims[a] ? i + strides[a] : i;
+                float span = (p[a] > 0 && p[a] + 1 < m_dims[a]) ? 2.0f : 1.0f;
+                rv[a] = (m_values[hi] - m_values[lo]) / (span*m_cell_size);
+            }
+            return rv;
+        }
+
+        void ScalarGrid::sampleMetaballs(const std::vector<glm::vec3> &centers, float radius, float threshold) {
+            const float r2 = radius*radius, inv_r2 = 1.0f / r2, inv_h = 1.0f / m_cell_size;
+            parallelFor(m_dims[2], 1, [&](std::size_t zi) {
+                    const unsigned int z = static_cast<unsigned int>(zi);
+                    float *slice = &m_values[index(0, 0, z)];
+                    std::fill(slice, slice + static_cast<std::size_t>(m_dims[0])*m_dims[1], threshold);
+
+                    const float pz = m_origin.z + m_cell_size*z;
+                    for (std::size_t b = 0; b < centers.size(); ++b) {
+                        const glm::vec3 &c = centers[b];
+                        const float dz2 = (pz - c.z)*(pz - c.z);
+                        if (dz2 >= r2) {
+                            continue;
+                        }
+
+                        // The points of this slice within the ball's
+                        // circle.
+                        const float slice_r = std::sqrt(r2 - dz2);
+                        const int y0 = std::max(0, static_cast<int>(std::ceil((c.y - slice_r - m_origin.y)*inv_h)));
+                        const int y1 = std::min(static_cast<int>(m_dims[1]) - 1, static_cast<int>(std::floor((c.y + slice_r - m_origin.y)*inv_h)));
+                        for (int y = y0; y <= y1; ++y) {
+                            const float py = m_origin.y + m_cell_size*y;
+                            const float dyz2 = dz2 + (py - c.y)*(py - c.y);
+                            if (dyz2 >= r2) {
+                                continue;
+                            }
+                            const float row_r = std::sqrt(r2 - dyz2);
+                            const int x0 = std::max(0, static_cast<int>(std::ceil((c.x - row_r - m_origin.x)*inv_h)));
+                            const int x1 = std::min(static_cast<int>(m_dims[0]) - 1, static_cast<int>(std::floor((c.x + row_r - m_origin.x)*inv_h)));
+                            float *row = slice + static_cast<std::size_t>(y)*m_dims[0];
+                            for (int x = x0; x <= x1; ++x) {
+                                const float px = m_origin.x + m_cell_size*x;
+                                const float d = std::max(0.0f, 1.0f - (dyz2 + (px - c.x)*(px - c.x))*inv_r2);
+                                row[x] -= d*d;
+                            }
+                        }
+                    }
+                });
+        }
+
+        void ScalarGrid::sampleMetaballs(const std::vector<fzx::Body::sptr_type> &bodies, float alpha, float radius, float threshold) {
+            std::vector<glm::vec3> centers;
+            centers.reserve(bodies.size());
+            for (auto body : bodies) {
+                centers.push_back(body->position(alpha));
+            }
+            sampleMetaballs(centers, radius, threshold);
+        }
+
+        IsosurfaceExtractor::IsosurfaceExtractor()
+            : m_slabs(),
+              m_inside(),
+              m_cell_vertices()
+        {}
+
+        // Whether all the cells from x to x + 7 in a row have every
+        // corner on the same side of the surface, judging by the
+        // four rows of points around them.
+        static inline bool uniformCells(const std::uint8_t *const rows[4], unsigned int x) {
+            const std::uint64_t ONES = 0x0101010101010101ull;
+            std::uint64_t any = 0, all = ONES;
+            for (unsigned int r = 0; r < 4; ++r) {
+                std::uint64_t lo, hi;
+                std::memcpy(&lo, rows[r] + x, 8);
+                std::memcpy(&hi, rows[r] + x + 1, 8);
+                any |= lo | hi;
+                all &= lo & hi;
+            }
+            return any == 0 || all == ONES;
+        }
+
+        void IsosurfaceExtractor::extract(const ScalarGrid &grid, float iso, const glm::vec4 &color, Geometry<PCNVertex> &geo) {
+            geo.draw_type = GL_TRIANGLES;
+            geo.primitive_restart = false;
+
+            const unsigned int nx = grid.dimension(0), ny = grid.dimension(1), nz = grid.dimension(2);
+            if (nx < 2 || ny < 2 || nz < 2) {
+                geo.setVertexData(Geometry<PCNVertex>::elem_array_type(), Geometry<PCNVertex>::vertex_array_type());
+                return;
+            }
+
+            const unsigned int cx = nx - 1, cy = ny - 1, cz = nz - 1;
+            const std::size_t sy = nx, sz = static_cast<std::size_t>(nx)*ny;
+            const std::size_t offsets[8] = { 0, 1, sy, sy + 1, sz, sz + 1, sz + sy, sz + sy + 1 };
+            const float *values = grid.values().data();
+            const float h = grid.cellSize();
+            const glm::vec3 origin = grid.origin();
+
+            const unsigned int num_slabs = (cz + SLAB_CELLS - 1) / SLAB_CELLS;
+            m_slabs.resize(num_slabs);
+            m_cell_vertices.resize(static_cast<std::size_t>(cx)*cy*cz);
+            auto cellIndex = [cx, cy](unsigned int x, unsigned int y, unsigned int z) {
+                return (static_cast<std::size_t>(z)*cy + y)*cx + x;
+            };
+
+            // Which side of the surface each point is on, a byte
+            // each, so that whole runs of cells can be skipped at once.
+            m_inside.resize(grid.values().size());
+            parallelFor(nz, 1, [&](std::size_t z) {
+                    for (std::size_t i = z*sz; i < (z + 1)*sz; ++i) {
+                        m_inside[i] = values[i] < iso ? 1 : 0;
+                    }
+                });
+            const std::uint8_t *inside = m_inside.data();
+
+            // One vertex in each cell with corners on both sides of
+            // the surface.
+            parallelFor(num_slabs, 1, [&](std::size_t s) {
+                    Slab &slab = m_slabs[s];
+                    slab.vertices.clear();
+                    slab.cells.clear();
+                    slab.elems.clear();
+
+                    const unsigned int z_end = std::min(cz, static_cast<unsigned int>(s + 1)*SLAB_CELLS);
+                    for (unsigned int z = static_cast<unsigned int>(s)*SLAB_CELLS; z < z_end; ++z) {
+                        for (unsigned int y = 0; y < cy; ++y) {
+                            const std::size_t row = grid.index(0, y, z);
+                            const std::uint8_t *const rows[4] = { inside + row, inside + row + sy, inside + row + sz, inside + row + sz + sy };
+
+                            for (unsigned int x = 0; x < cx; ++x) {
+                                if (x % 8 == 0 && x + 9 <= nx && uniformCells(rows, x)) {
+                                    x += 7;
+                                    continue;
+                                }
+
+                                unsigned int mask = 0;
+                                for (unsigned int c = 0; c < 8; ++c) {
+                                    mask |= static_cast<unsigned int>(inside[row + x + offsets[c]]) << c;
+                                }
+                                if (mask == 0 || mask == 0xFF) {
+                                    continue;
+                                }
+
+                                const float *v = values + row + x;
+                                glm::vec3 normals[8];
+                                unsigned int have_normal = 0;
+                                float sum[3] = { 0.0f, 0.0f, 0.0f }, normal[3] = { 0.0f, 0.0f, 0.0f };
+                                unsigned int crossings = 0;
+                                for (unsigned int e = 0; e < 12; ++e) {
+                                    const unsigned int a = EDGES[e][0], b = EDGES[e][1];
+                                    if (((mask >> a) & 1) == ((mask >> b) & 1)) {
+                                        continue;
+                                    }
+
+                                    for (unsigned int c : { a, b }) {
+                                        if (!(have_normal & (1 << c))) {
+                                            normals[c] = grid.gradient(x + CORNERS[c][0], y + CORNERS[c][1], z + CORNERS[c][2]);
+                                            have_normal |= 1 << c;
+                                        }
+                                    }
+
+                                    const float va = v[offsets[a]], vb = v[offsets[b]];
+                                    const float t = (iso - va) / (vb - va);
+                                    for (unsigned int k = 0; k < 3; ++k) {
+                                        sum[k] += CORNERS[a][k] + t*(static_cast<float>(CORNERS[b][k]) - CORNERS[a][k]);
+                                        normal[k] += normals[a][k] + t*(normals[b][k] - normals[a][k]);
+                                    }
+                                    ++crossings;
+                                }
+
+                                PCNVertex vertex;
+                                const float inv = 1.0f / crossings;
+                                const float length = std::sqrt(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2]);
+                                const float inv_length = length > 0.0f ? 1.0f / length : 0.0f;
+                                const unsigned int cell[3] = { x, y, z };
+                                for (unsigned int k = 0; k < 3; ++k) {
+                                    vertex.position[k] = origin[k] + h*(cell[k] + sum[k]*inv);
+                                    vertex.normal[k] = normal[k]*inv_length;
+                                }
+                                for (unsigned int k = 0; k < 4; ++k) {
+                                    vertex.color[k] = color[k];
+                                }
+
+                                ActiveCell active = { x, y, z, mask };
+                                m_cell_vertices[cellIndex(x, y, z)] = static_cast<GLuint>(slab.vertices.size());
+                                slab.vertices.push_back(vertex);
+                                slab.cells.push_back(active);
+                            }
+                        }
+                    }
+                });
+
+            std::size_t num_vertices = 0;
+            for (Slab &slab : m_slabs) {
+                slab.first_vertex = num_vertices;
+                num_vertices += slab.vertices.size();
+            }
+
+            // A quad for each grid edge the surface crosses, joining
+            // the four cells around it and facing the outside end of
+            // the edge. Each one is made by the cell the edge leaves
+            // the lowest corner of.
+            parallelFor(num_slabs, 1, [&](std::size_t s) {
+                    Slab &slab = m_slabs[s];
+                    auto vertexIndex = [&](const unsigned int *cell) {
+                        return static_cast<GLuint>(m_slabs[cell[2] / SLAB_CELLS].first_vertex + m_cell_vertices[cellIndex(cell[0], cell[1], cell[2])]);
+                    };
+
+                    for (const ActiveCell &active : slab.cells) {
+                        const unsigned int p[3] = { active.x, active.y, active.z };
+                        const unsigned int far_corners[3] = { 1 << 1, 1 << 2, 1 << 4 };
+                        const bool in = (active.mask & 1) != 0;
+
+                        for (unsigned int a = 0; a < 3; ++a) {
+                            const unsigned int b = (a + 1) % 3, c = (a + 2) % 3;
+                            if (p[b] == 0 || p[c] == 0 || in == ((active.mask & far_corners[a]) != 0)) {
+                                continue;
+                            }
+
+                            // The cells at (b - 1, c - 1), (b, c - 1),
+                            // (b, c) and (b - 1, c), which wind
+                            // around +a.
+                            GLuint quad[4];
+                            const unsigned int steps[4][2] = { { 1, 1 }, { 0, 1 }, { 0, 0 }, { 1, 0 } };
+                            for (unsigned int q = 0; q < 4; ++q) {
+                                unsigned int cell[3] = { p[0], p[1], p[2] };
+                                cell[b] -= steps[q][0];
+                                cell[c] -= steps[q][1];
+                                quad[q] = vertexIndex(cell);
+                            }
+                            if (!in) {
+                                std::swap(quad[1], quad[3]);
+                            }
+
+                            GLuint tris[6] = { quad[0], quad[1], quad[2], quad[0], quad[2], quad[3] };
+                            slab.elems.insert(slab.elems.end(), tris, tris + 6);
+                        }
+                    }
+                });
+
+            std::size_t num_elems = 0;
+            for (Slab &slab : m_slabs) {
+                slab.first_elem = num_elems;
+                num_elems += slab.elems.size();
+            }
+
+            // Moving the arrays out and back keeps their memory from
+            // one extraction to the next.
+            Geometry<PCNVertex>::vertex_array_type verts(std::move(geo.vertices()));
+            Geometry<PCNVertex>::elem_array_type elems(std::move(geo.elements()));
+            verts.resize(num_vertices);
+            elems.resize(num_elems);
+            parallelFor(num_slabs, 1, [&](std::size_t s) {
+                    const Slab &slab = m_slabs[s];
+                    std::copy(slab.vertices.begin(), slab.vertices.end(), verts.begin() + slab.first_vertex);
+                    std::copy(slab.elems.begin(), slab.elems.end(), elems.begin() + slab.first_elem);
+                });
+            geo.setVertexData(std::move(elems), std::move(verts));
+        }
+
+        Geometry<PCNVertex>::sptr_type extractIsosurface(const ScalarGrid &grid, float iso, const glm::vec4 &color) {
+            Geometry<PCNVertex>::sptr_type rv = std::make_shared<Geometry<PCNVertex> >();
+            IsosurfaceExtractor extractor;
+            extractor.extract(grid, iso, color, *rv);
+            return rv;
+        }
+    }
+}
@@ -0,0 +1,129 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_ISOSURFACE_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_ISOSURFACE_H_
+
+#include "../graphplay.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include "../opengl.h"
+#include "../Parallel.h"
+#include "../fzx/Body.h"
+#include "Geometry.h"
+
+namespace graphplay {
+    namespace gfx {
+        // A scalar field sampled at the corners of a regular grid of
+        // cells. Like a distance field, it's negative inside the
+        // surface and positive outside it.
+        class ScalarGrid {
+        public:
+            ScalarGrid();
+            ScalarGrid(const glm::vec3 &origin, float cell_size, unsigned int nx, unsigned int ny, unsigned int nz);
+
+            // nx, ny and nz are the number of points along each axis,
+            // one more than the number of cells.
+            void resize(const glm::vec3 &origin, float cell_size, unsigned int nx, unsigned int ny, unsigned int nz);
+
+            inline const glm::vec3& origin() const { return m_origin; }
+            inline float cellSize() const { return m_cell_size; }
+            inline unsigned int dimension(unsigned int axis) const { return m_dims[axis]; }
+            inline std::vector<float>& values() { return m_values; }
+            inline const std::vector<float>& values() const { return m_values; }
+
+            inline std::size_t index(unsigned int x, unsigned int y, unsigned int z) const {
+                return (static_cast<std::size_t>(z)*m_dims[1] + y)*m_dims[0] + x;
+            }
+            inline float& at(unsigned int x, unsigned int y, unsigned int z) { return m_values[index(x, y, z)]; }
+            inline float at(unsigned int x, unsigned int y, unsigned int z) const { return m_values[index(x, y, z)]; }
+            inline glm::vec3 pointAt(unsigned int x, unsigned int y, unsigned int z) const {
+                return glm::vec3(m_origin.x + m_cell_size*x, m_origin.y + m_cell_size*y, m_origin.z + m_cell_size*z);
+            }
+
+            // The gradient at a grid point, by central differences
+            // (one-sided at the edges).
+            glm::vec3 gradient(unsigned int x, unsigned int y, unsigned int z) const;
+
+            // Set every point to fn(position), in parallel.
+            template <typename F>
+            void sample(F fn) {
+                parallelFor(m_dims[2], 1, [&](std::size_t z) {
+                        for (unsigned int y = 0; y < m_dims[1]; ++y) {
+                            for (unsigned int x = 0; x < m_dims[0]; ++x) {
+                                at(x, y, static_cast<unsigned int>(z)) = fn(pointAt(x, y, static_cast<unsigned int>(z)));
+                            }
+                        }
+                    });
+            }
+
+            // Metaballs: each center adds (1 - r^2/R^2)^2 of density
+            // within radius R of it, and the surface is where the
+            // density reaches threshold. Only the points near each
+            // ball are touched.
+            void sampleMetaballs(const std::vector<glm::vec3> &centers, float radius, float threshold);
+            void sampleMetaballs(const std::vector<fzx::Body::sptr_type> &bodies, float alpha, float radius, float threshold);
+
+        private:
+            glm::vec3 m_origin;
+            float m_cell_size;
+            unsigned int m_dims[3];
+            std::vector<float> m_values;
+        };
+
+        // Extracts triangle meshes from scalar grids by dual
+        // contouring: every cell the surface passes through gets one
+        // vertex, at the average of the places the surface crosses
+        // the cell's edges, and every grid edge the surface crosses
+        // gets a quad joining the four cells around it. Normals come
+        // from the field's gradient.
+        //
+        // The grid is split into slabs of cells that are processed in
+        // parallel, each with its own vertex and element lists, which
+        // are then stitched together. An extractor keeps all of that
+        // from one extraction to the next, so re-extracting a field
+        // every frame doesn't allocate.
+        class IsosurfaceExtractor {
+        public:
+            IsosurfaceExtractor();
+
+            // Replace geo's vertices and elements with the surface
+            // where grid is iso. The geometry's buffers are left for
+            // the caller to update.
+            void extract(const ScalarGrid &grid, float iso, const glm::vec4 &color, Geometry<PCNVertex> &geo);
+
+            static const unsigned int SLAB_CELLS = 4;
+
+        private:
+            // A cell the surface passes through, and which of its
+            // corners are inside.
+            struct ActiveCell {
+                unsigned int x, y, z;
+                unsigned int mask;
+            };
+
+            struct Slab {
+                std::vector<PCNVertex> vertices;
+                std::vector<ActiveCell> cells;
+                std::vector<GLuint> elems;
+                std::size_t first_vertex, first_elem;
+            };
+
+            std::vector<Slab> m_slabs;
+            std::vector<std::uint8_t> m_inside;
+            // The index within its slab of the vertex in each cell the
+            // surface passes through. Other cells are never read, so
+            // this never needs clearing.
+            std::vector<GLuint> m_cell_vertices;
+        };
+
+        Geometry<PCNVertex>::sptr_type extractIsosurface(const ScalarGrid &grid, float iso, const glm::vec4 &color);
+    }
+}
+
+#endif
@@ -0,0 +1,284 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../graphplay.h"
+#include "LightClusters.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../Parallel.h"
+
+namespace graphplay {
+    namespace gfx {
+        const unsigned int LightClusters::TILES_ACROSS;
+        const unsigned int LightClusters::TILES_DOWN;
+        const unsigned int LightClusters::SLICES;
+        const unsigned int LightClusters::CLUSTERS;
+        const unsigned int LightClusters::EVERYWHERE;
+
+        LightClusters::LightClusters()
+            : m_near(0.0f),
+              m_far(0.0f),
+              m_slice_scale(0.0f),
+              m_slice_bias(0.0f),
+              m_cluster_min(CLUSTERS),
+              m_cluster_max(CLUSTERS),
+              m_slice_depths(SLICES + 1),
+              m_view_lights(),
+              m_grid(2*(CLUSTERS + 1), 0),
+              m_indices(),
+              m_slice_indices(SLICES),
+              m_slice_lights(SLICES),
+              m_light_data(),
+              m_light_capacity(0),
+              m_buffers{ 0, 0, 0 },
+              m_textures{ 0, 0, 0 }
+        {
+            setProjection(glm::perspective(1.0f, 1.0f, 0.1f, 100.0f));
+        }
+
+        LightClusters::~LightClusters() {
+            deleteBuffers();
+        }
+
+        void LightClusters::setProjection(const glm::mat4x4 &projection) {
+            // Undo what glm::perspective did.
+            m_near = projection[3][2] / (projection[2][2] - 1.0f);
+            m_far = projection[3][2] / (projection[2][2] + 1.0f);
+            const float tan_x = 1.0f / projection[0][0], tan_y = 1.0f / projection[1][1];
+
+            const float log_ratio = std::log(m_far / m_near);
+            m_slice_scale = SLICES / log_ratio;
+            m_slice_bias = -(float)SLICES * std::log(m_near) / log_ratio;
+            for (unsigned int z = 0; z <= SLICES; ++z) {
+                m_slice_depths[z] = m_near * std::pow(m_far / m_near, (float)z / SLICES);
+            }
+
+            for (unsigned int z = 0; z < SLICES; ++z) {
+                const float d0 = m_slice_depths[z], d1 = m_slice_depths[z + 1];
+                for (unsigned int y = 0; y < TILES_DOWN; ++y) {
+                    const float y0 = (2.0f*y/TILES_DOWN - 1.0f)*tan_y, y1 = (2.0f*(y + 1)/TILES_DOWN - 1.0f)*tan_y;
+                    for (unsigned int x = 0; x < TILES_ACROSS; ++x) {
+                        const float x0 = (2.0f*x/TILES_ACROSS - 1.0f)*tan_x, x1 = (2.0f*(x + 1)/TILES_ACROSS - 1.0f)*tan_x;
+
+                        // The tile's sides spread out with depth, so
+                        // the box has to take in both ends of them.
+                        const unsigned int c = clusterIndex(x, y, z);
+                        m_cluster_min[c] = glm::vec3(std::min(x0*d0, x0*d1), std::min(y0*d0, y0*d1), -d1);
+                        m_cluster_max[c] = glm::vec3(std::max(x1*d0, x1*d1), std::max(y1*d0, y1*d1), -d0);
+                    }
+                }
+            }
+        }
+
+        unsigned int LightClusters::slice(float depth) const {
+            float s = std::log(std::max(depth, 1.0e-4f))*m_slice_scale + m_slice_bias;
+            return (unsigned int)std::min(std::max(s, 0.0f), (float)(SLICES - 1));
+        }
+
+        void LightClusters::assign(const std::vector<Light> &lights, const glm::mat4x4 &view) {
+            m_view_lights.resize(lights.size());
+            parallelFor(lights.size(), 1 << 10, [&](std::size_t i) {
+                    glm::vec4 position = view * glm::vec4(lights[i].position, 1.0f);
+                    m_view_lights[i] = glm::vec4(position.x, position.y, position.z, lights[i].radius);
+                });
+
+            parallelFor(SLICES, 1, [&](std::size_t z) {
+                    const float d0 = m_slice_depths[z], d1 = m_slice_depths[z + 1];
+                    std::vector<Candidate> &candidates = m_slice_lights[z];
+                    std::vector<GLuint> &indices = m_slice_indices[z];
+                    candidates.clear();
+                    indices.clear();
+
+                    // Only the lights that reach this deep are worth
+                    // checking against each cluster, and then only
+                    // the columns and rows of tiles they overlap.
+                    // The boxes of a column all have the same x
+                    // extent, and those of a row the same y.
+                    for (std::size_t i = 0; i < lights.size(); ++i) {
+                        const glm::vec4 &light = m_view_lights[i];
+                        if (!lights[i].enabled || light.w <= 0.0f || -light.z + light.w < d0 || -light.z - light.w > d1) {
+                            continue;
+                        }
+
+                        Candidate candidate = { (GLuint)i, 0, TILES_ACROSS - 1, 0, TILES_DOWN - 1 };
+                        const unsigned int slice_first = clusterIndex(0, 0, (unsigned int)z);
+                        while (candidate.first_x < candidate.last_x && m_cluster_max[slice_first + candidate.first_x].x < light.x - light.w) {
+                            ++candidate.first_x;
+                        }
+                        while (candidate.last_x > candidate.first_x && m_cluster_min[slice_first + candidate.last_x].x > light.x + light.w) {
+                            --candidate.last_x;
+                        }
+                        while (candidate.first_y < candidate.last_y && m_cluster_max[clusterIndex(0, candidate.first_y, (unsigned int)z)].y < light.y - light.w) {
+                            ++candidate.first_y;
+                        }
+                        while (candidate.last_y > candidate.first_y && m_cluster_min[clusterIndex(0, candidate.last_y, (unsigned int)z)].y > light.y + light.w) {
+                            --candidate.last_y;
+                        }
+                        candidates.push_back(candidate);
+                    }
+
+                    for (unsigned int y = 0; y < TILES_DOWN; ++y) {
+                        for (unsigned int x = 0; x < TILES_ACROSS; ++x) {
+                            const unsigned int c = clusterIndex(x, y, (unsigned int)z);
+                            const GLuint first = (GLuint)indices.size();
+                            for (auto &&candidate : candidates) {
+                                if (x < candidate.first_x || x > candidate.last_x || y < candidate.first_y || y > candidate.last_y) {
+                                    continue;
+                                }
+
+                                const glm::vec4 &light = m_view_lights[candidate.light];
+                                glm::vec3 center(light.x, light.y, light.z);
+                                glm::vec3 off = center - glm::clamp(center, m_cluster_min[c], m_cluster_max[c]);
+                                if (glm::dot(off, off) <= light.w*light.w) {
+                                    indices.push_back(candidate.light);
+                                }
+                            }
+
+                            // Relative to the slice for now.
+                            m_grid[2*c] = first;
+                            m_grid[2*c + 1] = (GLuint)indices.size() - first;
+                        }
+                    }
+                });
+
+            m_indices.clear();
+            for (unsigned int z = 0; z < SLICES; ++z) {
+                const GLuint base = (GLuint)m_indices.size();
+                for (unsigned int c = clusterIndex(0, 0, z); c < clusterIndex(0, 0, z + 1); ++c) {
+                    m_grid[2*c] += base;
+                }
+                m_indices.insert(m_indices.end(), m_slice_indices[z].begin(), m_slice_indices[z].end());
+            }
+
+            m_grid[2*EVERYWHERE] = (GLuint)m_indices.size();
+            for (std::size_t i = 0; i < lights.size(); ++i) {
+                if (lights[i].enabled && lights[i].radius <= 0.0f) {
+                    m_indices.push_back((GLuint)i);
+                }
+            }
+            m_grid[2*EVERYWHERE + 1] = (GLuint)m_indices.size() - m_grid[2*EVERYWHERE];
+        }
+
+        LightClusterBlock LightClusters::block(unsigned int vp_width, unsigned int vp_height) const {
+            LightClusterBlock rv;
+            rv.size[0] = TILES_ACROSS;
+            rv.size[1] = TILES_DOWN;
+            rv.size[2] = SLICES;
+            rv.deferred = 0;
+            rv.scale = glm::vec4((float)vp_width / TILES_ACROSS, (float)vp_height / TILES_DOWN, m_slice_scale, m_slice_bias);
+            return rv;
+        }
+
+        void LightClusters::createBuffers() {
+            const GLenum formats[] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+
+            deleteBuffers();
+            glGenBuffers(3, m_buffers);
+            glGenTextures(3, m_textures);
+            for (int i = 0; i < 3; ++i) {
+                glBindBuffer(GL_TEXTURE_BUFFER, m_buffers[i]);
+                glBufferData(GL_TEXTURE_BUFFER, 0, nullptr, GL_DYNAMIC_DRAW);
+                glBindTexture(GL_TEXTURE_BUFFER, m_textures[i]);
+                glTexBuffer(GL_TEXTURE_BUFFER, formats[i], m_buffers[i]);
+            }
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+            m_light_capacity = 0;
+        }
+
+        std::size_t LightClusters::updateLights(const std::vector<Light> &lights, std::size_t first, std::size_t last) {
+            // If it's grown, it all has to go up again.
+            const bool grown = lights.size() > m_light_capacity;
+            if (grown) {
+                first = 0;
+                last = lights.size();
+            }
+            last = std::min(last, lights.size());
+            if (first >= last) {
+                return 0;
+            }
+
+            m_light_data.resize(lights.size());
+            for (std::size_t i = first; i < last; ++i) {
+                LightProperties &props = m_light_data[i];
+                props.position = lights[i].position;
+                props.radius = lights[i].radius;
+                props.color = lights[i].color;
+                props.specular_exp = (GLfloat)lights[i].specular_exp;
+                props.pad0[0] = props.pad0[1] = props.pad0[2] = 0.0f;
+            }
+
+            const std::size_t bytes = (last - first)*sizeof(LightProperties);
+            glBindBuffer(GL_TEXTURE_BUFFER, m_buffers[0]);
+            if (grown) {
+                glBufferData(GL_TEXTURE_BUFFER, bytes, m_light_data.data(), GL_DYNAMIC_DRAW);
+                m_light_capacity = lights.size();
+            } else {
+                glBufferSubData(GL_TEXTURE_BUFFER, first*sizeof(LightProperties), bytes, &m_light_data[first]);
+            }
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+            return bytes;
+        }
+
+        std::size_t LightClusters::updateClusters() {
+            // Both change completely whenever the camera moves, so
+            // just replace them.
+            const std::size_t grid_bytes = m_grid.size()*sizeof(GLuint), index_bytes = m_indices.size()*sizeof(GLuint);
+            glBindBuffer(GL_TEXTURE_BUFFER, m_buffers[1]);
+            glBufferData(GL_TEXTURE_BUFFER, grid_bytes, m_grid.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_TEXTURE_BUFFER, m_buffers[2]);
+            glBufferData(GL_TEXTURE_BUFFER, index_bytes, m_indices.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+            return grid_bytes + index_bytes;
+        }
+
+        void LightClusters::bindTextures() {
+            const GLuint units[] = {
+                Program::LIGHT_DATA_TEXTURE_UNIT,
+                Program::LIGHT_GRID_TEXTURE_UNIT,
+                Program::LIGHT_INDEX_TEXTURE_UNIT,
+            };
+            for (int i = 0; i < 3; ++i) {
+                glActiveTexture(GL_TEXTURE0 + units[i]);
+                glBindTexture(GL_TEXTURE_BUFFER, m_textures[i]);
+            }
+            glActiveTexture(GL_TEXTURE0);
+        }
+
+        void LightClusters::unbindTextures() {
+            const GLuint units[] = {
+                Program::LIGHT_DATA_TEXTURE_UNIT,
+                Program::LIGHT_GRID_TEXTURE_UNIT,
+                Program::LIGHT_INDEX_TEXTURE_UNIT,
+            };
+            for (int i = 0; i < 3; ++i) {
+                glActiveTexture(GL_TEXTURE0 + units[i]);
+                glBindTexture(GL_TEXTURE_BUFFER, 0);
+            }
+            glActiveTexture(GL_TEXTURE0);
+        }
+
+        void LightClusters::deleteBuffers() {
+            // Nothing to do (and maybe no context to do it in) if
+            // createBuffers was never called.
+            if (m_buffers[0] == 0) {
+                return;
+            }
+
+            for (int i = 0; i < 3; ++i) {
+                if (glIsTexture(m_textures[i])) {
+                    glDeleteTextures(1, &m_textures[i]);
+                }
+                if (glIsBuffer(m_buffers[i])) {
+                    glDeleteBuffers(1, &m_buffers[i]);
+                }
+                m_textures[i] = m_buffers[i] = 0;
+            }
+            m_light_capacity = 0;
+        }
+    }
+}
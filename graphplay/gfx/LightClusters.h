@@ -0,0 +1,135 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_LIGHT_CLUSTERS_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_LIGHT_CLUSTERS_H_
+
+#include "../graphplay.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include "../opengl.h"
+#include "Shader.h"
+
+namespace graphplay {
+    namespace gfx {
+        struct Light {
+            bool enabled;
+            glm::vec3 position;
+            glm::vec4 color;
+            int specular_exp;
+
+            // How far the light reaches, fading out to nothing at
+            // the edge. 0 means everywhere, like the sun; those are
+            // kept in a list of their own that every fragment looks
+            // at, so there shouldn't be many of them.
+            float radius;
+        };
+
+        // Splits the view frustum into a grid of clusters, tiles of
+        // the screen cut into slices by depth, and works out which
+        // lights reach each one. That way the lit shaders only loop
+        // over the lights that can touch a fragment, and having
+        // hundreds of small lights around doesn't cost much.
+        //
+        // The slices get deeper exponentially, so the clusters are
+        // roughly as deep as they are wide. The lights are sorted
+        // into them in view space, a slice per thread.
+        //
+        // The shaders get it all in three texture buffers:
+        // light_data, with a LightProperties per light; light_grid,
+        // with the offset and count of each cluster's lights, plus
+        // one more for the lights that reach everywhere; and
+        // light_indices, which they're offsets into.
+        class LightClusters {
+        public:
+            typedef std::unique_ptr<LightClusters> uptr_type;
+
+            static const unsigned int TILES_ACROSS = 16, TILES_DOWN = 9, SLICES = 24;
+            static const unsigned int CLUSTERS = TILES_ACROSS*TILES_DOWN*SLICES;
+
+            // Not really a cluster: where the lights without a radius
+            // are listed.
+            static const unsigned int EVERYWHERE = CLUSTERS;
+
+            LightClusters();
+            LightClusters(const LightClusters &other) = delete;
+            LightClusters& operator=(const LightClusters &other) = delete;
+            ~LightClusters();
+
+            // The frustum to split up, from a perspective projection
+            // like glm::perspective makes.
+            void setProjection(const glm::mat4x4 &projection);
+            inline float nearPlane() const { return m_near; }
+            inline float farPlane() const { return m_far; }
+
+            // Work out which lights reach which clusters, with the
+            // camera at view.
+            void assign(const std::vector<Light> &lights, const glm::mat4x4 &view);
+
+            static inline unsigned int clusterIndex(unsigned int x, unsigned int y, unsigned int z) {
+                return (z*TILES_DOWN + y)*TILES_ACROSS + x;
+            }
+
+            // Which slice something depth in front of the camera is
+            // in, the same way the shaders work it out.
+            unsigned int slice(float depth) const;
+
+            // The lights in a cluster (or EVERYWHERE), as indices
+            // into the lights assign was last called with.
+            inline GLuint lightCount(unsigned int cluster) const { return m_grid[2*cluster + 1]; }
+            inline const GLuint* lights(unsigned int cluster) const { return m_indices.data() + m_grid[2*cluster]; }
+            inline std::size_t indexCount() const { return m_indices.size(); }
+
+            // The light_clusters block for a viewport this size.
+            LightClusterBlock block(unsigned int vp_width, unsigned int vp_height) const;
+
+            // Manage the texture buffers. updateLights copies up the
+            // lights from first up to last, and updateClusters what
+            // the last assign worked out. They return how many bytes
+            // they copied.
+            void createBuffers();
+            std::size_t updateLights(const std::vector<Light> &lights, std::size_t first, std::size_t last);
+            std::size_t updateClusters();
+            void bindTextures();
+            void unbindTextures();
+            void deleteBuffers();
+
+        private:
+            // A light that reaches into a slice, and the tiles it
+            // might touch there.
+            struct Candidate {
+                GLuint light;
+                unsigned int first_x, last_x, first_y, last_y;
+            };
+
+            float m_near, m_far;
+            float m_slice_scale, m_slice_bias;
+
+            // The view space bounding box of each cluster, and how
+            // deep each slice starts.
+            std::vector<glm::vec3> m_cluster_min, m_cluster_max;
+            std::vector<float> m_slice_depths;
+
+            // The lights in view space, with their radius in w.
+            std::vector<glm::vec4> m_view_lights;
+
+            // Each cluster's offset and count, and the indices each
+            // slice came up with before they're stuck together.
+            std::vector<GLuint> m_grid, m_indices;
+            std::vector<std::vector<GLuint> > m_slice_indices;
+            std::vector<std::vector<Candidate> > m_slice_lights;
+
+            std::vector<LightProperties> m_light_data;
+            std::size_t m_light_capacity;
+            GLuint m_buffers[3], m_textures[3];
+        };
+    }
+}
+
+#endif
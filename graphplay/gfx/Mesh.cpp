@@ -3,30 +3,33 @@
 #include "../graphplay.h"
 #include "Mesh.h"
 
-#include <glm/gtc/type_ptr.hpp>
+#include <iostream>
+
 #include <glm/gtc/matrix_inverse.hpp>
 
 namespace graphplay {
     namespace gfx {
         Mesh::Mesh()
             : m_model_transform(),
+              m_model_inv_trans_3(glm::inverseTranspose(glm::mat3x3(m_model_transform))),
               m_geometry(),
               m_program()
         {}
 
         Mesh::Mesh(AbstractGeometry::sptr_type geo, Program::sptr_type program)
             : m_model_transform(),
+              m_model_inv_trans_3(glm::inverseTranspose(glm::mat3x3(m_model_transform))),
               m_geometry(geo),
               m_program(program)
         {
-            m_geometry->createVertexArray(*m_program);
+            setUpVertexArray();
         }
 
         void Mesh::geometry(AbstractGeometry::sptr_type geo) {
             m_geometry = geo;
 
             if (m_program) {
-                m_geometry->createVertexArray(*m_program);
+                setUpVertexArray();
             }
         }
 
@@ -34,32 +37,179 @@ namespace graphplay {
             m_program = program;
 
             if (m_geometry) {
+                setUpVertexArray();
+            }
+        }
+
+        void Mesh::setUpVertexArray() {
+            // A geometry shared between meshes only needs its vertex
+            // array made once per program.
+            if (m_geometry->vertexArrayProgramId() != m_program->getProgramId()) {
                 m_geometry->createVertexArray(*m_program);
             }
+
+            if (!drawable()) {
+                std::cerr << "Mesh has a batched program but its geometry isn't in a BufferArena; it won't be drawn" << std::endl;
+            }
         }
 
         void Mesh::modelTransformation(const glm::mat4x4 &new_transform) {
             m_model_transform = new_transform;
+            m_model_inv_trans_3 = glm::inverseTranspose(glm::mat3x3(new_transform));
         }
 
-        void Mesh::render() const {
-            const IndexMap &unifs = m_program->getUniforms();
+        glm::vec3 Mesh::center() const {
+            const fzx::BBox &bbox = m_geometry->boundingBox();
+            return glm::vec3(m_model_transform * glm::vec4(0.5f*(bbox.min + bbox.max), 1.0f));
+        }
 
+        void Mesh::useProgram() const {
             glUseProgram(m_program->getProgramId());
-            auto tf_elem = unifs.find("model");
-            if (tf_elem != unifs.end()) {
-                glUniformMatrix4fv(tf_elem->second, 1, GL_FALSE, glm::value_ptr(m_model_transform));
+            setUniforms();
+        }
+
+        void Mesh::setUniforms(bool model_block_bound) const {
+            if (!model_block_bound && m_program->hasModelBlock()) {
+                ModelTransformationBlock block;
+                modelBlock(block);
+                m_program->setModelBlock(block);
+            }
+
+            Program::StandardUniforms &unifs = m_program->getStandardUniforms();
+            unifs.model.set(m_model_transform);
+            unifs.model_inv_trans_3.set(m_model_inv_trans_3);
+        }
+
+        bool Mesh::inFrustum(const Frustum &frustum) const {
+            if (!m_geometry || m_geometry->draw_type == GL_PATCHES) {
+                return true;
             }
 
-            tf_elem = unifs.find("model_inv_trans_3");
-            if (tf_elem != unifs.end()) {
-                glm::mat3x3 model_inv_trans_3 = glm::inverseTranspose(glm::mat3x3(m_model_transform));
-                glUniformMatrix3fv(tf_elem->second, 1, GL_FALSE, glm::value_ptr(model_inv_trans_3));
+            const fzx::BBox &local = m_geometry->boundingBox();
+            if (local.min.x > local.max.x) {
+                // No vertices.
+                return false;
             }
 
+            fzx::BBox world = local.axisAlignedAfterTransform(m_model_transform);
+            return frustum.intersectsBox(world.min, world.max);
+        }
+
+        void Mesh::render() const {
+            if (!drawable()) {
+                return;
+            }
+
+            useProgram();
             m_geometry->render();
+            glUseProgram(0);
+        }
+
+        void Mesh::render(const glm::mat4x4 &view_projection, const glm::vec3 &eye) const {
+            if (!drawable()) {
+                return;
+            }
+
+            const ClusterList &clusters = m_geometry->clusters();
+            if (clusters.empty()) {
+                render();
+                return;
+            }
+
+            std::vector<GLuint> firsts;
+            std::vector<GLsizei> counts;
+            if (!visibleRanges(view_projection, eye, firsts, counts)) {
+                return;
+            }
 
+            useProgram();
+            m_geometry->renderRanges(firsts, counts);
             glUseProgram(0);
         }
+
+        void Mesh::draw(const glm::mat4x4 &view_projection, const glm::vec3 &eye, bool model_block_bound) const {
+            if (!drawable()) {
+                return;
+            }
+
+            if (m_geometry->clusters().empty()) {
+                setUniforms(model_block_bound);
+                m_geometry->draw();
+                return;
+            }
+
+            std::vector<GLuint> firsts;
+            std::vector<GLsizei> counts;
+            if (visibleRanges(view_projection, eye, firsts, counts)) {
+                setUniforms(model_block_bound);
+                m_geometry->drawRanges(firsts, counts);
+            }
+        }
+
+        void Mesh::drawInstances(GLsizei count) const {
+            if (!drawable()) {
+                return;
+            }
+
+            setUniforms();
+            m_geometry->drawInstances(count);
+        }
+
+        bool Mesh::batchesWith(const Mesh &other) const {
+            return m_program == other.m_program
+                && vertexArrayObjectId() == other.vertexArrayObjectId()
+                && m_geometry->draw_type == other.m_geometry->draw_type
+                && m_geometry->elemGLType() == other.m_geometry->elemGLType()
+                && m_geometry->primitive_restart == other.m_geometry->primitive_restart;
+        }
+
+        bool Mesh::drawCommands(const glm::mat4x4 &view_projection, const glm::vec3 &eye, GLuint draw_id,
+                                std::vector<DrawElementsCommand> &commands) const {
+            const GLuint first_elem = m_geometry->firstElem();
+            const GLint base_vertex = m_geometry->baseVertex();
+
+            if (m_geometry->clusters().empty()) {
+                commands.push_back(DrawElementsCommand{ (GLuint)m_geometry->elemCount(), 1, first_elem, base_vertex, draw_id });
+                return true;
+            }
+
+            std::vector<GLuint> firsts;
+            std::vector<GLsizei> counts;
+            if (!visibleRanges(view_projection, eye, firsts, counts)) {
+                return false;
+            }
+
+            for (std::size_t i = 0; i < firsts.size(); ++i) {
+                commands.push_back(DrawElementsCommand{ (GLuint)counts[i], 1, first_elem + firsts[i], base_vertex, draw_id });
+            }
+            return true;
+        }
+
+        // The ranges of elements of the clusters that might be
+        // visible, or false if there aren't any.
+        bool Mesh::visibleRanges(const glm::mat4x4 &view_projection, const glm::vec3 &eye,
+                                 std::vector<GLuint> &firsts, std::vector<GLsizei> &counts) const {
+            // Cull in model space, so the clusters don't have to be
+            // transformed.
+            Frustum frustum(view_projection * m_model_transform);
+            glm::vec3 model_eye = glm::vec3(glm::inverse(m_model_transform) * glm::vec4(eye, 1.0f));
+
+            // Neighboring visible clusters are next to each other in
+            // the element array, so they get merged into one range.
+            for (auto &&cluster : m_geometry->clusters()) {
+                if (!clusterVisible(cluster, frustum, model_eye)) {
+                    continue;
+                }
+
+                if (!counts.empty() && firsts.back() + counts.back() == cluster.first_elem) {
+                    counts.back() += cluster.elem_count;
+                } else {
+                    firsts.push_back(cluster.first_elem);
+                    counts.push_back(cluster.elem_count);
+                }
+            }
+
+            return !counts.empty();
+        }
     }
 }
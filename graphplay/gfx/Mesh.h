@@ -5,10 +5,14 @@
 
 #include "../graphplay.h"
 
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 #include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
 
+#include "Frustum.h"
 #include "Geometry.h"
 #include "Shader.h"
 
@@ -33,10 +37,83 @@ namespace graphplay {
             void modelTransformation(const glm::mat4x4 &new_transform);
             inline const glm::mat4x4& modelTransformation() const { return m_model_transform; }
 
+            // What has to be bound to draw the mesh.
+            inline GLuint programId() const { return m_program->getProgramId(); }
+            inline GLuint vertexArrayObjectId() const { return m_geometry->vertexArrayObjectId(); }
+
+            // Meshes with an instanced program get drawn along with
+            // all the others with the same program and geometry.
+            inline bool instanced() const { return m_program->isInstanced(); }
+            inline bool sameBatch(const Mesh &other) const { return m_program == other.m_program && m_geometry == other.m_geometry; }
+            inline std::uintptr_t geometryKey() const { return reinterpret_cast<std::uintptr_t>(m_geometry.get()); }
+
+            // Meshes whose programs have a model_transformation block
+            // can have it filled in ahead of time (say in a FrameRing)
+            // and bound before they're drawn.
+            inline bool usesModelBlock() const { return m_program->hasModelBlock(); }
+            inline void modelBlock(ModelTransformationBlock &block) const { block.set(m_model_transform, m_model_inv_trans_3); }
+
+            // Meshes with a batched program whose geometry is in a
+            // BufferArena can be drawn in one go with the others that
+            // have the same program, vertex array and kind of
+            // primitives.
+            inline bool batched() const { return m_program->isBatched() && m_geometry->arenaRange(); }
+            // Batched programs have nowhere to get their model
+            // transformation from outside a batch, so meshes with one
+            // and a geometry that isn't in an arena don't get drawn.
+            inline bool drawable() const { return !m_program->isBatched() || m_geometry->arenaRange(); }
+            bool batchesWith(const Mesh &other) const;
+            inline GLenum drawType() const { return m_geometry->draw_type; }
+            inline GLenum elemGLType() const { return m_geometry->elemGLType(); }
+            inline Program::StandardUniforms& standardUniforms() const { return m_program->getStandardUniforms(); }
+            inline bool primitiveRestart() const { return m_geometry->primitive_restart; }
+
+            // Add the draws for the possibly visible clusters (or the
+            // whole geometry) to commands, tagged with draw_id.
+            // Returns false if nothing's visible.
+            bool drawCommands(const glm::mat4x4 &view_projection, const glm::vec3 &eye, GLuint draw_id,
+                              std::vector<DrawElementsCommand> &commands) const;
+
+            // The middle of the geometry's bounding box, in world
+            // space.
+            glm::vec3 center() const;
+
+            // Whether the geometry's bounding box, moved by the model
+            // transformation, might be in the (world space) frustum.
+            // Patches are always in, since tessellation can put their
+            // vertices anywhere.
+            bool inFrustum(const Frustum &frustum) const;
+
             void render() const;
 
+            // Draw only the clusters of the geometry that might be
+            // visible through the view_projection transformation from
+            // eye (in world space): the ones in the frustum that
+            // aren't facing away. Geometries without clusters are
+            // drawn whole.
+            void render(const glm::mat4x4 &view_projection, const glm::vec3 &eye) const;
+
+            // Like render(), but with the program and vertex array
+            // already bound (and left bound afterwards). If
+            // model_block_bound, the mesh's model_transformation block
+            // is bound too.
+            void draw(const glm::mat4x4 &view_projection, const glm::vec3 &eye, bool model_block_bound = false) const;
+
+            // Draw count instances of the geometry, with the program,
+            // vertex array and instance attributes already bound.
+            void drawInstances(GLsizei count) const;
+
         private:
+            void setUpVertexArray();
+            void useProgram() const;
+            void setUniforms(bool model_block_bound = false) const;
+            bool visibleRanges(const glm::mat4x4 &view_projection, const glm::vec3 &eye,
+                               std::vector<GLuint> &firsts, std::vector<GLsizei> &counts) const;
+
             glm::mat4x4 m_model_transform;
+            // Kept alongside the model transformation, so it isn't
+            // worked out again on every draw.
+            glm::mat3x3 m_model_inv_trans_3;
             AbstractGeometry::sptr_type m_geometry;
             Program::sptr_type m_program;
         };
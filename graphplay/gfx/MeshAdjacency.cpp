@@ -0,0 +1,244 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../graphplay.h"
+#include "MeshAdjacency.h"
+
+#include <cstdint>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+#include "../Parallel.h"
+
+namespace graphplay {
+    namespace gfx {
+        static const std::size_t MIN_EDGE_CHUNK = 1 << 16;
+        static const GLuint NO_COMPONENT = 0xFFFFFFFF;
+        static const std::uint64_t DEGENERATE_EDGE = std::numeric_limits<std::uint64_t>::max();
+
+        // A half-edge, keyed by its vertices with the lower-numbered
+        // one in the high bits, so that a half-edge and its twin get
+        // the same key.
+        struct EdgeKey {
+            std::uint64_t key;
+            GLuint corner;
+        };
+
+        VertexCorners buildVertexCorners(const std::vector<GLuint> &elems, std::size_t num_verts) {
+            const std::size_t min_chunk = 1 << 16;
+            const std::size_t num_corners = elems.size();
+            const unsigned int num_chunks = chunkCount(num_corners, min_chunk);
+            VertexCorners rv;
+
+            // Each chunk counts its own corners per vertex, so nothing
+            // has to be shared between threads.
+            std::vector<unsigned int> counts(num_chunks*num_verts, 0);
+            parallelChunks(num_corners, min_chunk, [&](unsigned int chunk, std::size_t first, std::size_t last) {
+                    unsigned int *chunk_counts = &counts[chunk*num_verts];
+                    for (std::size_t i = first; i < last; ++i) {
+                        if (elems[i] < num_verts) {
+                            ++chunk_counts[elems[i]];
+                        }
+                    }
+                });
+
+            // Turn the per-chunk counts into each chunk's starting
+            // position within its vertex's row.
+            std::vector<unsigned int> totals(num_verts, 0);
+            parallelFor(num_verts, min_chunk, [&](std::size_t v) {
+                    unsigned int running = 0;
+                    for (unsigned int c = 0; c < num_chunks; ++c) {
+                        unsigned int n = counts[c*num_verts + v];
+                        counts[c*num_verts + v] = running;
+                        running += n;
+                    }
+                    totals[v] = running;
+                });
+
+            rv.offsets.resize(num_verts + 1);
+            rv.offsets[0] = 0;
+            for (std::size_t v = 0; v < num_verts; ++v) {
+                rv.offsets[v + 1] = rv.offsets[v] + totals[v];
+            }
+
+            rv.corners.resize(rv.offsets[num_verts]);
+            parallelChunks(num_corners, min_chunk, [&](unsigned int chunk, std::size_t first, std::size_t last) {
+                    unsigned int *chunk_pos = &counts[chunk*num_verts];
+                    for (std::size_t i = first; i < last; ++i) {
+                        GLuint v = elems[i];
+                        if (v < num_verts) {
+                            rv.corners[rv.offsets[v] + chunk_pos[v]++] = static_cast<unsigned int>(i);
+                        }
+                    }
+                });
+
+            return rv;
+        }
+
+        HalfEdges buildHalfEdges(const std::vector<GLuint> &elems) {
+            const std::size_t num_corners = elems.size() - elems.size() % 3;
+            HalfEdges rv;
+            rv.twins.assign(num_corners, NO_TWIN);
+            rv.boundary_edges = 0;
+            rv.non_manifold_edges = 0;
+
+            std::vector<EdgeKey> keys(num_corners);
+            parallelFor(num_corners, MIN_EDGE_CHUNK, [&](std::size_t c) {
+                    GLuint a = elems[c], b = elems[HalfEdges::next(static_cast<GLuint>(c))];
+                    GLuint other = elems[HalfEdges::prev(static_cast<GLuint>(c))];
+                    keys[c].corner = static_cast<GLuint>(c);
+                    // Leave faces with a repeated vertex out entirely,
+                    // so they don't end up as their own neighbors.
+                    if (a == b || a == other || b == other) {
+                        keys[c].key = DEGENERATE_EDGE;
+                    } else {
+                        keys[c].key = (static_cast<std::uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+                    }
+                });
+
+            parallelSort(keys, MIN_EDGE_CHUNK, [](const EdgeKey &x, const EdgeKey &y) {
+                    return x.key < y.key || (x.key == y.key && x.corner < y.corner);
+                });
+
+            // Pair up the runs of equal keys. Each chunk handles the
+            // runs that start inside it, even if they run past its end.
+            const unsigned int num_chunks = chunkCount(num_corners, MIN_EDGE_CHUNK);
+            std::vector<std::size_t> boundary(num_chunks, 0), non_manifold(num_chunks, 0);
+            parallelChunks(num_corners, MIN_EDGE_CHUNK, [&](unsigned int chunk, std::size_t first, std::size_t last) {
+                    std::size_t i = first;
+                    while (i > 0 && i < last && keys[i].key == keys[i - 1].key) {
+                        ++i;
+                    }
+
+                    while (i < last) {
+                        std::size_t run_end = i + 1;
+                        while (run_end < num_corners && keys[run_end].key == keys[i].key) {
+                            ++run_end;
+                        }
+
+                        if (keys[i].key != DEGENERATE_EDGE) {
+                            if (run_end - i == 2) {
+                                rv.twins[keys[i].corner] = keys[i + 1].corner;
+                                rv.twins[keys[i + 1].corner] = keys[i].corner;
+                            } else if (run_end - i == 1) {
+                                ++boundary[chunk];
+                            } else {
+                                ++non_manifold[chunk];
+                            }
+                        }
+
+                        i = run_end;
+                    }
+                });
+
+            for (unsigned int c = 0; c < num_chunks; ++c) {
+                rv.boundary_edges += boundary[c];
+                rv.non_manifold_edges += non_manifold[c];
+            }
+
+            return rv;
+        }
+
+        std::size_t countInconsistentEdges(const std::vector<GLuint> &elems, const HalfEdges &half_edges) {
+            const std::size_t num_corners = half_edges.twins.size();
+            const unsigned int num_chunks = chunkCount(num_corners, MIN_EDGE_CHUNK);
+            std::vector<std::size_t> counts(num_chunks, 0);
+
+            // Twins that start at the same vertex run the same way.
+            parallelChunks(num_corners, MIN_EDGE_CHUNK, [&](unsigned int chunk, std::size_t first, std::size_t last) {
+                    for (std::size_t c = first; c < last; ++c) {
+                        GLuint t = half_edges.twins[c];
+                        if (t != NO_TWIN && c < t && elems[c] == elems[t]) {
+                            ++counts[chunk];
+                        }
+                    }
+                });
+
+            std::size_t rv = 0;
+            for (auto &&n : counts) {
+                rv += n;
+            }
+            return rv;
+        }
+
+        static std::size_t repairWinding(std::vector<GLuint> &elems, const std::vector<glm::vec3> *positions) {
+            HalfEdges half_edges = buildHalfEdges(elems);
+            const std::size_t num_faces = half_edges.twins.size() / 3;
+            std::vector<GLuint> component(num_faces, NO_COMPONENT);
+            std::vector<bool> flip(num_faces, false);
+            std::vector<GLuint> stack;
+            GLuint num_components = 0;
+
+            // Flood fill each connected piece from its first face,
+            // deciding whether each neighbor has to flip to match.
+            for (GLuint seed = 0; seed < num_faces; ++seed) {
+                if (component[seed] != NO_COMPONENT) {
+                    continue;
+                }
+
+                component[seed] = num_components;
+                stack.push_back(seed);
+                while (!stack.empty()) {
+                    GLuint f = stack.back();
+                    stack.pop_back();
+
+                    for (GLuint c = 3*f; c < 3*f + 3; ++c) {
+                        GLuint t = half_edges.twins[c];
+                        if (t == NO_TWIN) {
+                            continue;
+                        }
+
+                        GLuint g = HalfEdges::face(t);
+                        if (component[g] == NO_COMPONENT) {
+                            component[g] = num_components;
+                            flip[g] = flip[f] != (elems[c] == elems[t]);
+                            stack.push_back(g);
+                        }
+                    }
+                }
+
+                ++num_components;
+            }
+
+            // Turn pieces that are inside out.
+            if (positions != nullptr) {
+                const std::size_t num_verts = positions->size();
+                std::vector<double> volumes(num_components, 0.0);
+                for (GLuint f = 0; f < num_faces; ++f) {
+                    if (elems[3*f] >= num_verts || elems[3*f + 1] >= num_verts || elems[3*f + 2] >= num_verts) {
+                        continue;
+                    }
+
+                    const glm::vec3 &p0 = (*positions)[elems[3*f]];
+                    const glm::vec3 &p1 = (*positions)[elems[3*f + 1]];
+                    const glm::vec3 &p2 = (*positions)[elems[3*f + 2]];
+                    double volume = glm::dot(p0, glm::cross(p1, p2));
+                    volumes[component[f]] += flip[f] ? -volume : volume;
+                }
+
+                for (GLuint f = 0; f < num_faces; ++f) {
+                    if (volumes[component[f]] < 0.0) {
+                        flip[f] = !flip[f];
+                    }
+                }
+            }
+
+            std::size_t rv = 0;
+            for (GLuint f = 0; f < num_faces; ++f) {
+                if (flip[f]) {
+                    std::swap(elems[3*f + 1], elems[3*f + 2]);
+                    ++rv;
+                }
+            }
+            return rv;
+        }
+
+        std::size_t repairWinding(std::vector<GLuint> &elems) {
+            return repairWinding(elems, nullptr);
+        }
+
+        std::size_t repairWinding(std::vector<GLuint> &elems, const std::vector<glm::vec3> &positions) {
+            return repairWinding(elems, &positions);
+        }
+    }
+}
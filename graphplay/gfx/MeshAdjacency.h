@@ -0,0 +1,93 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_MESH_ADJACENCY_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_MESH_ADJACENCY_H_
+
+#include "../graphplay.h"
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "../opengl.h"
+#include "Geometry.h"
+
+namespace graphplay {
+    namespace gfx {
+        // The face corners that touch each vertex of a triangle
+        // list, in compressed rows. A corner is an index into the
+        // element array, so the face it belongs to is corner / 3. The
+        // corners around vertex v are corners[offsets[v]] up to (but
+        // not including) corners[offsets[v+1]].
+        struct VertexCorners {
+            std::vector<unsigned int> offsets;
+            std::vector<unsigned int> corners;
+
+            inline unsigned int begin(std::size_t v) const { return offsets[v]; }
+            inline unsigned int end(std::size_t v) const { return offsets[v + 1]; }
+            inline unsigned int count(std::size_t v) const { return offsets[v + 1] - offsets[v]; }
+        };
+
+        // Elements that refer past num_verts are left out.
+        VertexCorners buildVertexCorners(const std::vector<GLuint> &elems, std::size_t num_verts);
+
+#ifdef MSVC
+        const
+#else
+        constexpr
+#endif
+        GLuint NO_TWIN = 0xFFFFFFFF;
+
+        // A corner table for a triangle list, which is a half-edge
+        // structure that gets everything but the twins from the
+        // element array itself. Half-edge c belongs to face c / 3 and
+        // runs from elems[c] to elems[next(c)]. twins[c] is the
+        // half-edge of the neighboring face across the same edge, or
+        // NO_TWIN if the edge is on a boundary, belongs to a
+        // degenerate face, or is shared by more than two faces.
+        struct HalfEdges {
+            std::vector<GLuint> twins;
+            std::size_t boundary_edges;
+            std::size_t non_manifold_edges;
+
+            static inline GLuint face(GLuint c) { return c / 3; }
+            static inline GLuint next(GLuint c) { return c % 3 == 2 ? c - 2 : c + 1; }
+            static inline GLuint prev(GLuint c) { return c % 3 == 0 ? c + 2 : c - 1; }
+        };
+
+        // Build the twins by sorting every half-edge by its (unordered)
+        // pair of vertices, so that twins end up next to each other.
+        HalfEdges buildHalfEdges(const std::vector<GLuint> &elems);
+
+        // The number of edges whose two faces run along them in the
+        // same direction, i.e. disagree about which side is the front.
+        std::size_t countInconsistentEdges(const std::vector<GLuint> &elems, const HalfEdges &half_edges);
+
+        // Flip faces until every connected piece of the mesh winds
+        // the same way as the lowest-numbered face in it, and return
+        // the number of faces flipped. With positions, each piece is
+        // also turned so that it winds counter-clockwise from the
+        // outside (i.e. it has a positive signed volume). Meshes that
+        // can't be oriented (like a Mobius strip) come out as close
+        // as the flood fill gets them.
+        std::size_t repairWinding(std::vector<GLuint> &elems);
+        std::size_t repairWinding(std::vector<GLuint> &elems, const std::vector<glm::vec3> &positions);
+
+        template <typename V>
+        HalfEdges buildHalfEdges(const Geometry<V> &geo) {
+            return buildHalfEdges(geo.elements());
+        }
+
+        template <typename V>
+        std::size_t repairWinding(Geometry<V> &geo) {
+            std::vector<glm::vec3> positions(geo.vertices().size());
+            for (std::size_t i = 0; i < positions.size(); ++i) {
+                positions[i] = vertexPosition(geo.vertices()[i]);
+            }
+            return repairWinding(geo.elements(), positions);
+        }
+    }
+}
+
+#endif
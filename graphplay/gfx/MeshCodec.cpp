@@ -0,0 +1,563 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../graphplay.h"
+#include "MeshCodec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GRAPHPLAY_MESH_CODEC_SSE
+#include <emmintrin.h>
+#endif
+
+#if defined(GRAPHPLAY_MESH_CODEC_SSE) && (defined(__SSSE3__) || defined(__AVX__))
+#define GRAPHPLAY_MESH_CODEC_SSSE3
+#include <tmmintrin.h>
+#endif
+
+#include "../Parallel.h"
+
+namespace graphplay {
+    namespace gfx {
+        static const std::uint8_t MAGIC[4] = { 'G', 'P', 'M', 'C' };
+        static const std::uint32_t FORMAT_VERSION = 1;
+        static const std::uint32_t FLAG_PRIMITIVE_RESTART = 1 << 0;
+        static const std::uint32_t FLAG_COMPRESSED = 1 << 1;
+        static const std::size_t HEADER_SIZE = 4 + 8*4;
+
+        static const std::size_t VERTEX_BLOCK_SIZE = 256;
+        static const std::size_t GROUP_SIZE = 16;
+
+        static const std::size_t LZ_MIN_MATCH = 4;
+        static const std::size_t LZ_LAST_LITERALS = 5;
+        static const std::size_t LZ_MAX_OFFSET = 0xFFFF;
+        static const unsigned int LZ_HASH_BITS = 16;
+        static const std::uint32_t LZ_NO_POSITION = 0xFFFFFFFF;
+
+        static inline void putU32(ByteArray &out, std::uint32_t v) {
+            for (unsigned int b = 0; b < 4; ++b) {
+                out.push_back(static_cast<std::uint8_t>(v >> 8*b));
+            }
+        }
+
+        static inline std::uint32_t getU32(const std::uint8_t *p) {
+            return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+        }
+
+        // Index streams.
+
+#ifdef GRAPHPLAY_MESH_CODEC_SSSE3
+        // For each control byte, the shuffle that spreads the four
+        // values it describes out into 32-bit lanes, and how many
+        // bytes they take up.
+        struct IndexShuffles {
+            IndexShuffles() {
+                for (unsigned int c = 0; c < 256; ++c) {
+                    std::uint8_t shuffle[16];
+                    unsigned int src = 0;
+                    for (unsigned int k = 0; k < 4; ++k) {
+                        unsigned int len = ((c >> 2*k) & 3) + 1;
+                        for (unsigned int b = 0; b < 4; ++b) {
+                            shuffle[4*k + b] = b < len ? static_cast<std::uint8_t>(src++) : 0x80;
+                        }
+                    }
+                    masks[c] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(shuffle));
+                    lengths[c] = static_cast<std::uint8_t>(src);
+                }
+            }
+
+            __m128i masks[256];
+            std::uint8_t lengths[256];
+        };
+
+        static const IndexShuffles& indexShuffles() {
+            static const IndexShuffles shuffles;
+            return shuffles;
+        }
+#endif
+
+        void encodeIndices(const GLuint *elems, std::size_t count, ByteArray &out) {
+            const std::size_t control = out.size();
+            out.resize(out.size() + (count + 3)/4, 0);
+
+            GLuint prev = 0;
+            for (std::size_t i = 0; i < count; ++i) {
+                std::uint32_t delta = elems[i] - prev;
+                std::uint32_t zz = (delta << 1) ^ static_cast<std::uint32_t>(static_cast<std::int32_t>(delta) >> 31);
+                unsigned int len = zz < (1u << 8) ? 1 : zz < (1u << 16) ? 2 : zz < (1u << 24) ? 3 : 4;
+                out[control + i/4] |= static_cast<std::uint8_t>((len - 1) << 2*(i % 4));
+                for (unsigned int b = 0; b < len; ++b) {
+                    out.push_back(static_cast<std::uint8_t>(zz >> 8*b));
+                }
+                prev = elems[i];
+            }
+        }
+
+        bool decodeIndices(const std::uint8_t *data, std::size_t size, GLuint *elems, std::size_t count) {
+            const std::size_t control_size = (count + 3)/4;
+            if (size < control_size) {
+                return false;
+            }
+
+            const std::uint8_t *control = data, *p = data + control_size, *end = data + size;
+            std::size_t i = 0;
+            GLuint prev = 0;
+
+#ifdef GRAPHPLAY_MESH_CODEC_SSSE3
+            // Four at a time, as long as there's a whole vector's
+            // worth of input left to load.
+            const IndexShuffles &shuffles = indexShuffles();
+            const __m128i one = _mm_set1_epi32(1);
+            __m128i prev_v = _mm_setzero_si128();
+            for (; i + 4 <= count && end - p >= 16; i += 4) {
+                const std::uint8_t c = control[i/4];
+                __m128i zz = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), shuffles.masks[c]);
+                p += shuffles.lengths[c];
+
+                __m128i d = _mm_xor_si128(_mm_srli_epi32(zz, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(zz, one)));
+                d = _mm_add_epi32(d, _mm_slli_si128(d, 4));
+                d = _mm_add_epi32(d, _mm_slli_si128(d, 8));
+                d = _mm_add_epi32(d, prev_v);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(elems + i), d);
+                prev_v = _mm_shuffle_epi32(d, 0xFF);
+            }
+            if (i > 0) {
+                prev = elems[i - 1];
+            }
+#endif
+
+            for (; i < count; ++i) {
+                unsigned int len = ((control[i/4] >> 2*(i % 4)) & 3) + 1;
+                if (static_cast<std::size_t>(end - p) < len) {
+                    return false;
+                }
+
+                std::uint32_t zz = 0;
+                for (unsigned int b = 0; b < len; ++b) {
+                    zz |= static_cast<std::uint32_t>(p[b]) << 8*b;
+                }
+                p += len;
+                prev += (zz >> 1) ^ (0u - (zz & 1));
+                elems[i] = prev;
+            }
+
+            return p == end;
+        }
+
+        // Vertex streams.
+
+        static inline std::uint8_t zigzag8(std::uint8_t d) {
+            return static_cast<std::uint8_t>((d << 1) ^ (static_cast<std::int8_t>(d) >> 7));
+        }
+
+        void encodeVertices(const void *verts, std::size_t count, std::size_t stride, ByteArray &out) {
+            const std::uint8_t *bytes = static_cast<const std::uint8_t*>(verts);
+            std::vector<std::uint8_t> prev(stride, 0);
+            std::uint8_t deltas[VERTEX_BLOCK_SIZE];
+
+            for (std::size_t block = 0; block < count; block += VERTEX_BLOCK_SIZE) {
+                const std::size_t n = std::min(VERTEX_BLOCK_SIZE, count - block);
+                const std::size_t num_groups = (n + GROUP_SIZE - 1)/GROUP_SIZE;
+
+                for (std::size_t b = 0; b < stride; ++b) {
+                    std::uint8_t last = prev[b];
+                    for (std::size_t i = 0; i < n; ++i) {
+                        std::uint8_t v = bytes[(block + i)*stride + b];
+                        deltas[i] = zigzag8(static_cast<std::uint8_t>(v - last));
+                        last = v;
+                    }
+                    std::fill(deltas + n, deltas + num_groups*GROUP_SIZE, 0);
+                    prev[b] = last;
+
+                    // Two bits per group saying how many bits each of
+                    // its deltas takes, then the groups.
+                    const std::size_t header = out.size();
+                    out.resize(out.size() + (num_groups + 3)/4, 0);
+                    for (std::size_t g = 0; g < num_groups; ++g) {
+                        const std::uint8_t *d = deltas + g*GROUP_SIZE;
+                        std::uint8_t max = *std::max_element(d, d + GROUP_SIZE);
+                        unsigned int mode = max == 0 ? 0 : max < 4 ? 1 : max < 16 ? 2 : 3;
+                        out[header + g/4] |= static_cast<std::uint8_t>(mode << 2*(g % 4));
+
+                        if (mode == 1) {
+                            for (unsigned int j = 0; j < 4; ++j) {
+                                out.push_back(static_cast<std::uint8_t>(d[j] | (d[j + 4] << 2) | (d[j + 8] << 4) | (d[j + 12] << 6)));
+                            }
+                        } else if (mode == 2) {
+                            for (unsigned int j = 0; j < 8; ++j) {
+                                out.push_back(static_cast<std::uint8_t>(d[j] | (d[j + 8] << 4)));
+                            }
+                        } else if (mode == 3) {
+                            out.insert(out.end(), d, d + GROUP_SIZE);
+                        }
+                    }
+                }
+            }
+        }
+
+        // Unpack a group of sixteen deltas, add them up starting from
+        // last, and return the final value.
+        static inline std::uint8_t decodeGroup(const std::uint8_t *p, unsigned int mode, std::uint8_t last, std::uint8_t *dst) {
+#ifdef GRAPHPLAY_MESH_CODEC_SSE
+            const __m128i zero = _mm_setzero_si128();
+            __m128i zz;
+            if (mode == 0) {
+                zz = zero;
+            } else if (mode == 1) {
+                std::int32_t word;
+                std::memcpy(&word, p, 4);
+                const __m128i x = _mm_cvtsi32_si128(word), mask = _mm_set1_epi8(0x03);
+                __m128i v0 = _mm_and_si128(x, mask);
+                __m128i v1 = _mm_and_si128(_mm_srli_epi16(x, 2), mask);
+                __m128i v2 = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+                __m128i v3 = _mm_and_si128(_mm_srli_epi16(x, 6), mask);
+                zz = _mm_unpacklo_epi64(_mm_unpacklo_epi32(v0, v1), _mm_unpacklo_epi32(v2, v3));
+            } else if (mode == 2) {
+                const __m128i x = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), mask = _mm_set1_epi8(0x0F);
+                zz = _mm_unpacklo_epi64(_mm_and_si128(x, mask), _mm_and_si128(_mm_srli_epi16(x, 4), mask));
+            } else {
+                zz = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            }
+
+            __m128i d = _mm_xor_si128(
+                _mm_and_si128(_mm_srli_epi16(zz, 1), _mm_set1_epi8(0x7F)),
+                _mm_sub_epi8(zero, _mm_and_si128(zz, _mm_set1_epi8(1))));
+            d = _mm_add_epi8(d, _mm_slli_si128(d, 1));
+            d = _mm_add_epi8(d, _mm_slli_si128(d, 2));
+            d = _mm_add_epi8(d, _mm_slli_si128(d, 4));
+            d = _mm_add_epi8(d, _mm_slli_si128(d, 8));
+            d = _mm_add_epi8(d, _mm_set1_epi8(static_cast<char>(last)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), d);
+            return dst[GROUP_SIZE - 1];
+#else
+            for (unsigned int i = 0; i < GROUP_SIZE; ++i) {
+                std::uint8_t zz;
+                if (mode == 0) {
+                    zz = 0;
+                } else if (mode == 1) {
+                    zz = (p[i % 4] >> 2*(i / 4)) & 0x03;
+                } else if (mode == 2) {
+                    zz = (p[i % 8] >> 4*(i / 8)) & 0x0F;
+                } else {
+                    zz = p[i];
+                }
+                last = static_cast<std::uint8_t>(last + ((zz >> 1) ^ (0u - (zz & 1))));
+                dst[i] = last;
+            }
+            return last;
+#endif
+        }
+
+        // Interleave the decoded planes of a block back into n
+        // vertices.
+        static void scatterPlanes(const std::uint8_t *planes, std::size_t n, std::size_t stride, std::uint8_t *out) {
+            std::size_t b = 0;
+
+#ifdef GRAPHPLAY_MESH_CODEC_SSE
+            // Transpose four planes at a time, sixteen vertices at a
+            // time, and write each vertex's four bytes at once.
+            for (; b + 4 <= stride; b += 4) {
+                const std::uint8_t *p = planes + b*VERTEX_BLOCK_SIZE;
+                for (std::size_t i = 0; i < n; i += GROUP_SIZE) {
+                    __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+                    __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + VERTEX_BLOCK_SIZE + i));
+                    __m128i p2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 2*VERTEX_BLOCK_SIZE + i));
+                    __m128i p3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 3*VERTEX_BLOCK_SIZE + i));
+                    __m128i lo01 = _mm_unpacklo_epi8(p0, p1), hi01 = _mm_unpackhi_epi8(p0, p1);
+                    __m128i lo23 = _mm_unpacklo_epi8(p2, p3), hi23 = _mm_unpackhi_epi8(p2, p3);
+
+                    std::uint32_t words[GROUP_SIZE];
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(words), _mm_unpacklo_epi16(lo01, lo23));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(words + 4), _mm_unpackhi_epi16(lo01, lo23));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(words + 8), _mm_unpacklo_epi16(hi01, hi23));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(words + 12), _mm_unpackhi_epi16(hi01, hi23));
+
+                    const std::size_t m = std::min(GROUP_SIZE, n - i);
+                    for (std::size_t k = 0; k < m; ++k) {
+                        std::memcpy(out + (i + k)*stride + b, &words[k], 4);
+                    }
+                }
+            }
+#endif
+
+            for (; b < stride; ++b) {
+                for (std::size_t i = 0; i < n; ++i) {
+                    out[i*stride + b] = planes[b*VERTEX_BLOCK_SIZE + i];
+                }
+            }
+        }
+
+        bool decodeVertices(const std::uint8_t *data, std::size_t size, void *verts, std::size_t count, std::size_t stride) {
+            std::uint8_t *out = static_cast<std::uint8_t*>(verts);
+            const std::uint8_t *p = data, *end = data + size;
+            std::vector<std::uint8_t> prev(stride, 0);
+            std::vector<std::uint8_t> planes(stride*VERTEX_BLOCK_SIZE);
+
+            for (std::size_t block = 0; block < count; block += VERTEX_BLOCK_SIZE) {
+                const std::size_t n = std::min(VERTEX_BLOCK_SIZE, count - block);
+                const std::size_t num_groups = (n + GROUP_SIZE - 1)/GROUP_SIZE;
+                const std::size_t header_size = (num_groups + 3)/4;
+
+                for (std::size_t b = 0; b < stride; ++b) {
+                    if (static_cast<std::size_t>(end - p) < header_size) {
+                        return false;
+                    }
+                    const std::uint8_t *header = p;
+                    p += header_size;
+
+                    std::uint8_t last = prev[b];
+                    std::uint8_t *plane = &planes[b*VERTEX_BLOCK_SIZE];
+                    for (std::size_t g = 0; g < num_groups; ++g) {
+                        static const std::size_t GROUP_BYTES[4] = { 0, 4, 8, 16 };
+                        unsigned int mode = (header[g/4] >> 2*(g % 4)) & 3;
+                        if (static_cast<std::size_t>(end - p) < GROUP_BYTES[mode]) {
+                            return false;
+                        }
+                        last = decodeGroup(p, mode, last, plane + g*GROUP_SIZE);
+                        p += GROUP_BYTES[mode];
+                    }
+
+                    // The padding at the end of the last group is all
+                    // zero deltas, so last is the last vertex's byte.
+                    prev[b] = last;
+                }
+
+                scatterPlanes(planes.data(), n, stride, out + block*stride);
+            }
+
+            return p == end;
+        }
+
+        // LZ compression.
+
+        static void putLength(ByteArray &out, std::size_t len) {
+            while (len >= 255) {
+                out.push_back(255);
+                len -= 255;
+            }
+            out.push_back(static_cast<std::uint8_t>(len));
+        }
+
+        static bool getLength(const std::uint8_t *&p, const std::uint8_t *end, std::size_t &len) {
+            std::uint8_t b;
+            do {
+                if (p >= end) {
+                    return false;
+                }
+                b = *p++;
+                len += b;
+            } while (b == 255);
+            return true;
+        }
+
+        // A run of literals, followed by a match unless it's the last
+        // one.
+        static void putSequence(
+            ByteArray &out, const std::uint8_t *literals, std::size_t num_literals,
+            std::size_t offset, std::size_t match_len)
+        {
+            const std::size_t match_code = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+            out.push_back(static_cast<std::uint8_t>((std::min<std::size_t>(num_literals, 15) << 4) | std::min<std::size_t>(match_code, 15)));
+            if (num_literals >= 15) {
+                putLength(out, num_literals - 15);
+            }
+            out.insert(out.end(), literals, literals + num_literals);
+
+            if (match_len > 0) {
+                out.push_back(static_cast<std::uint8_t>(offset));
+                out.push_back(static_cast<std::uint8_t>(offset >> 8));
+                if (match_code >= 15) {
+                    putLength(out, match_code - 15);
+                }
+            }
+        }
+
+        void lzCompress(const std::uint8_t *data, std::size_t size, ByteArray &out) {
+            std::vector<std::uint32_t> table(1 << LZ_HASH_BITS, LZ_NO_POSITION);
+            const std::size_t limit = size > LZ_LAST_LITERALS ? size - LZ_LAST_LITERALS : 0;
+            std::size_t anchor = 0, i = 0;
+
+            while (i + LZ_MIN_MATCH <= limit) {
+                std::uint32_t seq;
+                std::memcpy(&seq, data + i, 4);
+                std::uint32_t &slot = table[(seq*2654435761u) >> (32 - LZ_HASH_BITS)];
+                std::uint32_t candidate = slot;
+                slot = static_cast<std::uint32_t>(i);
+
+                if (candidate != LZ_NO_POSITION && i - candidate <= LZ_MAX_OFFSET &&
+                    std::memcmp(data + candidate, data + i, LZ_MIN_MATCH) == 0)
+                {
+                    std::size_t len = LZ_MIN_MATCH;
+                    while (i + len < limit && data[candidate + len] == data[i + len]) {
+                        ++len;
+                    }
+                    putSequence(out, data + anchor, i - anchor, i - candidate, len);
+                    i += len;
+                    anchor = i;
+                } else {
+                    ++i;
+                }
+            }
+
+            putSequence(out, data + anchor, size - anchor, 0, 0);
+        }
+
+        bool lzDecompress(const std::uint8_t *data, std::size_t size, std::uint8_t *out, std::size_t out_size) {
+            const std::uint8_t *p = data, *end = data + size;
+            std::uint8_t *o = out, *const out_end = out + out_size;
+
+            while (p < end) {
+                const std::uint8_t token = *p++;
+                std::size_t num_literals = token >> 4;
+                if (num_literals == 15 && !getLength(p, end, num_literals)) {
+                    return false;
+                }
+                if (static_cast<std::size_t>(end - p) < num_literals || static_cast<std::size_t>(out_end - o) < num_literals) {
+                    return false;
+                }
+                std::memcpy(o, p, num_literals);
+                o += num_literals;
+                p += num_literals;
+
+                // The last sequence has no match.
+                if (p == end) {
+                    break;
+                }
+
+                if (end - p < 2) {
+                    return false;
+                }
+                const std::size_t offset = p[0] | (p[1] << 8);
+                p += 2;
+                std::size_t len = token & 15;
+                if (len == 15 && !getLength(p, end, len)) {
+                    return false;
+                }
+                len += LZ_MIN_MATCH;
+                if (offset == 0 || offset > static_cast<std::size_t>(o - out) || static_cast<std::size_t>(out_end - o) < len) {
+                    return false;
+                }
+
+                // Matches can overlap what they're copying into, which
+                // repeats the last offset bytes.
+                const std::uint8_t *match = o - offset;
+                if (offset >= len) {
+                    std::memcpy(o, match, len);
+                } else {
+                    for (std::size_t k = 0; k < len; ++k) {
+                        o[k] = match[k];
+                    }
+                }
+                o += len;
+            }
+
+            return o == out_end;
+        }
+
+        // Whole geometries.
+
+        ByteArray encodeGeometryData(const EncodedGeometryHeader &header, const GLuint *elems, const void *verts) {
+            ByteArray streams;
+            encodeIndices(elems, header.elem_count, streams);
+            const std::size_t index_bytes = streams.size();
+            encodeVertices(verts, header.vertex_count, header.vertex_stride, streams);
+            const std::size_t vertex_bytes = streams.size() - index_bytes;
+
+            std::uint32_t flags = 0;
+            if (header.primitive_restart) {
+                flags |= FLAG_PRIMITIVE_RESTART;
+            }
+            if (header.compressed) {
+                flags |= FLAG_COMPRESSED;
+            }
+
+            ByteArray rv(MAGIC, MAGIC + 4);
+            putU32(rv, FORMAT_VERSION);
+            putU32(rv, flags);
+            putU32(rv, header.draw_type);
+            putU32(rv, header.vertex_stride);
+            putU32(rv, header.vertex_count);
+            putU32(rv, header.elem_count);
+            putU32(rv, static_cast<std::uint32_t>(index_bytes));
+            putU32(rv, static_cast<std::uint32_t>(vertex_bytes));
+
+            if (header.compressed) {
+                lzCompress(streams.data(), streams.size(), rv);
+            } else {
+                rv.insert(rv.end(), streams.begin(), streams.end());
+            }
+            return rv;
+        }
+
+        bool readEncodedGeometryHeader(const ByteArray &data, EncodedGeometryHeader &header) {
+            if (data.size() < HEADER_SIZE || !std::equal(MAGIC, MAGIC + 4, data.begin()) || getU32(&data[4]) != FORMAT_VERSION) {
+                return false;
+            }
+
+            std::uint32_t flags = getU32(&data[8]);
+            header.primitive_restart = (flags & FLAG_PRIMITIVE_RESTART) != 0;
+            header.compressed = (flags & FLAG_COMPRESSED) != 0;
+            header.draw_type = getU32(&data[12]);
+            header.vertex_stride = getU32(&data[16]);
+            header.vertex_count = getU32(&data[20]);
+            header.elem_count = getU32(&data[24]);
+            return true;
+        }
+
+        bool decodeGeometryData(const ByteArray &data, const EncodedGeometryHeader &header, GLuint *elems, void *verts) {
+            const std::size_t index_bytes = getU32(&data[28]), vertex_bytes = getU32(&data[32]);
+            const std::uint8_t *payload = data.data() + HEADER_SIZE;
+            const std::size_t payload_size = data.size() - HEADER_SIZE;
+
+            ByteArray streams;
+            if (header.compressed) {
+                streams.resize(index_bytes + vertex_bytes);
+                if (!lzDecompress(payload, payload_size, streams.data(), streams.size())) {
+                    return false;
+                }
+                payload = streams.data();
+            } else if (payload_size != index_bytes + vertex_bytes) {
+                return false;
+            }
+
+            // The two streams are independent, so decode them side by
+            // side.
+            bool ok[2] = { false, false };
+            parallelFor(2, 1, [&](std::size_t s) {
+                    if (s == 0) {
+                        ok[0] = decodeIndices(payload, index_bytes, elems, header.elem_count);
+                    } else {
+                        ok[1] = decodeVertices(payload + index_bytes, vertex_bytes, verts, header.vertex_count, header.vertex_stride);
+                    }
+                });
+            return ok[0] && ok[1];
+        }
+
+        bool writeByteFile(const char *filename, const ByteArray &data) {
+            std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!file) {
+                std::cerr << "Could not open " << filename << " for writing." << std::endl;
+                return false;
+            }
+
+            file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+            return static_cast<bool>(file);
+        }
+
+        bool readByteFile(const char *filename, ByteArray &data) {
+            std::ifstream file(filename, std::ios::in | std::ios::binary | std::ios::ate);
+            if (!file) {
+                return false;
+            }
+
+            std::streamoff size = file.tellg();
+            file.seekg(0, std::ios::beg);
+            data.resize(static_cast<std::size_t>(size));
+            file.read(reinterpret_cast<char*>(data.data()), size);
+            return static_cast<bool>(file);
+        }
+    }
+}
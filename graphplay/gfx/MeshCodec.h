@@ -0,0 +1,123 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_MESH_CODEC_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_MESH_CODEC_H_
+
+#include "../graphplay.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../opengl.h"
+#include "Geometry.h"
+
+namespace graphplay {
+    namespace gfx {
+        typedef std::vector<std::uint8_t> ByteArray;
+
+        // Index streams: each index is stored as the zigzagged
+        // difference from the one before it, so meshes whose
+        // triangles use nearby vertices (after mortonSort() or
+        // buildClusters(), say) come out mostly as one byte per
+        // index. The differences are packed with a variable number
+        // of bytes each, with the lengths of four of them in each
+        // control byte. Appends to out.
+        void encodeIndices(const GLuint *elems, std::size_t count, ByteArray &out);
+
+        // Decode exactly count indices. Returns false if data is
+        // truncated or otherwise malformed.
+        bool decodeIndices(const std::uint8_t *data, std::size_t size, GLuint *elems, std::size_t count);
+
+        // Vertex streams: the vertices are split into blocks, and each
+        // byte of the vertex format is stored a block at a time as
+        // zigzagged differences from the same byte of the vertex
+        // before it, packed into groups of sixteen with 0, 2, 4 or 8
+        // bits each. Appends to out.
+        void encodeVertices(const void *verts, std::size_t count, std::size_t stride, ByteArray &out);
+
+        // Decode exactly count vertices of stride bytes into verts.
+        bool decodeVertices(const std::uint8_t *data, std::size_t size, void *verts, std::size_t count, std::size_t stride);
+
+        // A small general purpose LZ77 compressor, with a block format
+        // like LZ4's, for squeezing the streams above a little more.
+        void lzCompress(const std::uint8_t *data, std::size_t size, ByteArray &out);
+
+        // Decompress exactly out_size bytes into out.
+        bool lzDecompress(const std::uint8_t *data, std::size_t size, std::uint8_t *out, std::size_t out_size);
+
+        // The sizes and settings stored at the front of an encoded
+        // geometry.
+        struct EncodedGeometryHeader {
+            GLenum draw_type;
+            bool primitive_restart;
+            bool compressed;
+            std::uint32_t vertex_stride;
+            std::uint32_t vertex_count;
+            std::uint32_t elem_count;
+        };
+
+        // Encode a geometry's element and vertex arrays, optionally
+        // followed by lzCompress.
+        ByteArray encodeGeometryData(
+            const EncodedGeometryHeader &header,
+            const GLuint *elems, const void *verts);
+
+        // Read the header of an encoded geometry, and then decode its
+        // arrays into elems and verts, which need to have room for
+        // header.elem_count and header.vertex_count items.
+        bool readEncodedGeometryHeader(const ByteArray &data, EncodedGeometryHeader &header);
+        bool decodeGeometryData(const ByteArray &data, const EncodedGeometryHeader &header, GLuint *elems, void *verts);
+
+        bool writeByteFile(const char *filename, const ByteArray &data);
+        bool readByteFile(const char *filename, ByteArray &data);
+
+        template <typename V>
+        ByteArray encodeGeometry(const Geometry<V> &geo, bool compress = true) {
+            EncodedGeometryHeader header;
+            header.draw_type = geo.draw_type;
+            header.primitive_restart = geo.primitive_restart;
+            header.compressed = compress;
+            header.vertex_stride = sizeof(V);
+            header.vertex_count = static_cast<std::uint32_t>(geo.vertices().size());
+            header.elem_count = static_cast<std::uint32_t>(geo.elements().size());
+            return encodeGeometryData(header, geo.elements().data(), geo.vertices().data());
+        }
+
+        // Replace geo's data with an encoded geometry's. Fails if the
+        // data is malformed or has a different vertex size.
+        template <typename V>
+        bool decodeGeometry(const ByteArray &data, Geometry<V> &geo) {
+            EncodedGeometryHeader header;
+            if (!readEncodedGeometryHeader(data, header) || header.vertex_stride != sizeof(V)) {
+                return false;
+            }
+
+            typename Geometry<V>::elem_array_type elems(header.elem_count);
+            typename Geometry<V>::vertex_array_type verts(header.vertex_count);
+            if (!decodeGeometryData(data, header, elems.data(), verts.data())) {
+                return false;
+            }
+
+            geo.draw_type = header.draw_type;
+            geo.primitive_restart = header.primitive_restart;
+            geo.setVertexData(std::move(elems), std::move(verts));
+            return true;
+        }
+
+        // Cache files for geometries, so that big meshes don't have
+        // to be parsed and processed every time they're loaded.
+        template <typename V>
+        bool saveGeometryCache(const char *filename, const Geometry<V> &geo, bool compress = true) {
+            return writeByteFile(filename, encodeGeometry(geo, compress));
+        }
+
+        template <typename V>
+        bool loadGeometryCache(const char *filename, Geometry<V> &geo) {
+            ByteArray data;
+            return readByteFile(filename, data) && decodeGeometry(data, geo);
+        }
+    }
+}
+
+#endif
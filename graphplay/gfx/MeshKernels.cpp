@@ -0,0 +1,276 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../graphplay.h"
+#include "MeshKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GRAPHPLAY_MESH_KERNELS_SSE
+#include <emmintrin.h>
+#endif
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#include "../Parallel.h"
+#include "Geometry.h"
+
+namespace graphplay {
+    namespace gfx {
+        static const std::size_t MIN_KERNEL_CHUNK = 1 << 15;
+        static const float FLOAT_MIN = std::numeric_limits<float>::lowest();
+        static const float FLOAT_MAX = std::numeric_limits<float>::max();
+
+        static inline const float* at(const float *first, std::size_t stride, std::size_t i) {
+            return reinterpret_cast<const float*>(reinterpret_cast<const char*>(first) + i*stride);
+        }
+
+        static inline float* at(float *first, std::size_t stride, std::size_t i) {
+            return reinterpret_cast<float*>(reinterpret_cast<char*>(first) + i*stride);
+        }
+
+#ifdef GRAPHPLAY_MESH_KERNELS_SSE
+        // Load and store just three floats, so that we never touch
+        // memory past the end of a packed array. The fourth lane is
+        // loaded as zero.
+        static inline __m128 load3(const float *p) {
+            __m128 xy = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(p)));
+            return _mm_movelh_ps(xy, _mm_load_ss(p + 2));
+        }
+
+        static inline void store3(float *p, __m128 v) {
+            _mm_storel_pi(reinterpret_cast<__m64*>(p), v);
+            _mm_store_ss(p + 2, _mm_movehl_ps(v, v));
+        }
+#endif
+
+#ifdef __AVX__
+        // Two vectors at a time, one in each 128-bit half.
+        static inline __m256 pair(__m128 lo, __m128 hi) {
+            return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+        }
+#endif
+
+        static void minMax3Range(
+            const float *first, std::size_t stride, std::size_t begin, std::size_t end,
+            glm::vec3 &min, glm::vec3 &max)
+        {
+            std::size_t i = begin;
+
+#ifdef GRAPHPLAY_MESH_KERNELS_SSE
+            __m128 lo = _mm_set1_ps(FLOAT_MAX), hi = _mm_set1_ps(FLOAT_MIN);
+
+#ifdef __AVX__
+            __m256 lo2 = _mm256_set1_ps(FLOAT_MAX), hi2 = _mm256_set1_ps(FLOAT_MIN);
+            for (; i + 1 < end; i += 2) {
+                __m256 v = pair(load3(at(first, stride, i)), load3(at(first, stride, i + 1)));
+                lo2 = _mm256_min_ps(lo2, v);
+                hi2 = _mm256_max_ps(hi2, v);
+            }
+            lo = _mm_min_ps(_mm256_castps256_ps128(lo2), _mm256_extractf128_ps(lo2, 1));
+            hi = _mm_max_ps(_mm256_castps256_ps128(hi2), _mm256_extractf128_ps(hi2, 1));
+#endif
+
+            for (; i < end; ++i) {
+                __m128 v = load3(at(first, stride, i));
+                lo = _mm_min_ps(lo, v);
+                hi = _mm_max_ps(hi, v);
+            }
+
+            float lo_out[4], hi_out[4];
+            _mm_storeu_ps(lo_out, lo);
+            _mm_storeu_ps(hi_out, hi);
+            min = glm::vec3(lo_out[0], lo_out[1], lo_out[2]);
+            max = glm::vec3(hi_out[0], hi_out[1], hi_out[2]);
+#else
+            min = glm::vec3(FLOAT_MAX);
+            max = glm::vec3(FLOAT_MIN);
+            for (; i < end; ++i) {
+                const float *p = at(first, stride, i);
+                for (unsigned int j = 0; j < 3; ++j) {
+                    min[j] = std::min(min[j], p[j]);
+                    max[j] = std::max(max[j], p[j]);
+                }
+            }
+#endif
+        }
+
+        void minMax3(const float *first, std::size_t count, std::size_t stride, glm::vec3 &min, glm::vec3 &max) {
+            if (count == 0) {
+                return;
+            }
+
+            const unsigned int num_chunks = chunkCount(count, MIN_KERNEL_CHUNK);
+            std::vector<glm::vec3> mins(num_chunks), maxes(num_chunks);
+            parallelChunks(count, MIN_KERNEL_CHUNK, [&](unsigned int chunk, std::size_t begin, std::size_t end) {
+                    minMax3Range(first, stride, begin, end, mins[chunk], maxes[chunk]);
+                });
+
+            min = mins[0];
+            max = maxes[0];
+            for (unsigned int c = 1; c < num_chunks; ++c) {
+                for (unsigned int j = 0; j < 3; ++j) {
+                    min[j] = std::min(min[j], mins[c][j]);
+                    max[j] = std::max(max[j], maxes[c][j]);
+                }
+            }
+        }
+
+        static void transformPoints3Range(
+            float *first, std::size_t stride, std::size_t begin, std::size_t end,
+            const glm::mat4x4 &transform)
+        {
+            std::size_t i = begin;
+
+#ifdef GRAPHPLAY_MESH_KERNELS_SSE
+            __m128 cols[4];
+            for (unsigned int c = 0; c < 4; ++c) {
+                cols[c] = _mm_setr_ps(transform[c][0], transform[c][1], transform[c][2], transform[c][3]);
+            }
+
+#ifdef __AVX__
+            __m256 cols2[4];
+            for (unsigned int c = 0; c < 4; ++c) {
+                cols2[c] = pair(cols[c], cols[c]);
+            }
+
+            for (; i + 1 < end; i += 2) {
+                float *p0 = at(first, stride, i), *p1 = at(first, stride, i + 1);
+                __m256 v = pair(load3(p0), load3(p1));
+                __m256 r = _mm256_add_ps(
+                    _mm256_add_ps(
+                        _mm256_mul_ps(cols2[0], _mm256_permute_ps(v, 0x00)),
+                        _mm256_mul_ps(cols2[1], _mm256_permute_ps(v, 0x55))),
+                    _mm256_add_ps(
+                        _mm256_mul_ps(cols2[2], _mm256_permute_ps(v, 0xAA)),
+                        cols2[3]));
+                store3(p0, _mm256_castps256_ps128(r));
+                store3(p1, _mm256_extractf128_ps(r, 1));
+            }
+#endif
+
+            for (; i < end; ++i) {
+                float *p = at(first, stride, i);
+                __m128 v = load3(p);
+                __m128 r = _mm_add_ps(
+                    _mm_add_ps(
+                        _mm_mul_ps(cols[0], _mm_shuffle_ps(v, v, 0x00)),
+                        _mm_mul_ps(cols[1], _mm_shuffle_ps(v, v, 0x55))),
+                    _mm_add_ps(
+                        _mm_mul_ps(cols[2], _mm_shuffle_ps(v, v, 0xAA)),
+                        cols[3]));
+                store3(p, r);
+            }
+#else
+            for (; i < end; ++i) {
+                float *p = at(first, stride, i);
+                glm::vec4 r = transform * glm::vec4(p[0], p[1], p[2], 1.0f);
+                p[0] = r.x;
+                p[1] = r.y;
+                p[2] = r.z;
+            }
+#endif
+        }
+
+        void transformPoints3(float *first, std::size_t count, std::size_t stride, const glm::mat4x4 &transform) {
+            parallelChunks(count, MIN_KERNEL_CHUNK, [&](unsigned int, std::size_t begin, std::size_t end) {
+                    transformPoints3Range(first, stride, begin, end, transform);
+                });
+        }
+
+        static void scale4Range(
+            float *first, std::size_t stride, std::size_t begin, std::size_t end,
+            const glm::vec4 &scale)
+        {
+            std::size_t i = begin;
+
+#ifdef GRAPHPLAY_MESH_KERNELS_SSE
+            __m128 s = _mm_setr_ps(scale[0], scale[1], scale[2], scale[3]);
+
+#ifdef __AVX__
+            __m256 s2 = pair(s, s);
+            for (; i + 1 < end; i += 2) {
+                float *p0 = at(first, stride, i), *p1 = at(first, stride, i + 1);
+                __m256 r = _mm256_mul_ps(s2, pair(_mm_loadu_ps(p0), _mm_loadu_ps(p1)));
+                _mm_storeu_ps(p0, _mm256_castps256_ps128(r));
+                _mm_storeu_ps(p1, _mm256_extractf128_ps(r, 1));
+            }
+#endif
+
+            for (; i < end; ++i) {
+                float *p = at(first, stride, i);
+                _mm_storeu_ps(p, _mm_mul_ps(s, _mm_loadu_ps(p)));
+            }
+#else
+            for (; i < end; ++i) {
+                float *p = at(first, stride, i);
+                for (unsigned int j = 0; j < 4; ++j) {
+                    p[j] *= scale[j];
+                }
+            }
+#endif
+        }
+
+        void scale4(float *first, std::size_t count, std::size_t stride, const glm::vec4 &scale) {
+            parallelChunks(count, MIN_KERNEL_CHUNK, [&](unsigned int, std::size_t begin, std::size_t end) {
+                    scale4Range(first, stride, begin, end, scale);
+                });
+        }
+
+        void positionBounds(const std::vector<PCNVertex> &verts, glm::vec3 &min, glm::vec3 &max) {
+            if (!verts.empty()) {
+                minMax3(verts[0].position, verts.size(), sizeof(PCNVertex), min, max);
+            }
+        }
+
+        void transformPositions(std::vector<PCNVertex> &verts, const glm::mat4x4 &transform) {
+            if (!verts.empty()) {
+                transformPoints3(verts[0].position, verts.size(), sizeof(PCNVertex), transform);
+            }
+        }
+
+        void scaleColors(std::vector<PCNVertex> &verts, const glm::vec4 &scale) {
+            if (!verts.empty()) {
+                scale4(verts[0].color, verts.size(), sizeof(PCNVertex), scale);
+            }
+        }
+
+        static void tintColorsByPositionRange(PCNVertex *verts, std::size_t begin, std::size_t end) {
+            std::size_t i = begin;
+
+#ifdef GRAPHPLAY_MESH_KERNELS_SSE
+            const __m128 sign_mask = _mm_set1_ps(-0.0f);
+            const __m128 opaque = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+            const __m128 rgb_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+
+            for (; i < end; ++i) {
+                __m128 color = _mm_loadu_ps(verts[i].color);
+                __m128 alpha = _mm_shuffle_ps(color, color, 0xFF);
+                __m128 tint = _mm_andnot_ps(sign_mask, load3(verts[i].position));
+                __m128 rgb = _mm_and_ps(rgb_mask, _mm_mul_ps(_mm_div_ps(color, alpha), tint));
+                _mm_storeu_ps(verts[i].color, _mm_or_ps(rgb, opaque));
+            }
+#else
+            for (; i < end; ++i) {
+                PCNVertex &v = verts[i];
+                for (unsigned int j = 0; j < 3; ++j) {
+                    v.color[j] = (v.color[j] / v.color[3]) * std::abs(v.position[j]);
+                }
+                v.color[3] = 1.0f;
+            }
+#endif
+        }
+
+        void tintColorsByPosition(std::vector<PCNVertex> &verts) {
+            PCNVertex *data = verts.data();
+            parallelChunks(verts.size(), MIN_KERNEL_CHUNK, [data](unsigned int, std::size_t begin, std::size_t end) {
+                    tintColorsByPositionRange(data, begin, end);
+                });
+        }
+    }
+}
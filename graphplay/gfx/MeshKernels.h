@@ -0,0 +1,48 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_MESH_KERNELS_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_MESH_KERNELS_H_
+
+#include "../graphplay.h"
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+namespace graphplay {
+    namespace gfx {
+        struct PCNVertex;
+
+        // Bulk operations on vectors of floats that are stride bytes
+        // apart, so that they work on one field of an array of vertex
+        // structs as well as on packed float arrays. They use AVX
+        // and/or SSE when the compiler is targeting them (build with
+        // -mavx to get the AVX versions), plain C++ otherwise, and
+        // split large arrays across threads.
+
+        // The per-component minimum and maximum of count 3-vectors.
+        // If count is 0, min and max are left alone.
+        void minMax3(const float *first, std::size_t count, std::size_t stride, glm::vec3 &min, glm::vec3 &max);
+
+        // Replace each 3-vector p with (transform * (p, 1)).xyz.
+        void transformPoints3(float *first, std::size_t count, std::size_t stride, const glm::mat4x4 &transform);
+
+        // Multiply each 4-vector by scale, component by component.
+        void scale4(float *first, std::size_t count, std::size_t stride, const glm::vec4 &scale);
+
+        // The same, over the fields of PCNVertex arrays.
+        void positionBounds(const std::vector<PCNVertex> &verts, glm::vec3 &min, glm::vec3 &max);
+        void transformPositions(std::vector<PCNVertex> &verts, const glm::mat4x4 &transform);
+        void scaleColors(std::vector<PCNVertex> &verts, const glm::vec4 &scale);
+
+        // Divide out each vertex's alpha, tint it by the absolute
+        // value of its position, and make it opaque. This is how
+        // loadPlyFile colors its meshes.
+        void tintColorsByPosition(std::vector<PCNVertex> &verts);
+    }
+}
+
+#endif
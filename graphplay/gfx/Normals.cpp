@@ -0,0 +1,211 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../graphplay.h"
+#include "Normals.h"
+
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "../Parallel.h"
+#include "MeshAdjacency.h"
+
+namespace graphplay {
+    namespace gfx {
+        static const std::size_t MIN_NORMALS_CHUNK = 1 << 14;
+
+        // The (unnormalized) normal of face f, with a length of twice
+        // its area, and the angle of the face at each of its corners.
+        static glm::vec3 faceNormalAndAngles(
+            const Geometry<PCNVertex>::elem_array_type &elems,
+            const Geometry<PCNVertex>::vertex_array_type &verts,
+            std::size_t f, float angles[3])
+        {
+            glm::vec3 p[3];
+            for (unsigned int k = 0; k < 3; ++k) {
+                p[k] = glm::make_vec3(verts[elems[3*f + k]].position);
+            }
+
+            for (unsigned int k = 0; k < 3; ++k) {
+                glm::vec3 e1 = p[(k + 1) % 3] - p[k];
+                glm::vec3 e2 = p[(k + 2) % 3] - p[k];
+                // atan2 stays accurate for very thin triangles, where
+                // acos of the normalized dot product does not.
+                angles[k] = std::atan2(glm::length(glm::cross(e1, e2)), glm::dot(e1, e2));
+            }
+
+            return glm::cross(p[1] - p[0], p[2] - p[0]);
+        }
+
+        static bool faceInRange(
+            const Geometry<PCNVertex>::elem_array_type &elems,
+            std::size_t num_verts, std::size_t f)
+        {
+            return elems[3*f] < num_verts && elems[3*f + 1] < num_verts && elems[3*f + 2] < num_verts;
+        }
+
+        static void setNormal(PCNVertex &vert, const glm::vec3 &sum) {
+            float len = glm::length(sum);
+            // Vertices that no (non-degenerate) face touches keep
+            // whatever normal they had.
+            if (len > 0.0f) {
+                glm::vec3 n = sum / len;
+                vert.normal[0] = n.x;
+                vert.normal[1] = n.y;
+                vert.normal[2] = n.z;
+            }
+        }
+
+        static void generateSmoothNormals(
+            const Geometry<PCNVertex>::elem_array_type &elems,
+            Geometry<PCNVertex>::vertex_array_type &verts)
+        {
+            const std::size_t num_faces = elems.size() / 3;
+            const std::size_t num_verts = verts.size();
+            const unsigned int num_chunks = chunkCount(num_faces, MIN_NORMALS_CHUNK);
+
+            // Every chunk of faces sums into its own copy of the
+            // vertex normals, which get added together afterwards.
+            std::vector<glm::vec3> sums(num_chunks*num_verts, glm::vec3(0.0f));
+            parallelChunks(num_faces, MIN_NORMALS_CHUNK, [&](unsigned int chunk, std::size_t first, std::size_t last) {
+                    glm::vec3 *chunk_sums = &sums[chunk*num_verts];
+                    float angles[3];
+                    for (std::size_t f = first; f < last; ++f) {
+                        if (!faceInRange(elems, num_verts, f)) {
+                            continue;
+                        }
+
+                        glm::vec3 n = faceNormalAndAngles(elems, verts, f, angles);
+                        for (unsigned int k = 0; k < 3; ++k) {
+                            chunk_sums[elems[3*f + k]] += n*angles[k];
+                        }
+                    }
+                });
+
+            parallelFor(num_verts, MIN_NORMALS_CHUNK, [&](std::size_t v) {
+                    glm::vec3 sum(0.0f);
+                    for (unsigned int c = 0; c < num_chunks; ++c) {
+                        sum += sums[c*num_verts + v];
+                    }
+                    setNormal(verts[v], sum);
+                });
+        }
+
+        static void generateCreasedNormals(
+            Geometry<PCNVertex>::elem_array_type &elems,
+            Geometry<PCNVertex>::vertex_array_type &verts,
+            float crease_angle)
+        {
+            const std::size_t num_faces = elems.size() / 3;
+            const std::size_t num_verts = verts.size();
+            const float min_cos = std::cos(crease_angle);
+
+            // The weighted contribution of every face corner, and the
+            // unit normal of every face to compare across creases.
+            std::vector<glm::vec3> corner_normals(elems.size(), glm::vec3(0.0f));
+            std::vector<glm::vec3> face_normals(num_faces, glm::vec3(0.0f));
+            parallelFor(num_faces, MIN_NORMALS_CHUNK, [&](std::size_t f) {
+                    if (!faceInRange(elems, num_verts, f)) {
+                        return;
+                    }
+
+                    float angles[3];
+                    glm::vec3 n = faceNormalAndAngles(elems, verts, f, angles);
+                    float len = glm::length(n);
+                    if (len > 0.0f) {
+                        face_normals[f] = n / len;
+                    }
+                    for (unsigned int k = 0; k < 3; ++k) {
+                        corner_normals[3*f + k] = n*angles[k];
+                    }
+                });
+
+            VertexCorners vc = buildVertexCorners(elems, num_verts);
+
+            // For every corner, sum the contributions of the corners
+            // around the same vertex that are on its side of any
+            // crease. Corners that come out with the same normal share
+            // a vertex; the rest get their own copies.
+            std::vector<glm::vec3> smoothed(elems.size(), glm::vec3(0.0f));
+            std::vector<unsigned int> corner_group(elems.size(), 0);
+            std::vector<unsigned int> num_groups(num_verts, 0);
+            parallelFor(num_verts, MIN_NORMALS_CHUNK, [&](std::size_t v) {
+                    std::vector<unsigned int> firsts;
+
+                    for (unsigned int i = vc.begin(v); i < vc.end(v); ++i) {
+                        unsigned int c = vc.corners[i];
+                        const glm::vec3 &fn = face_normals[c / 3];
+                        glm::vec3 sum(0.0f);
+
+                        for (unsigned int j = vc.begin(v); j < vc.end(v); ++j) {
+                            unsigned int other = vc.corners[j];
+                            // Degenerate faces (with no normal) go
+                            // along with whatever is around them.
+                            if (glm::dot(fn, face_normals[other / 3]) >= min_cos ||
+                                fn == glm::vec3(0.0f) ||
+                                face_normals[other / 3] == glm::vec3(0.0f))
+                            {
+                                sum += corner_normals[other];
+                            }
+                        }
+
+                        float len = glm::length(sum);
+                        smoothed[c] = len > 0.0f ? sum / len : glm::vec3(0.0f);
+
+                        unsigned int group = 0;
+                        while (group < firsts.size() &&
+                               glm::dot(smoothed[firsts[group]], smoothed[c]) < 0.9999f &&
+                               !(smoothed[firsts[group]] == smoothed[c]))
+                        {
+                            ++group;
+                        }
+                        if (group == firsts.size()) {
+                            firsts.push_back(c);
+                        }
+                        corner_group[c] = group;
+                    }
+
+                    // Unreferenced vertices are kept as they are.
+                    num_groups[v] = std::max<unsigned int>(1, static_cast<unsigned int>(firsts.size()));
+                });
+
+            std::vector<unsigned int> new_index(num_verts + 1, 0);
+            for (std::size_t v = 0; v < num_verts; ++v) {
+                new_index[v + 1] = new_index[v] + num_groups[v];
+            }
+
+            Geometry<PCNVertex>::vertex_array_type new_verts(new_index[num_verts]);
+            parallelFor(num_verts, MIN_NORMALS_CHUNK, [&](std::size_t v) {
+                    for (unsigned int g = 0; g < num_groups[v]; ++g) {
+                        new_verts[new_index[v] + g] = verts[v];
+                    }
+
+                    for (unsigned int i = vc.begin(v); i < vc.end(v); ++i) {
+                        unsigned int c = vc.corners[i];
+                        unsigned int nv = new_index[v] + corner_group[c];
+                        setNormal(new_verts[nv], smoothed[c]);
+                        elems[c] = nv;
+                    }
+                });
+
+            verts = std::move(new_verts);
+        }
+
+        void generateNormals(
+            Geometry<PCNVertex>::elem_array_type &elems,
+            Geometry<PCNVertex>::vertex_array_type &verts,
+            float crease_angle)
+        {
+            if (crease_angle > 0.0f) {
+                generateCreasedNormals(elems, verts, crease_angle);
+            } else {
+                generateSmoothNormals(elems, verts);
+            }
+        }
+
+        void generateNormals(Geometry<PCNVertex> &geo, float crease_angle) {
+            generateNormals(geo.elements(), geo.vertices(), crease_angle);
+        }
+    }
+}
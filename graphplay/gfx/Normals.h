@@ -0,0 +1,31 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_NORMALS_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_NORMALS_H_
+
+#include "../graphplay.h"
+
+#include "Geometry.h"
+
+namespace graphplay {
+    namespace gfx {
+        // Replace the vertex normals of a triangle list with ones
+        // computed from its faces. Each face adds its normal to each
+        // of its vertices, weighted by the face's area and by its
+        // angle at that vertex. Faces are assumed to wind
+        // counter-clockwise when seen from the outside.
+        //
+        // If crease_angle (in radians) is greater than zero, faces
+        // around a vertex are only smoothed together when their
+        // normals are within crease_angle of each other, and vertices
+        // on a crease are split into one copy per side. This changes
+        // the vertex and element arrays.
+        void generateNormals(
+            Geometry<PCNVertex>::elem_array_type &elems,
+            Geometry<PCNVertex>::vertex_array_type &verts,
+            float crease_angle = 0.0f);
+        void generateNormals(Geometry<PCNVertex> &geo, float crease_angle = 0.0f);
+    }
+}
+
+#endif
@@ -10,24 +10,22 @@
 
 namespace graphplay {
     namespace gfx {
-        GLuint duplicateBuffer(GLenum target, GLuint src) {
+        GLuint duplicateBuffer(GLuint src) {
             if (glIsBuffer(src)) {
-                // Retrieve the size, usage, and data of the buffer.
+                // Copy on the GPU, through the copy targets so
+                // nothing else's bindings get disturbed.
                 GLint size = 0, usage = 0;
-                glBindBuffer(target, src);
-                glGetBufferParameteriv(target, GL_BUFFER_SIZE, &size);
-                glGetBufferParameteriv(target, GL_BUFFER_USAGE, &usage);
-                char *src_data = (char *)glMapBuffer(target, GL_READ_ONLY);
-                std::vector<char> inter_data(src_data, src_data + size);
-                glUnmapBuffer(target);
-                glBindBuffer(target, 0);
-
-                // Copy the data to a new buffer.
+                glBindBuffer(GL_COPY_READ_BUFFER, src);
+                glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+                glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_USAGE, &usage);
+
                 GLuint dst = 0;
                 glGenBuffers(1, &dst);
-                glBindBuffer(target, dst);
-                glBufferData(target, size, inter_data.data(), usage);
-                glBindBuffer(target, 0);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+                glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, usage);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+                glBindBuffer(GL_COPY_READ_BUFFER, 0);
 
                 return dst;
             }
@@ -36,6 +34,24 @@ namespace graphplay {
             }
         }
 
+        SharedGLObject shareBuffer(GLuint buffer) {
+            return SharedGLObject(new GLuint(buffer), [](const GLuint *b) {
+                    if (glIsBuffer(*b)) {
+                        glDeleteBuffers(1, b);
+                    }
+                    delete b;
+                });
+        }
+
+        SharedGLObject shareVertexArray(GLuint array) {
+            return SharedGLObject(new GLuint(array), [](const GLuint *a) {
+                    if (glIsVertexArray(*a)) {
+                        glDeleteVertexArrays(1, a);
+                    }
+                    delete a;
+                });
+        }
+
         struct VAPState {
             GLuint enabled;
             GLuint array_buffer_binding;
@@ -48,7 +64,7 @@ namespace graphplay {
             GLvoid *offset;
         };
 
-        GLuint duplicateVertexArrayObject(GLuint src) {
+        GLuint duplicateVertexArrayObject(GLuint src, GLuint array_buffer, GLuint elem_buffer) {
             if (glIsVertexArray(src)) {
                 glBindVertexArray(src);
 
@@ -77,11 +93,11 @@ namespace graphplay {
                 glGenVertexArrays(1, &dst);
                 glBindVertexArray(dst);
 
-                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elem_binding);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elem_buffer != 0 ? elem_buffer : elem_binding);
                 for (auto i = 0; i < max_attribs; ++i) {
                     if (attribs[i].enabled) {
                         glEnableVertexAttribArray(i);
-                        glBindBuffer(GL_ARRAY_BUFFER, attribs[i].array_buffer_binding);
+                        glBindBuffer(GL_ARRAY_BUFFER, array_buffer != 0 ? array_buffer : attribs[i].array_buffer_binding);
                         glVertexAttribDivisor(i, attribs[i].divisor);
 
                         switch (attribs[i].type) {
@@ -159,9 +175,30 @@ namespace graphplay {
         }
 
         GLuint createProgramFromShaders(GLuint vertex_shader, GLuint fragment_shader) {
+            std::vector<GLuint> shaders = { vertex_shader, fragment_shader };
+            return createProgramFromShaders(shaders);
+        }
+
+        const IndexMap& standardAttributeLocations() {
+            static const IndexMap locations = {
+                { "position", 0 },
+                { "color", 1 },
+                { "normal", 2 },
+                { "instance_model", 3 },
+                { "instance_normal", 7 },
+                { "draw_id", 10 },
+            };
+            return locations;
+        }
+
+        GLuint createProgramFromShaders(const std::vector<GLuint> &shaders) {
             GLuint program = glCreateProgram();
-            glAttachShader(program, vertex_shader);
-            glAttachShader(program, fragment_shader);
+            for (auto s : shaders) {
+                glAttachShader(program, s);
+            }
+            for (auto &&attr : standardAttributeLocations()) {
+                glBindAttribLocation(program, attr.second, attr.first.c_str());
+            }
             glLinkProgram(program);
 
             GLint status;
@@ -6,6 +6,7 @@
 #include "../graphplay.h"
 
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include "../opengl.h"
@@ -14,10 +15,30 @@ namespace graphplay {
     namespace gfx {
         typedef std::map<std::string, GLuint> IndexMap;
 
-        GLuint duplicateBuffer(GLenum target, GLuint src);
-        GLuint duplicateVertexArrayObject(GLuint src);
+        // A GL buffer or vertex array that can have more than one
+        // owner. It's deleted when the last one lets go of it.
+        typedef std::shared_ptr<const GLuint> SharedGLObject;
+        SharedGLObject shareBuffer(GLuint buffer);
+        SharedGLObject shareVertexArray(GLuint array);
+
+        // Copy a buffer's contents into a new buffer, without the
+        // data leaving the GPU.
+        GLuint duplicateBuffer(GLuint src);
+
+        // Copy a vertex array's attribute setup. If array_buffer or
+        // elem_buffer is given, the copy reads from it instead of
+        // the buffers the original reads from.
+        GLuint duplicateVertexArrayObject(GLuint src, GLuint array_buffer = 0, GLuint elem_buffer = 0);
         GLuint createAndCompileShader(GLenum shader_type, const char* shader_src);
+        // The locations every program's vertex attributes are bound
+        // to, so that a vertex array set up for one program works
+        // with the others too. The per-instance matrices of
+        // instanced programs take up a location per column, and
+        // batched programs get their draw_id after them.
+        const IndexMap& standardAttributeLocations();
+
         GLuint createProgramFromShaders(GLuint vertex_shader, GLuint fragment_shader);
+        GLuint createProgramFromShaders(const std::vector<GLuint> &shaders);
         void getAttachedShaders(GLuint program, std::vector<GLuint> &shaders);
         void getAttributeInfo(GLuint program, IndexMap &attributes);
         void getUniformInfo(GLuint program, IndexMap &uniforms);
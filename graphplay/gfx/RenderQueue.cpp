@@ -0,0 +1,461 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../graphplay.h"
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+#include <glm/gtc/matrix_inverse.hpp>
+
+#include "../Parallel.h"
+#include "OpenGLUtils.h"
+
+namespace graphplay {
+    namespace gfx {
+        RenderQueue::RenderQueue()
+            : m_items(),
+              m_meshes(),
+              m_instanced_count(0),
+              m_model_block_count(0),
+              m_batched_count(0),
+              m_model_offsets(),
+              m_instances(),
+              m_instance_buffer(0),
+              m_draw_ring(),
+              m_draw_texture(0),
+              m_draw_texture_buffer(0),
+              m_draw_slots(),
+              m_draw_base(0),
+              m_commands(),
+              m_indirect_buffer(0),
+              m_draw_id_buffer(0),
+              m_draw_id_capacity(0),
+              m_program_binds(0),
+              m_vertex_array_binds(0),
+              m_draw_calls(0),
+              m_batches(0)
+        {}
+
+        RenderQueue::~RenderQueue() {
+            if (glIsBuffer(m_instance_buffer)) {
+                glDeleteBuffers(1, &m_instance_buffer);
+            }
+            if (glIsTexture(m_draw_texture)) {
+                glDeleteTextures(1, &m_draw_texture);
+            }
+            if (glIsBuffer(m_indirect_buffer)) {
+                glDeleteBuffers(1, &m_indirect_buffer);
+            }
+            if (glIsBuffer(m_draw_id_buffer)) {
+                glDeleteBuffers(1, &m_draw_id_buffer);
+            }
+        }
+
+        bool RenderQueue::indirectBatches() {
+#ifdef GL_VERSION_4_3
+            // Only if the loader was generated for 4.3 or later.
+            return GLAD_GL_VERSION_4_3 != 0;
+#else
+            return false;
+#endif
+        }
+
+        std::uint64_t RenderQueue::sortKey(GLuint program, GLuint vertex_array, float depth) {
+            // Non-negative floats sort the same as their bits do.
+            if (!(depth > 0.0f)) {
+                depth = 0.0f;
+            }
+            std::uint32_t depth_bits;
+            std::memcpy(&depth_bits, &depth, sizeof(depth_bits));
+
+            return (std::uint64_t)(program & 0xFFFF) << 48
+                | (std::uint64_t)(vertex_array & 0xFFFF) << 32
+                | depth_bits;
+        }
+
+        std::uint64_t RenderQueue::batchKey(GLuint program, GLuint vertex_array, std::uintptr_t geometry) {
+            // The low bits of an address are all the same, so leave
+            // them out.
+            return (std::uint64_t)(program & 0xFFFF) << 48
+                | (std::uint64_t)(vertex_array & 0xFFFF) << 32
+                | (std::uint32_t)(geometry >> 4);
+        }
+
+        void RenderQueue::clear() {
+            m_items.clear();
+            m_meshes.clear();
+            m_instanced_count = 0;
+            m_model_block_count = 0;
+            m_batched_count = 0;
+        }
+
+        void RenderQueue::add(Mesh::sptr_type mesh, float depth) {
+            if (!mesh->drawable()) {
+                return;
+            }
+
+            Item item;
+            if (mesh->instanced()) {
+                item.key = batchKey(mesh->programId(), mesh->vertexArrayObjectId(), mesh->geometryKey());
+                ++m_instanced_count;
+            } else {
+                item.key = sortKey(mesh->programId(), mesh->vertexArrayObjectId(), depth);
+                if (mesh->usesModelBlock()) {
+                    ++m_model_block_count;
+                }
+                if (mesh->batched()) {
+                    ++m_batched_count;
+                }
+            }
+            item.index = (std::uint32_t)m_meshes.size();
+            m_items.push_back(item);
+            m_meshes.push_back(std::move(mesh));
+        }
+
+        void RenderQueue::sort() {
+            parallelRadixSort(m_items, 1 << 14, 64, [](const Item &item) {
+                    return item.key;
+                });
+        }
+
+        void RenderQueue::render(const glm::mat4x4 &view_projection, const glm::vec3 &eye, FrameRing *ring) {
+            GLuint program = 0, vertex_array = 0;
+            m_program_binds = 0;
+            m_vertex_array_binds = 0;
+            m_draw_calls = 0;
+            m_batches = 0;
+
+            if (m_instanced_count > 0) {
+                uploadInstances();
+            }
+
+            const bool ring_blocks = ring && writeModelBlocks(*ring);
+            const bool draw_data = m_batched_count > 0 && writeDrawData();
+            if (draw_data) {
+                glActiveTexture(GL_TEXTURE0 + Program::DRAW_DATA_TEXTURE_UNIT);
+                glBindTexture(GL_TEXTURE_BUFFER, m_draw_texture);
+            }
+
+            for (std::size_t i = 0; i < m_items.size(); ) {
+                const Mesh &mesh = *m_meshes[m_items[i].index];
+
+                if (mesh.programId() != program) {
+                    program = mesh.programId();
+                    glUseProgram(program);
+                    ++m_program_binds;
+                }
+
+                if (mesh.vertexArrayObjectId() != vertex_array) {
+                    vertex_array = mesh.vertexArrayObjectId();
+                    glBindVertexArray(vertex_array);
+                    ++m_vertex_array_binds;
+                }
+
+                if (mesh.batched()) {
+                    std::size_t last = i + 1;
+                    while (last < m_items.size()
+                           && m_meshes[m_items[last].index]->batched()
+                           && mesh.batchesWith(*m_meshes[m_items[last].index])) {
+                        ++last;
+                    }
+
+                    if (draw_data) {
+                        drawBatch(i, last, view_projection, eye);
+                    }
+                    i = last;
+                    continue;
+                }
+
+                ++m_draw_calls;
+                if (!mesh.instanced()) {
+                    const bool bound = ring_blocks && mesh.usesModelBlock();
+                    if (bound) {
+                        glBindBufferRange(GL_UNIFORM_BUFFER, ModelTransformationBlock::BINDING, ring->bufferId(),
+                                          m_model_offsets[i], sizeof(ModelTransformationBlock));
+                    }
+                    mesh.draw(view_projection, eye, bound);
+                    ++i;
+                    continue;
+                }
+
+                std::size_t last = i + 1;
+                while (last < m_items.size() && mesh.sameBatch(*m_meshes[m_items[last].index])) {
+                    ++last;
+                }
+
+                bindInstances(i);
+                mesh.drawInstances((GLsizei)(last - i));
+                unbindInstances();
+                i = last;
+            }
+
+            glBindVertexArray(0);
+            glUseProgram(0);
+
+            if (ring) {
+                ring->endFrame();
+            }
+
+            if (draw_data) {
+                glBindTexture(GL_TEXTURE_BUFFER, 0);
+                m_draw_ring->endFrame();
+            }
+
+            clear();
+        }
+
+        // Put the batched meshes' transformations in this frame's
+        // part of the draw data ring.
+        bool RenderQueue::writeDrawData() {
+            const std::size_t bytes = m_batched_count*sizeof(ModelTransformationBlock);
+            if (!m_draw_ring) {
+                m_draw_ring.reset(new FrameRing(GL_TEXTURE_BUFFER, bytes));
+                glGenTextures(1, &m_draw_texture);
+            }
+
+            m_draw_ring->reserve(bytes);
+            m_draw_ring->beginFrame();
+            GLintptr offset = 0;
+            ModelTransformationBlock *dest = (ModelTransformationBlock*)m_draw_ring->allocate(bytes, offset);
+            if (!dest) {
+                std::cerr << "Could not write the draw data for " << m_batched_count << " meshes" << std::endl;
+                m_draw_ring->unmap();
+                m_draw_ring->endFrame();
+                return false;
+            }
+
+            // A texel is a vec4.
+            m_draw_base = (GLint)(offset / sizeof(glm::vec4));
+            m_draw_slots.assign(m_items.size(), 0);
+            GLuint slot = 0;
+            for (std::size_t i = 0; i < m_items.size(); ++i) {
+                if (m_meshes[m_items[i].index]->batched()) {
+                    m_draw_slots[i] = slot++;
+                }
+            }
+
+            parallelFor(m_items.size(), 1 << 12, [&](std::size_t i) {
+                    const Mesh &mesh = *m_meshes[m_items[i].index];
+                    if (mesh.batched()) {
+                        mesh.modelBlock(dest[m_draw_slots[i]]);
+                    }
+                });
+            m_draw_ring->unmap();
+
+            // The texture has to follow the buffer if the ring grew.
+            if (m_draw_texture_buffer != m_draw_ring->bufferId()) {
+                m_draw_texture_buffer = m_draw_ring->bufferId();
+                glBindTexture(GL_TEXTURE_BUFFER, m_draw_texture);
+                glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_draw_texture_buffer);
+                glBindTexture(GL_TEXTURE_BUFFER, 0);
+            }
+
+            return true;
+        }
+
+        // Draw the batched meshes from first up to last, with the
+        // program and vertex array already bound.
+        void RenderQueue::drawBatch(std::size_t first, std::size_t last, const glm::mat4x4 &view_projection, const glm::vec3 &eye) {
+            m_commands.clear();
+            for (std::size_t i = first; i < last; ++i) {
+                m_meshes[m_items[i].index]->drawCommands(view_projection, eye, m_draw_slots[i], m_commands);
+            }
+            if (m_commands.empty()) {
+                return;
+            }
+
+            const Mesh &mesh = *m_meshes[m_items[first].index];
+            mesh.standardUniforms().draw_base.set(m_draw_base);
+
+            if (mesh.primitiveRestart()) {
+                glEnable(GL_PRIMITIVE_RESTART);
+                glPrimitiveRestartIndex(mesh.elemGLType() == GL_UNSIGNED_SHORT ? 0xFFFF : PRIMITIVE_RESTART_INDEX);
+            }
+            if (mesh.drawType() == GL_PATCHES) {
+                glPatchParameteri(GL_PATCH_VERTICES, 3);
+            }
+
+            if (indirectBatches()) {
+                submitIndirect(mesh);
+            } else {
+                submitMultiDraws(mesh);
+            }
+            ++m_batches;
+
+            if (mesh.primitiveRestart()) {
+                glDisable(GL_PRIMITIVE_RESTART);
+            }
+        }
+
+        // The whole batch in one call. The draw_id comes from an
+        // instanced attribute that counts up from 0, offset by each
+        // command's base_instance.
+        void RenderQueue::submitIndirect(const Mesh &mesh) {
+#ifdef GL_VERSION_4_3
+            const GLuint draw_id_location = standardAttributeLocations().at("draw_id");
+
+            if (m_draw_id_capacity < m_batched_count) {
+                m_draw_id_capacity = std::max(m_batched_count, 2*m_draw_id_capacity);
+                std::vector<GLuint> ids(m_draw_id_capacity);
+                for (std::size_t i = 0; i < ids.size(); ++i) {
+                    ids[i] = (GLuint)i;
+                }
+                if (m_draw_id_buffer == 0) {
+                    glGenBuffers(1, &m_draw_id_buffer);
+                }
+                glBindBuffer(GL_ARRAY_BUFFER, m_draw_id_buffer);
+                glBufferData(GL_ARRAY_BUFFER, ids.size()*sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+            }
+
+            if (m_indirect_buffer == 0) {
+                glGenBuffers(1, &m_indirect_buffer);
+            }
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirect_buffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, m_commands.size()*sizeof(DrawElementsCommand), m_commands.data(), GL_STREAM_DRAW);
+
+            glBindBuffer(GL_ARRAY_BUFFER, m_draw_id_buffer);
+            glEnableVertexAttribArray(draw_id_location);
+            glVertexAttribIPointer(draw_id_location, 1, GL_UNSIGNED_INT, sizeof(GLuint), BUFFER_OFFSET_BYTES(0));
+            glVertexAttribDivisor(draw_id_location, 1);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            glMultiDrawElementsIndirect(mesh.drawType(), mesh.elemGLType(), BUFFER_OFFSET_BYTES(0), (GLsizei)m_commands.size(), 0);
+            ++m_draw_calls;
+
+            glDisableVertexAttribArray(draw_id_location);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+#else
+            submitMultiDraws(mesh);
+#endif
+        }
+
+        // Without draw IDs, each mesh's ranges go in a multi-draw of
+        // their own, with draw_id set as a constant attribute.
+        void RenderQueue::submitMultiDraws(const Mesh &mesh) {
+            const GLuint draw_id_location = standardAttributeLocations().at("draw_id");
+            const std::size_t elem_size = mesh.elemGLType() == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+            std::vector<GLsizei> counts;
+            std::vector<const GLvoid*> offsets;
+            std::vector<GLint> base_vertices;
+
+            for (std::size_t c = 0; c < m_commands.size(); ) {
+                const GLuint draw_id = m_commands[c].base_instance;
+                counts.clear();
+                offsets.clear();
+                base_vertices.clear();
+                for (; c < m_commands.size() && m_commands[c].base_instance == draw_id; ++c) {
+                    counts.push_back((GLsizei)m_commands[c].count);
+                    offsets.push_back(BUFFER_OFFSET_BYTES(m_commands[c].first_index*elem_size));
+                    base_vertices.push_back(m_commands[c].base_vertex);
+                }
+
+                glVertexAttribI1ui(draw_id_location, draw_id);
+                glMultiDrawElementsBaseVertex(mesh.drawType(), counts.data(), mesh.elemGLType(), offsets.data(),
+                                              (GLsizei)counts.size(), base_vertices.data());
+                ++m_draw_calls;
+            }
+        }
+
+        // Fill in this frame's part of the ring. If it doesn't work
+        // out, the meshes set their own blocks as they're drawn.
+        bool RenderQueue::writeModelBlocks(FrameRing &ring) {
+            const std::size_t stride = ring.alignedSize(sizeof(ModelTransformationBlock));
+            ring.reserve(m_model_block_count*stride);
+            ring.beginFrame();
+
+            GLintptr base = 0;
+            GLubyte *dest = m_model_block_count > 0
+                ? (GLubyte*)ring.allocate(m_model_block_count*stride, base)
+                : nullptr;
+            if (m_model_block_count > 0 && !dest) {
+                ring.unmap();
+                return false;
+            }
+
+            m_model_offsets.assign(m_items.size(), -1);
+            std::size_t slot = 0;
+            for (std::size_t i = 0; i < m_items.size(); ++i) {
+                const Mesh &mesh = *m_meshes[m_items[i].index];
+                if (!mesh.instanced() && mesh.usesModelBlock()) {
+                    m_model_offsets[i] = base + slot*stride;
+                    ++slot;
+                }
+            }
+
+            parallelFor(m_items.size(), 1 << 12, [&](std::size_t i) {
+                    if (m_model_offsets[i] >= 0) {
+                        ModelTransformationBlock *block = (ModelTransformationBlock*)(dest + (m_model_offsets[i] - base));
+                        m_meshes[m_items[i].index]->modelBlock(*block);
+                    }
+                });
+
+            ring.unmap();
+            return true;
+        }
+
+        void RenderQueue::uploadInstances() {
+            // Slots for meshes that aren't instanced are left alone;
+            // it's simpler than packing the instanced ones together,
+            // and they're usually a small minority.
+            m_instances.resize(m_items.size());
+            parallelFor(m_items.size(), 1 << 12, [&](std::size_t i) {
+                    const Mesh &mesh = *m_meshes[m_items[i].index];
+                    if (mesh.instanced()) {
+                        m_instances[i].model = mesh.modelTransformation();
+                        m_instances[i].model_inv_trans_3 = glm::inverseTranspose(glm::mat3x3(mesh.modelTransformation()));
+                    }
+                });
+
+            if (m_instance_buffer == 0) {
+                glGenBuffers(1, &m_instance_buffer);
+            }
+
+            // Respecifying the whole buffer orphans last frame's, so
+            // this doesn't wait for the GPU to finish with it.
+            glBindBuffer(GL_ARRAY_BUFFER, m_instance_buffer);
+            glBufferData(GL_ARRAY_BUFFER, m_instances.size()*sizeof(InstanceData), m_instances.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+
+        // Point the instance attributes of the bound vertex array at
+        // the instances starting at first.
+        void RenderQueue::bindInstances(std::size_t first) const {
+            const IndexMap &locations = standardAttributeLocations();
+            const GLuint model_location = locations.at("instance_model");
+            const GLuint normal_location = locations.at("instance_normal");
+            const std::size_t base = first*sizeof(InstanceData);
+
+            glBindBuffer(GL_ARRAY_BUFFER, m_instance_buffer);
+            for (GLuint c = 0; c < 4; ++c) {
+                glEnableVertexAttribArray(model_location + c);
+                glVertexAttribPointer(model_location + c, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                      BUFFER_OFFSET_BYTES(base + offsetof(InstanceData, model) + c*sizeof(glm::vec4)));
+                glVertexAttribDivisor(model_location + c, 1);
+            }
+            for (GLuint c = 0; c < 3; ++c) {
+                glEnableVertexAttribArray(normal_location + c);
+                glVertexAttribPointer(normal_location + c, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                      BUFFER_OFFSET_BYTES(base + offsetof(InstanceData, model_inv_trans_3) + c*sizeof(glm::vec3)));
+                glVertexAttribDivisor(normal_location + c, 1);
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+
+        // Leave the vertex array the way other meshes expect it.
+        void RenderQueue::unbindInstances() const {
+            const IndexMap &locations = standardAttributeLocations();
+            const GLuint model_location = locations.at("instance_model");
+            const GLuint normal_location = locations.at("instance_normal");
+
+            for (GLuint c = 0; c < 4; ++c) {
+                glDisableVertexAttribArray(model_location + c);
+            }
+            for (GLuint c = 0; c < 3; ++c) {
+                glDisableVertexAttribArray(normal_location + c);
+            }
+        }
+    }
+}
@@ -0,0 +1,140 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_RENDER_QUEUE_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_RENDER_QUEUE_H_
+
+#include "../graphplay.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include "../opengl.h"
+#include "FrameRing.h"
+#include "Mesh.h"
+
+namespace graphplay {
+    namespace gfx {
+        // What the instanced programs get for each instance.
+        struct InstanceData {
+            glm::mat4x4 model;
+            glm::mat3x3 model_inv_trans_3;
+        };
+
+        // The meshes to draw in a frame, sorted so that everything
+        // using the same program is drawn together, and within that
+        // everything using the same vertex array, and within that
+        // nearest first (so the depth test throws away as much as
+        // possible). The program and vertex array are only bound
+        // when they change.
+        //
+        // Meshes with instanced programs are sorted by geometry
+        // instead of depth, and each run of them with the same
+        // program and geometry is drawn with one instanced draw call.
+        // Their transformations go into an instance buffer that's
+        // filled once a frame.
+        //
+        // Given a FrameRing, the model_transformation blocks of the
+        // other meshes are all written into it up front, and each
+        // mesh's is picked out with glBindBufferRange.
+        //
+        // Meshes with batched programs have their transformations
+        // written into a texture buffer instead, and each run of them
+        // that can be drawn together is: with one
+        // glMultiDrawElementsIndirect under 4.3, or with a
+        // glMultiDrawElementsBaseVertex per mesh otherwise, with
+        // nothing but the draw_id changing in between.
+        class RenderQueue {
+        public:
+            RenderQueue();
+            RenderQueue(const RenderQueue &other) = delete;
+            RenderQueue& operator=(const RenderQueue &other) = delete;
+            ~RenderQueue();
+
+            // The sort key: the low 16 bits of the program id, then
+            // the low 16 bits of the vertex array id, then the depth.
+            // Ids that share their low bits just get sorted together;
+            // they're still bound properly.
+            static std::uint64_t sortKey(GLuint program, GLuint vertex_array, float depth);
+
+            // The sort key for instanced meshes, with (part of) the
+            // geometry's address in place of the depth.
+            static std::uint64_t batchKey(GLuint program, GLuint vertex_array, std::uintptr_t geometry);
+
+            void clear();
+
+            // Queue mesh, depth away from the eye. Meshes that aren't
+            // drawable() are left out.
+            void add(Mesh::sptr_type mesh, float depth);
+
+            void sort();
+
+            // Draw everything, in order. Leaves nothing bound, and the
+            // queue empty, so it doesn't keep the meshes alive until
+            // the next frame.
+            void render(const glm::mat4x4 &view_projection, const glm::vec3 &eye, FrameRing *ring = nullptr);
+
+            inline std::size_t size() const { return m_items.size(); }
+            inline const Mesh& mesh(std::size_t i) const { return *m_meshes[m_items[i].index]; }
+
+            // How many times the last render() bound a program or a
+            // vertex array, and how many draw calls it made.
+            inline unsigned int programBinds() const { return m_program_binds; }
+            inline unsigned int vertexArrayBinds() const { return m_vertex_array_binds; }
+            inline unsigned int drawCalls() const { return m_draw_calls; }
+
+            // How many batches the last render() drew, and whether
+            // they were drawn with glMultiDrawElementsIndirect.
+            inline unsigned int batches() const { return m_batches; }
+            static bool indirectBatches();
+
+        private:
+            struct Item {
+                std::uint64_t key;
+                std::uint32_t index;
+            };
+
+            void uploadInstances();
+            bool writeModelBlocks(FrameRing &ring);
+            bool writeDrawData();
+            void drawBatch(std::size_t first, std::size_t last, const glm::mat4x4 &view_projection, const glm::vec3 &eye);
+            void submitIndirect(const Mesh &mesh);
+            void submitMultiDraws(const Mesh &mesh);
+            void bindInstances(std::size_t first) const;
+            void unbindInstances() const;
+
+            std::vector<Item> m_items;
+            std::vector<Mesh::sptr_type> m_meshes;
+            std::size_t m_instanced_count, m_model_block_count, m_batched_count;
+
+            // Where each item's model block is in the ring, indexed
+            // like m_items.
+            std::vector<GLintptr> m_model_offsets;
+
+            // Indexed the same as m_items, after sorting.
+            std::vector<InstanceData> m_instances;
+            GLuint m_instance_buffer;
+
+            // The batched meshes' transformations, their slots in it
+            // (indexed like m_items), and where this frame's start,
+            // in texels.
+            FrameRing::uptr_type m_draw_ring;
+            GLuint m_draw_texture, m_draw_texture_buffer;
+            std::vector<GLuint> m_draw_slots;
+            GLint m_draw_base;
+
+            // The current batch, and the buffers for drawing it
+            // indirectly.
+            std::vector<DrawElementsCommand> m_commands;
+            GLuint m_indirect_buffer, m_draw_id_buffer;
+            std::size_t m_draw_id_capacity;
+
+            unsigned int m_program_binds, m_vertex_array_binds, m_draw_calls, m_batches;
+        };
+    }
+}
+
+#endif
@@ -3,43 +3,59 @@
 #include "../graphplay.h"
 #include "Scene.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#include "Shader.h"
+#include "Frustum.h"
 
 namespace graphplay {
     namespace gfx {
-        Scene::Scene(unsigned int vp_width, unsigned int vp_height)
+        const GLuint Scene::VIEW_AND_PROJECTION_BINDING;
+        const GLuint Scene::LIGHT_CLUSTERS_BINDING;
+
+        Scene::Scene(unsigned int vp_width, unsigned int vp_height, RenderPath path)
             : m_vp_width(vp_width),
               m_vp_height(vp_height),
+              m_render_path(path),
               m_camera(),
               m_projection(),
               m_lights(),
               m_meshes(),
               m_view_projection_uniform_buffer(0),
-              m_light_uniform_buffer(0),
-              m_uniform_buffer_bindings()
+              m_cluster_uniform_buffer(0),
+              m_view_projection_block(),
+              m_cluster_block(),
+              m_view_dirty(true),
+              m_projection_dirty(true),
+              m_lights_dirty_first(0),
+              m_lights_dirty_last(0),
+              m_clusters_dirty(true),
+              m_light_clusters(),
+              m_uploaded_bytes(0),
+              m_frame_ring(),
+              m_gbuffer(),
+              m_drawn_count(0),
+              m_culled_count(0),
+              m_render_queue()
         {
             setViewport(vp_width, vp_height);
 
-            m_uniform_buffer_bindings["view_and_projection"] = 0;
-            m_uniform_buffer_bindings["light_list"] = 1;
-
-            for (auto i = 0; i < MAX_LIGHTS; ++i) {
-                m_lights[i].enabled = false;
-            }
-
-            m_lights[0].enabled = true;
-            m_lights[0].position = glm::vec3(0.0, 10.0, 10.0);
-            m_lights[0].color = glm::vec4(1.0, 1.0, 1.0, 1.0);
-            m_lights[0].specular_exp = 4;
-
-            // m_lights[1].enabled = true;
-            // m_lights[1].position = glm::vec3(10.0, 10.0, 0.0);
-            // m_lights[1].color = glm::vec4(1.0, 0.0, 0.0, 1.0);
-            // m_lights[1].specular_exp = 4;
+            Light light;
+            light.enabled = true;
+            light.position = glm::vec3(0.0, 10.0, 10.0);
+            light.color = glm::vec4(1.0, 1.0, 1.0, 1.0);
+            light.specular_exp = 4;
+            light.radius = 0.0f;
+            setLight(0, light);
+
+            // light.position = glm::vec3(10.0, 10.0, 0.0);
+            // light.color = glm::vec4(1.0, 0.0, 0.0, 1.0);
+            // setLight(1, light);
         }
 
         Scene::~Scene() {
@@ -54,6 +70,48 @@ namespace graphplay {
                 20,
                 (float)m_vp_width / (float)m_vp_height,
                 0.1f, 100);
+            m_view_projection_block.projection = m_projection;
+            m_view_projection_block.viewport = glm::vec2((float)m_vp_width, (float)m_vp_height);
+            m_light_clusters.setProjection(m_projection);
+            m_cluster_block = m_light_clusters.block(m_vp_width, m_vp_height);
+            m_cluster_block.deferred = m_render_path == DEFERRED;
+            m_projection_dirty = true;
+
+            if (m_gbuffer) {
+                m_gbuffer->resize(m_vp_width, m_vp_height);
+                checkGBuffer();
+            }
+        }
+
+        void Scene::checkGBuffer() {
+            if (!m_gbuffer || m_gbuffer->complete()) {
+                return;
+            }
+
+            // Nothing can be drawn into it, so light everything as
+            // it's drawn instead.
+            std::cerr << "Deferred shading isn't available; falling back to forward" << std::endl;
+            m_gbuffer.reset();
+            m_render_path = FORWARD;
+            m_cluster_block.deferred = 0;
+            m_projection_dirty = true;
+        }
+
+        void Scene::setLight(std::size_t i, const Light &light) {
+            if (i >= m_lights.size()) {
+                Light off = light;
+                off.enabled = false;
+                m_lights.resize(i + 1, off);
+            }
+            m_lights[i] = light;
+
+            if (m_lights_dirty_first >= m_lights_dirty_last) {
+                m_lights_dirty_first = i;
+                m_lights_dirty_last = i + 1;
+            } else {
+                m_lights_dirty_first = std::min(m_lights_dirty_first, i);
+                m_lights_dirty_last = std::max(m_lights_dirty_last, i + 1);
+            }
         }
 
         void Scene::addMesh(Mesh::wptr_type mesh) {
@@ -63,18 +121,24 @@ namespace graphplay {
             if (smesh) {
                 Program::sptr_type sprogram = smesh->program().lock();
                 if (sprogram) {
-                    GLuint progid = sprogram->getProgramId();
-                    const IndexMap &program_blocks = sprogram->getUniformBlocks();
-                    for (auto buffer_binding : m_uniform_buffer_bindings) {
-                        auto block_elem = program_blocks.find(buffer_binding.first);
-                        if (block_elem != program_blocks.end()) {
-                            glUniformBlockBinding(progid, block_elem->second, buffer_binding.second);
-                        }
-                    }
+                    bindBlocks(*sprogram);
                 }
             }
         }
 
+        void Scene::bindBlocks(const Program &program) {
+            GLuint progid = program.getProgramId();
+            const IndexMap &program_blocks = program.getUniformBlocks();
+            auto block_elem = program_blocks.find("view_and_projection");
+            if (block_elem != program_blocks.end()) {
+                glUniformBlockBinding(progid, block_elem->second, VIEW_AND_PROJECTION_BINDING);
+            }
+            block_elem = program_blocks.find("light_clusters");
+            if (block_elem != program_blocks.end()) {
+                glUniformBlockBinding(progid, block_elem->second, LIGHT_CLUSTERS_BINDING);
+            }
+        }
+
         Mesh::wptr_type Scene::removeMesh(Mesh::wptr_type mesh) {
             Mesh::wptr_type rv;
 
@@ -95,100 +159,101 @@ namespace graphplay {
             deleteBuffers();
             glGenBuffers(2, bufids);
 
-            const ViewAndProjectionBlock &vp_block = ViewAndProjectionBlock::getDescriptor();
-            const LightListBlock &light_block = LightListBlock::getDescriptor();
-
+            // The new buffers start out with whatever's staged, so
+            // there's nothing left to upload.
             m_view_projection_uniform_buffer = bufids[0];
             glBindBuffer(GL_UNIFORM_BUFFER, m_view_projection_uniform_buffer);
-            glBufferData(GL_UNIFORM_BUFFER, vp_block.getDataSize(), nullptr, GL_DYNAMIC_DRAW);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(ViewAndProjectionBlock), &m_view_projection_block, GL_DYNAMIC_DRAW);
 
-            m_light_uniform_buffer = bufids[1];
-            glBindBuffer(GL_UNIFORM_BUFFER, m_light_uniform_buffer);
-            glBufferData(GL_UNIFORM_BUFFER, light_block.getDataSize(), nullptr, GL_DYNAMIC_DRAW);
+            m_cluster_uniform_buffer = bufids[1];
+            glBindBuffer(GL_UNIFORM_BUFFER, m_cluster_uniform_buffer);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(LightClusterBlock), &m_cluster_block, GL_DYNAMIC_DRAW);
 
             glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            m_view_dirty = m_projection_dirty = false;
+
+            // The lights go up now too, but the clusters depend on
+            // the view, so they wait for updateBuffers.
+            m_light_clusters.createBuffers();
+            m_light_clusters.updateLights(m_lights, 0, m_lights.size());
+            m_lights_dirty_first = m_lights_dirty_last = 0;
+            m_clusters_dirty = true;
+
+            // Room for a few hundred meshes to start with; it grows
+            // if there are more.
+            m_frame_ring.reset(new FrameRing(GL_UNIFORM_BUFFER, 256*sizeof(ModelTransformationBlock)));
+
+            if (m_render_path == DEFERRED) {
+                m_gbuffer.reset(new GBuffer(m_vp_width, m_vp_height));
+                bindBlocks(m_gbuffer->lightingProgram());
+                checkGBuffer();
+            }
         }
 
         void Scene::updateBuffers() {
-            const ViewAndProjectionBlock &vp_block = ViewAndProjectionBlock::getDescriptor();
-            const LightListBlock &light_block = LightListBlock::getDescriptor();
-            GLubyte *buffer = nullptr;
+            m_uploaded_bytes = 0;
 
+            // The camera doesn't say when it moves, so just compare.
             glm::mat4x4 view = m_camera.viewTransformation();
-            glm::mat4x4 view_inv = glm::inverse(view);
+            if (view != m_view_projection_block.view) {
+                m_view_projection_block.view = view;
+                m_view_projection_block.view_inv = glm::inverse(view);
+                m_view_dirty = true;
+            }
 
-            glBindBuffer(GL_UNIFORM_BUFFER, m_view_projection_uniform_buffer);
-            buffer = (GLubyte*)glMapBuffer(GL_UNIFORM_BUFFER, GL_READ_WRITE);
-            for (auto off_ptr : vp_block.getOffsets()) {
-                switch (off_ptr.first) {
-                case ViewAndProjectionBlock::field_name::VIEW:
-                    // glBufferSubData(GL_UNIFORM_BUFFER, off_ptr.second, sizeof(view), glm::value_ptr(view));
-                    *(glm::mat4x4*)(buffer + off_ptr.second) = view;
-                    break;
-                case ViewAndProjectionBlock::field_name::VIEW_INV:
-                    // glBufferSubData(GL_UNIFORM_BUFFER, off_ptr.second, sizeof(view_inv), glm::value_ptr(view_inv));
-                    *(glm::mat4x4*)(buffer + off_ptr.second) = view_inv;
-                    break;
-                case ViewAndProjectionBlock::field_name::PROJECTION:
-                    // glBufferSubData(GL_UNIFORM_BUFFER, off_ptr.second, sizeof(m_projection), glm::value_ptr(m_projection));
-                    *(glm::mat4x4*)(buffer + off_ptr.second) = m_projection;
-                    break;
-                }
+            const bool lights_dirty = m_lights_dirty_first < m_lights_dirty_last;
+            m_clusters_dirty = m_clusters_dirty || m_view_dirty || m_projection_dirty || lights_dirty;
+
+            if (m_projection_dirty) {
+                glBindBuffer(GL_UNIFORM_BUFFER, m_cluster_uniform_buffer);
+                glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightClusterBlock), &m_cluster_block);
+                m_uploaded_bytes += sizeof(LightClusterBlock);
             }
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
-
-            glBindBuffer(GL_UNIFORM_BUFFER, m_light_uniform_buffer);
-            buffer = (GLubyte*)glMapBuffer(GL_UNIFORM_BUFFER, GL_READ_WRITE);
-            for (auto i = 0; i < MAX_LIGHTS; ++i) {
-                GLuint enabled = m_lights[i].enabled ? GL_TRUE : GL_FALSE;
-
-                if (m_lights[i].enabled) {
-                    for (auto off_ptr : light_block.getOffsets()[i]) {
-                        switch (off_ptr.first) {
-                        case LightListBlock::field_name::ENABLED:
-                            // glBufferSubData(GL_UNIFORM_BUFFER, off_ptr.second, sizeof(GLuint), &enabled);
-                            *(GLuint*)(buffer + off_ptr.second) = enabled;
-                            break;
-                        case LightListBlock::field_name::POSITION:
-                            // glBufferSubData(GL_UNIFORM_BUFFER, off_ptr.second, sizeof(m_lights[i].position), glm::value_ptr(m_lights[i].position));
-                            *(glm::vec3*)(buffer + off_ptr.second) = m_lights[i].position;
-                            break;
-                        case LightListBlock::field_name::COLOR:
-                            // glBufferSubData(GL_UNIFORM_BUFFER, off_ptr.second, sizeof(m_lights[i].color), glm::value_ptr(m_lights[i].color));
-                            *(glm::vec4*)(buffer + off_ptr.second) = m_lights[i].color;
-                            break;
-                        case LightListBlock::field_name::SPECULAR_EXP:
-                            // glBufferSubData(GL_UNIFORM_BUFFER, off_ptr.second, sizeof(m_lights[i].specular_exp), &m_lights[i].specular_exp);
-                            *(GLint*)(buffer + off_ptr.second) = m_lights[i].specular_exp;
-                            break;
-                        }
-                    }
-                } else {
-                    auto off_ptr = light_block.getOffsets()[i].find(LightListBlock::field_name::ENABLED);
-                    // glBufferSubData(GL_UNIFORM_BUFFER, off_ptr->second, sizeof(GLuint), &enabled);
-                    *(GLuint*)(buffer + off_ptr->second) = enabled;
+
+            if (m_view_dirty || m_projection_dirty) {
+                glBindBuffer(GL_UNIFORM_BUFFER, m_view_projection_uniform_buffer);
+                if (m_view_dirty) {
+                    // view and view_inv are next to each other.
+                    std::size_t size = offsetof(ViewAndProjectionBlock, projection);
+                    glBufferSubData(GL_UNIFORM_BUFFER, 0, size, &m_view_projection_block.view);
+                    m_uploaded_bytes += size;
                 }
+                if (m_projection_dirty) {
+                    // And so are projection and viewport.
+                    std::size_t size = offsetof(ViewAndProjectionBlock, viewport) + sizeof(glm::vec2)
+                        - offsetof(ViewAndProjectionBlock, projection);
+                    glBufferSubData(GL_UNIFORM_BUFFER, offsetof(ViewAndProjectionBlock, projection),
+                                    size, &m_view_projection_block.projection);
+                    m_uploaded_bytes += size;
+                }
+                m_view_dirty = m_projection_dirty = false;
             }
-            glUnmapBuffer(GL_UNIFORM_BUFFER);
 
             glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+            if (lights_dirty) {
+                m_uploaded_bytes += m_light_clusters.updateLights(m_lights, m_lights_dirty_first, m_lights_dirty_last);
+                m_lights_dirty_first = m_lights_dirty_last = 0;
+            }
+
+            if (m_clusters_dirty) {
+                m_light_clusters.assign(m_lights, m_view_projection_block.view);
+                m_uploaded_bytes += m_light_clusters.updateClusters();
+                m_clusters_dirty = false;
+            }
         }
 
         void Scene::bindBuffers() {
-            glBindBufferBase(
-                GL_UNIFORM_BUFFER,
-                m_uniform_buffer_bindings["view_and_projection"],
-                m_view_projection_uniform_buffer);
-
-            glBindBufferBase(
-                GL_UNIFORM_BUFFER,
-                m_uniform_buffer_bindings["light_list"],
-                m_light_uniform_buffer);
+            glBindBufferBase(GL_UNIFORM_BUFFER, VIEW_AND_PROJECTION_BINDING, m_view_projection_uniform_buffer);
+            glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT_CLUSTERS_BINDING, m_cluster_uniform_buffer);
+            m_light_clusters.bindTextures();
         }
 
         void Scene::unbindBuffers() {
-            glBindBufferBase(GL_UNIFORM_BUFFER, m_uniform_buffer_bindings["view_and_projection"], 0);
-            glBindBufferBase(GL_UNIFORM_BUFFER, m_uniform_buffer_bindings["light_list"], 0);
+            glBindBufferBase(GL_UNIFORM_BUFFER, VIEW_AND_PROJECTION_BINDING, 0);
+            glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT_CLUSTERS_BINDING, 0);
+            glBindBufferBase(GL_UNIFORM_BUFFER, ModelTransformationBlock::BINDING, 0);
+            m_light_clusters.unbindTextures();
         }
 
         void Scene::deleteBuffers() {
@@ -196,24 +261,53 @@ namespace graphplay {
                 glDeleteBuffers(1, &m_view_projection_uniform_buffer);
             }
 
-            if (glIsBuffer(m_light_uniform_buffer)) {
-                glDeleteBuffers(1, &m_light_uniform_buffer);
+            if (glIsBuffer(m_cluster_uniform_buffer)) {
+                glDeleteBuffers(1, &m_cluster_uniform_buffer);
             }
 
             m_view_projection_uniform_buffer = 0;
-            m_light_uniform_buffer = 0;
+            m_cluster_uniform_buffer = 0;
+            m_frame_ring.reset();
+            m_gbuffer.reset();
+            m_light_clusters.deleteBuffers();
         }
 
         void Scene::render() {
             updateBuffers();
             bindBuffers();
 
+            glm::mat4x4 view = m_camera.viewTransformation();
+            glm::mat4x4 view_projection = m_projection * view;
+            glm::vec3 eye = m_camera.position();
+            Frustum frustum(view_projection);
+
+            m_drawn_count = 0;
+            m_culled_count = 0;
+            m_render_queue.clear();
             for (auto wm : m_meshes) {
                 if (auto sm = wm.lock()) {
-                    sm->render();
+                    if (!sm->inFrustum(frustum)) {
+                        ++m_culled_count;
+                        continue;
+                    }
+
+                    // The camera looks down -z.
+                    float depth = -(view * glm::vec4(sm->center(), 1.0f)).z;
+                    m_render_queue.add(sm, depth);
                 }
             }
 
+            m_render_queue.sort();
+            const bool deferred = m_gbuffer && m_gbuffer->bindForGeometry();
+            m_drawn_count = (unsigned int)m_render_queue.size();
+            m_render_queue.render(view_projection, eye, m_frame_ring.get());
+
+            if (deferred) {
+                // Only bother with the clustered pass if there's
+                // something in the clusters.
+                m_gbuffer->light(m_light_clusters.indexCount() > m_light_clusters.lightCount(LightClusters::EVERYWHERE));
+            }
+
             unbindBuffers();
         }
     }
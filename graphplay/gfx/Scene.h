@@ -13,24 +13,15 @@
 #include "../opengl.h"
 
 #include "Camera.h"
+#include "FrameRing.h"
+#include "GBuffer.h"
+#include "LightClusters.h"
 #include "Mesh.h"
+#include "RenderQueue.h"
+#include "Shader.h"
 
 namespace graphplay {
     namespace gfx {
-#ifdef MSVC
-        const
-#else
-        constexpr
-#endif
-        int MAX_LIGHTS = 10;
-
-        struct Light {
-            bool enabled;
-            glm::vec3 position;
-            glm::vec4 color;
-            int specular_exp;
-        };
-
         class Scene
         {
         public:
@@ -39,7 +30,18 @@ namespace graphplay {
             typedef std::weak_ptr<Scene> wptr_type;
             typedef std::vector<Mesh::wptr_type> mesh_list_type;
 
-            Scene(unsigned int vp_width, unsigned int vp_height);
+            // The uniform buffer binding points for the scene's
+            // blocks.
+            static const GLuint VIEW_AND_PROJECTION_BINDING = 0;
+            static const GLuint LIGHT_CLUSTERS_BINDING = 1;
+
+            // How the scene gets lit. FORWARD lights each fragment as
+            // it's drawn; DEFERRED draws everything into a GBuffer
+            // first and lights each pixel once, which is cheaper when
+            // there's a lot of overdraw.
+            enum RenderPath { FORWARD, DEFERRED };
+
+            Scene(unsigned int vp_width, unsigned int vp_height, RenderPath path = FORWARD);
             Scene(const Scene &other);
             Scene(Scene &&other);
             ~Scene();
@@ -52,6 +54,13 @@ namespace graphplay {
             inline unsigned int getViewportWidth() const { return m_vp_width; }
             inline unsigned int getViewportHeight() const { return m_vp_height; }
 
+            inline RenderPath getRenderPath() const { return m_render_path; }
+
+            // The deferred path's GBuffer. Made by createBuffers;
+            // nullptr for the forward path, which is what the scene
+            // falls back to if the GBuffer is incomplete.
+            inline const GBuffer* getGBuffer() const { return m_gbuffer.get(); }
+
             // Manage the list of meshes.
             void addMesh(Mesh::wptr_type mesh);
             Mesh::wptr_type removeMesh(Mesh::wptr_type mesh);
@@ -59,28 +68,75 @@ namespace graphplay {
             // Manipulate the camera.
             inline Camera &getCamera() { return m_camera; }
 
-            // Manage the uniform buffers.
+            // Manipulate the lights. There can be as many as you
+            // like; setting one past the end adds it, with disabled
+            // ones in between if need be.
+            inline std::size_t getLightCount() const { return m_lights.size(); }
+            inline const Light& getLight(std::size_t i) const { return m_lights[i]; }
+            void setLight(std::size_t i, const Light &light);
+
+            // Which lights reach which parts of the view, as of the
+            // last updateBuffers.
+            inline const LightClusters& getLightClusters() const { return m_light_clusters; }
+
+            // Manage the uniform buffers. The blocks are kept on the
+            // CPU, and updateBuffers only copies up the parts of them
+            // that changed since the last time. It sorts the lights
+            // into clusters again if they or the camera moved.
             void createBuffers();
             void updateBuffers();
+            inline std::size_t getUploadedBytes() const { return m_uploaded_bytes; }
+
+            // Where the meshes' model transformations go each frame.
+            // Made by createBuffers.
+            inline const FrameRing* getFrameRing() const { return m_frame_ring.get(); }
             void bindBuffers();
             void unbindBuffers();
             void deleteBuffers();
 
-            // Draw the scene.
+            // Draw the scene. Meshes that are entirely outside the
+            // view frustum are skipped, and the rest go through a
+            // RenderQueue.
             void render();
 
+            // How many meshes the last render() drew and skipped.
+            inline unsigned int getDrawnCount() const { return m_drawn_count; }
+            inline unsigned int getCulledCount() const { return m_culled_count; }
+            inline const RenderQueue& getRenderQueue() const { return m_render_queue; }
+
         private:
+            // Point program's blocks at the scene's binding points.
+            void bindBlocks(const Program &program);
+            // Go back to the forward path if the GBuffer can't be
+            // drawn into.
+            void checkGBuffer();
+
             unsigned int m_vp_width, m_vp_height;
+            RenderPath m_render_path;
 
             Camera m_camera;
             glm::mat4x4 m_projection;
-            Light m_lights[MAX_LIGHTS];
+            std::vector<Light> m_lights;
 
             mesh_list_type m_meshes;
 
             GLuint m_view_projection_uniform_buffer;
-            GLuint m_light_uniform_buffer;
-            IndexMap m_uniform_buffer_bindings;
+            GLuint m_cluster_uniform_buffer;
+
+            ViewAndProjectionBlock m_view_projection_block;
+            LightClusterBlock m_cluster_block;
+            bool m_view_dirty, m_projection_dirty;
+            // The lights from first up to last changed.
+            std::size_t m_lights_dirty_first, m_lights_dirty_last;
+            bool m_clusters_dirty;
+            LightClusters m_light_clusters;
+            // How much the last updateBuffers copied.
+            std::size_t m_uploaded_bytes;
+            FrameRing::uptr_type m_frame_ring;
+            GBuffer::uptr_type m_gbuffer;
+
+            unsigned int m_drawn_count, m_culled_count;
+            RenderQueue m_render_queue;
         };
     }
 }
@@ -3,12 +3,29 @@
 #include "../graphplay.h"
 #include "Shader.h"
 
+#include <cstring>
 #include <iostream>
-#include <regex>
 #include <string>
+#include <utility>
 
 namespace graphplay {
     namespace gfx {
+        const GLuint ModelTransformationBlock::BINDING;
+        const GLuint Program::DRAW_DATA_TEXTURE_UNIT;
+        const GLuint Program::LIGHT_DATA_TEXTURE_UNIT;
+        const GLuint Program::LIGHT_GRID_TEXTURE_UNIT;
+        const GLuint Program::LIGHT_INDEX_TEXTURE_UNIT;
+        const GLuint Program::GBUFFER_COLOR_TEXTURE_UNIT;
+        const GLuint Program::GBUFFER_NORMAL_TEXTURE_UNIT;
+        const GLuint Program::GBUFFER_POSITION_TEXTURE_UNIT;
+
+        // The lit fragment shaders and the deferred lighting one
+        // start with the same lighting code.
+        static Shader::sptr_type createLightingShader(const char *source) {
+            std::string full = std::string(Shader::lighting_shader_source) + source;
+            return std::make_shared<Shader>(GL_FRAGMENT_SHADER, full.c_str());
+        }
+
         // Global functions.
         Program::sptr_type createUnlitProgram() {
             Shader::sptr_type vertex = std::make_shared<Shader>(GL_VERTEX_SHADER, Shader::unlit_vertex_shader_source);
@@ -18,155 +35,46 @@ namespace graphplay {
 
         Program::sptr_type createLitProgram() {
             Shader::sptr_type vertex = std::make_shared<Shader>(GL_VERTEX_SHADER, Shader::lit_vertex_shader_source);
-            Shader::sptr_type fragment = std::make_shared<Shader>(GL_FRAGMENT_SHADER, Shader::lit_fragment_shader_source);
+            Shader::sptr_type fragment = createLightingShader(Shader::lit_fragment_shader_source);
             return std::make_shared<Program>(vertex, fragment);
         }
 
-        // ViewAndProjectionBlock class.
-        ViewAndProjectionBlock::ViewAndProjectionBlock()
-            : m_offsets(),
-              m_data_size(0)
-        {
-            Shader::sptr_type vert = std::make_shared<Shader>(GL_VERTEX_SHADER, Shader::lit_vertex_shader_source);
-            Shader::sptr_type frag = std::make_shared<Shader>(GL_FRAGMENT_SHADER, Shader::lit_fragment_shader_source);
-            Program::sptr_type prog = std::make_shared<Program>(vert, frag);
-
-            GLuint progid = prog->getProgramId();
-            GLuint vp_block_index = glGetUniformBlockIndex(progid, "view_and_projection");
-            GLint vp_data_size = -1, num_uniforms = -1, *uniform_indices_int = nullptr, *uniform_offsets = nullptr, max_name_len = -1;
-            GLuint *uniform_indices = nullptr;
-            char *name = nullptr;
-
-            glGetProgramiv(progid, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_len);
-            name = new char[max_name_len];
-
-            glGetActiveUniformBlockiv(progid, vp_block_index, GL_UNIFORM_BLOCK_DATA_SIZE, &vp_data_size);
-            m_data_size = vp_data_size;
-
-            glGetActiveUniformBlockiv(progid, vp_block_index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &num_uniforms);
-            uniform_indices_int = new GLint[num_uniforms];
-            uniform_offsets = new GLint[num_uniforms];
-            uniform_indices = new GLuint[num_uniforms];
-
-            // Oy. Why do I have to get the list of indices as a GLint but pass it as a GLuint?
-            glGetActiveUniformBlockiv(progid, vp_block_index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, uniform_indices_int);
-            for (auto i = 0; i < num_uniforms; ++i) { uniform_indices[i] = uniform_indices_int[i]; }
-            glGetActiveUniformsiv(progid, num_uniforms, uniform_indices, GL_UNIFORM_OFFSET, uniform_offsets);
-
-            for (auto i = 0; i < num_uniforms; ++i) {
-                glGetActiveUniformName(progid, uniform_indices[i], max_name_len, nullptr, name);
-                std::string name_str(name);
-
-                if (name_str == "view") {
-                    m_offsets[field_name::VIEW] = uniform_offsets[i];
-                } else if (name_str == "view_inv") {
-                    m_offsets[field_name::VIEW_INV] = uniform_offsets[i];
-                } else if (name_str == "projection") {
-                    m_offsets[field_name::PROJECTION] = uniform_offsets[i];
-                }
-            }
-
-            delete [] name;
-            delete [] uniform_indices_int;
-            delete [] uniform_indices;
-            delete [] uniform_offsets;
-        }
-
-        const ViewAndProjectionBlock& ViewAndProjectionBlock::getDescriptor() {
-            static std::unique_ptr<ViewAndProjectionBlock> instance_ptr;
-
-            // We don't want to do this at static initialization time,
-            // because the OpenGL context probably won't be created yet.
-            if (!instance_ptr) {
-                instance_ptr.reset(new ViewAndProjectionBlock());
-            }
-
-            return *instance_ptr;
-        }
-
-        const ViewAndProjectionBlock::offset_map_type& ViewAndProjectionBlock::getOffsets() const {
-            return m_offsets;
+        Program::sptr_type createUnlitInstancedProgram() {
+            Shader::sptr_type vertex = std::make_shared<Shader>(GL_VERTEX_SHADER, Shader::unlit_instanced_vertex_shader_source);
+            Shader::sptr_type fragment = std::make_shared<Shader>(GL_FRAGMENT_SHADER, Shader::unlit_fragment_shader_source);
+            return std::make_shared<Program>(vertex, fragment);
         }
 
-        long ViewAndProjectionBlock::getDataSize() const {
-            return m_data_size;
+        Program::sptr_type createLitInstancedProgram() {
+            Shader::sptr_type vertex = std::make_shared<Shader>(GL_VERTEX_SHADER, Shader::lit_instanced_vertex_shader_source);
+            Shader::sptr_type fragment = createLightingShader(Shader::lit_fragment_shader_source);
+            return std::make_shared<Program>(vertex, fragment);
         }
 
-        // LightListBlock class.
-        LightListBlock::LightListBlock()
-            : m_offsets(MAX_LIGHTS),
-              m_data_size(0)
-        {
-            Shader::sptr_type vert = std::make_shared<Shader>(GL_VERTEX_SHADER, Shader::lit_vertex_shader_source);
-            Shader::sptr_type frag = std::make_shared<Shader>(GL_FRAGMENT_SHADER, Shader::lit_fragment_shader_source);
-            Program::sptr_type prog = std::make_shared<Program>(vert, frag);
-
-            GLuint progid = prog->getProgramId();
-            GLuint light_block_index = glGetUniformBlockIndex(progid, "light_list");
-            GLint light_data_size = -1, num_uniforms = -1, *uniform_indices_int = nullptr, *uniform_offsets = nullptr, max_name_len = -1;
-            GLuint *uniform_indices = nullptr;
-            char *name = nullptr;
-            std::regex light_field_name("^lights\\[(\\d+)\\]\\.(\\w+)$");
-            std::cmatch light_field_parts;
-
-            glGetProgramiv(progid, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_len);
-            name = new char[max_name_len];
-
-            glGetActiveUniformBlockiv(progid, light_block_index, GL_UNIFORM_BLOCK_DATA_SIZE, &light_data_size);
-            m_data_size = light_data_size;
-
-            glGetActiveUniformBlockiv(progid, light_block_index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &num_uniforms);
-            uniform_indices_int = new GLint[num_uniforms];
-            uniform_offsets = new GLint[num_uniforms];
-            uniform_indices = new GLuint[num_uniforms];
-
-            // Oy. Why do I have to get the list of indices as a GLint but pass it as a GLuint?
-            glGetActiveUniformBlockiv(progid, light_block_index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, uniform_indices_int);
-            for (auto i = 0; i < num_uniforms; ++i) { uniform_indices[i] = uniform_indices_int[i]; }
-            glGetActiveUniformsiv(progid, num_uniforms, uniform_indices, GL_UNIFORM_OFFSET, uniform_offsets);
-
-            for (auto i = 0; i < num_uniforms; ++i) {
-                glGetActiveUniformName(progid, uniform_indices[i], max_name_len, nullptr, name);
-                if (std::regex_search(name, light_field_parts, light_field_name)) {
-                    int light_index = std::stoi(light_field_parts[1]);
-                    std::string field_str(light_field_parts[2]);
-
-                    if (field_str == "enabled") {
-                        m_offsets[light_index][field_name::ENABLED] = uniform_offsets[i];
-                    } else if (field_str == "position") {
-                        m_offsets[light_index][field_name::POSITION] = uniform_offsets[i];
-                    } else if (field_str == "color") {
-                        m_offsets[light_index][field_name::COLOR] = uniform_offsets[i];
-                    } else if (field_str == "specular_exp") {
-                        m_offsets[light_index][field_name::SPECULAR_EXP] = uniform_offsets[i];
-                    }
-                }
-            }
-
-            delete [] name;
-            delete [] uniform_indices_int;
-            delete [] uniform_indices;
-            delete [] uniform_offsets;
+        Program::sptr_type createUnlitBatchedProgram() {
+            Shader::sptr_type vertex = std::make_shared<Shader>(GL_VERTEX_SHADER, Shader::unlit_batched_vertex_shader_source);
+            Shader::sptr_type fragment = std::make_shared<Shader>(GL_FRAGMENT_SHADER, Shader::unlit_fragment_shader_source);
+            return std::make_shared<Program>(vertex, fragment);
         }
 
-        const LightListBlock& LightListBlock::getDescriptor() {
-            static std::unique_ptr<LightListBlock> instance_ptr;
-
-            // We don't want to do this at static initialization time,
-            // because the OpenGL context probably won't be created yet.
-            if (!instance_ptr) {
-                instance_ptr.reset(new LightListBlock());
-            }
-
-            return *instance_ptr;
+        Program::sptr_type createLitBatchedProgram() {
+            Shader::sptr_type vertex = std::make_shared<Shader>(GL_VERTEX_SHADER, Shader::lit_batched_vertex_shader_source);
+            Shader::sptr_type fragment = createLightingShader(Shader::lit_fragment_shader_source);
+            return std::make_shared<Program>(vertex, fragment);
         }
 
-        const std::vector<LightListBlock::offset_map_type>& LightListBlock::getOffsets() const {
-            return m_offsets;
+        Program::sptr_type createDeferredLightingProgram() {
+            Shader::sptr_type vertex = std::make_shared<Shader>(GL_VERTEX_SHADER, Shader::fullscreen_vertex_shader_source);
+            Shader::sptr_type fragment = createLightingShader(Shader::deferred_lighting_fragment_shader_source);
+            return std::make_shared<Program>(vertex, fragment);
         }
 
-        long LightListBlock::getDataSize() const {
-            return m_data_size;
+        Program::sptr_type createTessellatedSphereProgram() {
+            Shader::sptr_type vertex = std::make_shared<Shader>(GL_VERTEX_SHADER, Shader::sphere_vertex_shader_source);
+            Shader::sptr_type tess_control = std::make_shared<Shader>(GL_TESS_CONTROL_SHADER, Shader::sphere_tess_control_shader_source);
+            Shader::sptr_type tess_evaluation = std::make_shared<Shader>(GL_TESS_EVALUATION_SHADER, Shader::sphere_tess_evaluation_shader_source);
+            Shader::sptr_type fragment = createLightingShader(Shader::lit_fragment_shader_source);
+            return std::make_shared<Program>(vertex, tess_control, tess_evaluation, fragment);
         }
 
         // Shader class.
@@ -185,49 +93,100 @@ namespace graphplay {
             : m_program{0},
               m_vertex_shader{vertex_shader},
               m_fragment_shader{fragment_shader},
+              m_tess_control_shader(),
+              m_tess_evaluation_shader(),
               m_attributes(),
               m_uniforms(),
-              m_uniform_blocks()
+              m_uniform_blocks(),
+              m_standard_uniforms(),
+              m_model_block_index(GL_INVALID_INDEX),
+              m_model_buffer(0),
+              m_model_block(),
+              m_model_block_current(false),
+              m_instanced(false),
+              m_batched(false)
         {
-            m_program = createProgramFromShaders(
-                m_vertex_shader->getShaderId(),
-                m_fragment_shader->getShaderId());
-            getAttributeInfo(m_program, m_attributes);
-            getUniformInfo(m_program, m_uniforms);
-            getUniformBlockInfo(m_program, m_uniform_blocks);
+            link();
+        }
+
+        Program::Program(Shader::sptr_type vertex_shader,
+                         Shader::sptr_type tess_control_shader,
+                         Shader::sptr_type tess_evaluation_shader,
+                         Shader::sptr_type fragment_shader)
+            : m_program{0},
+              m_vertex_shader{vertex_shader},
+              m_fragment_shader{fragment_shader},
+              m_tess_control_shader{tess_control_shader},
+              m_tess_evaluation_shader{tess_evaluation_shader},
+              m_attributes(),
+              m_uniforms(),
+              m_uniform_blocks(),
+              m_standard_uniforms(),
+              m_model_block_index(GL_INVALID_INDEX),
+              m_model_buffer(0),
+              m_model_block(),
+              m_model_block_current(false),
+              m_instanced(false),
+              m_batched(false)
+        {
+            link();
         }
 
         Program::Program(const Program &other)
             : m_program{0},
               m_vertex_shader{other.m_vertex_shader},
               m_fragment_shader{other.m_fragment_shader},
+              m_tess_control_shader{other.m_tess_control_shader},
+              m_tess_evaluation_shader{other.m_tess_evaluation_shader},
               m_attributes(),
               m_uniforms(),
-              m_uniform_blocks()
+              m_uniform_blocks(),
+              m_standard_uniforms(),
+              m_model_block_index(GL_INVALID_INDEX),
+              m_model_buffer(0),
+              m_model_block(),
+              m_model_block_current(false),
+              m_instanced(false),
+              m_batched(false)
         {
-            m_program = createProgramFromShaders(
-                m_vertex_shader->getShaderId(),
-                m_fragment_shader->getShaderId());
-            getAttributeInfo(m_program, m_attributes);
-            getUniformInfo(m_program, m_uniforms);
-            getUniformBlockInfo(m_program, m_uniform_blocks);
+            link();
         }
 
         Program::Program(Program &&other)
             : m_program{other.m_program},
               m_vertex_shader{other.m_vertex_shader},
               m_fragment_shader{other.m_fragment_shader},
+              m_tess_control_shader{other.m_tess_control_shader},
+              m_tess_evaluation_shader{other.m_tess_evaluation_shader},
               m_attributes(),
               m_uniforms(),
-              m_uniform_blocks()
+              m_uniform_blocks(),
+              m_standard_uniforms(),
+              m_model_block_index(GL_INVALID_INDEX),
+              m_model_buffer(0),
+              m_model_block(),
+              m_model_block_current(false),
+              m_instanced(false),
+              m_batched(false)
         {
             other.m_program = 0;
+            m_instanced = other.m_instanced;
+            m_batched = other.m_batched;
             std::swap(m_attributes, other.m_attributes);
             std::swap(m_uniforms, other.m_uniforms);
             std::swap(m_uniform_blocks, other.m_uniform_blocks);
+            std::swap(m_standard_uniforms, other.m_standard_uniforms);
+            std::swap(m_model_block_index, other.m_model_block_index);
+            std::swap(m_model_buffer, other.m_model_buffer);
+            std::swap(m_model_block, other.m_model_block);
+            std::swap(m_model_block_current, other.m_model_block_current);
         }
 
         Program::~Program() {
+            if (glIsBuffer(m_model_buffer)) {
+                glDeleteBuffers(1, &m_model_buffer);
+            }
+
             if (glIsProgram(m_program)) {
                 std::vector<GLuint> shaders;
                 getAttachedShaders(m_program, shaders);
@@ -255,12 +214,84 @@ namespace graphplay {
             std::swap(m_program, other.m_program);
             std::swap(m_vertex_shader, other.m_vertex_shader);
             std::swap(m_fragment_shader, other.m_fragment_shader);
+            std::swap(m_tess_control_shader, other.m_tess_control_shader);
+            std::swap(m_tess_evaluation_shader, other.m_tess_evaluation_shader);
             std::swap(m_attributes, other.m_attributes);
             std::swap(m_uniforms, other.m_uniforms);
             std::swap(m_uniform_blocks, other.m_uniform_blocks);
+            std::swap(m_standard_uniforms, other.m_standard_uniforms);
+            std::swap(m_model_block_index, other.m_model_block_index);
+            std::swap(m_model_buffer, other.m_model_buffer);
+            std::swap(m_model_block, other.m_model_block);
+            std::swap(m_model_block_current, other.m_model_block_current);
+            std::swap(m_instanced, other.m_instanced);
+            std::swap(m_batched, other.m_batched);
             return *this;
         }
 
+        void Program::link() {
+            std::vector<GLuint> shaders = { m_vertex_shader->getShaderId() };
+            if (m_tess_control_shader) {
+                shaders.push_back(m_tess_control_shader->getShaderId());
+            }
+            if (m_tess_evaluation_shader) {
+                shaders.push_back(m_tess_evaluation_shader->getShaderId());
+            }
+            shaders.push_back(m_fragment_shader->getShaderId());
+
+            m_program = createProgramFromShaders(shaders);
+            getAttributeInfo(m_program, m_attributes);
+            getUniformInfo(m_program, m_uniforms);
+            getUniformBlockInfo(m_program, m_uniform_blocks);
+            m_standard_uniforms.model.resolve(m_uniforms, "model");
+            m_standard_uniforms.model_inv_trans_3.resolve(m_uniforms, "model_inv_trans_3");
+            m_standard_uniforms.draw_base.resolve(m_uniforms, "draw_base");
+            m_instanced = m_attributes.find("instance_model") != m_attributes.end();
+            m_batched = m_attributes.find("draw_id") != m_attributes.end();
+
+            const std::pair<const char*, GLuint> samplers[] = {
+                { "draw_data", DRAW_DATA_TEXTURE_UNIT },
+                { "light_data", LIGHT_DATA_TEXTURE_UNIT },
+                { "light_grid", LIGHT_GRID_TEXTURE_UNIT },
+                { "light_indices", LIGHT_INDEX_TEXTURE_UNIT },
+                { "g_color", GBUFFER_COLOR_TEXTURE_UNIT },
+                { "g_normal", GBUFFER_NORMAL_TEXTURE_UNIT },
+                { "g_position", GBUFFER_POSITION_TEXTURE_UNIT },
+            };
+            for (auto &&sampler : samplers) {
+                auto found = m_uniforms.find(sampler.first);
+                if (found != m_uniforms.end()) {
+                    glProgramUniform1i(m_program, found->second, sampler.second);
+                }
+            }
+
+            auto model_block = m_uniform_blocks.find("model_transformation");
+            if (model_block != m_uniform_blocks.end()) {
+                m_model_block_index = model_block->second;
+                glUniformBlockBinding(m_program, m_model_block_index, ModelTransformationBlock::BINDING);
+            }
+        }
+
+        void Program::setModelBlock(const ModelTransformationBlock &block) const {
+            if (m_model_buffer == 0) {
+                glGenBuffers(1, &m_model_buffer);
+                glBindBuffer(GL_UNIFORM_BUFFER, m_model_buffer);
+                glBufferData(GL_UNIFORM_BUFFER, sizeof(ModelTransformationBlock), nullptr, GL_DYNAMIC_DRAW);
+                glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            }
+
+            if (!m_model_block_current || std::memcmp(&block, &m_model_block, sizeof(block)) != 0) {
+                m_model_block = block;
+                m_model_block_current = true;
+                glBindBuffer(GL_UNIFORM_BUFFER, m_model_buffer);
+                glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+                glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            }
+
+            // Something else may be using the binding.
+            glBindBufferBase(GL_UNIFORM_BUFFER, ModelTransformationBlock::BINDING, m_model_buffer);
+        }
+
         // Actual shader code.
         const char *Shader::unlit_vertex_shader_source = R"glsl(
             #version 410 core
@@ -268,12 +299,15 @@ namespace graphplay {
             in vec3 position;
             in vec4 color;
 
-            uniform mat4x4 model;
-            uniform mat3x3 model_inv_trans_3;
-            layout (shared) uniform view_and_projection {
+            layout (std140) uniform model_transformation {
+                mat4x4 model;
+                mat3x3 model_inv_trans_3;
+            };
+            layout (std140) uniform view_and_projection {
                 mat4x4 view;
                 mat4x4 view_inv;
                 mat4x4 projection;
+                vec2 viewport;
             };
 
             out vec4 v_color;
@@ -289,44 +323,39 @@ namespace graphplay {
 
             in vec4 v_color;
 
-            out vec4 FragColor;
+            layout (location = 0) out vec4 FragColor;
+            // For a GBuffer, a w of -1 means the color shouldn't be
+            // lit. Otherwise it goes nowhere.
+            layout (location = 2) out vec4 g_position;
 
             void main(void) {
                 FragColor = v_color;
+                g_position = vec4(0.0, 0.0, 0.0, -1.0);
             }
         )glsl";
 
         const char *Shader::lit_vertex_shader_source = R"glsl(
             #version 410 core
 
-            const int MAX_LIGHTS = 10;
-            struct LightProperties {
-                bool enabled;
-                vec3 position;
-                vec4 color;
-                uint specular_exp;
-            };
-
             in vec3 position;
             in vec3 normal;
             in vec4 color;
 
-            uniform mat4x4 model;
-            uniform mat3x3 model_inv_trans_3;
-            layout (shared) uniform view_and_projection {
+            layout (std140) uniform model_transformation {
+                mat4x4 model;
+                mat3x3 model_inv_trans_3;
+            };
+            layout (std140) uniform view_and_projection {
                 mat4x4 view;
                 mat4x4 view_inv;
                 mat4x4 projection;
-            };
-            layout (shared) uniform light_list {
-                LightProperties lights[MAX_LIGHTS];
+                vec2 viewport;
             };
 
+            out vec3 v_position;
             out vec3 v_normal;
             out vec4 v_color;
             out vec3 v_eye_dir;
-            out vec3 v_light_dir[MAX_LIGHTS];
-            out vec3 v_light_reflect_dir[MAX_LIGHTS];
 
             void main(void) {
                 vec4 wld_vert_position4 = model * vec4(position, 1.0);
@@ -343,59 +372,448 @@ namespace graphplay {
                 v_color = color;
                 v_eye_dir = wld_vert_eye_dir;
                 v_normal = wld_vert_normal;
-                for (int i = 0; i < MAX_LIGHTS; ++i) {
-                    if (lights[i].enabled) {
-                        v_light_dir[i] = normalize(lights[i].position - wld_vert_position);
-                        v_light_reflect_dir[i] = normalize(reflect(-1 * v_light_dir[i], wld_vert_normal));
-                    }
-                }
+                v_position = wld_vert_position;
             }
         )glsl";
 
-        const char *Shader::lit_fragment_shader_source = R"glsl(
+        // What the lit fragment shaders and the deferred lighting
+        // pass have in common: the blocks and textures the lights are
+        // found through, and the lighting itself. Their own sources
+        // get appended to it.
+        const char *Shader::lighting_shader_source = R"glsl(
             #version 410 core
 
-            const int MAX_LIGHTS = 10;
-            struct LightProperties {
-                bool enabled;
-                vec3 position;
-                vec4 color;
-                uint specular_exp;
+            layout (std140) uniform view_and_projection {
+                mat4x4 view;
+                mat4x4 view_inv;
+                mat4x4 projection;
+                vec2 viewport;
             };
+            layout (std140) uniform light_clusters {
+                uvec3 cluster_size;
+                uint deferred;
+                vec4 cluster_scale;
+            };
+
+            // Three texels per light: position and radius, color, and
+            // specular exponent.
+            uniform samplerBuffer light_data;
+            // Where each cluster's lights are in light_indices, and
+            // how many there are.
+            uniform usamplerBuffer light_grid;
+            uniform usamplerBuffer light_indices;
+
+            // What a light adds to the color of a fragment at
+            // position.
+            vec3 shade(uint light, vec3 position, vec3 normal, vec3 eye_dir, vec3 color) {
+                int texel = 3 * int(light);
+                vec4 position_radius = texelFetch(light_data, texel);
+                vec3 light_color = texelFetch(light_data, texel + 1).rgb;
+                float specular_exp = texelFetch(light_data, texel + 2).r;
+
+                vec3 to_light = position_radius.xyz - position;
+                vec3 light_dir = normalize(to_light);
+
+                // Lights with a radius fade out to nothing at it.
+                float attenuation = 1.0;
+                if (position_radius.w > 0.0) {
+                    float falloff = clamp(1.0 - dot(to_light, to_light) / (position_radius.w * position_radius.w), 0.0, 1.0);
+                    attenuation = falloff * falloff;
+                }
+
+                vec3 color_combination = light_color * color;
+
+                vec3 ambient_color = 0.1 * color_combination;
+
+                float diffuse_coeff = 0.7 * max(0.0, dot(normal, light_dir));
+                vec3 diffuse_color = diffuse_coeff * color_combination;
+
+                vec3 specular_color = vec3(0.0, 0.0, 0.0);
+                if (dot(normal, light_dir) >= 0.0) {
+                    float spec_coeff = 0.7 * pow(max(0.0, dot(reflect(-light_dir, normal), eye_dir)), specular_exp);
+                    specular_color = spec_coeff * color_combination;
+                }
+
+                return attenuation * clamp(ambient_color + diffuse_color + specular_color, 0.0, 1.0);
+            }
 
+            // The offset and count of the lights in the cluster
+            // position is in, or of the ones that reach everywhere.
+            uvec2 clusterLights(vec3 position) {
+                float depth = -(view * vec4(position, 1.0)).z;
+                uvec3 cluster = uvec3(
+                    min(uvec2(gl_FragCoord.xy / cluster_scale.xy), cluster_size.xy - 1u),
+                    uint(clamp(log(max(depth, 1.0e-4)) * cluster_scale.z + cluster_scale.w, 0.0, float(cluster_size.z - 1u))));
+                return texelFetch(light_grid, int((cluster.z * cluster_size.y + cluster.y) * cluster_size.x + cluster.x)).rg;
+            }
+
+            uvec2 everywhereLights() {
+                return texelFetch(light_grid, int(cluster_size.x * cluster_size.y * cluster_size.z)).rg;
+            }
+
+            vec3 shadeAll(uvec2 lights, vec3 position, vec3 normal, vec3 eye_dir, vec3 color) {
+                vec3 rv = vec3(0.0, 0.0, 0.0);
+                for (uint i = 0u; i < lights.y; ++i) {
+                    uint light = texelFetch(light_indices, int(lights.x + i)).r;
+                    rv = clamp(rv + shade(light, position, normal, eye_dir, color), 0.0, 1.0);
+                }
+                return rv;
+            }
+        )glsl";
+
+        // Each fragment only looks at the lights that reach its
+        // cluster, and the ones that reach everywhere. See
+        // LightClusters. When the scene is deferred, it just fills in
+        // the GBuffer instead.
+        const char *Shader::lit_fragment_shader_source = R"glsl(
+            in vec3 v_position;
             in vec3 v_normal;
             in vec4 v_color;
             in vec3 v_eye_dir;
-            in vec3 v_light_dir[MAX_LIGHTS];
-            in vec3 v_light_reflect_dir[MAX_LIGHTS];
 
-            layout (shared) uniform light_list {
-                LightProperties lights[MAX_LIGHTS];
+            layout (location = 0) out vec4 frag_color;
+            layout (location = 1) out vec4 g_normal;
+            layout (location = 2) out vec4 g_position;
+
+            void main(void) {
+                if (deferred != 0u) {
+                    frag_color = v_color;
+                    g_normal = vec4(normalize(v_normal), 0.0);
+                    g_position = vec4(v_position, 1.0);
+                    return;
+                }
+
+                vec3 normal = normalize(v_normal);
+                vec3 eye_dir = normalize(v_eye_dir);
+                vec3 lit = shadeAll(everywhereLights(), v_position, normal, eye_dir, v_color.rgb)
+                    + shadeAll(clusterLights(v_position), v_position, normal, eye_dir, v_color.rgb);
+                frag_color = vec4(clamp(lit, 0.0, 1.0), 1.0);
+            }
+        )glsl";
+
+        // The instanced versions are the same, except that model and
+        // model_inv_trans_3 are per-instance attributes.
+        const char *Shader::unlit_instanced_vertex_shader_source = R"glsl(
+            #version 410 core
+
+            in vec3 position;
+            in vec4 color;
+            in mat4x4 instance_model;
+
+            layout (std140) uniform view_and_projection {
+                mat4x4 view;
+                mat4x4 view_inv;
+                mat4x4 projection;
+                vec2 viewport;
             };
 
-            out vec4 frag_color;
+            out vec4 v_color;
 
             void main(void) {
-                frag_color = vec4(0.0, 0.0, 0.0, 1.0);
+                gl_Position = projection * view * instance_model * vec4(position, 1.0);
+                v_color = color;
+            }
+        )glsl";
 
-                for (int i = 0; i < MAX_LIGHTS; ++i) {
-                    if (lights[i].enabled) {
-                        vec3 color_combination = lights[i].color.rgb * v_color.rgb;
+        const char *Shader::lit_instanced_vertex_shader_source = R"glsl(
+            #version 410 core
 
-                        vec3 ambient_color = 0.1 * color_combination;
+            in vec3 position;
+            in vec3 normal;
+            in vec4 color;
+            in mat4x4 instance_model;
+            in mat3x3 instance_normal;
 
-                        float diffuse_coeff = 0.7 * max(0.0, dot(v_normal, v_light_dir[i]));
-                        vec3 diffuse_color = diffuse_coeff * color_combination;
+            layout (std140) uniform view_and_projection {
+                mat4x4 view;
+                mat4x4 view_inv;
+                mat4x4 projection;
+                vec2 viewport;
+            };
+
+            out vec3 v_position;
+            out vec3 v_normal;
+            out vec4 v_color;
+            out vec3 v_eye_dir;
+
+            void main(void) {
+                vec4 wld_vert_position4 = instance_model * vec4(position, 1.0);
+                vec3 wld_vert_position = wld_vert_position4.xyz / wld_vert_position4.w;
+
+                vec4 wld_eye_position4 = view_inv * vec4(0.0, 0.0, 0.0, 1.0);
+                vec3 wld_eye_position = wld_eye_position4.xyz / wld_eye_position4.w;
+
+                vec3 wld_vert_normal = normalize(instance_normal * normal);
 
-                        vec3 specular_color = vec3(0.0, 0.0, 0.0);
-                        if (dot(v_normal, v_light_dir[i]) >= 0.0) {
-                            float spec_coeff = 0.7 * pow(max(0.0, dot(v_light_reflect_dir[i], v_eye_dir)), lights[i].specular_exp);
-                            specular_color = spec_coeff * color_combination;
-                        }
+                vec3 wld_vert_eye_dir = normalize(wld_eye_position - wld_vert_position);
 
-                        frag_color = clamp(frag_color + vec4(clamp(ambient_color + diffuse_color + specular_color, 0.0, 1.0), v_color.a), 0.0, 1.0);
+                gl_Position = projection * view * wld_vert_position4;
+                v_color = color;
+                v_eye_dir = wld_vert_eye_dir;
+                v_normal = wld_vert_normal;
+                v_position = wld_vert_position;
+            }
+        )glsl";
+
+        // The batched versions look their transformations up by
+        // draw_id in draw_data, which holds a ModelTransformationBlock
+        // (seven vec4's) per draw, starting at draw_base.
+        const char *Shader::unlit_batched_vertex_shader_source = R"glsl(
+            #version 410 core
+
+            in vec3 position;
+            in vec4 color;
+            in uint draw_id;
+
+            uniform samplerBuffer draw_data;
+            uniform int draw_base;
+            layout (std140) uniform view_and_projection {
+                mat4x4 view;
+                mat4x4 view_inv;
+                mat4x4 projection;
+                vec2 viewport;
+            };
+
+            out vec4 v_color;
+
+            void main(void) {
+                int base = draw_base + 7 * int(draw_id);
+                mat4x4 model = mat4x4(
+                    texelFetch(draw_data, base),
+                    texelFetch(draw_data, base + 1),
+                    texelFetch(draw_data, base + 2),
+                    texelFetch(draw_data, base + 3));
+
+                gl_Position = projection * view * model * vec4(position, 1.0);
+                v_color = color;
+            }
+        )glsl";
+
+        const char *Shader::lit_batched_vertex_shader_source = R"glsl(
+            #version 410 core
+
+            in vec3 position;
+            in vec3 normal;
+            in vec4 color;
+            in uint draw_id;
+
+            uniform samplerBuffer draw_data;
+            uniform int draw_base;
+            layout (std140) uniform view_and_projection {
+                mat4x4 view;
+                mat4x4 view_inv;
+                mat4x4 projection;
+                vec2 viewport;
+            };
+
+            out vec3 v_position;
+            out vec3 v_normal;
+            out vec4 v_color;
+            out vec3 v_eye_dir;
+
+            void main(void) {
+                int base = draw_base + 7 * int(draw_id);
+                mat4x4 model = mat4x4(
+                    texelFetch(draw_data, base),
+                    texelFetch(draw_data, base + 1),
+                    texelFetch(draw_data, base + 2),
+                    texelFetch(draw_data, base + 3));
+                mat3x3 model_inv_trans_3 = mat3x3(
+                    texelFetch(draw_data, base + 4).xyz,
+                    texelFetch(draw_data, base + 5).xyz,
+                    texelFetch(draw_data, base + 6).xyz);
+
+                vec4 wld_vert_position4 = model * vec4(position, 1.0);
+                vec3 wld_vert_position = wld_vert_position4.xyz / wld_vert_position4.w;
+
+                vec4 wld_eye_position4 = view_inv * vec4(0.0, 0.0, 0.0, 1.0);
+                vec3 wld_eye_position = wld_eye_position4.xyz / wld_eye_position4.w;
+
+                vec3 wld_vert_normal = normalize(model_inv_trans_3 * normal);
+
+                vec3 wld_vert_eye_dir = normalize(wld_eye_position - wld_vert_position);
+
+                gl_Position = projection * view * wld_vert_position4;
+                v_color = color;
+                v_eye_dir = wld_vert_eye_dir;
+                v_normal = wld_vert_normal;
+                v_position = wld_vert_position;
+            }
+        )glsl";
+
+        // The tessellated sphere. The vertex shader just passes the
+        // patch corners through; the control shader picks how finely
+        // to split each edge from how long it would be on screen; and
+        // the evaluation shader puts the new vertices on the sphere
+        // and does what the lit vertex shader does with them.
+        const char *Shader::sphere_vertex_shader_source = R"glsl(
+            #version 410 core
+
+            in vec3 position;
+            in vec4 color;
+
+            out vec3 tc_position;
+            out vec4 tc_color;
+
+            void main(void) {
+                tc_position = position;
+                tc_color = color;
+            }
+        )glsl";
+
+        const char *Shader::sphere_tess_control_shader_source = R"glsl(
+            #version 410 core
+
+            // Roughly how long each tessellated edge should be, in
+            // pixels, and the most an edge gets split.
+            const float PIXELS_PER_EDGE = 8.0;
+            const float MAX_LEVEL = 64.0;
+
+            layout (vertices = 3) out;
+
+            in vec3 tc_position[];
+            in vec4 tc_color[];
+
+            layout (std140) uniform model_transformation {
+                mat4x4 model;
+                mat3x3 model_inv_trans_3;
+            };
+            layout (std140) uniform view_and_projection {
+                mat4x4 view;
+                mat4x4 view_inv;
+                mat4x4 projection;
+                vec2 viewport;
+            };
+
+            out vec3 te_position[];
+            out vec4 te_color[];
+
+            // The edge's length in pixels as though it were facing
+            // the camera, so it only depends on the two ends and the
+            // patches on either side of it agree.
+            float edgeLevel(vec3 a, vec3 b) {
+                float len = distance(a, b);
+                float depth = max(-0.5 * (a.z + b.z), 0.001);
+                float pixels = len * projection[1][1] * 0.5 * viewport.y / depth;
+                return clamp(pixels / PIXELS_PER_EDGE, 1.0, MAX_LEVEL);
+            }
+
+            void main(void) {
+                te_position[gl_InvocationID] = tc_position[gl_InvocationID];
+                te_color[gl_InvocationID] = tc_color[gl_InvocationID];
+
+                if (gl_InvocationID == 0) {
+                    mat4x4 model_view = view * model;
+                    vec3 eye_position[3];
+                    for (int i = 0; i < 3; ++i) {
+                        vec4 p = model_view * vec4(tc_position[i], 1.0);
+                        eye_position[i] = p.xyz / p.w;
                     }
+
+                    // Outer level i is the edge across from vertex i.
+                    gl_TessLevelOuter[0] = edgeLevel(eye_position[1], eye_position[2]);
+                    gl_TessLevelOuter[1] = edgeLevel(eye_position[2], eye_position[0]);
+                    gl_TessLevelOuter[2] = edgeLevel(eye_position[0], eye_position[1]);
+                    gl_TessLevelInner[0] = max(gl_TessLevelOuter[0], max(gl_TessLevelOuter[1], gl_TessLevelOuter[2]));
+                }
+            }
+        )glsl";
+
+        const char *Shader::sphere_tess_evaluation_shader_source = R"glsl(
+            #version 410 core
+
+            layout (triangles, fractional_odd_spacing, ccw) in;
+
+            in vec3 te_position[];
+            in vec4 te_color[];
+
+            layout (std140) uniform model_transformation {
+                mat4x4 model;
+                mat3x3 model_inv_trans_3;
+            };
+            layout (std140) uniform view_and_projection {
+                mat4x4 view;
+                mat4x4 view_inv;
+                mat4x4 projection;
+                vec2 viewport;
+            };
+
+            out vec3 v_position;
+            out vec3 v_normal;
+            out vec4 v_color;
+            out vec3 v_eye_dir;
+
+            void main(void) {
+                vec3 position = normalize(
+                    gl_TessCoord.x * te_position[0] +
+                    gl_TessCoord.y * te_position[1] +
+                    gl_TessCoord.z * te_position[2]);
+                vec4 color =
+                    gl_TessCoord.x * te_color[0] +
+                    gl_TessCoord.y * te_color[1] +
+                    gl_TessCoord.z * te_color[2];
+
+                vec4 wld_vert_position4 = model * vec4(position, 1.0);
+                vec3 wld_vert_position = wld_vert_position4.xyz / wld_vert_position4.w;
+
+                vec4 wld_eye_position4 = view_inv * vec4(0.0, 0.0, 0.0, 1.0);
+                vec3 wld_eye_position = wld_eye_position4.xyz / wld_eye_position4.w;
+
+                // On a unit sphere, the normal is the position.
+                vec3 wld_vert_normal = normalize(model_inv_trans_3 * position);
+
+                vec3 wld_vert_eye_dir = normalize(wld_eye_position - wld_vert_position);
+
+                gl_Position = projection * view * wld_vert_position4;
+                v_color = color;
+                v_eye_dir = wld_vert_eye_dir;
+                v_normal = wld_vert_normal;
+                v_position = wld_vert_position;
+            }
+        )glsl";
+
+        // The lighting passes over a GBuffer. One triangle covers the
+        // screen, and each pixel gets lit from what was drawn there:
+        // by the lights that reach everywhere on the first pass, and
+        // by the ones in its cluster on the second.
+        const char *Shader::fullscreen_vertex_shader_source = R"glsl(
+            #version 410 core
+
+            void main(void) {
+                vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+                gl_Position = vec4(2.0 * corner - 1.0, 0.0, 1.0);
+            }
+        )glsl";
+
+        const char *Shader::deferred_lighting_fragment_shader_source = R"glsl(
+            uniform sampler2D g_color;
+            uniform sampler2D g_normal;
+            uniform sampler2D g_position;
+            uniform int light_pass;
+
+            out vec4 frag_color;
+
+            void main(void) {
+                ivec2 pixel = ivec2(gl_FragCoord.xy);
+                vec4 position = texelFetch(g_position, pixel, 0);
+                vec4 color = texelFetch(g_color, pixel, 0);
+
+                // Nothing was drawn here, or something unlit was,
+                // which only goes through once.
+                if (position.w == 0.0 || (position.w < 0.0 && light_pass != 0)) {
+                    discard;
+                }
+                if (position.w < 0.0) {
+                    frag_color = color;
+                    return;
                 }
+
+                vec3 normal = normalize(texelFetch(g_normal, pixel, 0).xyz);
+                vec4 eye_position = view_inv * vec4(0.0, 0.0, 0.0, 1.0);
+                vec3 eye_dir = normalize(eye_position.xyz / eye_position.w - position.xyz);
+
+                uvec2 lights = light_pass == 0 ? everywhereLights() : clusterLights(position.xyz);
+                frag_color = vec4(shadeAll(lights, position.xyz, normal, eye_dir, color.rgb), 1.0);
             }
         )glsl";
     }
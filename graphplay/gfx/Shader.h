@@ -5,66 +5,88 @@
 
 #include "../graphplay.h"
 
+#include <cstddef>
 #include <map>
 #include <memory>
 #include <vector>
+
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
 #include "OpenGLUtils.h"
+#include "Uniform.h"
 
 namespace graphplay {
     namespace gfx {
-        class ViewAndProjectionBlock {
-        public:
-            enum field_name {
-                VIEW,
-                VIEW_INV,
-                PROJECTION,
-            };
-            typedef std::map<field_name, GLuint> offset_map_type;
-
-            static const ViewAndProjectionBlock& getDescriptor();
-
-            const offset_map_type& getOffsets() const;
-            long getDataSize() const;
-
-        private:
-            ViewAndProjectionBlock();
-            ViewAndProjectionBlock(const ViewAndProjectionBlock &other) = delete;
-            ViewAndProjectionBlock(ViewAndProjectionBlock &&other) = delete;
-            ViewAndProjectionBlock& operator=(const ViewAndProjectionBlock &other) = delete;
-            ViewAndProjectionBlock& operator=(ViewAndProjectionBlock &&other) = delete;
-
-            offset_map_type m_offsets;
-            long m_data_size;
+        // C++ versions of the std140 uniform blocks the shaders
+        // share, so they can be filled in on the CPU and copied
+        // straight into a buffer.
+        struct ViewAndProjectionBlock {
+            glm::mat4x4 view;
+            glm::mat4x4 view_inv;
+            glm::mat4x4 projection;
+            // The viewport's width and height in pixels, which the
+            // tessellation shaders size things by.
+            glm::vec2 viewport;
+            GLfloat pad0[2];
         };
 
-        class LightListBlock {
-        public:
-            static const int MAX_LIGHTS = 10;
-
-            enum field_name {
-                ENABLED,
-                POSITION,
-                COLOR,
-                SPECULAR_EXP,
-            };
-            typedef std::map<field_name, GLuint> offset_map_type;
-
-            static const LightListBlock& getDescriptor();
+        // Where the lit shaders find the lights for their cluster;
+        // see LightClusters. std140 packs deferred in after the
+        // uvec3.
+        struct LightClusterBlock {
+            // Clusters across, down and deep.
+            GLuint size[3];
+            // Whether the meshes are being drawn into a GBuffer
+            // rather than lit.
+            GLuint deferred;
+            // Pixels per cluster across and down, then the scale and
+            // bias that turn log(depth) into a slice.
+            glm::vec4 scale;
+        };
 
-            const std::vector<offset_map_type>& getOffsets() const;
-            long getDataSize() const;
+        // A light as the lit shaders read it from their light_data
+        // texture buffer: three vec4 texels.
+        struct LightProperties {
+            glm::vec3 position;
+            GLfloat radius;
+            glm::vec4 color;
+            GLfloat specular_exp;
+            GLfloat pad0[3];
+        };
 
-        private:
-            LightListBlock();
-            LightListBlock(const LightListBlock &other) = delete;
-            LightListBlock(LightListBlock &&other) = delete;
-            LightListBlock& operator=(const LightListBlock &other) = delete;
-            LightListBlock& operator=(LightListBlock &&other) = delete;
-
-            std::vector<offset_map_type> m_offsets;
-            long m_data_size;
+        // The model transformations for one draw. A mat3x3 in std140
+        // is three vec4 columns. Programs with this block bind it to
+        // BINDING when they're linked.
+        struct ModelTransformationBlock {
+            static const GLuint BINDING = 2;
+
+            glm::mat4x4 model;
+            glm::vec4 model_inv_trans_3[3];
+
+            inline void set(const glm::mat4x4 &new_model, const glm::mat3x3 &new_inv_trans_3) {
+                model = new_model;
+                for (int c = 0; c < 3; ++c) {
+                    model_inv_trans_3[c] = glm::vec4(new_inv_trans_3[c], 0.0f);
+                }
+            }
         };
 
+        static_assert(offsetof(ViewAndProjectionBlock, view_inv) == 64, "view_inv isn't where std140 puts it");
+        static_assert(offsetof(ViewAndProjectionBlock, projection) == 128, "projection isn't where std140 puts it");
+        static_assert(offsetof(ViewAndProjectionBlock, viewport) == 192, "viewport isn't where std140 puts it");
+        static_assert(sizeof(ViewAndProjectionBlock) == 208, "ViewAndProjectionBlock isn't the std140 size");
+        static_assert(offsetof(LightClusterBlock, deferred) == 12, "deferred isn't where std140 puts it");
+        static_assert(offsetof(LightClusterBlock, scale) == 16, "scale isn't where std140 puts it");
+        static_assert(sizeof(LightClusterBlock) == 32, "LightClusterBlock isn't the std140 size");
+        static_assert(offsetof(LightProperties, color) == 16, "color isn't in the second texel");
+        static_assert(sizeof(LightProperties) == 48, "LightProperties isn't three texels");
+        static_assert(offsetof(ModelTransformationBlock, model_inv_trans_3) == 64, "model_inv_trans_3 isn't where std140 puts it");
+        static_assert(sizeof(ModelTransformationBlock) == 112, "ModelTransformationBlock isn't the std140 size");
+
         class Shader {
         public:
             typedef std::unique_ptr<Shader> uptr_type;
@@ -83,6 +105,13 @@ namespace graphplay {
 
             static const char *unlit_vertex_shader_source, *unlit_fragment_shader_source;
             static const char *lit_vertex_shader_source, *lit_fragment_shader_source;
+            static const char *unlit_instanced_vertex_shader_source, *lit_instanced_vertex_shader_source;
+            static const char *unlit_batched_vertex_shader_source, *lit_batched_vertex_shader_source;
+            static const char *sphere_vertex_shader_source, *sphere_tess_control_shader_source, *sphere_tess_evaluation_shader_source;
+            static const char *fullscreen_vertex_shader_source, *deferred_lighting_fragment_shader_source;
+            // The lit and deferred lighting fragment shaders are
+            // compiled with this in front of them.
+            static const char *lighting_shader_source;
 
         private:
             GLuint m_shader;
@@ -94,7 +123,35 @@ namespace graphplay {
             typedef std::shared_ptr<Program> sptr_type;
             typedef std::weak_ptr<Program> wptr_type;
 
+            // The uniforms meshes set on every draw, resolved when
+            // the program is linked. The ones the program doesn't
+            // have are invalid.
+            struct StandardUniforms {
+                Uniform<glm::mat4x4> model;
+                Uniform<glm::mat3x3> model_inv_trans_3;
+                Uniform<GLint> draw_base;
+            };
+
+            // The texture unit batched programs read their draw_data
+            // from.
+            static const GLuint DRAW_DATA_TEXTURE_UNIT = 0;
+
+            // And the ones lit programs read the LightClusters from.
+            static const GLuint LIGHT_DATA_TEXTURE_UNIT = 1;
+            static const GLuint LIGHT_GRID_TEXTURE_UNIT = 2;
+            static const GLuint LIGHT_INDEX_TEXTURE_UNIT = 3;
+
+            // And the ones the deferred lighting program reads the
+            // GBuffer from.
+            static const GLuint GBUFFER_COLOR_TEXTURE_UNIT = 4;
+            static const GLuint GBUFFER_NORMAL_TEXTURE_UNIT = 5;
+            static const GLuint GBUFFER_POSITION_TEXTURE_UNIT = 6;
+
             Program(Shader::sptr_type vertex_shader, Shader::sptr_type fragment_shader);
+            Program(Shader::sptr_type vertex_shader,
+                    Shader::sptr_type tess_control_shader,
+                    Shader::sptr_type tess_evaluation_shader,
+                    Shader::sptr_type fragment_shader);
             Program(const Program &other);
             Program(Program &&other);
             ~Program();
@@ -105,18 +162,72 @@ namespace graphplay {
             inline const GLuint getProgramId() const { return m_program; }
             inline const Shader::sptr_type getVertexShader()   const { return m_vertex_shader; }
             inline const Shader::sptr_type getFragmentShader() const { return m_fragment_shader; }
+            inline const Shader::sptr_type getTessControlShader()    const { return m_tess_control_shader; }
+            inline const Shader::sptr_type getTessEvaluationShader() const { return m_tess_evaluation_shader; }
             inline const IndexMap& getAttributes()    const { return m_attributes; }
             inline const IndexMap& getUniforms()      const { return m_uniforms; }
             inline const IndexMap& getUniformBlocks() const { return m_uniform_blocks; };
 
+            // These remember what they were last set to, which isn't
+            // really part of the program, hence the const.
+            inline StandardUniforms& getStandardUniforms() const { return m_standard_uniforms; }
+
+            // Whether the program takes its model transformations
+            // from the model_transformation block.
+            inline bool hasModelBlock() const { return m_model_block_index != GL_INVALID_INDEX; }
+
+            // For drawing without a FrameRing: copy block into the
+            // program's own buffer (unless it's already there) and
+            // bind it.
+            void setModelBlock(const ModelTransformationBlock &block) const;
+
+            // Whether the model transformations come from the
+            // instance_model and instance_normal attributes, rather
+            // than uniforms.
+            inline bool isInstanced() const { return m_instanced; }
+
+            // Whether the model transformations are looked up in the
+            // draw_data texture buffer by the draw_id attribute.
+            inline bool isBatched() const { return m_batched; }
+
         private:
+            void link();
+
             GLuint m_program;
             Shader::sptr_type m_vertex_shader, m_fragment_shader;
+            Shader::sptr_type m_tess_control_shader, m_tess_evaluation_shader;
             IndexMap m_attributes, m_uniforms, m_uniform_blocks;
+            mutable StandardUniforms m_standard_uniforms;
+            GLuint m_model_block_index;
+            mutable GLuint m_model_buffer;
+            mutable ModelTransformationBlock m_model_block;
+            mutable bool m_model_block_current;
+            bool m_instanced, m_batched;
         };
 
         Program::sptr_type createUnlitProgram();
         Program::sptr_type createLitProgram();
+
+        // Versions of the unlit and lit programs for drawing lots of
+        // copies of a geometry at once. Meshes using them get drawn
+        // together by the RenderQueue.
+        Program::sptr_type createUnlitInstancedProgram();
+        Program::sptr_type createLitInstancedProgram();
+
+        // Versions of the unlit and lit programs whose meshes get
+        // drawn in batches by the RenderQueue, as many per draw call
+        // as it can manage.
+        Program::sptr_type createUnlitBatchedProgram();
+        Program::sptr_type createLitBatchedProgram();
+
+        // A lit program for drawing spheres from
+        // makeSpherePatchGeometry. The patches get tessellated on the
+        // GPU, finer the bigger they are on screen, and pushed out
+        // onto the unit sphere.
+        Program::sptr_type createTessellatedSphereProgram();
+
+        // The full screen passes that light a GBuffer.
+        Program::sptr_type createDeferredLightingProgram();
     }
 }
 
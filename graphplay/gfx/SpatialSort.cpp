@@ -0,0 +1,121 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../graphplay.h"
+#include "SpatialSort.h"
+
+#include <algorithm>
+
+#include "../Parallel.h"
+
+namespace graphplay {
+    namespace gfx {
+        static const std::size_t MIN_SORT_CHUNK = 1 << 15;
+        static const unsigned int MORTON_BITS = 30;
+        static const float GRID_SIZE = 1024.0f;
+
+        struct MortonKey {
+            std::uint32_t code;
+            GLuint index;
+        };
+
+        // Spread the low 10 bits of v out so that there are two zero
+        // bits between each of them.
+        static inline std::uint32_t spreadBits(std::uint32_t v) {
+            v &= 0x3FF;
+            v = (v | (v << 16)) & 0x030000FF;
+            v = (v | (v <<  8)) & 0x0300F00F;
+            v = (v | (v <<  4)) & 0x030C30C3;
+            v = (v | (v <<  2)) & 0x09249249;
+            return v;
+        }
+
+        std::uint32_t mortonCode30(std::uint32_t x, std::uint32_t y, std::uint32_t z) {
+            return (spreadBits(x) << 2) | (spreadBits(y) << 1) | spreadBits(z);
+        }
+
+        std::uint32_t mortonCode30(const glm::vec3 &point, const fzx::BBox &bounds) {
+            std::uint32_t cell[3];
+            for (unsigned int j = 0; j < 3; ++j) {
+                float extent = bounds.max[j] - bounds.min[j];
+                float t = extent > 0.0f ? (point[j] - bounds.min[j]) / extent : 0.0f;
+                float c = std::min(std::max(t*GRID_SIZE, 0.0f), GRID_SIZE - 1.0f);
+                cell[j] = static_cast<std::uint32_t>(c);
+            }
+            return mortonCode30(cell[0], cell[1], cell[2]);
+        }
+
+        // Sort the keys by code and give back their indices.
+        static std::vector<GLuint> sortedIndices(std::vector<MortonKey> &keys) {
+            parallelRadixSort(keys, MIN_SORT_CHUNK, MORTON_BITS, [](const MortonKey &k) {
+                    return k.code;
+                });
+
+            std::vector<GLuint> rv(keys.size());
+            parallelFor(keys.size(), MIN_SORT_CHUNK, [&](std::size_t i) {
+                    rv[i] = keys[i].index;
+                });
+            return rv;
+        }
+
+        std::vector<GLuint> mortonOrder(const std::vector<glm::vec3> &points, const fzx::BBox &bounds) {
+            std::vector<MortonKey> keys(points.size());
+            parallelFor(points.size(), MIN_SORT_CHUNK, [&](std::size_t i) {
+                    keys[i].code = mortonCode30(points[i], bounds);
+                    keys[i].index = static_cast<GLuint>(i);
+                });
+            return sortedIndices(keys);
+        }
+
+        void reorderElements(std::vector<GLuint> &elems, const std::vector<GLuint> &order) {
+            const std::size_t num_verts = order.size();
+            std::vector<GLuint> new_index(num_verts);
+            parallelFor(num_verts, MIN_SORT_CHUNK, [&](std::size_t i) {
+                    new_index[order[i]] = static_cast<GLuint>(i);
+                });
+
+            parallelFor(elems.size(), MIN_SORT_CHUNK, [&](std::size_t i) {
+                    if (elems[i] < num_verts) {
+                        elems[i] = new_index[elems[i]];
+                    }
+                });
+        }
+
+        void mortonSortTriangles(std::vector<GLuint> &elems, const std::vector<glm::vec3> &positions) {
+            const std::size_t num_verts = positions.size();
+            const std::size_t num_faces = elems.size() / 3;
+            if (num_faces < 2) {
+                return;
+            }
+
+            // Faces that point past the vertices have nowhere to be,
+            // so they go to the front with a code of zero.
+            auto valid = [&](std::size_t f) {
+                return elems[3*f] < num_verts && elems[3*f + 1] < num_verts && elems[3*f + 2] < num_verts;
+            };
+
+            std::vector<glm::vec3> centroids(num_faces, glm::vec3(0.0f));
+            parallelFor(num_faces, MIN_SORT_CHUNK, [&](std::size_t f) {
+                    if (valid(f)) {
+                        const GLuint *tri = &elems[3*f];
+                        centroids[f] = (positions[tri[0]] + positions[tri[1]] + positions[tri[2]]) / 3.0f;
+                    }
+                });
+            fzx::BBox bounds = fzx::BBox::fromPositions(&centroids[0][0], num_faces, sizeof(glm::vec3));
+
+            std::vector<MortonKey> keys(num_faces);
+            parallelFor(num_faces, MIN_SORT_CHUNK, [&](std::size_t f) {
+                    keys[f].code = valid(f) ? mortonCode30(centroids[f], bounds) : 0;
+                    keys[f].index = static_cast<GLuint>(f);
+                });
+            std::vector<GLuint> face_order = sortedIndices(keys);
+
+            std::vector<GLuint> sorted(elems.size());
+            parallelFor(num_faces, MIN_SORT_CHUNK, [&](std::size_t f) {
+                    const GLuint *src = &elems[3*face_order[f]];
+                    std::copy(src, src + 3, &sorted[3*f]);
+                });
+            std::copy(elems.begin() + 3*num_faces, elems.end(), sorted.begin() + 3*num_faces);
+            elems.swap(sorted);
+        }
+    }
+}
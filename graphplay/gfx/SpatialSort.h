@@ -0,0 +1,41 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_SPATIAL_SORT_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_SPATIAL_SORT_H_
+
+#include "../graphplay.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "../opengl.h"
+#include "../fzx/BBox.h"
+
+namespace graphplay {
+    namespace gfx {
+        // Interleave the low 10 bits of x, y and z (x highest) into a
+        // 30-bit Morton code.
+        std::uint32_t mortonCode30(std::uint32_t x, std::uint32_t y, std::uint32_t z);
+
+        // The Morton code of a point on a 1024^3 grid over
+        // bounds. Points outside of bounds are clamped onto it.
+        std::uint32_t mortonCode30(const glm::vec3 &point, const fzx::BBox &bounds);
+
+        // The order that puts points along the Morton (Z-order) curve
+        // through bounds: order[i] is the index of the i'th point.
+        // Points in the same grid cell keep their relative order.
+        std::vector<GLuint> mortonOrder(const std::vector<glm::vec3> &points, const fzx::BBox &bounds);
+
+        // Renumber elems after the vertices have been moved so that
+        // vertex order[i] is now vertex i.
+        void reorderElements(std::vector<GLuint> &elems, const std::vector<GLuint> &order);
+
+        // Sort a triangle list by the Morton codes of the triangles'
+        // centroids. Each triangle keeps its winding.
+        void mortonSortTriangles(std::vector<GLuint> &elems, const std::vector<glm::vec3> &positions);
+    }
+}
+
+#endif
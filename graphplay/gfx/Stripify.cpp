@@ -0,0 +1,89 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../graphplay.h"
+#include "Stripify.h"
+
+#include "MeshAdjacency.h"
+
+namespace graphplay {
+    namespace gfx {
+        static const unsigned int NO_FACE = 0xFFFFFFFF;
+
+        // Find an unused face that has the directed edge from -> to,
+        // and return it along with its third vertex.
+        static unsigned int faceWithEdge(
+            const std::vector<GLuint> &tris, const VertexCorners &vc,
+            const std::vector<bool> &used, GLuint from, GLuint to, GLuint &third)
+        {
+            for (unsigned int i = vc.begin(from); i < vc.end(from); ++i) {
+                unsigned int corner = vc.corners[i];
+                unsigned int face = corner / 3;
+                unsigned int base = face*3;
+
+                if (!used[face] && tris[base + (corner + 1) % 3] == to) {
+                    third = tris[base + (corner + 2) % 3];
+                    return face;
+                }
+            }
+
+            return NO_FACE;
+        }
+
+        std::vector<GLuint> stripifyTriangles(const std::vector<GLuint> &tris, std::size_t num_verts) {
+            const std::size_t num_faces = tris.size() / 3;
+            VertexCorners vc = buildVertexCorners(tris, num_verts);
+            std::vector<bool> used(num_faces, false);
+            std::vector<GLuint> rv;
+            std::vector<GLuint> strip;
+            rv.reserve(tris.size());
+
+            for (std::size_t f = 0; f < num_faces; ++f) {
+                if (used[f]) {
+                    continue;
+                }
+
+                // Start on whichever rotation of the face lets the
+                // strip continue on to a neighbor.
+                GLuint a = tris[3*f], b = tris[3*f + 1], c = tris[3*f + 2], third = 0;
+                for (unsigned int r = 0; r < 3; ++r) {
+                    if (faceWithEdge(tris, vc, used, c, b, third) != NO_FACE) {
+                        break;
+                    }
+                    GLuint t = a; a = b; b = c; c = t;
+                }
+
+                used[f] = true;
+                strip.clear();
+                strip.push_back(a);
+                strip.push_back(b);
+                strip.push_back(c);
+
+                // Triangle i of a strip is (s[i], s[i+1], s[i+2]) when
+                // i is even and (s[i+1], s[i], s[i+2]) when it's odd,
+                // so the next face has to have whichever directed edge
+                // keeps the winding the same.
+                while (true) {
+                    std::size_t i = strip.size() - 2;
+                    GLuint second_last = strip[i], last = strip[i + 1];
+                    unsigned int next = (i % 2 == 0)
+                        ? faceWithEdge(tris, vc, used, second_last, last, third)
+                        : faceWithEdge(tris, vc, used, last, second_last, third);
+
+                    if (next == NO_FACE) {
+                        break;
+                    }
+
+                    used[next] = true;
+                    strip.push_back(third);
+                }
+
+                if (!rv.empty()) {
+                    rv.push_back(PRIMITIVE_RESTART_INDEX);
+                }
+                rv.insert(rv.end(), strip.begin(), strip.end());
+            }
+
+            return rv;
+        }
+    }
+}
@@ -0,0 +1,36 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_STRIPIFY_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_STRIPIFY_H_
+
+#include "../graphplay.h"
+
+#include <cstddef>
+#include <vector>
+
+#include "../opengl.h"
+#include "Geometry.h"
+
+namespace graphplay {
+    namespace gfx {
+        // Turn a triangle list into triangle strips separated by
+        // PRIMITIVE_RESTART_INDEX. Strips are grown greedily across
+        // shared edges, and every triangle keeps its winding.
+        std::vector<GLuint> stripifyTriangles(const std::vector<GLuint> &tris, std::size_t num_verts);
+
+        // Convert a GL_TRIANGLES geometry to primitive-restart
+        // triangle strips. Do this before its buffers are created.
+        template <typename V>
+        void stripify(Geometry<V> &geo) {
+            if (geo.draw_type != GL_TRIANGLES) {
+                return;
+            }
+
+            geo.elements() = stripifyTriangles(geo.elements(), geo.vertices().size());
+            geo.draw_type = GL_TRIANGLE_STRIP;
+            geo.primitive_restart = true;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,889 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../graphplay.h"
+#include "TriangleBVH.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GRAPHPLAY_BVH_SSE
+#include <emmintrin.h>
+#endif
+
+namespace graphplay {
+    namespace gfx {
+        const std::uint32_t TriangleBVH::LEAF_BIT;
+        const std::uint32_t TriangleBVH::NO_CHILD;
+        const GLuint TriangleBVH::NO_FACE;
+
+        static const unsigned int NUM_BINS = 16;
+        static const std::size_t MAX_LEAF_TRIANGLES = 4;
+        static const unsigned int MAX_SAH_DEPTH = 48;
+        static const std::size_t MIN_BIN_CHUNK = 1 << 14;
+        static const std::size_t MIN_SUBTREE_SIZE = 1 << 12;
+        static const unsigned int STACK_SIZE = 256;
+        static const float FLOAT_MAX = std::numeric_limits<float>::max();
+        static const float MIN_DETERMINANT = std::numeric_limits<float>::min();
+        static const float MIN_DIRECTION = 1e-20f;
+
+        // The bounds of a triangle or a group of them while the tree
+        // is being built.
+        struct Bounds {
+            Bounds() : min(FLOAT_MAX), max(-FLOAT_MAX) {}
+
+            inline void grow(const glm::vec3 &p) {
+                grow(p, p);
+            }
+
+            inline void grow(const Bounds &b) {
+                grow(b.min, b.max);
+            }
+
+            inline void grow(const glm::vec3 &lo, const glm::vec3 &hi) {
+                min.x = std::min(min.x, lo.x);
+                min.y = std::min(min.y, lo.y);
+                min.z = std::min(min.z, lo.z);
+                max.x = std::max(max.x, hi.x);
+                max.y = std::max(max.y, hi.y);
+                max.z = std::max(max.z, hi.z);
+            }
+
+            inline float area() const {
+                glm::vec3 d = max - min;
+                if (d.x < 0.0f || d.y < 0.0f || d.z < 0.0f) {
+                    return 0.0f;
+                }
+                return 2.0f*(d.x*d.y + d.y*d.z + d.z*d.x);
+            }
+
+            glm::vec3 min, max;
+        };
+
+        // A node of the binary tree the build starts with. Leaves
+        // have a count, inner nodes have children.
+        struct BuildNode {
+            Bounds bounds;
+            std::uint32_t left, right;
+            std::uint32_t first, count;
+        };
+
+        // A triangle being sorted into the tree. The references are
+        // partitioned in place, so the build reads them in order.
+        struct BuildRef {
+            Bounds bounds;
+            GLuint face;
+
+            inline glm::vec3 centroid() const { return (bounds.min + bounds.max)*0.5f; }
+        };
+
+        struct Bin {
+            Bin() : count(0) {}
+            Bounds bounds;
+            std::size_t count;
+        };
+
+        // A subtree that's left to be built on its own thread.
+        struct BuildTask {
+            std::uint32_t node;
+            std::size_t first, last;
+            unsigned int depth;
+        };
+
+        struct BuildContext {
+            std::vector<BuildRef> *refs;
+            std::size_t subtree_size;
+            bool parallel;
+        };
+
+        static void rangeBounds(
+            const BuildContext &ctx, std::size_t first, std::size_t last,
+            Bounds &bounds, Bounds &centroid_bounds)
+        {
+            const std::size_t count = last - first;
+            const std::size_t min_chunk = ctx.parallel ? MIN_BIN_CHUNK : count + 1;
+            const unsigned int num_chunks = chunkCount(count, min_chunk);
+            std::vector<Bounds> chunk_bounds(num_chunks), chunk_centroids(num_chunks);
+
+            parallelChunks(count, min_chunk, [&](unsigned int chunk, std::size_t begin, std::size_t end) {
+                    for (std::size_t i = first + begin; i < first + end; ++i) {
+                        const BuildRef &ref = (*ctx.refs)[i];
+                        chunk_bounds[chunk].grow(ref.bounds);
+                        chunk_centroids[chunk].grow(ref.centroid());
+                    }
+                });
+
+            for (unsigned int c = 0; c < num_chunks; ++c) {
+                bounds.grow(chunk_bounds[c]);
+                centroid_bounds.grow(chunk_centroids[c]);
+            }
+        }
+
+        static inline unsigned int binIndex(float c, float min, float scale) {
+            int bin = static_cast<int>((c - min)*scale);
+            return static_cast<unsigned int>(std::min(std::max(bin, 0), static_cast<int>(NUM_BINS) - 1));
+        }
+
+        // Find the bin boundary with the lowest surface area cost,
+        // binning the triangles by centroid along each axis. Faces in
+        // bins <= bin go on the left.
+        static bool findSplit(
+            const BuildContext &ctx, std::size_t first, std::size_t last,
+            const Bounds &centroid_bounds, unsigned int &axis, unsigned int &bin)
+        {
+            const std::size_t count = last - first;
+            glm::vec3 extent = centroid_bounds.max - centroid_bounds.min;
+            float scale[3];
+            for (unsigned int a = 0; a < 3; ++a) {
+                scale[a] = extent[a] > 0.0f ? NUM_BINS / extent[a] : 0.0f;
+            }
+
+            const std::size_t min_chunk = ctx.parallel ? MIN_BIN_CHUNK : count + 1;
+            const unsigned int num_chunks = chunkCount(count, min_chunk);
+            std::vector<Bin> bins(num_chunks*3*NUM_BINS);
+            parallelChunks(count, min_chunk, [&](unsigned int chunk, std::size_t begin, std::size_t end) {
+                    Bin *chunk_bins = &bins[chunk*3*NUM_BINS];
+                    for (std::size_t i = first + begin; i < first + end; ++i) {
+                        const BuildRef &ref = (*ctx.refs)[i];
+                        glm::vec3 c = ref.centroid();
+                        for (unsigned int a = 0; a < 3; ++a) {
+                            if (scale[a] > 0.0f) {
+                                Bin &b = chunk_bins[a*NUM_BINS + binIndex(c[a], centroid_bounds.min[a], scale[a])];
+                                b.bounds.grow(ref.bounds);
+                                ++b.count;
+                            }
+                        }
+                    }
+                });
+
+            for (unsigned int c = 1; c < num_chunks; ++c) {
+                for (unsigned int i = 0; i < 3*NUM_BINS; ++i) {
+                    bins[i].bounds.grow(bins[c*3*NUM_BINS + i].bounds);
+                    bins[i].count += bins[c*3*NUM_BINS + i].count;
+                }
+            }
+
+            bool found = false;
+            float best_cost = FLOAT_MAX;
+            for (unsigned int a = 0; a < 3; ++a) {
+                if (scale[a] <= 0.0f) {
+                    continue;
+                }
+
+                // The cost of everything to the right of each bin
+                // boundary, then sweep back from the left.
+                const Bin *axis_bins = &bins[a*NUM_BINS];
+                float right_cost[NUM_BINS];
+                Bounds right;
+                std::size_t right_count = 0;
+                for (unsigned int i = NUM_BINS - 1; i > 0; --i) {
+                    right.grow(axis_bins[i].bounds);
+                    right_count += axis_bins[i].count;
+                    right_cost[i - 1] = right.area()*right_count;
+                }
+
+                Bounds left;
+                std::size_t left_count = 0;
+                for (unsigned int i = 0; i < NUM_BINS - 1; ++i) {
+                    left.grow(axis_bins[i].bounds);
+                    left_count += axis_bins[i].count;
+                    float cost = left.area()*left_count + right_cost[i];
+                    if (left_count > 0 && left_count < count && cost < best_cost) {
+                        best_cost = cost;
+                        axis = a;
+                        bin = i;
+                        found = true;
+                    }
+                }
+            }
+
+            return found;
+        }
+
+        static void buildNode(
+            const BuildContext &ctx, std::vector<BuildNode> &nodes, std::uint32_t index,
+            std::size_t first, std::size_t last, unsigned int depth,
+            std::vector<BuildTask> *tasks)
+        {
+            Bounds bounds, centroid_bounds;
+            rangeBounds(ctx, first, last, bounds, centroid_bounds);
+            nodes[index].bounds = bounds;
+            nodes[index].left = nodes[index].right = TriangleBVH::NO_CHILD;
+            nodes[index].first = static_cast<std::uint32_t>(first);
+            nodes[index].count = 0;
+
+            const std::size_t count = last - first;
+            if (count <= MAX_LEAF_TRIANGLES) {
+                nodes[index].count = static_cast<std::uint32_t>(count);
+                return;
+            }
+
+            if (tasks != nullptr && count <= ctx.subtree_size) {
+                BuildTask task = { index, first, last, depth };
+                tasks->push_back(task);
+                return;
+            }
+
+            std::vector<BuildRef>::iterator begin = ctx.refs->begin() + first, end = ctx.refs->begin() + last;
+            std::size_t middle = first;
+            unsigned int axis = 0, bin = 0;
+            if (depth < MAX_SAH_DEPTH && findSplit(ctx, first, last, centroid_bounds, axis, bin)) {
+                float min = centroid_bounds.min[axis];
+                float scale = NUM_BINS / (centroid_bounds.max[axis] - centroid_bounds.min[axis]);
+                middle = std::partition(begin, end, [&](const BuildRef &ref) {
+                        return binIndex(ref.centroid()[axis], min, scale) <= bin;
+                    }) - ctx.refs->begin();
+            }
+
+            // Fall back to splitting at the median along the longest
+            // axis, which also bounds the depth of the tree.
+            if (middle == first || middle == last) {
+                glm::vec3 extent = centroid_bounds.max - centroid_bounds.min;
+                axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+                middle = first + count/2;
+                std::nth_element(begin, ctx.refs->begin() + middle, end, [&](const BuildRef &a, const BuildRef &b) {
+                        return a.centroid()[axis] < b.centroid()[axis];
+                    });
+            }
+
+            std::uint32_t left = static_cast<std::uint32_t>(nodes.size());
+            nodes.resize(nodes.size() + 2);
+            buildNode(ctx, nodes, left, first, middle, depth + 1, tasks);
+            buildNode(ctx, nodes, left + 1, middle, last, depth + 1, tasks);
+            nodes[index].left = left;
+            nodes[index].right = left + 1;
+        }
+
+        // Build the binary tree. The top of it is split up on this
+        // thread, binning big ranges in parallel, and then the
+        // subtrees below that are built on their own threads and
+        // stitched back in.
+        static std::vector<BuildNode> buildBinaryTree(BuildContext &ctx) {
+            std::vector<BuildNode> nodes(1);
+            std::vector<BuildTask> tasks;
+            ctx.parallel = true;
+            buildNode(ctx, nodes, 0, 0, ctx.refs->size(), 0, &tasks);
+
+            std::vector<std::vector<BuildNode> > subtrees(tasks.size());
+            parallelFor(tasks.size(), 1, [&](std::size_t t) {
+                    BuildContext serial = ctx;
+                    serial.parallel = false;
+                    subtrees[t].resize(1);
+                    buildNode(serial, subtrees[t], 0, tasks[t].first, tasks[t].last, tasks[t].depth, nullptr);
+                });
+
+            for (std::size_t t = 0; t < tasks.size(); ++t) {
+                const std::uint32_t offset = static_cast<std::uint32_t>(nodes.size());
+                auto place = [&](std::uint32_t i) {
+                    return i == 0 ? tasks[t].node : offset + i - 1;
+                };
+
+                nodes.resize(nodes.size() + subtrees[t].size() - 1);
+                for (std::uint32_t i = 0; i < subtrees[t].size(); ++i) {
+                    BuildNode n = subtrees[t][i];
+                    if (n.count == 0) {
+                        n.left = place(n.left);
+                        n.right = place(n.right);
+                    }
+                    nodes[place(i)] = n;
+                }
+            }
+
+            return nodes;
+        }
+
+        TriangleBVH::TriangleBVH()
+            : m_nodes{},
+              m_packs{},
+              m_triangle_count{0}
+        {}
+
+        TriangleBVH::TriangleBVH(const std::vector<GLuint> &elems, const std::vector<glm::vec3> &positions)
+            : TriangleBVH()
+        {
+            build(elems, positions);
+        }
+
+        void TriangleBVH::build(const std::vector<GLuint> &elems, const std::vector<glm::vec3> &positions) {
+            m_nodes.clear();
+            m_packs.clear();
+            m_triangle_count = 0;
+
+            const std::size_t num_verts = positions.size();
+            const std::size_t num_faces = elems.size() / 3;
+            std::vector<BuildRef> refs(num_faces);
+            std::vector<char> usable(num_faces);
+            parallelFor(num_faces, MIN_BIN_CHUNK, [&](std::size_t f) {
+                    GLuint a = elems[3*f], b = elems[3*f + 1], c = elems[3*f + 2];
+                    usable[f] = a < num_verts && b < num_verts && c < num_verts && a != b && b != c && c != a;
+                    if (usable[f]) {
+                        refs[f].bounds.grow(positions[a]);
+                        refs[f].bounds.grow(positions[b]);
+                        refs[f].bounds.grow(positions[c]);
+                        refs[f].face = static_cast<GLuint>(f);
+                    }
+                });
+
+            std::size_t num_usable = 0;
+            for (std::size_t f = 0; f < num_faces; ++f) {
+                if (usable[f]) {
+                    refs[num_usable++] = refs[f];
+                }
+            }
+            refs.resize(num_usable);
+            if (refs.empty()) {
+                return;
+            }
+            m_triangle_count = refs.size();
+
+            BuildContext ctx;
+            ctx.refs = &refs;
+            ctx.subtree_size = std::max(MIN_SUBTREE_SIZE, refs.size() / (4*workerThreadCount()));
+            std::vector<BuildNode> tree = buildBinaryTree(ctx);
+
+            // Collapse the binary tree into a four-wide one, by
+            // pulling up the grandchildren with the biggest bounds
+            // until each node has four children or only leaves.
+            auto makePack = [&](const BuildNode &leaf) {
+                TrianglePack pack;
+                for (unsigned int k = 0; k < 4; ++k) {
+                    pack.faces[k] = NO_FACE;
+                    for (unsigned int j = 0; j < 3; ++j) {
+                        pack.v0[j][k] = pack.e1[j][k] = pack.e2[j][k] = 0.0f;
+                    }
+                }
+
+                for (unsigned int k = 0; k < leaf.count; ++k) {
+                    GLuint f = refs[leaf.first + k].face;
+                    const glm::vec3 &a = positions[elems[3*f]];
+                    const glm::vec3 &b = positions[elems[3*f + 1]];
+                    const glm::vec3 &c = positions[elems[3*f + 2]];
+                    pack.faces[k] = f;
+                    for (unsigned int j = 0; j < 3; ++j) {
+                        pack.v0[j][k] = a[j];
+                        pack.e1[j][k] = b[j] - a[j];
+                        pack.e2[j][k] = c[j] - a[j];
+                    }
+                }
+
+                m_packs.push_back(pack);
+                return LEAF_BIT | static_cast<std::uint32_t>(m_packs.size() - 1);
+            };
+
+            std::function<std::uint32_t(std::uint32_t)> collapse = [&](std::uint32_t index) {
+                std::uint32_t children[4];
+                unsigned int num_children = 0;
+                if (tree[index].count > 0) {
+                    children[num_children++] = index;
+                } else {
+                    children[num_children++] = tree[index].left;
+                    children[num_children++] = tree[index].right;
+                }
+
+                while (num_children < 4) {
+                    int widest = -1;
+                    float widest_area = -1.0f;
+                    for (unsigned int k = 0; k < num_children; ++k) {
+                        const BuildNode &c = tree[children[k]];
+                        if (c.count == 0 && c.bounds.area() > widest_area) {
+                            widest = static_cast<int>(k);
+                            widest_area = c.bounds.area();
+                        }
+                    }
+                    if (widest < 0) {
+                        break;
+                    }
+
+                    const BuildNode &c = tree[children[widest]];
+                    children[widest] = c.left;
+                    children[num_children++] = c.right;
+                }
+
+                std::uint32_t rv = static_cast<std::uint32_t>(m_nodes.size());
+                m_nodes.push_back(Node());
+                for (unsigned int k = 0; k < 4; ++k) {
+                    std::uint32_t child = NO_CHILD;
+                    Bounds bounds;
+                    if (k < num_children) {
+                        const BuildNode &c = tree[children[k]];
+                        bounds = c.bounds;
+                        child = c.count > 0 ? makePack(c) : collapse(children[k]);
+                    }
+
+                    Node &node = m_nodes[rv];
+                    node.children[k] = child;
+                    for (unsigned int j = 0; j < 3; ++j) {
+                        node.bounds[j][k] = bounds.min[j];
+                        node.bounds[j + 3][k] = bounds.max[j];
+                    }
+                }
+                return rv;
+            };
+
+            m_nodes.reserve(tree.size() / 2 + 1);
+            m_packs.reserve(refs.size() / 2 + 1);
+            collapse(0);
+        }
+
+        fzx::BBox TriangleBVH::bounds() const {
+            fzx::BBox rv;
+            if (!m_nodes.empty()) {
+                const Node &root = m_nodes[0];
+                for (unsigned int k = 0; k < 4; ++k) {
+                    if (root.children[k] != NO_CHILD) {
+                        for (unsigned int j = 0; j < 3; ++j) {
+                            rv.min[j] = std::min(rv.min[j], root.bounds[j][k]);
+                            rv.max[j] = std::max(rv.max[j], root.bounds[j + 3][k]);
+                        }
+                    }
+                }
+            }
+            return rv;
+        }
+
+        // Per-ray values the node and triangle tests share.
+        struct Ray {
+            float origin[3], direction[3], inv_direction[3];
+            // Which row of a node's bounds is the near side on each
+            // axis, and which the far side.
+            unsigned int near_row[3], far_row[3];
+        };
+
+        struct StackEntry {
+            std::uint32_t child;
+            float distance;
+        };
+
+        // The nodes left to visit. The tree is never anywhere near
+        // deep enough to fill the array, but if it somehow is, the
+        // rest spill over onto the heap.
+        template <typename T>
+        class TraversalStack {
+        public:
+            TraversalStack() : m_size(0), m_spilled() {}
+
+            inline bool empty() const { return m_size == 0; }
+
+            inline void push(const T &entry) {
+                if (m_size < STACK_SIZE) {
+                    m_entries[m_size] = entry;
+                } else {
+                    m_spilled.push_back(entry);
+                }
+                ++m_size;
+            }
+
+            inline T pop() {
+                if (--m_size < STACK_SIZE) {
+                    return m_entries[m_size];
+                }
+                T entry = m_spilled.back();
+                m_spilled.pop_back();
+                return entry;
+            }
+
+        private:
+            T m_entries[STACK_SIZE];
+            std::size_t m_size;
+            std::vector<T> m_spilled;
+        };
+
+        // Test the ray against a node's four child boxes. Returns a
+        // mask of the ones it enters before max_t, and where.
+        static inline unsigned int rayNode(const TriangleBVH::Node &node, const Ray &ray, float max_t, float t_near[4]) {
+#ifdef GRAPHPLAY_BVH_SSE
+            __m128 near_t = _mm_setzero_ps(), far_t = _mm_set1_ps(max_t);
+            for (unsigned int j = 0; j < 3; ++j) {
+                __m128 o = _mm_set1_ps(ray.origin[j]), inv = _mm_set1_ps(ray.inv_direction[j]);
+                near_t = _mm_max_ps(near_t, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bounds[ray.near_row[j]]), o), inv));
+                far_t = _mm_min_ps(far_t, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bounds[ray.far_row[j]]), o), inv));
+            }
+            _mm_storeu_ps(t_near, near_t);
+            return static_cast<unsigned int>(_mm_movemask_ps(_mm_cmple_ps(near_t, far_t)));
+#else
+            unsigned int mask = 0;
+            for (unsigned int k = 0; k < 4; ++k) {
+                float near_t = 0.0f, far_t = max_t;
+                for (unsigned int j = 0; j < 3; ++j) {
+                    near_t = std::max(near_t, (node.bounds[ray.near_row[j]][k] - ray.origin[j])*ray.inv_direction[j]);
+                    far_t = std::min(far_t, (node.bounds[ray.far_row[j]][k] - ray.origin[j])*ray.inv_direction[j]);
+                }
+                t_near[k] = near_t;
+                mask |= (near_t <= far_t ? 1u : 0u) << k;
+            }
+            return mask;
+#endif
+        }
+
+        // Moller-Trumbore against all four triangles of a pack at
+        // once. Returns a mask of the ones hit before max_t.
+        static inline unsigned int rayPack(
+            const TriangleBVH::TrianglePack &pack, const Ray &ray, float max_t,
+            float t[4], float u[4], float v[4])
+        {
+#ifdef GRAPHPLAY_BVH_SSE
+            const __m128 dx = _mm_set1_ps(ray.direction[0]), dy = _mm_set1_ps(ray.direction[1]), dz = _mm_set1_ps(ray.direction[2]);
+            const __m128 e1x = _mm_loadu_ps(pack.e1[0]), e1y = _mm_loadu_ps(pack.e1[1]), e1z = _mm_loadu_ps(pack.e1[2]);
+            const __m128 e2x = _mm_loadu_ps(pack.e2[0]), e2y = _mm_loadu_ps(pack.e2[1]), e2z = _mm_loadu_ps(pack.e2[2]);
+
+            // p = d x e2, det = e1 . p
+            __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+            __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+            __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+            __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+            __m128 abs_det = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+            __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+            // s = o - v0, u = (s . p) / det
+            __m128 sx = _mm_sub_ps(_mm_set1_ps(ray.origin[0]), _mm_loadu_ps(pack.v0[0]));
+            __m128 sy = _mm_sub_ps(_mm_set1_ps(ray.origin[1]), _mm_loadu_ps(pack.v0[1]));
+            __m128 sz = _mm_sub_ps(_mm_set1_ps(ray.origin[2]), _mm_loadu_ps(pack.v0[2]));
+            __m128 uu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv_det);
+
+            // q = s x e1, v = (d . q) / det, t = (e2 . q) / det
+            __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+            __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+            __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+            __m128 vv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+            __m128 tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+
+            const __m128 zero = _mm_setzero_ps();
+            __m128 hit = _mm_cmpgt_ps(abs_det, _mm_set1_ps(MIN_DETERMINANT));
+            hit = _mm_and_ps(hit, _mm_cmpge_ps(uu, zero));
+            hit = _mm_and_ps(hit, _mm_cmpge_ps(vv, zero));
+            hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(uu, vv), _mm_set1_ps(1.0f)));
+            hit = _mm_and_ps(hit, _mm_cmpge_ps(tt, zero));
+            hit = _mm_and_ps(hit, _mm_cmplt_ps(tt, _mm_set1_ps(max_t)));
+
+            _mm_storeu_ps(t, tt);
+            _mm_storeu_ps(u, uu);
+            _mm_storeu_ps(v, vv);
+            return static_cast<unsigned int>(_mm_movemask_ps(hit));
+#else
+            unsigned int mask = 0;
+            for (unsigned int k = 0; k < 4; ++k) {
+                glm::vec3 d(ray.direction[0], ray.direction[1], ray.direction[2]);
+                glm::vec3 e1(pack.e1[0][k], pack.e1[1][k], pack.e1[2][k]);
+                glm::vec3 e2(pack.e2[0][k], pack.e2[1][k], pack.e2[2][k]);
+                glm::vec3 p = glm::cross(d, e2);
+                float det = glm::dot(e1, p);
+                if (std::abs(det) <= MIN_DETERMINANT) {
+                    continue;
+                }
+
+                float inv_det = 1.0f / det;
+                glm::vec3 s(ray.origin[0] - pack.v0[0][k], ray.origin[1] - pack.v0[1][k], ray.origin[2] - pack.v0[2][k]);
+                glm::vec3 q = glm::cross(s, e1);
+                u[k] = glm::dot(s, p)*inv_det;
+                v[k] = glm::dot(d, q)*inv_det;
+                t[k] = glm::dot(e2, q)*inv_det;
+                if (u[k] >= 0.0f && v[k] >= 0.0f && u[k] + v[k] <= 1.0f && t[k] >= 0.0f && t[k] < max_t) {
+                    mask |= 1u << k;
+                }
+            }
+            return mask;
+#endif
+        }
+
+        bool TriangleBVH::raycast(const glm::vec3 &origin, const glm::vec3 &direction, RayHit &hit, float max_t) const {
+            if (m_nodes.empty()) {
+                return false;
+            }
+
+            Ray ray;
+            for (unsigned int j = 0; j < 3; ++j) {
+                // Keep the sign of tiny components, so the ray still
+                // goes the right way through the boxes.
+                float d = std::copysign(std::max(std::abs(direction[j]), MIN_DIRECTION), direction[j]);
+                ray.origin[j] = origin[j];
+                ray.direction[j] = direction[j];
+                ray.inv_direction[j] = 1.0f / d;
+                ray.near_row[j] = d >= 0.0f ? j : j + 3;
+                ray.far_row[j] = d >= 0.0f ? j + 3 : j;
+            }
+
+            bool found = false;
+            hit.t = max_t;
+            TraversalStack<StackEntry> stack;
+            stack.push(StackEntry{ 0, 0.0f });
+
+            while (!stack.empty()) {
+                const StackEntry entry = stack.pop();
+                if (entry.distance > hit.t) {
+                    continue;
+                }
+
+                if (entry.child & LEAF_BIT) {
+                    const TrianglePack &pack = m_packs[entry.child & ~LEAF_BIT];
+                    float t[4], u[4], v[4];
+                    unsigned int mask = rayPack(pack, ray, hit.t, t, u, v);
+                    for (unsigned int k = 0; k < 4; ++k) {
+                        if ((mask & (1u << k)) && t[k] < hit.t) {
+                            hit.t = t[k];
+                            hit.u = u[k];
+                            hit.v = v[k];
+                            hit.face = pack.faces[k];
+                            found = true;
+                        }
+                    }
+                    continue;
+                }
+
+                const Node &node = m_nodes[entry.child];
+                float t_near[4];
+                unsigned int mask = rayNode(node, ray, hit.t, t_near);
+
+                // Push the children farthest first, so the nearest
+                // one comes off the stack next.
+                StackEntry hits[4];
+                unsigned int num_hits = 0;
+                for (unsigned int k = 0; k < 4; ++k) {
+                    if (mask & (1u << k)) {
+                        StackEntry e = { node.children[k], t_near[k] };
+                        unsigned int i = num_hits++;
+                        for (; i > 0 && hits[i - 1].distance < e.distance; --i) {
+                            hits[i] = hits[i - 1];
+                        }
+                        hits[i] = e;
+                    }
+                }
+                for (unsigned int i = 0; i < num_hits; ++i) {
+                    stack.push(hits[i]);
+                }
+            }
+
+            return found;
+        }
+
+        // The squared distances from p to each of a node's child
+        // boxes. Empty slots come out as infinity.
+        static inline void pointNode(const TriangleBVH::Node &node, const glm::vec3 &p, float distance2[4]) {
+#ifdef GRAPHPLAY_BVH_SSE
+            const __m128 zero = _mm_setzero_ps();
+            __m128 sum = zero;
+            for (unsigned int j = 0; j < 3; ++j) {
+                __m128 c = _mm_set1_ps(p[j]);
+                __m128 below = _mm_sub_ps(_mm_loadu_ps(node.bounds[j]), c);
+                __m128 above = _mm_sub_ps(c, _mm_loadu_ps(node.bounds[j + 3]));
+                __m128 d = _mm_max_ps(zero, _mm_max_ps(below, above));
+                sum = _mm_add_ps(sum, _mm_mul_ps(d, d));
+            }
+            _mm_storeu_ps(distance2, sum);
+#else
+            for (unsigned int k = 0; k < 4; ++k) {
+                distance2[k] = 0.0f;
+                for (unsigned int j = 0; j < 3; ++j) {
+                    float d = std::max(0.0f, std::max(node.bounds[j][k] - p[j], p[j] - node.bounds[j + 3][k]));
+                    distance2[k] += d*d;
+                }
+            }
+#endif
+        }
+
+        // From Ericson, Real-Time Collision Detection, 5.1.5.
+        static glm::vec3 closestPointOnTriangle(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+            glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+            float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+            if (d1 <= 0.0f && d2 <= 0.0f) {
+                return a;
+            }
+
+            glm::vec3 bp = p - b;
+            float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+            if (d3 >= 0.0f && d4 <= d3) {
+                return b;
+            }
+
+            float vc = d1*d4 - d3*d2;
+            if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+                return a + ab*(d1 / (d1 - d3));
+            }
+
+            glm::vec3 cp = p - c;
+            float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+            if (d6 >= 0.0f && d5 <= d6) {
+                return c;
+            }
+
+            float vb = d5*d2 - d1*d6;
+            if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+                return a + ac*(d2 / (d2 - d6));
+            }
+
+            float va = d3*d6 - d5*d4;
+            if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+                return b + (c - b)*((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+            }
+
+            float denom = 1.0f / (va + vb + vc);
+            return a + ab*(vb*denom) + ac*(vc*denom);
+        }
+
+        bool TriangleBVH::closestPoint(const glm::vec3 &point, ClosestPoint &result, float max_distance) const {
+            if (m_nodes.empty()) {
+                return false;
+            }
+
+            bool found = false;
+            float best = max_distance*max_distance;
+            TraversalStack<StackEntry> stack;
+            stack.push(StackEntry{ 0, 0.0f });
+
+            while (!stack.empty()) {
+                const StackEntry entry = stack.pop();
+                if (entry.distance >= best) {
+                    continue;
+                }
+
+                if (entry.child & LEAF_BIT) {
+                    const TrianglePack &pack = m_packs[entry.child & ~LEAF_BIT];
+                    for (unsigned int k = 0; k < 4 && pack.faces[k] != NO_FACE; ++k) {
+                        glm::vec3 a(pack.v0[0][k], pack.v0[1][k], pack.v0[2][k]);
+                        glm::vec3 e1(pack.e1[0][k], pack.e1[1][k], pack.e1[2][k]);
+                        glm::vec3 e2(pack.e2[0][k], pack.e2[1][k], pack.e2[2][k]);
+                        glm::vec3 q = closestPointOnTriangle(point, a, a + e1, a + e2);
+                        glm::vec3 d = q - point;
+                        float d2 = glm::dot(d, d);
+                        if (d2 < best) {
+                            best = d2;
+                            result.point = q;
+                            result.face = pack.faces[k];
+                            found = true;
+                        }
+                    }
+                    continue;
+                }
+
+                const Node &node = m_nodes[entry.child];
+                float distance2[4];
+                pointNode(node, point, distance2);
+
+                StackEntry closer[4];
+                unsigned int num_closer = 0;
+                for (unsigned int k = 0; k < 4; ++k) {
+                    if (node.children[k] != NO_CHILD && distance2[k] < best) {
+                        StackEntry e = { node.children[k], distance2[k] };
+                        unsigned int i = num_closer++;
+                        for (; i > 0 && closer[i - 1].distance < e.distance; --i) {
+                            closer[i] = closer[i - 1];
+                        }
+                        closer[i] = e;
+                    }
+                }
+                for (unsigned int i = 0; i < num_closer; ++i) {
+                    stack.push(closer[i]);
+                }
+            }
+
+            if (found) {
+                result.distance = std::sqrt(best);
+            }
+            return found;
+        }
+
+        // A mask of the child boxes that overlap [min, max].
+        static inline unsigned int boxNode(const TriangleBVH::Node &node, const glm::vec3 &min, const glm::vec3 &max) {
+#ifdef GRAPHPLAY_BVH_SSE
+            __m128 overlap = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (unsigned int j = 0; j < 3; ++j) {
+                overlap = _mm_and_ps(overlap, _mm_cmple_ps(_mm_loadu_ps(node.bounds[j]), _mm_set1_ps(max[j])));
+                overlap = _mm_and_ps(overlap, _mm_cmpge_ps(_mm_loadu_ps(node.bounds[j + 3]), _mm_set1_ps(min[j])));
+            }
+            return static_cast<unsigned int>(_mm_movemask_ps(overlap));
+#else
+            unsigned int mask = 0;
+            for (unsigned int k = 0; k < 4; ++k) {
+                bool overlap = true;
+                for (unsigned int j = 0; j < 3; ++j) {
+                    overlap = overlap && node.bounds[j][k] <= max[j] && node.bounds[j + 3][k] >= min[j];
+                }
+                mask |= (overlap ? 1u : 0u) << k;
+            }
+            return mask;
+#endif
+        }
+
+        // Whether the projections of the triangle and of a box with
+        // the given half extents (both centered on the origin) onto
+        // axis are disjoint.
+        static inline bool separated(
+            const glm::vec3 &axis, const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2,
+            const glm::vec3 &half)
+        {
+            float p0 = glm::dot(axis, v0), p1 = glm::dot(axis, v1), p2 = glm::dot(axis, v2);
+            float r = half.x*std::abs(axis.x) + half.y*std::abs(axis.y) + half.z*std::abs(axis.z);
+            return std::min(p0, std::min(p1, p2)) > r || std::max(p0, std::max(p1, p2)) < -r;
+        }
+
+        // The separating axis test of Akenine-Moller, "Fast 3D
+        // Triangle-Box Overlap Testing".
+        static bool triangleOverlapsBox(
+            const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c,
+            const glm::vec3 &center, const glm::vec3 &half)
+        {
+            glm::vec3 v[3] = { a - center, b - center, c - center };
+            glm::vec3 edges[3] = { v[1] - v[0], v[2] - v[1], v[0] - v[2] };
+            const glm::vec3 box_axes[3] = { glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1) };
+
+            for (unsigned int i = 0; i < 3; ++i) {
+                if (separated(box_axes[i], v[0], v[1], v[2], half)) {
+                    return false;
+                }
+            }
+
+            if (separated(glm::cross(edges[0], edges[1]), v[0], v[1], v[2], half)) {
+                return false;
+            }
+
+            for (unsigned int i = 0; i < 3; ++i) {
+                for (unsigned int e = 0; e < 3; ++e) {
+                    if (separated(glm::cross(box_axes[i], edges[e]), v[0], v[1], v[2], half)) {
+                        return false;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        std::size_t TriangleBVH::overlapBox(const fzx::BBox &box, std::vector<GLuint> &faces) const {
+            if (m_nodes.empty()) {
+                return 0;
+            }
+
+            const glm::vec3 center = (box.min + box.max)*0.5f, half = (box.max - box.min)*0.5f;
+            const std::size_t start = faces.size();
+            TraversalStack<std::uint32_t> stack;
+            stack.push(0);
+
+            while (!stack.empty()) {
+                const std::uint32_t child = stack.pop();
+                if (child & LEAF_BIT) {
+                    const TrianglePack &pack = m_packs[child & ~LEAF_BIT];
+                    for (unsigned int k = 0; k < 4 && pack.faces[k] != NO_FACE; ++k) {
+                        glm::vec3 a(pack.v0[0][k], pack.v0[1][k], pack.v0[2][k]);
+                        glm::vec3 e1(pack.e1[0][k], pack.e1[1][k], pack.e1[2][k]);
+                        glm::vec3 e2(pack.e2[0][k], pack.e2[1][k], pack.e2[2][k]);
+                        if (triangleOverlapsBox(a, a + e1, a + e2, center, half)) {
+                            faces.push_back(pack.faces[k]);
+                        }
+                    }
+                    continue;
+                }
+
+                const Node &node = m_nodes[child];
+                unsigned int mask = boxNode(node, box.min, box.max);
+                for (unsigned int k = 0; k < 4; ++k) {
+                    if (mask & (1u << k)) {
+                        stack.push(node.children[k]);
+                    }
+                }
+            }
+
+            return faces.size() - start;
+        }
+    }
+}
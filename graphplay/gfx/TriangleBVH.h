@@ -0,0 +1,133 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_TRIANGLE_BVH_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_TRIANGLE_BVH_H_
+
+#include "../graphplay.h"
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "../opengl.h"
+#include "../Parallel.h"
+#include "../fzx/BBox.h"
+#include "Geometry.h"
+
+namespace graphplay {
+    namespace gfx {
+        // The nearest triangle a ray hit. t is in units of the ray's
+        // direction, and (u, v) are the barycentric coordinates of the
+        // hit relative to the triangle's second and third corners.
+        struct RayHit {
+            float t;
+            float u, v;
+            GLuint face;
+        };
+
+        // The point on the mesh closest to a query point.
+        struct ClosestPoint {
+            glm::vec3 point;
+            float distance;
+            GLuint face;
+        };
+
+        // A bounding volume hierarchy over the triangles of a
+        // triangle list, for picking and collision queries. Faces are
+        // identified by their index in the element array divided by
+        // three. Everything is in the space of the positions it was
+        // built from (model space, for a geometry).
+        //
+        // The tree is built with a binned surface area heuristic and
+        // then collapsed so that every node has four children, with
+        // the children's bounds stored a coordinate at a time so that
+        // all four can be tested at once. Leaves are packs of up to
+        // four triangles laid out the same way.
+        class TriangleBVH {
+        public:
+            typedef std::shared_ptr<TriangleBVH> sptr_type;
+
+            TriangleBVH();
+            TriangleBVH(const std::vector<GLuint> &elems, const std::vector<glm::vec3> &positions);
+
+            // Triangles that refer past the end of positions, or whose
+            // corners aren't all distinct, are left out.
+            void build(const std::vector<GLuint> &elems, const std::vector<glm::vec3> &positions);
+
+            // Find the nearest triangle hit by the ray from origin
+            // along direction, no farther than max_t. Both sides of
+            // each triangle count.
+            bool raycast(
+                const glm::vec3 &origin, const glm::vec3 &direction, RayHit &hit,
+                float max_t = std::numeric_limits<float>::infinity()) const;
+
+            // Find the point on the mesh closest to point, if there is
+            // one within max_distance.
+            bool closestPoint(
+                const glm::vec3 &point, ClosestPoint &result,
+                float max_distance = std::numeric_limits<float>::infinity()) const;
+
+            // Append the faces that overlap box to faces, and return
+            // how many there were.
+            std::size_t overlapBox(const fzx::BBox &box, std::vector<GLuint> &faces) const;
+
+            inline bool empty() const { return m_nodes.empty(); }
+            inline std::size_t nodeCount() const { return m_nodes.size(); }
+            inline std::size_t triangleCount() const { return m_triangle_count; }
+            fzx::BBox bounds() const;
+
+            // A child index with this bit set is a leaf, and the rest
+            // of it is the index of its triangle pack.
+            static const std::uint32_t LEAF_BIT = 0x80000000;
+            static const std::uint32_t NO_CHILD = 0xFFFFFFFF;
+            static const GLuint NO_FACE = 0xFFFFFFFF;
+
+            // bounds[0..2] are the children's minimum x, y and z,
+            // bounds[3..5] their maximums. Empty slots have inverted
+            // bounds, so nothing ever overlaps them.
+            struct Node {
+                float bounds[6][4];
+                std::uint32_t children[4];
+            };
+
+            // Each triangle as its first corner and the two edges out
+            // of it, a coordinate at a time. Unused lanes have a face
+            // of NO_FACE and zero edges.
+            struct TrianglePack {
+                float v0[3][4];
+                float e1[3][4];
+                float e2[3][4];
+                GLuint faces[4];
+            };
+
+        private:
+            std::vector<Node> m_nodes;
+            std::vector<TrianglePack> m_packs;
+            std::size_t m_triangle_count;
+        };
+
+        // Build a BVH over a GL_TRIANGLES geometry's triangles, in
+        // model space. Other kinds of geometry get an empty one.
+        template <typename V>
+        TriangleBVH::sptr_type buildTriangleBVH(const Geometry<V> &geo) {
+            TriangleBVH::sptr_type rv = std::make_shared<TriangleBVH>();
+            if (geo.draw_type != GL_TRIANGLES || geo.primitive_restart) {
+                return rv;
+            }
+
+            const typename Geometry<V>::vertex_array_type &verts = geo.vertices();
+            std::vector<glm::vec3> positions(verts.size());
+            parallelFor(verts.size(), 1 << 14, [&](std::size_t i) {
+                    positions[i] = vertexPosition(verts[i]);
+                });
+
+            rv->build(geo.elements(), positions);
+            return rv;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,30 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#include "../graphplay.h"
+#include "Uniform.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+namespace graphplay {
+    namespace gfx {
+        template <>
+        void Uniform<glm::mat4x4>::upload() const {
+            glUniformMatrix4fv(m_location, 1, GL_FALSE, glm::value_ptr(m_value));
+        }
+
+        template <>
+        void Uniform<glm::mat3x3>::upload() const {
+            glUniformMatrix3fv(m_location, 1, GL_FALSE, glm::value_ptr(m_value));
+        }
+
+        template <>
+        void Uniform<glm::vec2>::upload() const {
+            glUniform2f(m_location, m_value.x, m_value.y);
+        }
+
+        template <>
+        void Uniform<GLint>::upload() const {
+            glUniform1i(m_location, m_value);
+        }
+    }
+}
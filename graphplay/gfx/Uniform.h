@@ -0,0 +1,73 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_UNIFORM_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_UNIFORM_H_
+
+#include "../graphplay.h"
+
+#include <string>
+
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+
+#include "../opengl.h"
+#include "OpenGLUtils.h"
+
+namespace graphplay {
+    namespace gfx {
+        // A uniform in a program, looked up by name once (when the
+        // program is linked) instead of on every draw. It remembers
+        // the last value it set, and setting the same value again
+        // doesn't call glUniform*.
+        //
+        // Like glUniform*, set() works on the program that's in use,
+        // so that had better be the program this came from.
+        template <typename T>
+        class Uniform {
+        public:
+            Uniform() : m_location(-1), m_value(), m_current(false) {}
+
+            // Look name up in a program's uniforms. If the program
+            // doesn't have it, the uniform is left invalid and
+            // setting it does nothing.
+            void resolve(const IndexMap &uniforms, const std::string &name) {
+                auto found = uniforms.find(name);
+                m_location = found == uniforms.end() ? -1 : (GLint)found->second;
+                m_current = false;
+            }
+
+            inline bool valid() const { return m_location >= 0; }
+            inline GLint location() const { return m_location; }
+
+            // Whether it called glUniform*.
+            bool set(const T &value) {
+                if (!valid() || (m_current && value == m_value)) {
+                    return false;
+                }
+                m_value = value;
+                m_current = true;
+                upload();
+                return true;
+            }
+
+            // Forget the last value, for when something else may
+            // have changed it behind our back.
+            inline void invalidate() { m_current = false; }
+
+        private:
+            void upload() const;
+
+            GLint m_location;
+            T m_value;
+            bool m_current;
+        };
+
+        template <> void Uniform<glm::mat4x4>::upload() const;
+        template <> void Uniform<glm::mat3x3>::upload() const;
+        template <> void Uniform<glm::vec2>::upload() const;
+        template <> void Uniform<GLint>::upload() const;
+    }
+}
+
+#endif
@@ -0,0 +1,27 @@
+// -*- mode: c++; c-basic-offset: 4; indent-tabs-mode: nil -*-
+
+#ifndef _GRAPHPLAY_GRAPHPLAY_GFX_VERTEX_FORMAT_H_
+#define _GRAPHPLAY_GRAPHPLAY_GFX_VERTEX_FORMAT_H_
+
+#include "../graphplay.h"
+
+#include <map>
+#include <string>
+
+#include "../opengl.h"
+
+namespace graphplay {
+    namespace gfx {
+        struct VertexDesc {
+            void *offset;
+            GLenum type;
+            unsigned int count;
+            // Whether integer data maps to [0, 1] (or [-1, 1]) in the
+            // shader, rather than being converted as-is.
+            GLboolean normalized;
+        };
+        typedef std::map<std::string, VertexDesc> AttrMap;
+    }
+}
+
+#endif